@@ -1,10 +1,10 @@
 // frontends/tui-ftxui/main.cpp
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <fstream>
 #include <iomanip>
+#include <iterator>
 #include <mutex>
-#include <set>
 #include <sstream>
 #include <thread>
 #include <vector>
@@ -12,6 +12,10 @@
 
 #include "worker.h"
 #include "cpu.h"
+#include "debug.h"
+#include "engine.h"
+#include "history.h"
+#include "memview.h"
 #include "types.h"
 
 #include <ftxui/component/component.hpp>
@@ -21,81 +25,199 @@
 using namespace ftxui;
 using namespace y86;
 
-std::string STAT[5] = {"", "AOK(1)", "HLT(2)", "ADR(3)", "INS(4)"};
+constexpr int FPS = 30;                  // 运行中的重绘帧率
+constexpr u64 SLICE = 4096;              // 运行线程每跑这么多步看一次时钟
+
+static const char* stat_str(Stat s) {
+  switch (s) {
+    case Stat::AOK: return "AOK(1)";
+    case Stat::HLT: return "HLT(2)";
+    case Stat::ADR: return "ADR(3)";
+    case Stat::INS: return "INS(4)";
+    default:  return "??";
+  }
+}
+
+// 一步之后的紧凑状态（不含内存）
+struct Snapshot {
+  u64 step = 0;
+  u64 pc = 0;
+  Stat stat = Stat::AOK;
+  CC cc{};
+  s64 R[REG_NUM] = {};
+};
+
+// 单生产者/单消费者的快照环：运行线程每片写一条（单步时每步一条），UI 每帧读最近几条。
+// 写满后覆盖最旧的槽位，生产者从不等待；每个槽位带序号（seqlock），
+// 读到正在改写的槽位就跳过，双方都不加锁。
+class SnapshotRing {
+public:
+  static constexpr size_t SIZE = 256;
+
+  void push(const CPU& c, u64 step) {
+    u64 k = head_.load(std::memory_order_relaxed);
+    Slot& s = slots_[k % SIZE];
+    s.seq.store(2 * k + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.w[0].store(step, std::memory_order_relaxed);
+    s.w[1].store(c.PC, std::memory_order_relaxed);
+    s.w[2].store((u64)c.stat | (u64)c.cc.ZF << 8 | (u64)c.cc.SF << 9 | (u64)c.cc.OF << 10,
+                 std::memory_order_relaxed);
+    for (int i = 0; i < REG_NUM; i++) s.w[3 + i].store((u64)c.R[i], std::memory_order_relaxed);
+    s.seq.store(2 * k + 2, std::memory_order_release);
+    head_.store(k + 1, std::memory_order_release);
+  }
+
+  // 最近至多 n 条写入 out（旧的在前），返回条数
+  size_t latest(Snapshot* out, size_t n) const {
+    u64 h = head_.load(std::memory_order_acquire);
+    n = std::min<u64>({n, h, SIZE - 1});
+    size_t got = 0;
+    for (u64 k = h - n; k < h; ++k)
+      if (read(k, out[got])) ++got;
+    return got;
+  }
+
+  // 只在没有生产者时调用
+  void clear() { head_.store(0, std::memory_order_relaxed); }
+
+private:
+  static constexpr size_t WORDS = 3 + REG_NUM;
+  struct Slot {
+    std::atomic<u64> seq{0};
+    std::atomic<u64> w[WORDS];
+  };
+
+  bool read(u64 k, Snapshot& o) const {
+    const Slot& s = slots_[k % SIZE];
+    u64 seq = s.seq.load(std::memory_order_acquire);
+    if (seq != 2 * k + 2) return false;
+    u64 w[WORDS];
+    for (size_t i = 0; i < WORDS; i++) w[i] = s.w[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s.seq.load(std::memory_order_relaxed) != seq) return false;
+    o.step = w[0];
+    o.pc = w[1];
+    o.stat = (Stat)(w[2] & 0xFF);
+    o.cc.ZF = (w[2] >> 8) & 1;
+    o.cc.SF = (w[2] >> 9) & 1;
+    o.cc.OF = (w[2] >> 10) & 1;
+    for (int i = 0; i < REG_NUM; i++) o.R[i] = (s64)w[3 + i];
+    return true;
+  }
+
+  Slot slots_[SIZE];
+  std::atomic<u64> head_{0};
+};
+
+enum StopReason { STOP_NONE, STOP_BREAKPOINT, STOP_HALT };
 
 struct Model {
+  // Run 期间 cpu/steps 归运行线程独占；running 变回 false 且线程 join
+  // 之后 UI 线程才读写它们，运行中 UI 只看快照环和 mem_rows。寄存器 F 的
+  // scratch 也在 cpu 里（CPU::scratch），UI 线程单步/后退与运行线程接着跑
+  // 看到的是同一个值，检查点也带着它
   CPU cpu;
+  u64 steps = 0;
   bool loaded = false;
-  std::set<u64> breakpoints;
+  // 断点/观察点的原始写法；Run/Step 时编进 dbg，运行中新加的下次生效
+  std::vector<std::string> breaks, watches;
+  Debugger dbg;
+  // Run/Step 都经过 hist 记录撤销日志和周期检查点，供后退/反向继续
+  History hist;
+
+  Model() { hist.set_debugger(&dbg); }
   std::atomic<bool> running{false};
-  std::mutex mtx;                 // 保护 cpu/mem
-  std::vector<nlohmann::json> last_logs; // 最近若干步快照
-  size_t mem_scroll = 0;          // 内存滚动位置（行）
-  std::string last_msg;           // 状态栏消息
+  std::atomic<int> stop_reason{STOP_NONE};
+  SnapshotRing ring;                // 最近若干步的状态
+  mutable Snapshot last_shown;      // current() 最近一次的结果，只在 UI 线程读写
+  std::string last_msg;             // 状态栏消息
+
+  // 内存面板：MemView 与 cpu 同属一个线程；UI 的滚动/跳转先记在原子量里，
+  // 由持有 cpu 的线程在 refresh_mem 时应用
+  static constexpr size_t MEM_PAGE = 20;
+  MemView view{MEM_PAGE};
+  std::atomic<long> mem_scroll{0};        // 待应用的滚动行数
+  std::atomic<bool> mem_jump_pending{false};
+  std::atomic<u64> mem_jump{0};
+  std::mutex mem_mtx;                     // 保护 mem_rows/mem_total
+  std::vector<MemView::Row> mem_rows;     // 运行线程按帧发布的可见内存行
+  size_t mem_total = 0;
 
   void reset_runtime() {
-    std::lock_guard<std::mutex> lk(mtx);
-    running = false;
-    last_logs.clear();
+    steps = 0;
+    hist.reset(cpu);
+    ring.clear();
+    view.reset(cpu);
     mem_scroll = 0;
+    mem_jump_pending = false;
     last_msg.clear();
   }
 
-  // 生成一步的快照，便于 UI 展示
-  nlohmann::json snapshot_nolock() {
-    nlohmann::json rec;
-    rec["STAT"] = cpu.stat;
-    rec["PC"]   = (s64)cpu.PC;
-    rec["CC"]   = cpu.dump_cc();
-    rec["REG"]  = cpu.dump_regs();
-    rec["MEM"]  = cpu.dump_mem_nonzero();
-    return rec;
+  void rebuild_debugger() {
+    dbg.clear();
+    for (auto& b : breaks) dbg.add_break(b);
+    for (auto& w : watches) dbg.add_watch(w);
   }
 
-  // 单步执行（含快照与断点判断）
+  // 单步执行（含快照与断点/观察点判断），只在没有运行线程时调用
   void step_once() {
-    std::lock_guard<std::mutex> lk(mtx);
     if (!loaded || cpu.stat != Stat::AOK) return;
 
-    y86::step(cpu);  // 更新 CPU/MEM
-    last_logs.push_back(snapshot_nolock());
-    if (last_logs.size() > 200) last_logs.erase(last_logs.begin());
+    rebuild_debugger();
+    steps += run_auto(cpu, 1, hist);
+    ring.push(cpu, steps);
 
-    // 命中断点？（取“执行后 PC”）
-    if (breakpoints.count(cpu.PC)) {
-      running = false;
-      last_msg = "Hit breakpoint at PC=" + std::to_string((s64)cpu.PC);
-    }
+    // 执行后 PC 处的断点、这一步的访存命中的观察点
+    if (dbg.hit().kind != Debugger::Hit::NONE) last_msg = "Hit " + dbg.describe(dbg.hit());
   }
 
-  // 根据 mem 构建非零 8B 列表（每次渲染计算一次，数据量通常很小）
-  std::vector<std::pair<u64, s64>> nonzero_qwords() {
-    std::lock_guard<std::mutex> lk(mtx);
-    std::vector<u64> bases;
-    bases.reserve(cpu.mem.size());
-    for (auto &kv : cpu.mem) bases.push_back(kv.first & ~7ULL);
-    std::sort(bases.begin(), bases.end());
-    bases.erase(std::unique(bases.begin(), bases.end()), bases.end());
-
-    std::vector<std::pair<u64, s64>> out;
-    for (u64 base : bases) {
-      u64 v = 0;
-      cpu.read8((s64)base, v);
-      s64 sv = (s64)v;
-      if (sv != 0) out.push_back({base, sv});
-    }
-    std::sort(out.begin(), out.end(), [](auto&a, auto&b){return a.first<b.first;});
-    return out;
+  // 后退 k 步：撤销日志够用时逐条撤销，否则从检查点重放；只在没有运行线程时调用
+  void step_back(u64 k) {
+    if (!loaded) return;
+    u64 b = hist.step_back(cpu, k);
+    steps = hist.now();
+    ring.push(cpu, steps);
+    last_msg = b ? "Back " + std::to_string(b) + " step(s)" : "No earlier history.";
+  }
+
+  // 向后运行到断点或写观察点（读观察点不会触发），最远到历史起点
+  void reverse_continue() {
+    if (!loaded) return;
+    rebuild_debugger();
+    u64 b = hist.reverse_continue(cpu, dbg);
+    steps = hist.now();
+    ring.push(cpu, steps);
+    if (dbg.hit().kind != Debugger::Hit::NONE)
+      last_msg = "Reverse hit " + dbg.describe(dbg.hit());
+    else
+      last_msg = "Back " + std::to_string(b) + " step(s) to the oldest recorded state.";
+  }
+
+  // 应用挂起的滚动/跳转并取可见行；代价只与可见行数有关，与内存大小无关
+  void refresh_mem(std::vector<MemView::Row>& out) {
+    if (mem_jump_pending.exchange(false)) view.jump(cpu, mem_jump.load());
+    if (long d = mem_scroll.exchange(0)) view.scroll(cpu, d);
+    view.refresh(cpu, out);
   }
 
-  std::string stat_str() const {
-    switch (cpu.stat) {
-      case Stat::AOK: return "AOK(1)";
-      case Stat::HLT: return "HLT(2)";
-      case Stat::ADR: return "ADR(3)";
-      case Stat::INS: return "INS(4)";
-      default:  return "??";
+  // 当前状态：运行中取快照环最新一条（读到正被改写的槽位就重试几次，仍失败
+  // 或环还空着时沿用上一次的快照），运行中绝不碰 cpu；停下后直接读 CPU。
+  // 只在 UI 线程调用
+  Snapshot current() const {
+    if (running.load(std::memory_order_acquire)) {
+      Snapshot s;
+      for (int tries = 0; tries < 4; tries++)
+        if (ring.latest(&s, 1)) return last_shown = s;
+      return last_shown;
     }
+    Snapshot& s = last_shown;
+    s.step = steps;
+    s.pc = cpu.PC;
+    s.stat = cpu.stat;
+    s.cc = cpu.cc;
+    std::copy(cpu.R, cpu.R + REG_NUM, s.R);
+    return s;
   }
 };
 
@@ -116,38 +238,77 @@ static bool parse_addr(const std::string& s, u64& out) {
 int main(int argc, char** argv) {
   Model model;
 
-  // 载入：命令行参数（可选）或 UI 里输入路径
-  auto load_file = [&](const std::string& path)->std::string {
-    std::ifstream fin(path);
-    if (!fin) return "Open failed: " + path;
-    model.reset_runtime();
-    {
-      std::lock_guard<std::mutex> lk(model.mtx);
-      model.cpu = CPU{};
-      load_yo(fin, model.cpu, false, 65536);
-      model.loaded = (model.cpu.PC != 0 || !model.cpu.mem.empty());
-    }
-    return model.loaded ? ("Loaded: " + path) : "No code found in file.";
-  };
-
   // ---------- UI 组件 ----------
-  std::string path_input, bp_input;
+  std::string path_input, bp_input, jump_input;
   auto input_path = Input(&path_input, "path/to/program.yo");
-  auto input_bp   = Input(&bp_input,   "breakpoint (e.g. 0x19)");
+  auto input_bp   = Input(&bp_input,   "0x19 / pc==0x40 && rax==0 / watch: 0x100:8:rw");
+  auto input_jump = Input(&jump_input, "go to address");
 
-  // 运行线程：循环 step，刷新屏幕
+  // 运行线程：run<Debugger> 全速执行，直到断点/观察点/停机/Stop；每片只往
+  // 快照环写一条，约每 1/FPS 秒发布一次可见内存行并请求重绘，从不等待 UI
   ScreenInteractive screen = ScreenInteractive::Fullscreen();
   std::thread runner;
+  // 运行线程自己停下后由 UI 线程 join，并据停止原因更新消息
+  auto reap_run = [&] {
+    if (model.running.load(std::memory_order_acquire) || !runner.joinable()) return;
+    runner.join();
+    switch (model.stop_reason.load()) {
+      case STOP_BREAKPOINT:
+        model.last_msg = "Hit " + model.dbg.describe(model.dbg.hit());
+        break;
+      case STOP_HALT:
+        model.last_msg = std::string("Stopped: ") + stat_str(model.cpu.stat);
+        break;
+      default:
+        break;
+    }
+  };
   auto start_run = [&] {
-    if (model.running || !model.loaded) return;
+    reap_run();
+    if (model.running || !model.loaded || model.cpu.stat != Stat::AOK) return;
+    // 断点/观察点在启动时编好；运行中新增的下次 Run 生效
+    model.rebuild_debugger();
+    model.refresh_mem(model.mem_rows);
+    model.mem_total = model.view.total(model.cpu);
+    // 先放一条起始状态，运行线程的第一片写完之前 current() 也有快照可读
+    model.ring.push(model.cpu, model.steps);
+    model.stop_reason = STOP_NONE;
     model.running = true;
     model.last_msg = "Running...";
-    runner = std::thread([&]{
-      while (model.running && model.cpu.stat == Stat::AOK) {
-        model.step_once();
-        screen.PostEvent(Event::Custom); // 刷新
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    runner = std::thread([&] {
+      using clock = std::chrono::steady_clock;
+      const auto frame = std::chrono::microseconds(1000000 / FPS);
+      auto next_frame = clock::now() + frame;
+      CPU& cpu = model.cpu;
+      u64 n = model.steps;
+      int reason = STOP_NONE;
+      std::vector<MemView::Row> rows;
+      while (model.running.load(std::memory_order_relaxed)) {
+        // 每片最多 SLICE 步；断点/观察点与历史记录都在 run<History> 的热循环里
+        n += run_auto(cpu, SLICE, model.hist);
+        model.ring.push(cpu, n);
+        if (cpu.stat != Stat::AOK) { reason = STOP_HALT; break; }
+        if (model.dbg.hit().kind != Debugger::Hit::NONE) {
+          reason = STOP_BREAKPOINT;
+          break;
+        }
+        if (clock::now() >= next_frame) {
+          model.refresh_mem(rows);
+          {
+            // UI 正在读就跳过这一帧，运行线程不等锁
+            std::unique_lock<std::mutex> lk(model.mem_mtx, std::try_to_lock);
+            if (lk.owns_lock()) {
+              std::swap(model.mem_rows, rows);
+              model.mem_total = model.view.total(cpu);
+            }
+          }
+          next_frame = clock::now() + frame;
+          screen.PostEvent(Event::Custom);
+        }
       }
+      model.steps = n;
+      model.stop_reason = reason;
+      model.running.store(false, std::memory_order_release);
       screen.PostEvent(Event::Custom);
     });
   };
@@ -156,6 +317,17 @@ int main(int argc, char** argv) {
     if (runner.joinable()) runner.join();
   };
 
+  // 载入：命令行参数（可选）或 UI 里输入路径
+  auto load_file = [&](const std::string& path)->std::string {
+    CPU fresh;
+    if (!load_yo_file(path, fresh, false, 65536)) return "Open failed: " + path;
+    stop_run();
+    model.cpu = std::move(fresh);
+    model.reset_runtime();
+    model.loaded = (model.cpu.PC != 0 || !model.cpu.mem_empty());
+    return model.loaded ? ("Loaded: " + path) : "No code found in file.";
+  };
+
   // 控件：载入/单步/运行/暂停/重载/断点增删
   auto btn_load = Button("Load (O)", [&]{
     if (path_input.empty()) { model.last_msg="Empty path."; return; }
@@ -163,6 +335,8 @@ int main(int argc, char** argv) {
     screen.PostEvent(Event::Custom);
   });
   auto btn_step = Button("Step (S)", [&]{ stop_run(); model.step_once(); screen.PostEvent(Event::Custom); });
+  auto btn_back = Button("Back (Z)", [&]{ stop_run(); model.step_back(1); screen.PostEvent(Event::Custom); });
+  auto btn_rcont = Button("RevCont (X)", [&]{ stop_run(); model.reverse_continue(); screen.PostEvent(Event::Custom); });
   auto btn_run  = Button("Run  (R)", [&]{ start_run(); });
   auto btn_stop = Button("Stop (T)", [&]{ stop_run(); model.last_msg="Stopped."; screen.PostEvent(Event::Custom); });
   auto btn_reload = Button("Reload", [&]{
@@ -170,57 +344,85 @@ int main(int argc, char** argv) {
     model.last_msg = load_file(path_input);
     screen.PostEvent(Event::Custom);
   });
+  // 断点：地址或条件表达式；观察点：ADDR[:LEN][:r|w|rw]。先试编一遍报错
   auto btn_add_bp = Button("Add BP (B)", [&]{
-    u64 a=0;
-    if (parse_addr(bp_input, a)) {
-      model.breakpoints.insert(a);
-      model.last_msg = "Add BP @" + std::to_string((s64)a);
+    Debugger probe;
+    std::string err;
+    if (probe.add_break(bp_input, &err)) {
+      model.breaks.push_back(bp_input);
+      model.last_msg = "Add BP: " + bp_input;
     } else {
-      model.last_msg = "Bad address.";
+      model.last_msg = "Bad breakpoint: " + err;
+    }
+    screen.PostEvent(Event::Custom);
+  });
+  auto btn_add_watch = Button("Watch (W)", [&]{
+    Debugger probe;
+    std::string err;
+    if (probe.add_watch(bp_input, &err)) {
+      model.watches.push_back(bp_input);
+      model.last_msg = "Add watch: " + bp_input;
+    } else {
+      model.last_msg = "Bad watch: " + err;
     }
     screen.PostEvent(Event::Custom);
   });
   auto btn_clear_bp = Button("Clear BPs (C)", [&]{
-    model.breakpoints.clear(); model.last_msg="Breakpoints cleared.";
+    model.breaks.clear(); model.watches.clear();
+    model.last_msg="Breakpoints and watches cleared.";
+    screen.PostEvent(Event::Custom);
+  });
+
+  // 内存视图跳到地址：运行中也只是挂个请求，由持有 CPU 的线程处理
+  auto btn_jump = Button("Go (G)", [&]{
+    u64 a=0;
+    if (parse_addr(jump_input, a)) {
+      model.mem_jump = a;
+      model.mem_jump_pending = true;
+    } else {
+      model.last_msg = "Bad address.";
+    }
     screen.PostEvent(Event::Custom);
   });
 
   // 顶部控制区容器
   auto control_row = Container::Horizontal({
     input_path, btn_load, btn_reload,
-    input_bp, btn_add_bp, btn_clear_bp,
-    btn_step, btn_run, btn_stop
+    input_bp, btn_add_bp, btn_add_watch, btn_clear_bp,
+    input_jump, btn_jump,
+    btn_step, btn_run, btn_stop, btn_back, btn_rcont
   });
 
   // 渲染寄存器表
-  auto render_regs = [&]{
+  auto render_regs = [&](const Snapshot& cur){
     Elements rows;
-    {
-      std::lock_guard<std::mutex> lk(model.mtx);
-      rows.push_back(text("Registers (dec)") | bold);
-      for (int i=0;i<15;i++) {
-        std::ostringstream ss;
-        ss << std::left << std::setw(4) << reg_name(i) << " : "
-           << std::right << std::setw(20) << model.cpu.R[i];
-        rows.push_back(text(ss.str()));
-      }
+    rows.push_back(text("Registers (dec)") | bold);
+    for (int i=0;i<REG_NUM;i++) {
+      std::ostringstream ss;
+      ss << std::left << std::setw(4) << reg_name(i) << " : "
+         << std::right << std::setw(20) << cur.R[i];
+      rows.push_back(text(ss.str()));
     }
     return vbox(std::move(rows)) | border;
   };
 
-  // 渲染 CC/PC/STAT/断点
-  auto render_status = [&]{
-    std::lock_guard<std::mutex> lk(model.mtx);
-    std::string s = "PC=" + std::to_string((s64)model.cpu.PC) +
-                    "   STAT=" + model.stat_str() +
-                    "   CC(ZF,SF,OF)=" + std::to_string(model.cpu.cc.ZF) + "," +
-                    std::to_string(model.cpu.cc.SF) + "," + std::to_string(model.cpu.cc.OF) +
+  // 渲染 CC/PC/STAT/步数/断点
+  auto render_status = [&](const Snapshot& cur){
+    std::string s = "PC=" + std::to_string((s64)cur.pc) +
+                    "   STAT=" + stat_str(cur.stat) +
+                    "   CC(ZF,SF,OF)=" + std::to_string(cur.cc.ZF) + "," +
+                    std::to_string(cur.cc.SF) + "," + std::to_string(cur.cc.OF) +
+                    "   steps=" + std::to_string(cur.step) +
                     (model.running ? "   [RUNNING]" : "   [IDLE]");
     auto bp = text("Breakpoints: ") | color(Color::GrayLight);
     std::string bplist;
-    bool first=true; for (auto a : model.breakpoints) {
+    bool first=true; for (auto& b : model.breaks) {
+      if (!first) bplist += ", ";
+      first=false; bplist += b;
+    }
+    for (auto& w : model.watches) {
       if (!first) bplist += ", ";
-      first=false; bplist += std::to_string((s64)a);
+      first=false; bplist += "watch " + w;
     }
     return vbox({
       text(s) | bold,
@@ -228,38 +430,49 @@ int main(int argc, char** argv) {
     }) | border;
   };
 
-  // 渲染内存非零块（分页/滚动）
+  // 渲染内存非零块：只取可见的 MEM_PAGE 行，最近改写的行高亮；
+  // 运行中用运行线程上一帧发布的行，停下后直接从 MemView 取
+  std::vector<MemView::Row> mem;
+  size_t mem_total = 0;
   auto render_mem = [&]{
-    auto items = model.nonzero_qwords();
-    const size_t per_page = 20;
-    if (model.mem_scroll > (items.size()>0?items.size()-1:0))
-      model.mem_scroll = (items.size()>0?items.size()-1:0);
-    size_t start = model.mem_scroll;
-    size_t end   = std::min(start + per_page, items.size());
+    if (model.running.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lk(model.mem_mtx);
+      mem = model.mem_rows;
+      mem_total = model.mem_total;
+    } else {
+      model.refresh_mem(mem);
+      mem_total = model.view.total(model.cpu);
+    }
 
     Elements lines;
-    lines.push_back(text("Memory (non-zero qwords, little-endian, signed)") | bold);
-    for (size_t i=start;i<end;i++){
+    lines.push_back(hbox({
+      text("Memory (non-zero qwords, little-endian, signed)") | bold,
+      filler(),
+      text(std::to_string(mem_total) + " qwords") | dim
+    }));
+    for (const auto& r : mem){
       std::ostringstream ss;
-      ss << std::setw(16) << std::right << items[i].first << "  :  "
-         << std::setw(20) << std::right << items[i].second;
-      lines.push_back(text(ss.str()));
+      ss << std::setw(16) << std::right << r.addr << "  :  "
+         << std::setw(20) << std::right << r.value;
+      auto line = text(ss.str());
+      if (r.age == 0) line = line | color(Color::Yellow) | bold;
+      else if (r.age != MemView::COLD) line = line | color(Color::Yellow);
+      lines.push_back(line);
     }
-    if (items.empty()) lines.push_back(text("(empty)"));
+    if (mem.empty()) lines.push_back(text("(empty)"));
     return vbox(std::move(lines)) | border;
   };
 
-  // 最近日志（最多 10 条）
+  // 最近若干步（最多 10 条，取自快照环）
   auto render_logs = [&]{
     Elements lines;
-    lines.push_back(text("Last steps (JSON summary)") | bold);
-    size_t n = model.last_logs.size();
-    size_t from = (n>10 ? n-10 : 0);
-    for (size_t i=from;i<n;i++) {
-      const auto& j = model.last_logs[i];
+    lines.push_back(text("Last steps") | bold);
+    Snapshot last[10];
+    size_t n = model.ring.latest(last, 10);
+    for (size_t i=0;i<n;i++) {
       std::ostringstream ss;
-      ss << "PC=" << j["PC"] << " STAT=" << STAT[j["STAT"]]
-         << " CC[ZF,SF,OF]=" << j["CC"]["ZF"] << "," << j["CC"]["SF"] << "," << j["CC"]["OF"];
+      ss << "#" << last[i].step << " PC=" << last[i].pc << " STAT=" << stat_str(last[i].stat)
+         << " CC[ZF,SF,OF]=" << last[i].cc.ZF << "," << last[i].cc.SF << "," << last[i].cc.OF;
       lines.push_back(text(ss.str()));
     }
     if (lines.size()==1) lines.push_back(text("(empty)"));
@@ -274,21 +487,24 @@ int main(int argc, char** argv) {
   });
 
   auto renderer = Renderer(root, [&]{
+    reap_run();
+    Snapshot cur = model.current();
+
     auto top = hbox({
       control_row->Render()
     });
 
     auto mid = hbox({
-      render_regs()     | flex,
+      render_regs(cur)  | flex,
       render_mem()      | flex,
       render_logs()     | flex
     });
 
-    auto bottom = render_status();
+    auto bottom = render_status(cur);
 
     auto help = text(
-      "[O] Load  [S] Step  [R] Run  [T] Stop  [B] Add BP  [C] Clear BP  "
-      "[Up/Down] Scroll memory  [Q] Quit") | dim;
+      "[O] Load  [S] Step  [R] Run  [T] Stop  [Z] Back  [X] Reverse  [B] Add BP  [W] Watch  [C] Clear BP  "
+      "[G] Go to address  [Up/Down/PgUp/PgDn] Scroll memory  [Q] Quit  (hotkeys off while an input has focus; Tab to leave)") | dim;
 
     auto msg = text(model.last_msg) | color(Color::GreenYellow);
 
@@ -305,6 +521,10 @@ int main(int argc, char** argv) {
 
   // 键盘事件：快捷键与滚动
   renderer = CatchEvent(renderer, [&](Event e){
+    // 输入框有焦点时字符全部交给它（地址里的 x、路径里的 w 等），单键快捷键只在没有输入框聚焦时生效
+    if (e.is_character() &&
+        (input_path->Focused() || input_bp->Focused() || input_jump->Focused()))
+      return false;
     if (e == Event::Character('q') || e == Event::Character('Q')) {
       stop_run();
       screen.Exit();
@@ -325,11 +545,26 @@ int main(int argc, char** argv) {
     if (e == Event::Character('b') || e == Event::Character('B')) {
       btn_add_bp->OnEvent(Event::Return); return true;
     }
+    if (e == Event::Character('z') || e == Event::Character('Z')) {
+      btn_back->OnEvent(Event::Return); return true;
+    }
+    if (e == Event::Character('x') || e == Event::Character('X')) {
+      btn_rcont->OnEvent(Event::Return); return true;
+    }
+    if (e == Event::Character('w') || e == Event::Character('W')) {
+      btn_add_watch->OnEvent(Event::Return); return true;
+    }
     if (e == Event::Character('c') || e == Event::Character('C')) {
       btn_clear_bp->OnEvent(Event::Return); return true;
     }
-    if (e == Event::ArrowDown) { if (model.mem_scroll < (1<<30)) model.mem_scroll++; return true; }
-    if (e == Event::ArrowUp)   { if (model.mem_scroll>0) model.mem_scroll--; return true; }
+    if (e == Event::Character('g') || e == Event::Character('G')) {
+      btn_jump->OnEvent(Event::Return); return true;
+    }
+    // 滚动只累加行数，越界由 MemView 截住
+    if (e == Event::ArrowDown) { model.mem_scroll += 1; return true; }
+    if (e == Event::ArrowUp)   { model.mem_scroll -= 1; return true; }
+    if (e == Event::PageDown)  { model.mem_scroll += (long)Model::MEM_PAGE; return true; }
+    if (e == Event::PageUp)    { model.mem_scroll -= (long)Model::MEM_PAGE; return true; }
     return false;
   });
 
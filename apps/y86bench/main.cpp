@@ -0,0 +1,543 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "bintrace.h"
+#include "bpred.h"
+#include "cachesim.h"
+#include "debug.h"
+#include "history.h"
+#include "engine.h"
+#include "ensemble.h"
+#include "image.h"
+#include "parse.h"
+#include "pipe.h"
+#include "profile.h"
+#include "trace.h"
+#include "worker.h"
+
+using nlohmann::json;
+using namespace y86;
+namespace fs = std::filesystem;
+
+// ---------- 分配计数：替换全局 operator new ----------
+// 全部替换形式（普通/数组 × 带大小/对齐/nothrow）都经过同一对不内联的
+// 分配/释放函数，因此 new 与 delete 总是成对，GCC 也看不到 malloc/free
+// 与 operator new/delete 的混用
+static std::atomic<std::uint64_t> g_allocs{0};
+
+[[gnu::noinline]] static void* counted_alloc(std::size_t n, std::size_t align) noexcept {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (n == 0) n = 1;
+    if (align <= alignof(std::max_align_t)) return std::malloc(n);
+    return std::aligned_alloc(align, (n + align - 1) / align * align);
+}
+[[gnu::noinline]] static void counted_free(void* p) noexcept { std::free(p); }
+
+static void* counted_new(std::size_t n, std::size_t align) {
+    if (void* p = counted_alloc(n, align)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t n) { return counted_new(n, 0); }
+void* operator new[](std::size_t n) { return counted_new(n, 0); }
+void* operator new(std::size_t n, std::align_val_t a) { return counted_new(n, (std::size_t)a); }
+void* operator new[](std::size_t n, std::align_val_t a) { return counted_new(n, (std::size_t)a); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept { return counted_alloc(n, 0); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { return counted_alloc(n, 0); }
+void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {
+    return counted_alloc(n, (std::size_t)a);
+}
+void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {
+    return counted_alloc(n, (std::size_t)a);
+}
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(p); }
+
+// ---------- 计时框架 ----------
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    double min_time = 0.2;  // 每项至少采样的秒数
+    std::size_t min_samples = 20;
+    std::size_t max_samples = 200000;
+    u64 limit = 1'000'000;  // 每次运行的指令上限，长程序（gen_corpus.py）需放宽
+    std::string filter;  // 只跑名字包含该子串的项
+};
+
+struct Result {
+    std::string name, program, unit;
+    std::uint64_t ops = 0;  // 总操作数（指令 / 访存 / 调用）
+    std::size_t samples = 0;
+    double ns_per_op = 0, allocs_per_op = 0;
+    double p50 = 0, p90 = 0, p99 = 0;  // 每个采样内的平均 ns/op 的分位数
+};
+
+// 每个采样：setup()（不计时）后执行 body()，body 返回本次完成的操作数
+static Result measure(const Options& opt, const std::string& name, const std::string& program,
+                      const char* unit, const std::function<void()>& setup,
+                      const std::function<std::uint64_t()>& body) {
+    Result r{name, program, unit};
+    std::vector<double> per_op;
+    double total_ns = 0;
+    std::uint64_t allocs = 0;
+    auto start = Clock::now();
+    while (per_op.size() < opt.max_samples) {
+        setup();
+        std::uint64_t a0 = g_allocs.load(std::memory_order_relaxed);
+        auto t0 = Clock::now();
+        std::uint64_t n = body();
+        auto t1 = Clock::now();
+        allocs += g_allocs.load(std::memory_order_relaxed) - a0;
+        if (n == 0) break;
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        total_ns += ns;
+        r.ops += n;
+        per_op.push_back(ns / (double)n);
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (per_op.size() >= opt.min_samples && elapsed >= opt.min_time) break;
+        // 单次就很长的采样（长程序语料）不强求 min_samples
+        if (per_op.size() >= 3 && elapsed >= 10 * opt.min_time) break;
+    }
+    r.samples = per_op.size();
+    if (r.ops == 0) return r;
+    r.ns_per_op = total_ns / (double)r.ops;
+    r.allocs_per_op = (double)allocs / (double)r.ops;
+    std::sort(per_op.begin(), per_op.end());
+    auto pct = [&](double q) { return per_op[std::min(per_op.size() - 1, (std::size_t)(q * per_op.size()))]; };
+    r.p50 = pct(0.50);
+    r.p90 = pct(0.90);
+    r.p99 = pct(0.99);
+    return r;
+}
+
+// 阻止编译器把只为计时而算的结果优化掉
+template <class T>
+static inline void keep(const T& v) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&v) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &v;
+#endif
+}
+
+static std::FILE* null_sink() {
+#ifdef _WIN32
+    return std::fopen("NUL", "wb");
+#else
+    return std::fopen("/dev/null", "wb");
+#endif
+}
+
+// ---------- 各层基准 ----------
+struct Program {
+    std::string name;
+    std::string text;  // .yo 源文本
+    CPU init;          // 载入后的初始状态
+    CPU warm;          // init + 已填好的译码缓存，测稳态执行
+    std::vector<u64> pcs;  // 执行过的不同 PC，用于译码基准
+    u64 steps = 0;         // 动态指令数（受 --limit 限制）
+    json final;            // 预跑结束时的状态，用于自检
+};
+
+// 逐步日志每步都带全部非零内存，长程序（语料）上跳过 step/json、step/stream
+static const u64 TRACE_MAX_STEPS = 1'000'000;
+
+static void bench_program(const Options& opt, const Program& p, std::vector<Result>& out) {
+    auto want = [&](const std::string& n) { return opt.filter.empty() || n.find(opt.filter) != std::string::npos; };
+    CPU cpu;
+    auto fresh = [&] { cpu = p.warm; };
+
+    if (want("load_yo")) {
+        out.push_back(measure(opt, "load_yo", p.name, "load", [] {}, [&] {
+            CPU c;
+            load_yo_buffer(p.text.data(), p.text.size(), c);
+            return std::uint64_t(1);
+        }));
+    }
+    if (want("decode/uncached")) {
+        out.push_back(measure(opt, "decode/uncached", p.name, "insn", fresh, [&] {
+            for (u64 pc : p.pcs) {
+                cpu.PC = pc;
+                Decoded d = decode_uncached(cpu);
+                keep(d);
+            }
+            return (std::uint64_t)p.pcs.size();
+        }));
+    }
+    if (want("decode/cached")) {
+        out.push_back(measure(opt, "decode/cached", p.name, "insn", fresh, [&] {
+            for (u64 pc : p.pcs) {
+                cpu.PC = pc;
+                Decoded d = fetch_and_decode(cpu);
+                keep(d);
+            }
+            return (std::uint64_t)p.pcs.size();
+        }));
+    }
+    if (want("step/execute")) {
+        out.push_back(measure(opt, "step/execute", p.name, "insn", fresh,
+                              [&] { return (std::uint64_t)run_engine(Engine::Step, cpu, opt.limit); }));
+    }
+    if (want("step/json") && p.steps <= TRACE_MAX_STEPS) {
+        out.push_back(measure(opt, "step/json", p.name, "insn", fresh, [&] {
+            std::uint64_t n = 0;
+            json log = json::array();
+            while (n < opt.limit) {
+                log.push_back(step(cpu));
+                ++n;
+                if (cpu.stat != Stat::AOK) break;
+            }
+            std::string s = log.dump(2);
+            keep(s);
+            return n;
+        }));
+    }
+    if (want("step/stream") && p.steps <= TRACE_MAX_STEPS) {
+        std::FILE* f = null_sink();
+        out.push_back(measure(opt, "step/stream", p.name, "insn", fresh, [&] {
+            OutBuf buf(f);
+            JsonTraceWriter w(buf);
+            TraceEach<JsonTraceWriter> t{w};
+            std::uint64_t n = run_auto(cpu, opt.limit, t);
+            w.finish();
+            return n;
+        }));
+        std::fclose(f);
+    }
+    if (want("run/bintrace")) {
+        // 二进制列式日志不含整份内存，长程序也测
+        std::FILE* f = null_sink();
+        out.push_back(measure(opt, "run/bintrace", p.name, "insn", fresh, [&] {
+            OutBuf buf(f, 1 << 20);
+            BinTraceWriter w(buf);
+            w.begin(cpu);
+            TraceEach<BinTraceWriter> t{w};
+            std::uint64_t n = run_auto(cpu, opt.limit, t);
+            w.finish();
+            return n;
+        }));
+        std::fclose(f);
+    }
+    if (want("run/notrace")) {
+        out.push_back(measure(opt, "run/notrace", p.name, "insn", fresh, [&] {
+            NoTrace t;
+            return run_auto(cpu, opt.limit, t);
+        }));
+    }
+    if (want("run/profile")) {
+        out.push_back(measure(opt, "run/profile", p.name, "insn", fresh, [&] {
+            Profiler prof;
+            return run_auto(cpu, opt.limit, prof);
+        }));
+    }
+    if (want("run/cachesim")) {
+        CacheConfig cfg;
+        out.push_back(measure(opt, "run/cachesim", p.name, "insn", fresh, [&] {
+            CacheModel model(cfg);
+            CacheSim sim(model);
+            return run_auto(cpu, opt.limit, sim);
+        }));
+    }
+    if (want("run/bpred")) {
+        out.push_back(measure(opt, "run/bpred", p.name, "insn", fresh, [&] {
+            auto sim = BranchSim::create("default");
+            return run_auto(cpu, opt.limit, *sim);
+        }));
+    }
+    if (want("run/debug")) {
+        // one breakpoint and one watchpoint that never fire: the cost of the
+        // filters alone
+        Debugger dbg;
+        dbg.add_break(u64(1) << 62);
+        dbg.add_watch(u64(1) << 62, 8, Debugger::READ | Debugger::WRITE);
+        out.push_back(measure(opt, "run/debug", p.name, "insn", fresh, [&] {
+            return run_auto(cpu, opt.limit, dbg);
+        }));
+    }
+    if (want("run/history")) {
+        // undo log plus a copy-on-write checkpoint every 64K steps
+        History hist;
+        out.push_back(measure(opt, "run/history", p.name, "insn", [&] {
+            fresh();
+            hist.reset(cpu);
+        }, [&] {
+            return run_auto(cpu, opt.limit, hist);
+        }));
+    }
+    for (LaneIsa isa : {LaneIsa::Scalar, LaneIsa::Avx2, LaneIsa::Avx512}) {
+        // 64 份相同输入锁步执行（始终同一组），按各 lane 指令之和计，对照 run/notrace
+        std::string name = std::string("ensemble/") + lane_isa_name(isa);
+        if (!want(name) || !lane_isa_supported(isa)) continue;
+        std::optional<Ensemble> ens;
+        out.push_back(measure(opt, name, p.name, "insn", [&] { ens.emplace(p.warm, 64, isa); },
+                              [&] { return ens->run(opt.limit); }));
+    }
+    if (want("run/pipe")) {
+        out.push_back(measure(opt, "run/pipe", p.name, "insn", fresh, [&] {
+            PipeEngine pipe;
+            return pipe.run(cpu, opt.limit);
+        }));
+    }
+    if (want("dump_mem_nonzero")) {
+        CPU end = p.init;
+        run_engine(Engine::Step, end, opt.limit);
+        out.push_back(measure(opt, "dump_mem_nonzero", p.name, "call", [] {}, [&] {
+            json j = end.dump_mem_nonzero();
+            keep(j);
+            return std::uint64_t(1);
+        }));
+    }
+}
+
+// 访存后端：64 KiB 区域内顺序 / 随机（含跨 8 字节边界）的 read8/write8
+static void bench_memory(const Options& opt, std::vector<Result>& out) {
+    const std::size_t N = 4096;
+    std::vector<u64> seq(N), rnd(N);
+    std::mt19937_64 rng(42);
+    for (std::size_t i = 0; i < N; i++) {
+        seq[i] = 0x1000 + 8 * i;
+        rnd[i] = 0x1000 + rng() % 0xFFF0;
+    }
+    for (MemBackend be : {MemBackend::Paged, MemBackend::Map}) {
+        const char* bn = be == MemBackend::Paged ? "paged" : "map";
+        CPU cpu;
+        cpu.backend = be;
+        for (u64 a : seq) cpu.write8((s64)a, a);
+        for (auto* pat : {&seq, &rnd}) {
+            std::string suffix = std::string(bn) + (pat == &seq ? "/seq" : "/random");
+            std::string rn = "mem/read8/" + suffix, wn = "mem/write8/" + suffix;
+            if (opt.filter.empty() || rn.find(opt.filter) != std::string::npos) {
+                out.push_back(measure(opt, rn, "", "access", [] {}, [&] {
+                    u64 sum = 0, v = 0;
+                    for (u64 a : *pat) {
+                        cpu.read8((s64)a, v);
+                        sum += v;
+                    }
+                    keep(sum);
+                    return (std::uint64_t)pat->size();
+                }));
+            }
+            if (opt.filter.empty() || wn.find(opt.filter) != std::string::npos) {
+                u64 k = 0;
+                out.push_back(measure(opt, wn, "", "access", [] {}, [&] {
+                    ++k;
+                    for (u64 a : *pat) cpu.write8((s64)a, a ^ k);
+                    return (std::uint64_t)pat->size();
+                }));
+            }
+        }
+    }
+}
+
+// ---------- 输入 / 输出 ----------
+static bool read_file(const std::string& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool load_program(const Options& opt, const std::string& path, Program& p) {
+    if (!read_file(path, p.text) || is_ybin(p.text.data(), p.text.size())) return false;
+    p.name = fs::path(path).filename().string();
+    load_yo_buffer(p.text.data(), p.text.size(), p.init);
+    // 记录实际执行到的 PC（去重、保持首次出现顺序）
+    CPU c = p.init;
+    std::map<u64, bool> seen;
+    for (; p.steps < opt.limit && c.stat == Stat::AOK; p.steps++) {
+        if (!seen[c.PC]) {
+            seen[c.PC] = true;
+            p.pcs.push_back(c.PC);
+        }
+        execute(c);
+    }
+    if (c.stat != Stat::AOK && !p.pcs.empty() && c.PC == p.pcs.back()) {
+        // 最后一条取指失败的 PC 无法译码
+        Decoded d = decode_uncached(c);
+        if (!d.ok) p.pcs.pop_back();
+    }
+    p.warm = p.init;
+    for (u64 pc : p.pcs) {
+        p.warm.PC = pc;
+        fetch_and_decode(p.warm);
+    }
+    p.warm.PC = p.init.PC;
+    p.final = {{"STAT", (int)c.stat}, {"REG", c.dump_regs()}};
+    return true;
+}
+
+// gen_corpus.py 生成的目录里有 expected.json：按其中的 STAT / 结果寄存器自检
+static bool check_expected(const std::string& path, const Program& p) {
+    std::string text;
+    if (!read_file((fs::path(path).parent_path() / "expected.json").string(), text)) return true;
+    json e = json::parse(text, nullptr, false);
+    if (!e.is_object() || !e.contains(p.name)) return true;
+    const json& want = e[p.name];
+    bool ok = p.final["STAT"] == want.value("STAT", 2);
+    json regs = want.value("REG", json::object());
+    for (auto& [reg, v] : regs.items())
+        if (p.final["REG"][reg] != v) ok = false;
+    if (!ok)
+        std::cerr << "check " << p.name << ": final state differs from expected.json after "
+                  << p.steps << " steps (raise --limit?)\n";
+    return ok;
+}
+
+static json to_json(const Result& r) {
+    json j = {{"name", r.name},       {"unit", r.unit},        {"ops", r.ops},
+              {"samples", r.samples}, {"ns_per_op", r.ns_per_op}, {"allocs_per_op", r.allocs_per_op},
+              {"p50_ns", r.p50},      {"p90_ns", r.p90},       {"p99_ns", r.p99}};
+    if (!r.program.empty()) j["program"] = r.program;
+    return j;
+}
+
+static std::string key_of(const std::string& name, const std::string& program) {
+    return program.empty() ? name : name + " @ " + program;
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0
+              << " [--json[=FILE]] [--baseline=FILE] [--min-time=SEC] [--filter=SUBSTR]\n"
+              << "       [--limit=N]\n"
+              << "       [program.yo|dir ...]   (default: ./test)\n";
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    bool as_json = false;
+    std::string json_path, baseline;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--json")) {
+            as_json = true;
+        } else if (!std::strncmp(argv[i], "--json=", 7)) {
+            as_json = true;
+            json_path = argv[i] + 7;
+        } else if (!std::strncmp(argv[i], "--baseline=", 11)) {
+            baseline = argv[i] + 11;
+        } else if (!std::strncmp(argv[i], "--min-time=", 11)) {
+            // 非负秒数，整串都要是数字
+            char* end = nullptr;
+            opt.min_time = std::strtod(argv[i] + 11, &end);
+            if (end == argv[i] + 11 || *end || !(opt.min_time >= 0 && opt.min_time < 1e9)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (!std::strncmp(argv[i], "--filter=", 9)) {
+            opt.filter = argv[i] + 9;
+        } else if (!std::strncmp(argv[i], "--limit=", 8)) {
+            // 与 y86sim --limit 相同：十进制或 0x 十六进制，不收符号和空白
+            if (!parse_u64(argv[i] + 8, opt.limit) || opt.limit == 0) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (argv[i][0] != '-') {
+            inputs.push_back(argv[i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (inputs.empty()) inputs.push_back("test");
+
+    std::vector<std::string> files;
+    for (auto& in : inputs) {
+        std::error_code ec;
+        if (fs::is_directory(in, ec)) {
+            std::vector<std::string> dir;
+            for (auto& e : fs::directory_iterator(in, ec))
+                if (e.path().extension() == ".yo") dir.push_back(e.path().string());
+            std::sort(dir.begin(), dir.end());
+            files.insert(files.end(), dir.begin(), dir.end());
+        } else {
+            files.push_back(in);
+        }
+    }
+
+    std::vector<Result> results;
+    int failed = 0;
+    for (auto& f : files) {
+        Program p;
+        if (!load_program(opt, f, p)) {
+            std::cerr << "skip " << f << ": cannot read .yo\n";
+            continue;
+        }
+        if (!check_expected(f, p)) ++failed;
+        bench_program(opt, p, results);
+    }
+    bench_memory(opt, results);
+
+    // 与基线（之前某次 --json 的输出）对比
+    std::map<std::string, double> base;
+    if (!baseline.empty()) {
+        std::string text;
+        if (!read_file(baseline, text)) {
+            std::cerr << "cannot read baseline " << baseline << "\n";
+            return 2;
+        }
+        json b = json::parse(text, nullptr, false);
+        if (b.is_object() && b.contains("results"))
+            for (auto& r : b["results"])
+                base[key_of(r.value("name", ""), r.value("program", ""))] = r.value("ns_per_op", 0.0);
+    }
+
+    if (as_json) {
+        json j = {{"version", 1}, {"results", json::array()}};
+#ifdef __VERSION__
+        j["compiler"] = __VERSION__;
+#endif
+        for (auto& r : results) {
+            json e = to_json(r);
+            auto it = base.find(key_of(r.name, r.program));
+            if (it != base.end() && it->second > 0) e["vs_baseline"] = r.ns_per_op / it->second;
+            j["results"].push_back(std::move(e));
+        }
+        std::string text = j.dump(2) + "\n";
+        if (json_path.empty()) {
+            std::cout << text;
+        } else {
+            std::ofstream(json_path) << text;
+        }
+        if (json_path.empty()) return failed ? 1 : 0;
+    }
+
+    std::printf("%-28s %-22s %10s %10s %10s %10s %10s\n", "benchmark", "program", "ns/op", "p50",
+                "p99", "allocs/op", "vs base");
+    for (auto& r : results) {
+        auto it = base.find(key_of(r.name, r.program));
+        char vs[32] = "";
+        if (it != base.end() && it->second > 0)
+            std::snprintf(vs, sizeof(vs), "%+.1f%%", (r.ns_per_op / it->second - 1) * 100);
+        std::printf("%-28s %-22s %10.2f %10.2f %10.2f %10.3f %10s\n", r.name.c_str(),
+                    r.program.c_str(), r.ns_per_op, r.p50, r.p99, r.allocs_per_op, vs);
+    }
+    return failed ? 1 : 0;
+}
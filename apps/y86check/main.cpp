@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "engine.h"
+#include "history.h"
+#include "memview.h"
+#include "worker.h"
+
+using namespace y86;
+using nlohmann::json;
+namespace fs = std::filesystem;
+
+// 库层面的自检，test.sh / ctest 调用；用法：y86check [test 目录]
+// 各项对照按定义算出的期望值，不一致时在 stderr 说明并以 1 退出
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (ok) return;
+    ++failures;
+    std::cerr << "FAIL: " << what << "\n";
+}
+
+static std::vector<u64> addrs(const std::vector<MemView::Row>& rows) {
+    std::vector<u64> out;
+    for (const auto& r : rows) out.push_back(r.addr);
+    return out;
+}
+
+// 第 first 个起连续 n 个非零 qword 的地址
+static std::vector<u64> expect(const CPU& S, std::size_t first, std::size_t n) {
+    std::vector<u64> out;
+    for (const auto& [a, v] : S.qword_nonzero()) {
+        if (first) {
+            --first;
+        } else if (out.size() < n) {
+            out.push_back(a);
+        }
+    }
+    return out;
+}
+
+// 内存面板：滚动、跳转、窗口在末尾补满，以及写入后的高亮年龄
+static void check_memview(const fs::path& dir) {
+    CPU S;
+    // 50 个非零 qword，间隔 24 字节，中间夹着零
+    for (u64 i = 0; i < 50; i++) S.write8((s64)(0x1000 + 24 * i), i + 1);
+    MemView v(10);
+    v.reset(S);
+    std::vector<MemView::Row> rows;
+
+    v.refresh(S, rows);
+    check(addrs(rows) == expect(S, 0, 10), "memview: first page");
+    bool cold = true;
+    for (const auto& r : rows)
+        cold = cold && r.age == MemView::COLD && r.value == (s64)((r.addr - 0x1000) / 24 + 1);
+    check(cold, "memview: writes before reset() are not highlighted");
+    check(v.total(S) == 50, "memview: total");
+
+    v.scroll(S, 5);
+    v.refresh(S, rows);
+    check(addrs(rows) == expect(S, 5, 10), "memview: scroll down 5 rows");
+    v.scroll(S, -2);
+    v.refresh(S, rows);
+    check(addrs(rows) == expect(S, 3, 10), "memview: scroll up 2 rows");
+    v.scroll(S, 1000);
+    v.refresh(S, rows);
+    check(v.top() == 0x1000 + 24 * 49 && addrs(rows) == expect(S, 40, 10),
+          "memview: scrolling past the end keeps the last page full");
+    v.scroll(S, -1000);
+    v.refresh(S, rows);
+    check(v.top() == 0x1000 && addrs(rows) == expect(S, 0, 10), "memview: scroll back to the top");
+
+    // 跳到两个非零 qword 之间、未对齐的地址：落在下一个非零 qword 上
+    v.jump(S, 0x1000 + 24 * 20 + 11);
+    v.refresh(S, rows);
+    check(v.top() == 0x1000 + 24 * 21 && addrs(rows) == expect(S, 21, 10), "memview: jump between qwords");
+    v.jump(S, 0x1000 + 24 * 30);
+    v.refresh(S, rows);
+    check(addrs(rows) == expect(S, 30, 10), "memview: jump onto a qword");
+    v.jump(S, 0x100000);
+    v.refresh(S, rows);
+    check(addrs(rows) == expect(S, 40, 10), "memview: jump past the end");
+
+    // 高亮：改写、清零、新写入；年龄按 refresh 次数增长，HOT_REFRESHES 次后消失
+    v.jump(S, 0);
+    S.write8(0x1000 + 24 * 2, 99);
+    S.write8(0x1000 + 24 * 4, 0);
+    S.write8(0x1000 + 24 * 3 + 8, 7);
+    v.refresh(S, rows);
+    check(rows.size() == 10 && rows[2].value == 99 && rows[2].age == 0 && rows[3].age == MemView::COLD &&
+              rows[4].addr == 0x1000 + 24 * 3 + 8 && rows[4].value == 7 && rows[4].age == 0 &&
+              rows[5].addr == 0x1000 + 24 * 5,
+          "memview: rewritten, cleared and new qwords");
+    check(v.total(S) == 50, "memview: total after one clear and one new qword");
+    for (u32 k = 1; k < MemView::HOT_REFRESHES; k++) {
+        v.refresh(S, rows);
+        check(rows[2].age == k && rows[4].age == k, "memview: age " + std::to_string(k));
+    }
+    v.refresh(S, rows);
+    check(rows[2].age == MemView::COLD && rows[4].age == MemView::COLD,
+          "memview: highlight ends after HOT_REFRESHES refreshes");
+
+    // 一次 refresh 之间的写多于 DIRTY_RING 次时，只有最后 DIRTY_RING 个高亮
+    S.write8(0x1000, 1000);
+    for (u64 k = 0; k < CPU::DIRTY_RING; k++) S.write8(0x1000 + 24 * 49, 2000 + k);
+    v.scroll(S, -1000);
+    v.refresh(S, rows);
+    check(rows[0].value == 1000 && rows[0].age == MemView::COLD,
+          "memview: writes older than the dirty ring are not highlighted");
+    v.scroll(S, 1000);
+    v.refresh(S, rows);
+    check(rows.back().age == 1 && rows.back().value == (s64)(2000 + CPU::DIRTY_RING - 1),
+          "memview: the newest writes are highlighted");
+
+    // restore() 和 drop_index() 之后环里是旧的写，不能当成新写入高亮
+    for (u32 k = 0; k < MemView::HOT_REFRESHES; k++) v.refresh(S, rows);
+    auto all_cold = [&] {
+        return std::all_of(rows.begin(), rows.end(), [](const MemView::Row& r) { return r.age == MemView::COLD; });
+    };
+    S.restore(S.checkpoint());
+    v.refresh(S, rows);
+    check(all_cold(), "memview: nothing highlighted after restore()");
+    S.drop_index();
+    v.refresh(S, rows);
+    check(all_cold(), "memview: nothing highlighted after drop_index()");
+    S.write8(0x1000 + 24 * 49, 3000);
+    v.refresh(S, rows);
+    check(rows.back().age == 0 && rows.back().value == 3000 && rows[rows.size() - 2].age == MemView::COLD,
+          "memview: writes after a restore are highlighted again");
+
+    // 真实程序：载入后（索引按需建立）第一页就是前 10 个非零 qword，执行中的
+    // 栈写入带高亮
+    CPU P;
+    if (!load_yo_file((dir / "asum.yo").string(), P)) {
+        check(false, "memview: cannot load asum.yo");
+        return;
+    }
+    v.reset(P);
+    v.refresh(P, rows);
+    check(addrs(rows) == expect(P, 0, 10), "memview: asum.yo after loading");
+    while (P.stat == Stat::AOK) execute(P);
+    v.jump(P, 0x1f0);
+    v.refresh(P, rows);
+    // 栈在最高处，窗口向前补满，最后两行是两个返回地址
+    check(rows.size() == 10 && addrs(rows) == expect(P, P.qword_nonzero().size() - 10, 10) &&
+              rows[8].addr == 0x1f0 && rows[8].value == 0x55 && rows[8].age == 0 &&
+              rows[9].addr == 0x1f8 && rows[9].value == 0x13 && rows[9].age == 0 &&
+              rows[7].age == MemView::COLD,
+          "memview: asum.yo return addresses on the stack");
+}
+
+// 写、读 RNONE scratch 的小程序；test/ 里的程序都不碰它
+static const char RNONE_PROG[] =
+    "0x000: 30ff0700000000000000 | irmovq $7, F\n"
+    "0x00a: 20f0                 | rrmovq F, %rax\n"
+    "0x00c: 30f30500000000000000 | irmovq $5, %rbx\n"
+    "0x016: 603f                 | addq %rbx, F\n"
+    "0x018: 20f1                 | rrmovq F, %rcx\n"
+    "0x01a: b0ff                 | popq F\n"
+    "0x01c: 20f2                 | rrmovq F, %rdx\n"
+    "0x01e: 00                   | halt\n";
+
+// 循环 400 次、每次写一次内存，共 1203 步；比 test/ 里的程序都长，走得到
+// 多个检查点
+static const char LOOP_PROG[] =
+    "0x000: 30f09001000000000000 | irmovq $400, %rax\n"
+    "0x00a: 30f30100000000000000 | irmovq $1, %rbx\n"
+    "0x014: 40010002000000000000 | loop: rmmovq %rax, 0x200(%rcx)\n"
+    "0x01e: 6130                 | subq %rbx, %rax\n"
+    "0x020: 741400000000000000   | jne loop\n"
+    "0x029: 00                   | halt\n";
+
+struct State {
+    json dump;
+    s64 scratch;
+    bool operator==(const State& o) const { return dump == o.dump && scratch == o.scratch; }
+};
+
+static State capture(const CPU& S) { return {dump_state(S), S.scratch}; }
+
+static void differs(const std::string& name, const std::string& what, u64 t, const State& got,
+                    const State& want) {
+    check(false, name + ": " + what + " at step " + std::to_string(t) + " differs from the forward run");
+    std::cerr << "  got:  " << got.dump.dump() << " scratch=" << got.scratch << "\n"
+              << "  want: " << want.dump.dump() << " scratch=" << want.scratch << "\n";
+}
+
+// 历史：回退到第 t 步的状态必须与从头正向执行 t 步完全一致（含 RNONE
+// scratch），覆盖撤销环和检查点重放两条路径
+static u64 check_history(const std::string& name, const CPU& init, u64 limit) {
+    // 参照：execute() 逐条执行，记下每一步之后的状态
+    std::vector<State> ref;
+    CPU S = init;
+    ref.push_back(capture(S));
+    while (S.stat == Stat::AOK && ref.size() <= limit) {
+        execute(S);
+        ref.push_back(capture(S));
+    }
+    u64 end = ref.size() - 1;
+
+    // 撤销环和检查点都取得很小，逼出重放和环耗尽的情形
+    History::Config cfg;
+    cfg.undo_steps = 8;
+    cfg.checkpoint_every = 5;
+    cfg.max_checkpoints = 1 << 20;
+    History h(cfg);
+    S = init;
+    h.reset(S);
+    u64 n = run_auto(S, end, h);
+    if (n != end || !(capture(S) == ref[end])) {
+        differs(name, "recorded run", n, capture(S), ref[end]);
+        return 0;
+    }
+    for (u64 t = end; t > 0; --t) {
+        if (h.step_back(S, 1) != 1) {
+            check(false, name + ": step_back stopped at step " + std::to_string(t));
+            return 0;
+        }
+        if (!(capture(S) == ref[t - 1])) {
+            differs(name, "step_back", t - 1, capture(S), ref[t - 1]);
+            return 0;
+        }
+    }
+
+    // 重新录一遍，再按伪随机顺序跳来跳去
+    run_auto(S, end, h);
+    u64 x = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < 64 && end; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        u64 t = x % (h.now() + 1);
+        if (!h.seek(S, t) || !(capture(S) == ref[t])) {
+            differs(name, "seek", t, capture(S), ref[t]);
+            return 0;
+        }
+        run_auto(S, end - t, h);
+    }
+
+    // 撤销环比保留的检查点走得更远：退回到唯一检查点之前再往前跑，要有检查点可依
+    History::Config far;
+    far.undo_steps = 4096;
+    far.checkpoint_every = 64;
+    far.max_checkpoints = 1;
+    History g(far);
+    S = init;
+    g.reset(S);
+    for (int i = 0; i < 3; i++) {
+        run_auto(S, end - g.now(), g);
+        u64 t = g.now() - g.step_back(S, end > 5 ? end - 5 : 0);
+        if (!(capture(S) == ref[t])) {
+            differs(name, "step_back past the last checkpoint", t, capture(S), ref[t]);
+            return 0;
+        }
+    }
+    run_auto(S, end - g.now(), g);
+    u64 t = g.oldest();
+    if (!(capture(S) == ref[end]) || !g.seek(S, t) || !(capture(S) == ref[t])) {
+        differs(name, "seek to oldest() after running on", t, capture(S), ref[t]);
+        return 0;
+    }
+    return end;
+}
+
+// 反向继续：断点、写观察点逐个倒着停下，与正向执行的停点一致；撤销环只有
+// 8 项，远处的停点要穿过多段重放
+static void check_reverse_continue(const std::string& name, const CPU& init, u64 limit) {
+    std::vector<State> ref;
+    std::vector<u64> pcs;
+    CPU S = init;
+    ref.push_back(capture(S));
+    pcs.push_back(S.PC);
+    while (S.stat == Stat::AOK && ref.size() <= limit) {
+        execute(S);
+        ref.push_back(capture(S));
+        pcs.push_back(S.PC);
+    }
+    u64 end = ref.size() - 1;
+    if (end < 2) return;
+
+    // 期望的停点，从近到远：断点是 PC 等于它的各步（不含 end 本身）；写观察点
+    // 是正向运行停在其后一步的那些写
+    std::vector<std::pair<std::string, Debugger>> cases;
+    std::vector<std::vector<u64>> stops;
+    {
+        Debugger d;
+        d.add_break(pcs[end / 2]);
+        std::vector<u64> want;
+        for (u64 t = end; t-- > 0;)
+            if (pcs[t] == pcs[end / 2]) want.push_back(t);
+        cases.emplace_back("breakpoint", std::move(d));
+        stops.push_back(std::move(want));
+    }
+    {
+        // 最终状态里第一个被改过的 qword
+        u64 addr = ~u64(0);
+        for (const auto& [a, v] : S.qword_nonzero())
+            if (init.read8_unchecked(a) != (u64)v) {
+                addr = a;
+                break;
+            }
+        if (addr != ~u64(0)) {
+            Debugger d;
+            d.add_watch(addr, 8, Debugger::WRITE);
+            std::vector<u64> want;
+            CPU F = init;
+            u64 t = 0;
+            while (t < end) {
+                t += run_auto(F, end - t, d);
+                if (d.hit().kind != Debugger::Hit::WATCH) break;
+                want.push_back(t - 1);
+            }
+            std::reverse(want.begin(), want.end());
+            cases.emplace_back("write watchpoint", std::move(d));
+            stops.push_back(std::move(want));
+        }
+    }
+
+    History::Config cfg;
+    cfg.undo_steps = 8;
+    cfg.checkpoint_every = 5;
+    cfg.max_checkpoints = 1 << 20;
+    for (std::size_t c = 0; c < cases.size(); c++) {
+        auto& [what, dbg] = cases[c];
+        History h(cfg);
+        S = init;
+        h.reset(S);
+        run_auto(S, end, h);
+        std::vector<u64> got;
+        while (h.reverse_continue(S, dbg) && dbg.hit().kind != Debugger::Hit::NONE) {
+            if (!(capture(S) == ref[h.now()])) {
+                differs(name, "reverse_continue to a " + what, h.now(), capture(S), ref[h.now()]);
+                return;
+            }
+            got.push_back(h.now());
+        }
+        check(got == stops[c] && h.now() == 0 && dbg.hit().kind == Debugger::Hit::NONE && capture(S) == ref[0],
+              name + ": reverse_continue to a " + what + " stops where the forward run does");
+    }
+}
+
+static void check_histories(const fs::path& dir) {
+    std::vector<std::pair<std::string, CPU>> progs;
+    {
+        CPU S;
+        load_yo_buffer(RNONE_PROG, std::strlen(RNONE_PROG), S);
+        progs.emplace_back("<rnone>", std::move(S));
+    }
+    {
+        CPU S;
+        load_yo_buffer(LOOP_PROG, std::strlen(LOOP_PROG), S);
+        progs.emplace_back("<loop>", std::move(S));
+    }
+    std::vector<fs::path> paths;
+    for (const auto& e : fs::directory_iterator(dir))
+        if (e.path().extension() == ".yo") paths.push_back(e.path());
+    std::sort(paths.begin(), paths.end());
+    for (const auto& p : paths) {
+        CPU S;
+        if (!load_yo_file(p.string(), S)) {
+            check(false, "history: cannot load " + p.string());
+            return;
+        }
+        progs.emplace_back(p.filename().string(), std::move(S));
+    }
+    u64 steps = 0;
+    for (const auto& [name, init] : progs) {
+        steps += check_history(name, init, 200000);
+        check_reverse_continue(name, init, 200000);
+    }
+    std::cout << "history: " << progs.size() << " programs, " << steps << " steps checked\n";
+}
+
+// TUI 的做法：单步、后退在 UI 线程，Run 在另开的线程上接着跑；寄存器 F
+// 跟着 CPU 走，换线程不丢
+static void check_history_threads() {
+    CPU init;
+    load_yo_buffer(RNONE_PROG, std::strlen(RNONE_PROG), init);
+    std::vector<State> ref;
+    CPU S = init;
+    ref.push_back(capture(S));
+    while (S.stat == Stat::AOK) {
+        execute(S);
+        ref.push_back(capture(S));
+    }
+    u64 end = ref.size() - 1;
+
+    History h;
+    S = init;
+    h.reset(S);
+    run_auto(S, 1, h);
+    std::thread([&] { run_auto(S, end - 1, h); }).join();
+    if (!(capture(S) == ref[end])) differs("threads", "run on another thread", end, capture(S), ref[end]);
+    h.step_back(S, 3);
+    if (!(capture(S) == ref[end - 3]))
+        differs("threads", "step_back on the UI thread", end - 3, capture(S), ref[end - 3]);
+    std::thread([&] { run_auto(S, 3, h); }).join();
+    if (!(capture(S) == ref[end])) differs("threads", "run again on another thread", end, capture(S), ref[end]);
+}
+
+int main(int argc, char** argv) {
+    fs::path dir = argc > 1 ? argv[1] : "test";
+    check_memview(dir);
+    check_histories(dir);
+    check_history_threads();
+    if (failures) return 1;
+    std::cout << "y86check: all checks passed\n";
+    return 0;
+}
@@ -1,28 +1,685 @@
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
 #include <nlohmann/json.hpp>
 
+#include "batch.h"
+#include "bintrace.h"
+#include "bpred.h"
+#include "cachesim.h"
+#include "debug.h"
+#include "engine.h"
+#include "ensemble.h"
+#include "image.h"
+#include "jit.h"
+#include "parse.h"
+#include "pipe.h"
+#include "profile.h"
+#include "sample.h"
+#include "trace.h"
 #include "worker.h"
 
 using nlohmann::json;
 using namespace y86;
 
-int main() {
-    std::ios::sync_with_stdio(false);
-    std::cin.tie(nullptr);
+enum class TraceMode { Full, Dom, Delta, Bin, None, Final };
 
-    CPU cpu;
-    // 如果希望对内存设置硬上界，第三个参数传 true（可按需要调整 slack）
-    load_yo(std::cin, cpu, /*bound=*/false, /*slack=*/65536);
+static void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0
+              << " [--mem=paged|map] [--trace=full|dom|delta|bin|none] [--engine=step|threaded|jit|pipe]\n"
+              << "       [--final-only] [--bound] [--no-icache] [--stats] [--diff] [--cache]\n"
+              << "       [--limit=N]  (instruction limit, default 1000000)\n"
+              << "       [--profile=PREFIX]  (writes PREFIX.json and PREFIX.folded)\n"
+              << "       [--cachesim[=SPEC]]  (cache model, e.g. l1d=16k:4:64:plru,l2=off,mem=80)\n"
+              << "       [--bpred[=SPEC]]  (branch predictors, e.g. btfn,bimodal:10,gshare:8:12,ras=8)\n"
+              << "       [--break=ADDR|EXPR]...  (e.g. 0x40, 'pc == 0x40 && rax == 0', '[0x100] > 5')\n"
+              << "       [--watch=ADDR[:LEN][:r|w|rw]]...  (stop after an access, default 8 bytes, w)\n"
+              << "       [--start=N|pc:ADDR]...  (run untraced until N instructions / PC == ADDR)\n"
+              << "       [--sample=SKIP:LEN[:COUNT]]  (then repeat: skip SKIP untraced, trace LEN)\n"
+              << "       [--lanes=FILE [--lane-isa=scalar|avx2|avx512]]  (one run per JSON line of\n"
+              << "        inputs, e.g. {\"REG\":{\"rdi\":5},\"MEM\":{\"0x100\":7}}, in lockstep)\n"
+              << "       [program.yo|program.ybin]\n"
+              << "       (reads the program from stdin when no path is given)\n"
+              << "       " << argv0 << " --batch=<dir|list> [--out=DIR] [--jobs=N] [options] > summary.json\n"
+              << "       " << argv0 << " --expand [trace.ytr] < trace.delta|trace.ytr > trace.json\n";
+}
 
-    const std::size_t LIMIT = 1'000'000;  // 防死循环
+// 旧路径：整份日志先建成 json::array 再一次性输出
+static std::size_t run_dom(CPU& cpu, std::size_t limit) {
     json out = json::array();
-    for (std::size_t i = 0; i < LIMIT; ++i) {
+    std::size_t n = 0;
+    while (n < limit) {
         json one = step(cpu);
         out.push_back(std::move(one));
+        ++n;
         if (cpu.stat != Stat::AOK) {
             break;
         }
     }
     std::cout << out.dump(2) << "\n";
+    return n;
+}
+
+// 把 --trace=delta / --trace=bin 的输出还原成完整日志。.ytr 按文件头识别，
+// 给出路径时直接 mmap，只在输出时逐块读取
+static int expand_trace(const std::string& path) {
+    OutBuf buf(stdout);
+    std::string err;
+    try {
+        BinTrace bin;
+        if (!path.empty()) {
+            std::ifstream in(path, std::ios::binary);
+            char magic[ytr::HEADER_SIZE] = {};
+            in.read(magic, sizeof magic);
+            if (!in && !in.eof()) throw std::runtime_error("cannot read " + path);
+            if (BinTrace::is_ytr(magic, (std::size_t)in.gcount())) {
+                if (!bin.open(path, &err)) throw std::runtime_error(err);
+                bin.to_json(buf);
+            } else {
+                in.clear();
+                in.seekg(0);
+                expand_delta_trace(in, buf);
+            }
+        } else if (std::cin.peek() == ytr::MAGIC[0]) {
+            std::vector<u8> all((std::istreambuf_iterator<char>(std::cin)),
+                                std::istreambuf_iterator<char>());
+            if (!bin.open_buffer(std::move(all), &err)) throw std::runtime_error(err);
+            bin.to_json(buf);
+        } else {
+            expand_delta_trace(std::cin, buf);
+        }
+    } catch (const std::exception& e) {
+        buf.flush();
+        std::cerr << "expand failed: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+static void print_stats(const CPU& cpu, std::size_t steps) {
+    std::cerr << "steps: " << steps << "\n"
+              << "icache: hits=" << cpu.icache.hits << " misses=" << cpu.icache.misses
+              << " invalidations=" << cpu.icache.invalidations << "\n";
+}
+
+// 批量模式：每个程序一个 CPU，多线程（work stealing）并行执行，
+// 日志各写一个文件，stdout 输出每个程序的步数/耗时/最终 STAT
+static int run_batch_mode(const std::string& src, const std::string& out_dir, unsigned jobs,
+                          TraceMode mode, Engine engine, const CPU& proto,
+                          const LoadOptions& load_opt, u64 limit) {
+    std::string err;
+    std::vector<std::string> programs = batch_inputs(src, &err);
+    if (!err.empty() || programs.empty()) {
+        std::cerr << "batch: no programs in " << src << (err.empty() ? "" : ": " + err) << "\n";
+        return 2;
+    }
+    BatchOptions opt;
+    opt.out_dir = out_dir;
+    opt.jobs = jobs;
+    opt.output = mode == TraceMode::None    ? BatchOptions::Output::None
+                 : mode == TraceMode::Delta ? BatchOptions::Output::Delta
+                 : mode == TraceMode::Bin   ? BatchOptions::Output::Bin
+                 : mode == TraceMode::Final ? BatchOptions::Output::Final
+                                            : BatchOptions::Output::Json;
+    opt.engine = engine;
+    opt.backend = proto.backend;
+    opt.icache = proto.icache.enabled;
+    opt.load = load_opt;
+    opt.limit = limit;
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results = run_batch(programs, opt);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    u64 total = 0;
+    int failed = 0;
+    for (auto& r : results) {
+        total += r.steps;
+        if (!r.error.empty()) {
+            ++failed;
+            std::cerr << "batch: " << r.program << ": " << r.error << "\n";
+        }
+    }
+    std::cout << batch_summary(results).dump(2) << "\n";
+    std::cerr << "batch: " << results.size() << " programs, " << total << " instructions in "
+              << secs << " s (" << (secs > 0 ? total / secs / 1e6 : 0) << " MIPS)\n";
+    return failed ? 1 : 0;
+}
+
+// 剖析结果：PREFIX.json 汇总与 PREFIX.folded 火焰图输入；程序由路径给出时
+// 用 .yo 里的标号命名函数
+static bool write_profile(const Profiler& prof, const std::string& path, const std::string& prefix) {
+    Symbols syms;
+    std::string text;
+    if (!path.empty()) {
+        std::ifstream in(path, std::ios::binary);
+        text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (!is_ybin(text.data(), text.size())) syms = yo_symbols(text.data(), text.size());
+    }
+    std::ofstream js(prefix + ".json"), folded(prefix + ".folded");
+    js << prof.summary(syms).dump(2) << "\n";
+    prof.write_folded(folded, syms);
+    if (!js || !folded) {
+        std::cerr << "cannot write " << prefix << ".json / .folded\n";
+        return false;
+    }
+    return true;
+}
+
+// 采样执行：不记录地快进到触发点，之后按 --sample 的周期交替跳过 / 详细执行。
+// 快进用所选引擎（jit 或 threaded 循环），窗口内用 detail 给出的策略；每个
+// 窗口的起点（已执行的指令数）和长度写到 stderr，detailed 累计窗口内的步数
+template <class Detail>
+static u64 run_sample_mode(CPU& cpu, u64 limit, const SampleSpec& spec, Engine engine,
+                           JitEngine& jit, u64& detailed, Detail&& detail) {
+    auto fast = [&](CPU& S, u64 n) -> u64 {
+        if (engine == Engine::Jit) return jit.run(S, n);
+        NoTrace t;
+        return run_auto(S, n, t);
+    };
+    return run_sampled(cpu, limit, spec, fast, detail, [&](u64 first, u64 n) {
+        detailed += n;
+        std::cerr << "window: {\"start\":" << first << ",\"steps\":" << n << "}\n";
+    });
+}
+
+// --lanes 的输入：每行一个 JSON 对象，给出该次运行相对载入状态的改动
+// （REG 按寄存器名，MEM 按 8 字节地址，PC），空行跳过
+struct LaneInput {
+    std::vector<std::pair<int, s64>> regs;
+    std::vector<std::pair<u64, s64>> mem;
+    bool set_pc = false;
+    u64 pc = 0;
+};
+
+static bool read_lane_inputs(const std::string& path, std::vector<LaneInput>& out, std::string& err) {
+    std::ifstream in(path);
+    if (!in) {
+        err = "cannot open " + path;
+        return false;
+    }
+    std::string line;
+    for (int no = 1; std::getline(in, line); no++) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        auto bad = [&](const std::string& what) {
+            err = path + ":" + std::to_string(no) + ": " + what;
+            return false;
+        };
+        json j = json::parse(line, nullptr, false);
+        if (!j.is_object()) return bad("expected a JSON object");
+        LaneInput lane;
+        for (auto& [key, v] : j.items()) {
+            if (key == "REG" && v.is_object()) {
+                for (auto& [name, x] : v.items()) {
+                    int r = 0;
+                    while (r < REG_NUM && name != reg_name(r)) r++;
+                    if (r == REG_NUM || !x.is_number_integer()) return bad("bad register " + name);
+                    lane.regs.emplace_back(r, x.get<s64>());
+                }
+            } else if (key == "MEM" && v.is_object()) {
+                for (auto& [addr, x] : v.items()) {
+                    u64 a;
+                    if (!parse_u64(addr, a) || !x.is_number_integer()) return bad("bad MEM entry " + addr);
+                    lane.mem.emplace_back(a, x.get<s64>());
+                }
+            } else if (key == "PC" && v.is_number_integer()) {
+                lane.set_pc = true;
+                lane.pc = v.get<u64>();
+            } else {
+                return bad("unknown key " + key);
+            }
+        }
+        out.push_back(std::move(lane));
+    }
+    if (out.empty()) {
+        err = path + ": no lanes";
+        return false;
+    }
+    return true;
+}
+
+// 多组输入的锁步执行（ensemble.h）：同一程序的各次运行按 PC 分组，取指译码
+// 一次，ALU 类指令用向量指令一起执行。stdout 依次输出每条 lane 的最终状态；
+// --diff 时改为把每条 lane 与单独 step() 的结果逐一对比
+static int run_lanes_mode(const CPU& cpu, const std::string& src, LaneIsa isa, u64 limit,
+                          TraceMode mode, bool diff, bool stats) {
+    std::vector<LaneInput> inputs;
+    std::string err;
+    if (!read_lane_inputs(src, inputs, err)) {
+        std::cerr << "--lanes: " << err << "\n";
+        return 2;
+    }
+    Ensemble ens(cpu, inputs.size(), isa);
+    for (std::size_t i = 0; i < inputs.size(); i++) {
+        for (auto& [r, v] : inputs[i].regs) ens.set_reg(i, r, v);
+        for (auto& [a, v] : inputs[i].mem) {
+            if (!ens.write8(i, a, (u64)v)) {
+                std::cerr << "--lanes: lane " << i << ": address " << a << " out of bounds\n";
+                return 2;
+            }
+        }
+        if (inputs[i].set_pc) ens.set_pc(i, inputs[i].pc);
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    u64 total = ens.run(limit);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (stats) {
+        const auto& st = ens.stats();
+        json js = {{"lanes", ens.size()},           {"isa", lane_isa_name(ens.isa())},
+                   {"instructions", total},         {"group_insns", st.group_insns},
+                   {"lane_insns", st.lane_insns},   {"regroups", st.regroups},
+                   {"divergences", st.divergences}, {"detached", st.detached},
+                   {"solo_insns", st.solo_insns},   {"seconds", secs}};
+        std::cerr << "ensemble: " << js.dump() << "\n";
+    }
+    if (diff) {
+        for (std::size_t i = 0; i < ens.size(); i++) {
+            CPU alone = cpu;
+            for (auto& [r, v] : inputs[i].regs) alone.R[r] = v;
+            for (auto& [a, v] : inputs[i].mem) alone.write8((s64)a, (u64)v);
+            if (inputs[i].set_pc) alone.PC = inputs[i].pc;
+            u64 n = 0;
+            while (n < limit && alone.stat == Stat::AOK) {
+                execute(alone);
+                ++n;
+            }
+            CPU lane;
+            ens.extract(i, lane);
+            if (dump_state(lane) != dump_state(alone) || ens.steps(i) != n ||
+                lane.scratch != alone.scratch) {
+                std::cerr << "diff: lane " << i << " differs from step after " << n << " steps\n"
+                          << "  lane: " << dump_state(lane).dump() << " steps " << ens.steps(i) << "\n"
+                          << "  step: " << dump_state(alone).dump() << "\n";
+                return 1;
+            }
+        }
+        std::cerr << "diff: " << ens.size() << " lanes match step\n";
+        return 0;
+    }
+    if (mode != TraceMode::None) {
+        OutBuf buf(stdout);
+        JsonTraceWriter writer(buf);
+        for (std::size_t i = 0; i < ens.size(); i++) {
+            CPU lane;
+            ens.extract(i, lane);
+            writer.record(lane);
+        }
+        writer.finish();
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    CPU cpu;
+    TraceMode mode = TraceMode::Full;
+    bool stats = false, diff = false, expand = false;
+    LoadOptions load_opt;
+    std::string path, batch, out_dir = "batch_out", profile;
+    bool cachesim = false;
+    CacheConfig cache_cfg;
+    std::unique_ptr<BranchSim> bpred;
+    Debugger dbg;
+    SampleSpec sample;
+    bool sampled = false;
+    std::string lanes;
+    LaneIsa lane_isa = best_lane_isa();
+    unsigned jobs = 0;
+    u64 limit = 1'000'000;  // 防死循环，长程序用 --limit 放宽
+    Engine engine = Engine::Step;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--mem=paged")) {
+            cpu.backend = MemBackend::Paged;
+        } else if (!std::strcmp(argv[i], "--mem=map")) {
+            cpu.backend = MemBackend::Map;
+        } else if (!std::strcmp(argv[i], "--no-icache")) {
+            cpu.icache.enabled = false;
+        } else if (!std::strcmp(argv[i], "--stats")) {
+            stats = true;
+        } else if (!std::strcmp(argv[i], "--trace=full")) {
+            mode = TraceMode::Full;
+        } else if (!std::strcmp(argv[i], "--trace=dom")) {
+            mode = TraceMode::Dom;
+        } else if (!std::strcmp(argv[i], "--trace=delta")) {
+            mode = TraceMode::Delta;
+        } else if (!std::strcmp(argv[i], "--trace=bin")) {
+            mode = TraceMode::Bin;
+        } else if (!std::strcmp(argv[i], "--trace=none")) {
+            mode = TraceMode::None;
+        } else if (!std::strcmp(argv[i], "--final-only")) {
+            mode = TraceMode::Final;
+        } else if (!std::strcmp(argv[i], "--bound")) {
+            load_opt.bound = true;
+        } else if (!std::strcmp(argv[i], "--engine=step")) {
+            engine = Engine::Step;
+        } else if (!std::strcmp(argv[i], "--engine=threaded")) {
+            engine = Engine::Threaded;
+        } else if (!std::strcmp(argv[i], "--engine=jit")) {
+            engine = Engine::Jit;
+        } else if (!std::strcmp(argv[i], "--engine=pipe")) {
+            engine = Engine::Pipe;
+        } else if (!std::strncmp(argv[i], "--batch=", 8)) {
+            batch = argv[i] + 8;
+        } else if (!std::strncmp(argv[i], "--out=", 6)) {
+            out_dir = argv[i] + 6;
+        } else if (!std::strncmp(argv[i], "--jobs=", 7)) {
+            // 0 表示按核数
+            u64 v = 0;
+            if (!parse_u64(argv[i] + 7, v) || v > UINT_MAX) {
+                usage(argv[0]);
+                return 2;
+            }
+            jobs = (unsigned)v;
+        } else if (!std::strncmp(argv[i], "--limit=", 8)) {
+            // 与 --start/--sample 相同：十进制或 0x 十六进制，不收符号和空白
+            if (!parse_u64(argv[i] + 8, limit) || limit == 0) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (!std::strncmp(argv[i], "--profile=", 10) && argv[i][10]) {
+            profile = argv[i] + 10;
+        } else if (!std::strcmp(argv[i], "--cachesim")) {
+            cachesim = true;
+        } else if (!std::strncmp(argv[i], "--cachesim=", 11)) {
+            std::string err;
+            if (!CacheConfig::parse(argv[i] + 11, cache_cfg, &err)) {
+                std::cerr << "--cachesim: " << err << "\n";
+                return 2;
+            }
+            cachesim = true;
+        } else if (!std::strcmp(argv[i], "--bpred") || !std::strncmp(argv[i], "--bpred=", 8)) {
+            std::string err;
+            bpred = BranchSim::create(argv[i][7] ? argv[i] + 8 : "default", &err);
+            if (!bpred) {
+                std::cerr << "--bpred: " << err << "\n";
+                return 2;
+            }
+        } else if (!std::strncmp(argv[i], "--break=", 8)) {
+            std::string err;
+            if (!dbg.add_break(argv[i] + 8, &err)) {
+                std::cerr << "--break: " << err << "\n";
+                return 2;
+            }
+        } else if (!std::strncmp(argv[i], "--watch=", 8)) {
+            std::string err;
+            if (!dbg.add_watch(argv[i] + 8, &err)) {
+                std::cerr << "--watch: " << err << "\n";
+                return 2;
+            }
+        } else if (!std::strncmp(argv[i], "--start=", 8)) {
+            std::string err;
+            if (!SampleSpec::parse_start(argv[i] + 8, sample, &err)) {
+                std::cerr << "--start: " << err << "\n";
+                return 2;
+            }
+            sampled = true;
+        } else if (!std::strncmp(argv[i], "--sample=", 9)) {
+            std::string err;
+            if (!SampleSpec::parse_period(argv[i] + 9, sample, &err)) {
+                std::cerr << "--sample: " << err << "\n";
+                return 2;
+            }
+            sampled = true;
+        } else if (!std::strncmp(argv[i], "--lanes=", 8) && argv[i][8]) {
+            lanes = argv[i] + 8;
+        } else if (!std::strncmp(argv[i], "--lane-isa=", 11)) {
+            if (!parse_lane_isa(argv[i] + 11, lane_isa)) {
+                usage(argv[0]);
+                return 2;
+            }
+            if (!lane_isa_supported(lane_isa)) {
+                std::cerr << "--lane-isa: " << lane_isa_name(lane_isa) << " is not supported on this CPU\n";
+                return 2;
+            }
+        } else if (!std::strcmp(argv[i], "--cache")) {
+            load_opt.cache = true;
+        } else if (!std::strcmp(argv[i], "--diff")) {
+            diff = true;
+        } else if (!std::strcmp(argv[i], "--expand")) {
+            expand = true;
+        } else if (argv[i][0] != '-' && path.empty()) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (expand) return expand_trace(path);
+    // 采样时 --engine 只决定快进用的引擎，窗口内总是 step 引擎的 run<>
+    bool fast_only = engine != Engine::Step && !sampled;
+    if (sampled && (engine == Engine::Pipe || diff || !batch.empty() || mode == TraceMode::Dom ||
+                    dbg.breaks() || dbg.watches())) {
+        std::cerr << "--start/--sample fast-forward with the step, threaded or jit engine;\n"
+                     "not with --diff, --batch, --trace=dom or --break/--watch\n";
+        return 2;
+    }
+    if (engine != Engine::Step && mode != TraceMode::None && mode != TraceMode::Final && !diff &&
+        !sampled) {
+        std::cerr << "--engine=" << engine_name(engine)
+                  << " only runs untraced; add --trace=none or --final-only\n";
+        return 2;
+    }
+    if (!profile.empty() && (fast_only || !batch.empty() || diff ||
+                             (mode != TraceMode::None && mode != TraceMode::Final))) {
+        std::cerr << "--profile runs the step engine untraced; add --trace=none or --final-only\n";
+        return 2;
+    }
+    if (cachesim && ((fast_only && engine != Engine::Pipe) || !profile.empty() ||
+                     !batch.empty() || diff || (mode != TraceMode::None && mode != TraceMode::Final))) {
+        std::cerr << "--cachesim runs the step or pipe engine untraced; add --trace=none or --final-only\n";
+        return 2;
+    }
+    if (bpred && ((fast_only && engine != Engine::Pipe) || !profile.empty() || cachesim ||
+                  !batch.empty() || diff || (mode != TraceMode::None && mode != TraceMode::Final))) {
+        std::cerr << "--bpred runs the step or pipe engine untraced, without --cachesim/--profile;\n"
+                     "add --trace=none or --final-only\n";
+        return 2;
+    }
+    bool debug = dbg.breaks() || dbg.watches();
+    if (debug && (engine != Engine::Step || !profile.empty() || cachesim || bpred || !batch.empty() ||
+                  diff || (mode != TraceMode::None && mode != TraceMode::Final))) {
+        std::cerr << "--break/--watch run the step engine untraced, without --cachesim/--bpred/--profile;\n"
+                     "add --trace=none or --final-only\n";
+        return 2;
+    }
+    if (!lanes.empty() && (engine != Engine::Step || sampled || debug || !profile.empty() || cachesim ||
+                           bpred || !batch.empty() ||
+                           (mode != TraceMode::Full && mode != TraceMode::Final && mode != TraceMode::None))) {
+        std::cerr << "--lanes prints the final state of every lane; it takes --limit, --bound,\n"
+                     "--mem, --diff, --stats and --trace=none, not other engines or modes\n";
+        return 2;
+    }
+    if (!batch.empty())
+        return run_batch_mode(batch, out_dir, jobs, mode, engine, cpu, load_opt, limit);
+    if (load_opt.cache && path.empty()) {
+        std::cerr << "--cache needs a program path\n";
+        return 2;
+    }
+
+    // .yo / .ybin 按文件头自动识别；普通文件直接 mmap，管道则整块读入。
+    // --cache 时把 .yo 编译成的镜像存到 <path>.ybin，源文件内容不变就直接复用；
+    // --bound 把内存上界设为最高装载地址 + 65536
+    std::string err;
+    bool loaded = path.empty() ? load_program_fd(0, cpu, load_opt, &err)
+                               : load_program_file(path, cpu, load_opt, &err);
+    if (!loaded) {
+        std::cerr << "load failed: " << (path.empty() ? "<stdin>" : path) << ": " << err << "\n";
+        return 2;
+    }
+
+    if (!lanes.empty()) return run_lanes_mode(cpu, lanes, lane_isa, limit, mode, diff, stats);
+    if (diff) {
+        // 差分测试：step() 与所选引擎按不同粒度对比完整体系结构状态
+        // （粒度为 1 时 JIT 只能走解释回退，较大的粒度才会执行翻译后的代码块）
+        for (u64 chunk : {u64(1), u64(7), u64(64), limit}) {
+            std::string d = diff_engine(engine, cpu, limit, chunk);
+            if (!d.empty()) {
+                std::cerr << "diff: chunk " << chunk << ": " << d << "\n";
+                return 1;
+            }
+        }
+        std::cerr << "diff: " << engine_name(engine) << " matches step\n";
+        return 0;
+    }
+    // 按参数选择 run<TracePolicy, BoundsPolicy> 的特化版本（见 engine.h）
+    std::size_t steps = 0;
+    JitEngine jit;
+    PipeEngine pipe;
+    CacheModel cache(cache_cfg);
+    if (cachesim && engine == Engine::Pipe) pipe.set_cache(&cache);
+    // pipe 引擎用列表中第一个预测器决定取指方向，完整报告仍由 step 引擎给出
+    std::unique_ptr<BranchPredictor> fetch_pred;
+    if (bpred && engine == Engine::Pipe) {
+        fetch_pred = make_predictor(bpred->predictor(0).name());
+        pipe.set_predictor(fetch_pred.get());
+    }
+    u64 detailed = 0;  // 采样时窗口内执行的步数
+    if (sampled) {
+        // 采样：统计 / 日志只覆盖各窗口，多个窗口的日志依次接在同一输出里
+        auto sampled_run = [&](auto&& detail) {
+            return run_sample_mode(cpu, limit, sample, engine, jit, detailed, detail);
+        };
+        if (!profile.empty()) {
+            Profiler prof;
+            steps = sampled_run([&](CPU& S, u64 n) { return run_auto(S, n, prof); });
+            if (!write_profile(prof, path, profile)) return 1;
+        } else if (cachesim) {
+            CacheSim sim(cache);
+            steps = sampled_run([&](CPU& S, u64 n) { return run_auto(S, n, sim); });
+        } else if (bpred) {
+            steps = sampled_run([&](CPU& S, u64 n) { return run_auto(S, n, *bpred); });
+        } else if (mode == TraceMode::Full) {
+            OutBuf buf(stdout);
+            JsonTraceWriter writer(buf);
+            TraceEach<JsonTraceWriter> trace{writer};
+            steps = sampled_run([&](CPU& S, u64 n) { return run_auto(S, n, trace); });
+            writer.finish();
+        } else if (mode == TraceMode::Delta || mode == TraceMode::Bin) {
+            // INIT / 初始状态取第一个窗口之前的状态
+            OutBuf buf(stdout, 1 << 20);
+            DeltaTraceWriter delta(buf);
+            BinTraceWriter bin(buf);
+            TraceEach<DeltaTraceWriter> delta_trace{delta};
+            TraceEach<BinTraceWriter> bin_trace{bin};
+            bool begun = false;
+            steps = sampled_run([&](CPU& S, u64 n) {
+                if (!begun) {
+                    mode == TraceMode::Bin ? bin.begin(S) : delta.begin(S);
+                    begun = true;
+                }
+                return mode == TraceMode::Bin ? run_auto(S, n, bin_trace) : run_auto(S, n, delta_trace);
+            });
+            if (!begun) mode == TraceMode::Bin ? bin.begin(cpu) : delta.begin(cpu);
+            if (mode == TraceMode::Bin) bin.finish();
+        } else {
+            steps = sampled_run([&](CPU& S, u64 n) {
+                NoTrace t;
+                return run_auto(S, n, t);
+            });
+        }
+    } else if (debug) {
+        // 断点/观察点：热循环每步只测一位过滤器，命中时才同步状态精确判断；
+        // 停下时最终状态就是停下那一刻的状态
+        steps = run_auto(cpu, limit, dbg);
+    } else if (bpred && engine == Engine::Step) {
+        // 分支预测：各预测器并排跑同一条 jXX 序列，call/ret 走返回地址栈
+        steps = run_auto(cpu, limit, *bpred);
+    } else if (cachesim && engine == Engine::Step) {
+        // 缓存模型：取指与数据访问逐级查 L1I/L1D/L2，按 PC 统计缺失
+        CacheSim sim(cache);
+        steps = run_auto(cpu, limit, sim);
+    } else if (!profile.empty()) {
+        // 剖析：按 PC / 指令类型计数，影子调用栈生成火焰图用的 folded 文件；
+        // 程序由路径给出时用 .yo 里的标号命名函数
+        Profiler prof;
+        steps = run_auto(cpu, limit, prof);
+        if (!write_profile(prof, path, profile)) return 1;
+    } else if (mode == TraceMode::Dom) {
+        steps = run_dom(cpu, limit);
+    } else if (engine != Engine::Step) {
+        // threaded/jit/pipe 只跑无日志循环
+        steps = engine == Engine::Jit    ? jit.run(cpu, limit)
+                : engine == Engine::Pipe ? pipe.run(cpu, limit)
+                                         : run_engine(engine, cpu, limit);
+    } else if (mode == TraceMode::None) {
+        NoTrace trace;
+        steps = run_auto(cpu, limit, trace);
+    } else if (mode == TraceMode::Delta) {
+        OutBuf buf(stdout);
+        DeltaTraceWriter writer(buf);
+        writer.begin(cpu);
+        TraceEach<DeltaTraceWriter> trace{writer};
+        steps = run_auto(cpu, limit, trace);
+    } else if (mode == TraceMode::Bin) {
+        // 二进制列式日志（bintrace.h），输出可以是管道；用 --expand 还原成 JSON
+        OutBuf buf(stdout, 1 << 20);
+        BinTraceWriter writer(buf);
+        writer.begin(cpu);
+        TraceEach<BinTraceWriter> trace{writer};
+        steps = run_auto(cpu, limit, trace);
+        writer.finish();
+    } else if (mode == TraceMode::Final) {
+        NoTrace trace;
+        steps = run_auto(cpu, limit, trace);
+    } else {
+        OutBuf buf(stdout);
+        JsonTraceWriter writer(buf);
+        TraceEach<JsonTraceWriter> trace{writer};
+        steps = run_auto(cpu, limit, trace);
+        writer.finish();
+    }
+    if (mode == TraceMode::Final) {
+        // --final-only 输出只含最后一个状态的数组，jq '.[-1]' 等用法不变；
+        // 上面各分支都不写日志，在这里统一补上
+        OutBuf buf(stdout);
+        write_final_state(cpu, steps, buf);
+    }
+    if (stats) {
+        print_stats(cpu, steps);
+        if (engine == Engine::Jit) {
+            const auto& js = jit.stats();
+            std::cerr << "jit: blocks=" << js.blocks << " chained=" << js.chained
+                      << " entries=" << js.entries << " interpreted=" << js.interpreted
+                      << " flushes=" << js.flushes << "\n";
+        }
+        if (engine == Engine::Pipe) {
+            // 周期数 / CPI / 按原因分类的停顿与气泡，json 一行便于脚本解析
+            std::cerr << "pipe: " << pipe.stats().to_json().dump() << "\n";
+        }
+    }
+    if (cachesim) {
+        // 各级命中/缺失/换出计数与缺失最多的 PC；step 引擎下的周期数按
+        // 每条指令 1 周期加上访存停顿估算，pipe 引擎的周期见 pipe: 一行
+        json js = cache.to_json();
+        // 采样时只统计窗口内的指令
+        u64 insns = sampled ? detailed : steps;
+        js["instructions"] = insns;
+        if (engine == Engine::Step || sampled) js["cycles"] = insns + cache.stall_cycles();
+        std::cerr << "cachesim: " << js.dump() << "\n";
+    }
+    if (debug && dbg.hit().kind != Debugger::Hit::NONE) {
+        json js = dbg.to_json(dbg.hit());
+        js["steps"] = steps;
+        std::cerr << "stop: " << js.dump() << "\n";
+    }
+    if (bpred && (engine == Engine::Step || sampled)) std::cerr << "bpred: " << bpred->to_json().dump() << "\n";
+    if (bpred && engine == Engine::Pipe) {
+        const auto& ps = pipe.stats();
+        json js = {{"predictor", fetch_pred->name()},
+                   {"mispredicts", ps.mispredicts},
+                   {"cycles", ps.cycles},
+                   {"CPI", ps.cpi()}};
+        std::cerr << "bpred: " << js.dump() << "\n";
+    }
     return 0;
 }
@@ -0,0 +1,74 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "image.h"
+#include "parse.h"
+
+using namespace y86;
+
+// .yo -> .ybin 转换器：y86sim 可以直接读取输出的镜像（自动识别文件头）
+static void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0 << " [--bound] [--slack=N] input.yo [output.ybin]\n";
+}
+
+int main(int argc, char** argv) {
+    bool bound = false;
+    std::uint64_t slack = 65536;
+    std::string in_path, out_path;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--bound")) {
+            bound = true;
+        } else if (!std::strncmp(argv[i], "--slack=", 8)) {
+            // 与 y86sim 的数字选项相同：十进制或 0x 十六进制，不收符号和空白
+            if (!parse_u64(argv[i] + 8, slack)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (argv[i][0] != '-' && in_path.empty()) {
+            in_path = argv[i];
+        } else if (argv[i][0] != '-' && out_path.empty()) {
+            out_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (in_path.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (out_path.empty()) {
+        out_path = in_path;
+        auto dot = out_path.rfind('.');
+        if (dot != std::string::npos && out_path.find('/', dot) == std::string::npos)
+            out_path.erase(dot);
+        out_path += ".ybin";
+    }
+
+    std::ifstream fin(in_path, std::ios::binary);
+    if (!fin) {
+        std::cerr << "cannot open " << in_path << "\n";
+        return 1;
+    }
+    std::string text((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    if (is_ybin(text.data(), text.size())) {
+        std::cerr << in_path << " is already a .ybin image\n";
+        return 1;
+    }
+
+    ProgramImage img = image_from_yo(text.data(), text.size(), bound, slack);
+    std::string err;
+    if (!write_ybin_file(out_path, img, content_hash(text.data(), text.size()), &err)) {
+        std::cerr << out_path << ": " << err << "\n";
+        return 1;
+    }
+    std::size_t bytes = 0;
+    for (auto& seg : img.segments) bytes += seg.bytes.size();
+    std::cerr << out_path << ": " << img.segments.size() << " segments, " << bytes
+              << " bytes, entry 0x" << std::hex << img.entry << std::dec << "\n";
+    return 0;
+}
@@ -5,11 +5,14 @@ bench_y86.py  —  Y86-64 软件模拟器基准脚本
 功能：
   * 读取 .yo，调用 y86sim（stdin<- .yo，stdout-> JSON 日志）
   * 解析日志得到动态指令数与 PC 轨迹，解码每条指令，统计指标
+  * --profile：改用 y86sim --profile 的剖析汇总（不输出逐步日志），适合长程序
   * 打印汇总；可 --json 输出到文件
+  * --corpus DIR：跑 gen_corpus.py 生成的长程序（10^6~10^9 条指令），
+    只取最终状态（--final-only），按 expected.json 自检结果寄存器并报告 MIPS
 跨平台：Linux/macOS/Windows（Windows 上内存占用统计将自动降级）
 """
 
-import argparse, json, os, re, subprocess, sys, time
+import argparse, json, os, re, subprocess, sys, tempfile, time
 from collections import Counter, defaultdict
 
 try:
@@ -71,7 +74,7 @@ def mem_bytes_rw(icode):
     return rd, wr
 
 # -------------- run simulator ------------------------
-def run_sim(sim_bin, yo_path, warmup=False):
+def run_sim(sim_bin, yo_path, warmup=False, sim_args=()):
     """return (wall_time, json_logs, rss_peak_bytes[optional])"""
     # Read yo
     with open(yo_path,'r',encoding='utf-8') as f:
@@ -79,9 +82,9 @@ def run_sim(sim_bin, yo_path, warmup=False):
 
     # Prepare process
     if psutil:
-        proc = psutil.Popen([sim_bin], stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        proc = psutil.Popen([sim_bin, *sim_args], stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
     else:
-        proc = subprocess.Popen([sim_bin], stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        proc = subprocess.Popen([sim_bin, *sim_args], stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
 
     t0 = time.perf_counter()
     out, err = proc.communicate(input=yo_txt)
@@ -103,8 +106,56 @@ def run_sim(sim_bin, yo_path, warmup=False):
 
     return wall, logs, rss_peak
 
+# --------------- metrics from y86sim --profile ----------------
+def run_profiled(sim_bin, yo_path, sim_args=(), limit=10**10):
+    """return (wall_time, profile summary json); the timing includes profiling"""
+    with tempfile.TemporaryDirectory() as tmp:
+        prefix = os.path.join(tmp, 'prof')
+        cmd = [sim_bin, '--trace=none', f'--limit={limit}', f'--profile={prefix}', *sim_args, yo_path]
+        t0 = time.perf_counter()
+        r = subprocess.run(cmd, capture_output=True, text=True)
+        wall = time.perf_counter() - t0
+        if r.returncode != 0:
+            raise RuntimeError(f"y86sim --profile failed:\n{r.stderr}")
+        with open(prefix + '.json', encoding='utf-8') as f:
+            return wall, json.load(f)
+
+def analyze_profile(yo_path, sim_bin, repeat=1, sim_args=()):
+    """same metrics as analyze(), from the per-PC profile instead of a trace"""
+    per_run, total_time, prof = [], 0.0, None
+    for _ in range(repeat):
+        wall, prof = run_profiled(sim_bin, yo_path, sim_args)
+        N = prof['instructions']
+        per_run.append({"time": wall, "N": N, "IPS": N/wall if wall > 0 else float('inf'), "rss": None})
+        total_time += wall
+    mix = Counter()
+    ifetch = mem_r = mem_w = jt = jn = 0
+    for h in prof['histogram']:
+        ic = h['icode']
+        mix[ICODE_NAME.get(ic, f"unk_{ic}")] += h['count']
+        ifetch += decode_at({0: ic << 4}, 0)['len'] * h['count']
+        rd, wr = mem_bytes_rw(ic)
+        mem_r += rd * h['count']; mem_w += wr * h['count']
+    for pc in prof['pcs']:
+        if pc['insn'].startswith('j'):
+            jt += pc['taken']; jn += pc['not_taken']
+    N = prof['instructions'] * repeat
+    t = total_time
+    return {
+        "file": yo_path, "runs": per_run, "repeat": repeat,
+        "total_N": N, "total_time": t,
+        "IPS_avg": N/t if t > 0 else float('inf'),
+        "ifetch_MBps": ifetch*repeat/1e6/t if t > 0 else 0.0,
+        "mem_read_MBps": mem_r*repeat/1e6/t if t > 0 else 0.0,
+        "mem_write_MBps": mem_w*repeat/1e6/t if t > 0 else 0.0,
+        "branch_taken_ratio": jt/(jt+jn) if jt+jn > 0 else None,
+        "mix": mix,
+        "hot_pcs": prof['pcs'][:10],
+        "functions": prof['functions'][:10],
+    }
+
 # --------------- metrics from logs + yo ----------------
-def analyze(yo_path, sim_bin, repeat=1):
+def analyze(yo_path, sim_bin, repeat=1, sim_args=()):
     mem, entry = parse_yo(yo_path)
 
     sums = {
@@ -115,7 +166,7 @@ def analyze(yo_path, sim_bin, repeat=1):
     per_run = []
 
     for r in range(repeat):
-        wall, logs, rss = run_sim(sim_bin, yo_path)
+        wall, logs, rss = run_sim(sim_bin, yo_path, sim_args=sim_args)
         N = len(logs)
         if N == 0:  # empty / early error
             per_run.append({"time":wall,"N":N,"IPS":0,"rss":rss})
@@ -186,17 +237,64 @@ def human_report(agg):
         print(f"  run#{i+1}: time={r['time']:.6f}s  N={r['N']}  IPS={r['IPS']:.2f}{rss}")
     # mix
     print(" mix:", ', '.join(f"{k}:{v}" for k,v in agg['mix'].most_common()))
+    if agg.get('functions'):
+        print(" hot functions (self):", ', '.join(f"{f['name']}:{f['self']}" for f in agg['functions'][:5]))
     print()
 
+# --------------- long-running corpus (gen_corpus.py) ----------------
+def run_corpus(sim_bin, corpus_dir, repeat=1, sim_args=(), limit=10**10):
+    """self-check each corpus program against expected.json; return result list"""
+    with open(os.path.join(corpus_dir, 'expected.json'), encoding='utf-8') as f:
+        expected = json.load(f)
+    results = []
+    for name in sorted(expected):
+        path = os.path.join(corpus_dir, name)
+        cmd = [sim_bin, '--final-only', f'--limit={limit}', '--stats', *sim_args, path]
+        times, steps, bad = [], 0, {}
+        for _ in range(repeat):
+            t0 = time.perf_counter()
+            r = subprocess.run(cmd, capture_output=True, text=True)
+            times.append(time.perf_counter() - t0)
+            if r.returncode != 0:
+                bad = {'error': r.stderr.strip()}
+                break
+            m = re.search(r'steps: (\d+)', r.stderr)
+            steps = int(m.group(1)) if m else 0
+            final = json.loads(r.stdout)[-1]
+            exp = expected[name]
+            bad = {k: (final['REG'].get(k), v) for k, v in exp['REG'].items() if final['REG'].get(k) != v}
+            if final['STAT'] != exp['STAT']:
+                bad['STAT'] = (final['STAT'], exp['STAT'])
+        best = min(times)
+        results.append({'file': name, 'params': expected[name].get('params', {}), 'N': steps,
+                        'times': times, 'MIPS': steps / best / 1e6 if best > 0 else 0.0,
+                        'ok': not bad, 'mismatch': bad})
+        status = 'ok' if not bad else f'FAIL {bad}'
+        print(f"{name:<16} N={steps:<12} best={best:.3f}s  {steps / best / 1e6 if best > 0 else 0:8.1f} MIPS  {status}")
+    return results
+
 def main():
     ap = argparse.ArgumentParser()
     ap.add_argument('--sim', default='./build/y86sim', help='y86sim executable')
     ap.add_argument('--yo', nargs='+', help='.yo files; or use --dir')
     ap.add_argument('--dir', help='directory containing .yo')
     ap.add_argument('--repeat', type=int, default=3)
+    ap.add_argument('--sim-args', default='', help='extra y86sim flags, e.g. "--mem=map"')
     ap.add_argument('--json', help='write aggregated JSON here')
+    ap.add_argument('--profile', action='store_true',
+                    help='use y86sim --profile summaries instead of parsing full traces')
+    ap.add_argument('--corpus', help='corpus directory from gen_corpus.py (self-checked, final state only)')
+    ap.add_argument('--limit', type=int, default=10**10, help='instruction limit for --corpus runs')
     args = ap.parse_args()
 
+    if args.corpus:
+        res = run_corpus(args.sim, args.corpus, repeat=args.repeat, sim_args=args.sim_args.split(),
+                         limit=args.limit)
+        if args.json:
+            with open(args.json, 'w', encoding='utf-8') as f:
+                json.dump(res, f, ensure_ascii=False, indent=2)
+        sys.exit(0 if all(r['ok'] for r in res) else 1)
+
     files = []
     if args.yo: files = args.yo
     if args.dir:
@@ -208,7 +306,8 @@ def main():
 
     allres = []
     for fp in sorted(files):
-        agg = analyze(fp, args.sim, repeat=args.repeat)
+        run = analyze_profile if args.profile else analyze
+        agg = run(fp, args.sim, repeat=args.repeat, sim_args=args.sim_args.split())
         allres.append(agg)
         human_report(agg)
 
@@ -0,0 +1,602 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+gen_corpus.py  —  生成长时间运行的 Y86-64 基准程序（.yo）
+  * memops     大缓冲区 memset / memcpy / 求和
+  * bsort      冒泡排序
+  * qsort      递归快速排序（Lomuto 划分）
+  * matmul     矩阵乘法，乘法用加法循环实现
+  * recursion  朴素递归 fib + 深递归求和（call/ret 压力）
+  * listchase  大链表指针追逐（步长打散访问顺序）
+  * fsm        分支密集的有限状态机
+每个程序的结果寄存器由本脚本用 Python 独立算出，写入 expected.json，
+bench_y86.py --corpus / y86bench 运行后据此自检。
+
+用法：
+  python3 benchmark/gen_corpus.py --out benchmark/corpus --scale 1
+  python3 benchmark/gen_corpus.py --out /tmp/big --scale 100 --set bsort.n=3000 --only bsort,fsm
+--scale 按比例放大各程序的重复次数（scale=1 时每个程序约 10^6~10^7 条指令）。
+"""
+
+import argparse, json, os, re, sys
+
+M64 = (1 << 64) - 1
+def s64(x):
+    x &= M64
+    return x - (1 << 64) if x >> 63 else x
+
+# ---------------- 两遍汇编器（yas 语法子集） ----------------
+REG = {'rax':0,'rcx':1,'rdx':2,'rbx':3,'rsp':4,'rbp':5,'rsi':6,'rdi':7,
+       'r8':8,'r9':9,'r10':10,'r11':11,'r12':12,'r13':13,'r14':14}
+COND = {'':0,'le':1,'l':2,'e':3,'ne':4,'ge':5,'g':6}
+OPQ = {'addq':0,'subq':1,'andq':2,'xorq':3}
+SIZE = {'halt':1,'nop':1,'ret':1,'rrmovq':2,'cmov':2,'opq':2,'pushq':2,'popq':2,
+        'irmovq':10,'rmmovq':10,'mrmovq':10,'jxx':9,'call':9}
+
+def classify(op):
+    if op in ('halt','nop','ret','rrmovq','irmovq','rmmovq','mrmovq','call','pushq','popq'): return op
+    if op in OPQ: return 'opq'
+    if op.startswith('cmov') and op[4:] in COND and op[4:]: return 'cmov'
+    if op.startswith('j') and (op[1:] in COND or op == 'jmp'): return 'jxx'
+    raise SyntaxError(f'unknown instruction {op}')
+
+def le(v, n=8): return bytes(((v & M64) >> (8*i)) & 0xFF for i in range(n))
+
+def assemble(src):
+    """return list of (addr, bytes, text)"""
+    items = []  # (kind, payload, text)
+    for raw in src.splitlines():
+        line = raw.split('#', 1)[0].strip()
+        if not line: continue
+        while True:
+            m = re.match(r'^([A-Za-z_.][\w.]*):\s*(.*)$', line)
+            if not m: break
+            items.append(('label', m.group(1), m.group(1) + ':'))
+            line = m.group(2)
+        if line: items.append(('ins', line, line))
+
+    labels = {}
+    def value(tok):
+        tok = tok.strip().lstrip('$')
+        if re.match(r'^-?(0x[0-9a-fA-F]+|\d+)$', tok): return int(tok, 0)
+        return labels[tok]
+
+    def layout(final):
+        addr, out = 0, []
+        for kind, p, text in items:
+            if kind == 'label':
+                labels[p] = addr
+                out.append((addr, b'', text))
+                continue
+            op, _, rest = p.partition(' ')
+            args = [a.strip() for a in re.split(r',(?![^(]*\))', rest)] if rest.strip() else []
+            if op == '.pos':
+                addr = value(args[0]); continue
+            if op == '.align':
+                a = value(args[0]); addr = (addr + a - 1) // a * a; continue
+            if op == '.quad':
+                out.append((addr, le(value(args[0])) if final else b'\0' * 8, text)); addr += 8; continue
+            k = classify(op)
+            b = b'\0' * SIZE[k]
+            if final: b = encode(op, k, args, value)
+            out.append((addr, b, text)); addr += SIZE[k]
+        return out
+
+    layout(False)
+    return layout(True)
+
+def encode(op, k, args, value):
+    def r(t): return REG[t.strip().lstrip('%')]
+    def mem(t):
+        m = re.match(r'^(.*)\(\s*%(\w+)\s*\)$', t.strip())
+        return (value(m.group(1)) if m.group(1).strip() else 0), REG[m.group(2)]
+    if k == 'halt': return b'\x00'
+    if k == 'nop': return b'\x10'
+    if k == 'ret': return b'\x90'
+    if k == 'rrmovq': return bytes([0x20, r(args[0]) << 4 | r(args[1])])
+    if k == 'cmov': return bytes([0x20 | COND[op[4:]], r(args[0]) << 4 | r(args[1])])
+    if k == 'irmovq': return bytes([0x30, 0xF0 | r(args[1])]) + le(value(args[0]))
+    if k == 'rmmovq':
+        d, rb = mem(args[1]); return bytes([0x40, r(args[0]) << 4 | rb]) + le(d)
+    if k == 'mrmovq':
+        d, rb = mem(args[0]); return bytes([0x50, r(args[1]) << 4 | rb]) + le(d)
+    if k == 'opq': return bytes([0x60 | OPQ[op], r(args[0]) << 4 | r(args[1])])
+    if k == 'jxx': return bytes([0x70 | (0 if op == 'jmp' else COND[op[1:]])]) + le(value(args[0]))
+    if k == 'call': return b'\x80' + le(value(args[0]))
+    if k == 'pushq': return bytes([0xA0, r(args[0]) << 4 | 0xF])
+    if k == 'popq': return bytes([0xB0, r(args[0]) << 4 | 0xF])
+    raise SyntaxError(op)
+
+def to_yo(recs):
+    lines = []
+    for addr, b, text in recs:
+        lines.append(f"0x{addr:03x}: {b.hex():<20} | {text}")
+    return '\n'.join(lines) + '\n'
+
+# ---------------- 公共片段 ----------------
+STACK = 0x400000     # 栈顶（向下增长）
+BUF0 = 0x1000000     # 数据缓冲区放在程序之外，.yo 本身保持很小
+BUF1 = 0x2000000
+GOLD = 0x9E3779B97F4A7C15
+SEED = 0x243F6A8885A308D3
+
+PROLOGUE = f"""
+    irmovq ${STACK}, %rsp
+    irmovq $8, %r8
+    irmovq $1, %r9
+    irmovq $0, %rax
+    call main
+    halt
+"""
+
+# fill(rdi=a, rcx=n, r11=mask)：x += GOLD; a[i] = (x ^ 2x) & mask，x 保存在 r14
+FILL = f"""
+fill:
+    irmovq ${GOLD}, %r10
+f_loop:
+    addq %r10, %r14
+    rrmovq %r14, %rdx
+    addq %rdx, %rdx
+    xorq %r14, %rdx
+    andq %r11, %rdx
+    rmmovq %rdx, 0(%rdi)
+    addq %r8, %rdi
+    subq %r9, %rcx
+    jne f_loop
+    ret
+"""
+
+class Gen:
+    """Python 参考实现里的同一个伪随机序列"""
+    def __init__(self): self.x = SEED
+    def take(self, n, mask):
+        out = []
+        for _ in range(n):
+            self.x = (self.x + GOLD) & M64
+            out.append((((self.x + self.x) & M64) ^ self.x) & mask)
+        return out
+
+# csum(rdi=a, rsi=n)：rax += Σ (a[i] ^ i)
+CSUM = """
+csum:
+    irmovq $0, %r13
+c_loop:
+    mrmovq 0(%rdi), %r10
+    xorq %r13, %r10
+    addq %r10, %rax
+    addq %r9, %r13
+    addq %r8, %rdi
+    rrmovq %r13, %r10
+    subq %rsi, %r10
+    jl c_loop
+    ret
+"""
+def csum(a): return sum(v ^ i for i, v in enumerate(a))
+
+# ---------------- 各个程序：返回 (汇编源码, 期望寄存器) ----------------
+def w_memops(p):
+    n, reps = p['n'], p['reps']
+    src = PROLOGUE + f"""
+main:
+    irmovq $1, %r12
+    irmovq ${reps}, %r13
+rep:
+    irmovq ${BUF0}, %rdi         # memset(src, v, n)
+    irmovq ${n}, %rcx
+ms:
+    rmmovq %r12, 0(%rdi)
+    addq %r8, %rdi
+    subq %r9, %rcx
+    jne ms
+    irmovq ${BUF0}, %rsi         # memcpy(dst, src, n)
+    irmovq ${BUF1}, %rdi
+    irmovq ${n}, %rcx
+mc:
+    mrmovq 0(%rsi), %r10
+    rmmovq %r10, 0(%rdi)
+    addq %r8, %rsi
+    addq %r8, %rdi
+    subq %r9, %rcx
+    jne mc
+    irmovq ${BUF1}, %rsi         # rax += sum(dst)
+    irmovq ${n}, %rcx
+sm:
+    mrmovq 0(%rsi), %r10
+    addq %r10, %rax
+    addq %r8, %rsi
+    subq %r9, %rcx
+    jne sm
+    irmovq $0x0101010101010101, %r10
+    addq %r10, %r12
+    subq %r9, %r13
+    jne rep
+    ret
+"""
+    rax, v = 0, 1
+    for _ in range(reps):
+        rax += n * v
+        v = (v + 0x0101010101010101) & M64
+    return src, {'rax': rax, 'r12': v, 'rcx': 0}
+
+SORT_MASK = 0xFFFFFFF
+
+def sort_main(p, call):
+    return PROLOGUE + f"""
+main:
+    irmovq ${SEED}, %r14
+    irmovq ${p['reps']}, %rbp
+rep:
+    irmovq ${BUF0}, %rdi
+    irmovq ${p['n']}, %rcx
+    irmovq ${SORT_MASK}, %r11
+    call fill
+{call}
+    irmovq ${BUF0}, %rdi
+    irmovq ${p['n']}, %rsi
+    call csum
+    subq %r9, %rbp
+    jne rep
+    ret
+""" + FILL + CSUM
+
+def sort_expect(p):
+    g, rax = Gen(), 0
+    for _ in range(p['reps']):
+        a = sorted(g.take(p['n'], SORT_MASK))
+        rax += csum(a)
+    return {'rax': rax, 'rbp': 0, 'rsp': STACK}
+
+def w_bsort(p):
+    src = sort_main(p, f"""
+    irmovq ${BUF0}, %rdi
+    irmovq ${p['n']}, %rsi
+    call bsort""") + """
+bsort:
+    rrmovq %rsi, %rbx
+    subq %r9, %rbx
+    jle b_done
+b_outer:
+    rrmovq %rdi, %rcx
+    rrmovq %rbx, %rdx
+b_inner:
+    mrmovq 0(%rcx), %r10
+    mrmovq 8(%rcx), %r11
+    rrmovq %r10, %r12
+    subq %r11, %r12
+    jle b_next
+    rmmovq %r11, 0(%rcx)
+    rmmovq %r10, 8(%rcx)
+b_next:
+    addq %r8, %rcx
+    subq %r9, %rdx
+    jne b_inner
+    subq %r9, %rbx
+    jne b_outer
+b_done:
+    ret
+"""
+    return src, sort_expect(p)
+
+def w_qsort(p):
+    src = sort_main(p, f"""
+    irmovq ${BUF0}, %rdi
+    irmovq ${BUF0 + 8 * (p['n'] - 1)}, %rsi
+    call qsort""") + """
+qsort:                          # 对 [rdi, rsi]（含两端）排序
+    rrmovq %rsi, %r10
+    subq %rdi, %r10
+    jle q_ret
+    mrmovq 0(%rsi), %r11        # pivot = *hi
+    rrmovq %rdi, %rcx           # i
+    rrmovq %rdi, %rdx           # j
+q_part:
+    mrmovq 0(%rdx), %r12
+    rrmovq %r12, %r13
+    subq %r11, %r13
+    jge q_skip
+    mrmovq 0(%rcx), %r13
+    rmmovq %r12, 0(%rcx)
+    rmmovq %r13, 0(%rdx)
+    addq %r8, %rcx
+q_skip:
+    addq %r8, %rdx
+    rrmovq %rdx, %r13
+    subq %rsi, %r13
+    jl q_part
+    mrmovq 0(%rcx), %r12
+    rmmovq %r11, 0(%rcx)
+    rmmovq %r12, 0(%rsi)
+    pushq %rsi
+    pushq %rcx
+    rrmovq %rcx, %rsi
+    subq %r8, %rsi
+    call qsort
+    popq %rcx
+    popq %rsi
+    rrmovq %rcx, %rdi
+    addq %r8, %rdi
+    jmp qsort                   # 尾调用
+q_ret:
+    ret
+"""
+    return src, sort_expect(p)
+
+def w_matmul(p):
+    n, reps = p['n'], p['reps']
+    A, B, C = BUF0, BUF0 + 8 * n * n, BUF1
+    src = PROLOGUE + f"""
+main:
+    irmovq ${SEED}, %r14
+    irmovq ${reps}, %rbp
+rep:
+    pushq %rbp
+    irmovq ${A}, %rdi
+    irmovq ${2 * n * n}, %rcx   # A、B 相邻，一次填满
+    irmovq $7, %r11
+    call fill
+    pushq %r14
+    call matmul
+    popq %r14
+    irmovq ${C}, %rdi
+    irmovq ${n * n}, %rsi
+    call csum
+    popq %rbp
+    subq %r9, %rbp
+    jne rep
+    ret
+
+matmul:                         # C = A * B，a*b 用 b 次加法实现
+    pushq %rax
+    irmovq ${8 * n}, %rax       # 行跨度
+    irmovq ${A}, %rbx
+    irmovq ${C}, %rbp
+    irmovq ${n}, %r13
+m_i:
+    irmovq ${B}, %r14
+    irmovq ${n}, %r12
+m_j:
+    rrmovq %rbx, %rsi
+    rrmovq %r14, %rdi
+    irmovq $0, %rdx
+    irmovq ${n}, %r11
+m_k:
+    mrmovq 0(%rsi), %r10
+    mrmovq 0(%rdi), %rcx
+    andq %rcx, %rcx
+    je m_zero
+m_mul:
+    addq %r10, %rdx
+    subq %r9, %rcx
+    jne m_mul
+m_zero:
+    addq %r8, %rsi
+    addq %rax, %rdi
+    subq %r9, %r11
+    jne m_k
+    rmmovq %rdx, 0(%rbp)
+    addq %r8, %rbp
+    addq %r8, %r14
+    subq %r9, %r12
+    jne m_j
+    addq %rax, %rbx
+    subq %r9, %r13
+    jne m_i
+    popq %rax
+    ret
+""" + FILL + CSUM
+    g, rax = Gen(), 0
+    for _ in range(reps):
+        v = g.take(2 * n * n, 7)
+        a, b = v[:n * n], v[n * n:]
+        c = [sum(a[i * n + k] * b[k * n + j] for k in range(n)) for i in range(n) for j in range(n)]
+        rax += csum(c)
+    return src, {'rax': rax, 'rbp': 0, 'rsp': STACK}
+
+def w_recursion(p):
+    k, depth, reps = p['k'], p['depth'], p['reps']
+    src = PROLOGUE + f"""
+main:
+    irmovq $0, %rbx
+    irmovq $0, %r12
+    irmovq ${reps}, %rbp
+rep:
+    irmovq ${k}, %rdi
+    call fib
+    addq %rax, %rbx
+    irmovq ${depth}, %rdi
+    call sumdown
+    addq %rax, %r12
+    subq %r9, %rbp
+    jne rep
+    rrmovq %rbx, %rax
+    addq %r12, %rax
+    ret
+
+fib:                            # rax = fib(rdi)
+    rrmovq %rdi, %r10
+    irmovq $2, %r11
+    subq %r11, %r10
+    jge f_rec
+    rrmovq %rdi, %rax
+    ret
+f_rec:
+    pushq %rdi
+    subq %r9, %rdi
+    call fib
+    popq %rdi
+    pushq %rax
+    subq %r9, %rdi
+    subq %r9, %rdi
+    call fib
+    popq %r10
+    addq %r10, %rax
+    ret
+
+sumdown:                        # rax = rdi + (rdi-1) + ... + 0，递归深度 rdi
+    andq %rdi, %rdi
+    jne s_rec
+    irmovq $0, %rax
+    ret
+s_rec:
+    pushq %rdi
+    subq %r9, %rdi
+    call sumdown
+    popq %rdi
+    addq %rdi, %rax
+    ret
+"""
+    a, b = 0, 1
+    for _ in range(k): a, b = b, a + b
+    fib_k, sd = a, depth * (depth + 1) // 2
+    return src, {'rax': reps * (fib_k + sd), 'rbx': reps * fib_k, 'r12': reps * sd,
+                 'rsp': STACK}
+
+def w_listchase(p):
+    n, reps, stride = p['n'], p['reps'], p['stride']
+    if n & (n - 1) or stride % 2 == 0:
+        sys.exit('listchase: n must be a power of two and stride odd')
+    src = PROLOGUE + f"""
+main:
+    irmovq ${BUF0}, %rbx
+    irmovq $0, %r10             # 下一个结点相对 base 的偏移
+    irmovq ${16 * stride}, %r12
+    irmovq ${16 * n - 1}, %r11
+    irmovq $0, %r13             # 结点值 i
+    irmovq ${n}, %rcx
+    rrmovq %rbx, %rsi
+build:
+    addq %r12, %r10
+    andq %r11, %r10
+    rrmovq %r10, %rdi
+    addq %rbx, %rdi
+    rmmovq %rdi, 0(%rsi)        # cur->next
+    rmmovq %r13, 8(%rsi)        # cur->val
+    addq %r9, %r13
+    rrmovq %rdi, %rsi
+    subq %r9, %rcx
+    jne build
+    rrmovq %rbx, %rsi           # 循环链表，走 reps 圈
+    irmovq ${n * reps}, %rcx
+chase:
+    mrmovq 8(%rsi), %r10
+    addq %r10, %rax
+    mrmovq 0(%rsi), %rsi
+    subq %r9, %rcx
+    jne chase
+    ret
+"""
+    return src, {'rax': reps * (n * (n - 1) // 2), 'rsi': BUF0, 'rcx': 0}
+
+# 4 状态机：每次转移给 rax 加上 ADD[s][y]，转到 NEXT[s][y]
+FSM_NEXT = [[1, 0, 2, 3], [2, 3, 1, 0], [3, 1, 0, 2], [0, 2, 3, 1]]
+FSM_ADD = [[3, 5, 7, 11], [13, 17, 19, 23], [29, 31, 37, 41], [43, 47, 53, 59]]
+
+def w_fsm(p):
+    m, reps = p['m'], p['reps']
+    body = []
+    for s in range(4):
+        body.append(f"""
+st{s}:
+    mrmovq 0(%rsi), %rdx
+    addq %r8, %rsi
+    andq %rdx, %rdx
+    je t{s}_0
+    subq %r9, %rdx
+    je t{s}_1
+    subq %r9, %rdx
+    je t{s}_2
+    jmp t{s}_3""")
+        for y in range(4):
+            t = FSM_NEXT[s][y]
+            body.append(f"""
+t{s}_{y}:
+    irmovq ${FSM_ADD[s][y]}, %r10
+    addq %r10, %rax
+    subq %r9, %rcx
+    jne st{t}
+    irmovq ${t}, %rbx
+    jmp pass_end""")
+    src = PROLOGUE + f"""
+main:
+    irmovq ${SEED}, %r14
+    irmovq ${BUF0}, %rdi
+    irmovq ${m}, %rcx
+    irmovq $3, %r11
+    call fill
+    irmovq $0, %rbx             # 当前状态
+    irmovq ${reps}, %rbp
+pass:
+    irmovq ${BUF0}, %rsi
+    irmovq ${m}, %rcx
+    rrmovq %rbx, %rdx           # 按状态分派
+    andq %rdx, %rdx
+    je st0
+    subq %r9, %rdx
+    je st1
+    subq %r9, %rdx
+    je st2
+    jmp st3
+pass_end:
+    subq %r9, %rbp
+    jne pass
+    ret
+""" + ''.join(body) + '\n' + FILL
+    syms = Gen().take(m, 3)
+    per = []
+    for s0 in range(4):
+        s, acc = s0, 0
+        for y in syms:
+            acc += FSM_ADD[s][y]; s = FSM_NEXT[s][y]
+        per.append((s, acc))
+    s, rax = 0, 0
+    for _ in range(reps):
+        s, add = per[s][0], per[s][1]
+        rax += add
+    return src, {'rax': rax, 'rbx': s, 'rbp': 0}
+
+# 名字 -> (生成函数, 默认参数)；reps 会乘以 --scale
+WORKLOADS = {
+    'memops':    (w_memops,    {'n': 65536, 'reps': 4}),
+    'bsort':     (w_bsort,     {'n': 800, 'reps': 1}),
+    'qsort':     (w_qsort,     {'n': 50000, 'reps': 1}),
+    'matmul':    (w_matmul,    {'n': 24, 'reps': 8}),
+    'recursion': (w_recursion, {'k': 22, 'depth': 100000, 'reps': 4}),
+    'listchase': (w_listchase, {'n': 65536, 'stride': 40503, 'reps': 16}),
+    'fsm':       (w_fsm,       {'m': 4096, 'reps': 64}),
+}
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('--out', default='benchmark/corpus', help='output directory')
+    ap.add_argument('--scale', type=int, default=1, help='multiply every reps parameter')
+    ap.add_argument('--set', action='append', default=[], metavar='NAME.PARAM=V',
+                    help='override a size parameter, e.g. bsort.n=2000')
+    ap.add_argument('--only', help='comma-separated subset of: ' + ','.join(WORKLOADS))
+    args = ap.parse_args()
+
+    params = {k: dict(v[1]) for k, v in WORKLOADS.items()}
+    for kv in args.set:
+        m = re.match(r'^(\w+)\.(\w+)=(\d+)$', kv)
+        if not m or m.group(1) not in params or m.group(2) not in params[m.group(1)]:
+            sys.exit(f'bad --set {kv}')
+        params[m.group(1)][m.group(2)] = int(m.group(3))
+    names = args.only.split(',') if args.only else list(WORKLOADS)
+
+    os.makedirs(args.out, exist_ok=True)
+    expected_path = os.path.join(args.out, 'expected.json')
+    expected = {}
+    if os.path.exists(expected_path):
+        with open(expected_path, encoding='utf-8') as f: expected = json.load(f)
+    for name in names:
+        if name not in WORKLOADS: sys.exit(f'unknown workload {name}')
+        p = dict(params[name]); p['reps'] *= args.scale
+        src, regs = WORKLOADS[name][0](p)
+        with open(os.path.join(args.out, name + '.yo'), 'w', encoding='utf-8') as f:
+            f.write(to_yo(assemble(src)))
+        expected[name + '.yo'] = {'STAT': 2, 'REG': {r: s64(v) for r, v in regs.items()}, 'params': p}
+        print(f'{name}.yo  {p}', file=sys.stderr)
+    with open(expected_path, 'w', encoding='utf-8') as f:
+        json.dump(expected, f, indent=2, sort_keys=True)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,153 @@
+import os
+import sys
+import random
+import argparse
+import subprocess
+import tempfile
+
+# 随机程序的差分测试：生成 .yo，检查
+#   * threaded / jit / pipe 引擎逐条指令与 step() 一致（--diff），--lanes 的各条 lane 也是
+#   * 不同执行路径得到的完整轨迹逐字节相同：路径、管道、.ybin（路径和管道）、
+#     --trace=bin 展开
+#   * 给了 --ref 时，与另一个 y86sim（例如旧版本）
+# 用法：python3 fuzz.py --bin ./build/y86sim [--count=N] [--seed=S] [--ref=OLD_Y86SIM]
+
+DATA = 0x800   # 数据区起点，访存大多落在附近
+STACK = 0xf00
+DIFF_ENGINES = ("threaded", "jit", "pipe")
+
+def reg(rng):
+    # 偶尔用 F（RNONE）
+    return 0xf if rng.random() < 0.05 else rng.randrange(15)
+
+def quad(v):
+    return (v & (1 << 64) - 1).to_bytes(8, "little")
+
+def gen_insn(rng, size):
+    k = rng.random()
+    if k < 0.02:
+        return bytes([0x00])                                      # halt
+    if k < 0.05:
+        return bytes([0x10])                                      # nop
+    if k < 0.15:
+        return bytes([0x20 | rng.randrange(7), reg(rng) << 4 | reg(rng)])   # rrmovq / cmovXX
+    if k < 0.28:
+        v = rng.choice([0, 1, -1, rng.randrange(-1000, 1000), rng.getrandbits(64), DATA + 8 * rng.randrange(32)])
+        return bytes([0x30, 0xf0 | reg(rng)]) + quad(v)           # irmovq
+    if k < 0.38:
+        return bytes([0x40, reg(rng) << 4 | reg(rng)]) + quad(rng.randrange(-16, DATA + 0x100))   # rmmovq
+    if k < 0.48:
+        return bytes([0x50, reg(rng) << 4 | reg(rng)]) + quad(rng.randrange(-16, DATA + 0x100))   # mrmovq
+    if k < 0.65:
+        return bytes([0x60 | rng.randrange(4), reg(rng) << 4 | reg(rng)])   # OPq
+    if k < 0.75:
+        return bytes([0x70 | rng.randrange(7)]) + quad(rng.randrange(size + 16))   # jXX
+    if k < 0.80:
+        return bytes([0x80]) + quad(rng.randrange(size + 16))     # call
+    if k < 0.84:
+        return bytes([0x90])                                      # ret
+    if k < 0.91:
+        return bytes([0xa0, reg(rng) << 4 | 0xf])                 # pushq
+    if k < 0.98:
+        return bytes([0xb0, reg(rng) << 4 | 0xf])                 # popq
+    return bytes([rng.randrange(256)])                            # 多半是非法指令
+
+def gen_program(rng):
+    """返回 .yo 文本；偶尔夹带空行、纯注释行和只有地址的行"""
+    lines = []
+    addr = 0
+    code = []
+    if rng.random() < 0.8:
+        code.append(bytes([0x30, 0xf4]) + quad(STACK))            # irmovq $STACK, %rsp
+    n = rng.randrange(8, 60)
+    size = n * 6
+    for _ in range(n):
+        code.append(gen_insn(rng, size))
+    for b in code:
+        lines.append(f"0x{addr:03x}: {b.hex():<20} |")
+        if rng.random() < 0.05:
+            lines.append("                            | # comment")
+        if rng.random() < 0.03:
+            lines.append("")
+        addr += len(b)
+        if rng.random() < 0.03:
+            lines.append(f"0x{addr:03x}:                      |")
+    if rng.random() < 0.7:
+        lines.append(f"0x{DATA:03x}:                      | .align 8")
+        for i in range(rng.randrange(1, 16)):
+            lines.append(f"0x{DATA + 8 * i:03x}: {quad(rng.getrandbits(64)).hex()} | .quad")
+    return "\n".join(lines) + "\n"
+
+def run(args, **kw):
+    return subprocess.run(args, capture_output=True, timeout=60, **kw)
+
+def main():
+    args = parse_args()
+    rng = random.Random(args.seed)
+    yo2ybin = os.path.join(os.path.dirname(args.bin), "yo2ybin")
+    limit = f"--limit={args.limit}"
+    bad = 0
+    with tempfile.TemporaryDirectory() as d:
+        for i in range(args.count):
+            text = gen_program(rng)
+            yo = os.path.join(d, "p.yo")
+            ybin = os.path.join(d, "p.ybin")
+            lanes = os.path.join(d, "lanes.jsonl")
+            with open(yo, "w") as f:
+                f.write(text)
+            with open(lanes, "w") as f:
+                f.write('{}\n{"REG":{"rax":%d,"rsp":%d}}\n{"MEM":{"%d":%d}}\n'
+                        % (rng.randrange(-99, 99), STACK - 64, DATA, rng.getrandbits(63)))
+
+            problems = []
+            for engine in DIFF_ENGINES:
+                r = run([args.bin, f"--engine={engine}", "--diff", limit, yo])
+                if r.returncode != 0:
+                    problems.append(f"--engine={engine} --diff: {r.stderr.decode().strip()}")
+
+            for isa in ("scalar", "avx2", "avx512"):
+                r = run([args.bin, "--lanes=" + lanes, f"--lane-isa={isa}", "--diff", limit, yo])
+                if r.returncode != 0 and b"not supported" not in r.stderr:
+                    problems.append(f"--lanes --lane-isa={isa} --diff: {r.stderr.decode().strip()}")
+
+            want = run([args.bin, limit, yo]).stdout
+            if run([args.bin, limit], input=text.encode()).stdout != want:
+                problems.append(".yo through a pipe differs from the path")
+            if run([yo2ybin, yo, ybin]).returncode != 0:
+                problems.append("yo2ybin failed")
+            else:
+                if run([args.bin, limit, ybin]).stdout != want:
+                    problems.append(".ybin path differs from .yo")
+                with open(ybin, "rb") as f:
+                    if run([args.bin, limit], stdin=f).stdout != want:
+                        problems.append(".ybin through a pipe differs from .yo")
+            ytr = run([args.bin, limit, "--trace=bin", yo]).stdout
+            if run([args.bin, "--expand"], input=ytr).stdout != want:
+                problems.append("--trace=bin expands to a different trace")
+            if args.ref and run([args.ref, limit], input=text.encode()).stdout != want:
+                problems.append(f"trace differs from {args.ref}")
+
+            if problems:
+                bad += 1
+                keep = f"fuzz-fail-{args.seed}-{i}.yo"
+                with open(keep, "w") as f:
+                    f.write(text)
+                print(f"{keep}:")
+                for p in problems:
+                    print("  " + p)
+    if bad:
+        print(f"{bad} of {args.count} programs failed")
+        sys.exit(1)
+    print(f"All {args.count} fuzzed programs agree!")
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--bin', type=str, help='path to y86sim (yo2ybin next to it)', required=True)
+    parser.add_argument('--ref', type=str, help='another y86sim whose full traces must match')
+    parser.add_argument('--count', type=int, default=200)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--limit', type=int, default=2000)
+    return parser.parse_args()
+
+if __name__ == "__main__":
+    main()
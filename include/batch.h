@@ -0,0 +1,45 @@
+#pragma once
+#include "cpu.h"
+#include "engine.h"
+#include "image.h"
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace y86 {
+
+// Batch mode: run many programs in one process, each on its own CPU,
+// spread over a work-stealing thread pool (pool.h).
+struct BatchOptions {
+    enum class Output { Json, Delta, Bin, Final, None };
+
+    std::string out_dir = "batch_out";  // one trace file per program
+    Output output = Output::Json;
+    unsigned jobs = 0;  // 0 = hardware concurrency
+    Engine engine = Engine::Step;
+    MemBackend backend = MemBackend::Paged;
+    bool icache = true;
+    LoadOptions load;
+    u64 limit = 1'000'000;
+};
+
+struct BatchResult {
+    std::string program;
+    std::string output;  // trace file, empty for Output::None
+    u64 steps = 0;
+    Stat stat = Stat::AOK;
+    double ms = 0;      // load + run + trace for this program
+    std::string error;  // non-empty if the program could not be loaded/written
+};
+
+// A directory yields its *.yo / *.ybin files (sorted by name); any other
+// path is read as a list with one program path per line.
+std::vector<std::string> batch_inputs(const std::string& dir_or_list, std::string* err);
+
+// results are in the order of `programs`
+std::vector<BatchResult> run_batch(const std::vector<std::string>& programs,
+                                   const BatchOptions& opt);
+
+nlohmann::json batch_summary(const std::vector<BatchResult>& results);
+
+}  // namespace y86
@@ -0,0 +1,196 @@
+#pragma once
+#include "cpu.h"
+#include "trace.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace y86 {
+
+// Binary columnar trace (.ytr), for traces too long to keep as JSON.
+//
+// Steps are stored in blocks of 2^BLOCK_SHIFT. Each block holds the
+// registers before its first step and then one column per field:
+//   pc       u64 per step
+//   flags    u8 per step: STAT | ZF << 3 | SF << 4 | OF << 5 | writes << 6
+//   regmask  u16 per step, registers that changed
+//   regvals  s64 per set regmask bit, in step and register order
+//   waddr    u64 per memory write, the aligned qword that changed
+//   wval     s64 per memory write, its new value
+// each padded to 8 bytes. A step has 0-2 writes; writes == 3 marks a
+// snapshot step, whose first write entry holds the count c of the c entries
+// after it, the complete nonzero memory (written when the trace skipped
+// steps, e.g. between sampled windows). The file is
+//   header   magic "Y86TRC\0\0", u32 version, u32 block shift, padding to 64
+//   init     state before the first step: PC, flags, 15 registers, the
+//            count of nonzero qwords and their (address, value) pairs
+//   blocks   as above, each starting with n, #regvals, #writes and the
+//            15 registers
+//   index    per block: file offset, writes in all earlier blocks
+//   trailer  magic "Y86TRIX\0", steps, blocks, index offset, total
+//            writes, padding to 64
+// All integers are little-endian. Since the index comes last the writer
+// streams, so the trace can go to a pipe.
+namespace ytr {
+constexpr char MAGIC[8] = {'Y', '8', '6', 'T', 'R', 'C', 0, 0};
+constexpr char TRAILER_MAGIC[8] = {'Y', '8', '6', 'T', 'R', 'I', 'X', 0};
+constexpr u32 VERSION = 1;
+constexpr unsigned BLOCK_SHIFT = 16;
+constexpr std::size_t HEADER_SIZE = 64;
+constexpr std::size_t TRAILER_SIZE = 64;
+}  // namespace ytr
+
+// Writer for TraceEach<>: begin() with the loaded CPU, record() after
+// each step to log, finish() once at the end. Memory writes come from the
+// CPU's dirty ring, so a store that leaves a qword unchanged is not logged;
+// a record after unlogged steps becomes a snapshot step when needed.
+class BinTraceWriter {
+public:
+    explicit BinTraceWriter(OutBuf& out);
+
+    void begin(const CPU& S);
+    void record(const CPU& S) {
+        pc_.push_back(S.PC);
+        u16 mask = 0;
+        for (int i = 0; i < REG_NUM; i++) {
+            if (S.R[i] == regs_[i]) continue;
+            mask |= (u16)(1u << i);
+            regs_[i] = S.R[i];
+            regvals_.push_back(S.R[i]);
+        }
+        mask_.push_back(mask);
+        u64 nw = S.dirty_seq - mem_seq_;
+        u8 wf = nw ? note_writes(S, nw) : 0;
+        flags_.push_back(pack_flags(S) | (u8)(wf << 6));
+        if (pc_.size() == BLOCK) flush_block();
+    }
+    // writes the last block, the index and the trailer, then flushes
+    void finish();
+
+private:
+    static constexpr std::size_t BLOCK = std::size_t(1) << ytr::BLOCK_SHIFT;
+
+    static u8 pack_flags(const CPU& S) {
+        return (u8)((int)S.stat | S.cc.ZF << 3 | S.cc.SF << 4 | S.cc.OF << 5);
+    }
+    // logs the changes since the last record; returns the writes field
+    u8 note_writes(const CPU& S, u64 nw);
+    void flush_block();
+    void emit(const void* p, std::size_t n);
+    void emit64(u64 v);
+    template <class T>
+    void emit_column(const std::vector<T>& v);
+    void pad8();
+
+    OutBuf& out_;
+    u64 pos_ = 0;
+    u64 steps_ = 0, writes_ = 0;
+    s64 regs_[REG_NUM]{};
+    s64 block_regs_[REG_NUM]{};
+    u64 mem_seq_ = 0;
+    std::vector<u64> pc_;
+    std::vector<u8> flags_;
+    std::vector<u16> mask_;
+    std::vector<s64> regvals_;
+    std::vector<u64> waddr_;
+    std::vector<s64> wval_;
+    std::vector<u64> index_;  // offset, earlier writes per block
+};
+
+// Read-only view of a .ytr, memory-mapped when it is a regular file. Step
+// k (0-based) is the state after the (k+1)-th instruction, i.e. element k
+// of the JSON trace. pc()/stat()/cc() of any step are O(1); registers at a
+// step cost up to one block of masks, memory the writes before it.
+class BinTrace {
+public:
+    struct Write {
+        u64 addr;
+        s64 value;
+    };
+
+    BinTrace() = default;
+    ~BinTrace();
+    BinTrace(const BinTrace&) = delete;
+    BinTrace& operator=(const BinTrace&) = delete;
+
+    // false with *err set on an unreadable or malformed trace; regular
+    // files are mapped, anything else is read into memory
+    bool open(const std::string& path, std::string* err = nullptr);
+    bool open_fd(int fd, std::string* err = nullptr);
+    bool open_buffer(std::vector<u8> data, std::string* err = nullptr);
+    static bool is_ytr(const void* p, std::size_t n);
+
+    u64 steps() const { return steps_; }
+    u64 writes() const { return writes_; }
+
+    u64 pc(u64 k) const;
+    Stat stat(u64 k) const;
+    CC cc(u64 k) const;
+    // memory writes of step k; with *snapshot set they replace all memory
+    void writes_at(u64 k, std::vector<Write>& out, bool* snapshot = nullptr) const;
+
+    // the state before the first step / after step k into a fresh CPU
+    void initial_state(CPU& S) const;
+    void state_at(u64 k, CPU& S) const;
+
+    // calls f(S) after applying each of steps [first, last) to S, which
+    // must hold the state before `first` (initial_state() for 0)
+    template <class F>
+    void replay(CPU& S, u64 first, u64 last, F&& f) const;
+
+    // the whole trace in --trace=full form, via JsonTraceWriter
+    void to_json(OutBuf& out) const;
+
+private:
+    struct Block {
+        u64 n = 0, nregs = 0, nwrites = 0;
+        u64 first_write = 0;  // writes in earlier blocks
+        const u8* regs = nullptr;
+        const u8* pc = nullptr;
+        const u8* flags = nullptr;
+        const u8* mask = nullptr;
+        const u8* regvals = nullptr;
+        const u8* waddr = nullptr;
+        const u8* wval = nullptr;
+    };
+
+    bool parse(std::string* err);
+    const Block& block_of(u64 k) const { return blocks_[k >> ytr::BLOCK_SHIFT]; }
+    // regval and write positions of step i within block b
+    static void position(const Block& b, u64 i, u64& rv, u64& w);
+    // applies step i of block b and advances the positions past it
+    static void apply(const Block& b, u64 i, u64& rv, u64& w, CPU& S);
+    // entries step i of block b occupies in the write columns, starting at w
+    static u64 write_entries(const Block& b, u64 i, u64 w);
+    static void apply_writes(const Block& b, u64 i, u64& w, CPU& S);
+    static void clear_mem(CPU& S);
+    void apply_block_writes(const Block& b, CPU& S) const;
+    static void set_regs(const u8* p, CPU& S);
+
+    const u8* data_ = nullptr;
+    std::size_t size_ = 0;
+    void* map_ = nullptr;    // munmap() on destruction if set
+    std::vector<u8> owned_;  // pipe input read into memory
+    u64 steps_ = 0, writes_ = 0;
+    const u8* init_ = nullptr;
+    std::vector<Block> blocks_;
+};
+
+template <class F>
+void BinTrace::replay(CPU& S, u64 first, u64 last, F&& f) const {
+    if (last > steps_) last = steps_;
+    while (first < last) {
+        const Block& b = block_of(first);
+        u64 base = (first >> ytr::BLOCK_SHIFT) << ytr::BLOCK_SHIFT;
+        u64 rv, w;
+        position(b, first - base, rv, w);
+        u64 end = std::min(last - base, b.n);
+        for (u64 i = first - base; i < end; i++) {
+            apply(b, i, rv, w, S);
+            f(static_cast<const CPU&>(S));
+        }
+        first = base + end;
+    }
+}
+
+}  // namespace y86
@@ -0,0 +1,119 @@
+#pragma once
+#include "icache.h"
+#include "types.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace y86 {
+
+class CPU;
+
+// Direction predictor for conditional jXX. predict() must not change any
+// state; update() is called once per branch with the real outcome.
+class BranchPredictor {
+public:
+    virtual ~BranchPredictor() = default;
+    virtual std::string name() const = 0;
+    virtual bool predict(u64 pc, u64 target) const = 0;
+    virtual void update(u64 pc, u64 target, bool taken) = 0;
+};
+
+// One of
+//   taken               always taken (what PIPE does)
+//   btfn                backward taken, forward not taken
+//   bimodal[:BITS]      2^BITS two-bit counters indexed by PC (default 12)
+//   gshare[:HIST[:BITS]] two-bit counters indexed by PC xor HIST bits of
+//                       global history (defaults 12, 12)
+// Numbers are decimal or 0x hex. Returns null and sets *err for anything else.
+std::unique_ptr<BranchPredictor> make_predictor(const std::string& spec, std::string* err = nullptr);
+
+// Return-address stack: call pushes, ret pops and predicts. A full stack
+// overwrites its oldest entry; popping an empty one predicts nothing.
+class ReturnStack {
+public:
+    explicit ReturnStack(std::size_t depth = 16) : slots_(depth ? depth : 1) {}
+
+    void push(u64 ret_addr) {
+        slots_[top_++ % slots_.size()] = ret_addr;
+        if (size_ < slots_.size()) ++size_; else ++overflows;
+    }
+    // true if the popped entry equals `target`
+    bool pop(u64 target) {
+        if (!size_) return false;
+        --size_;
+        return slots_[--top_ % slots_.size()] == target;
+    }
+    std::size_t depth() const { return slots_.size(); }
+
+    u64 overflows = 0;
+
+private:
+    std::vector<u64> slots_;
+    std::size_t top_ = 0, size_ = 0;
+};
+
+// Policy for run<> (engine.h) that evaluates several predictors side by
+// side on the conditional jXX stream, plus a return-address stack on
+// call/ret. Unconditional jmp and cmovXX are not counted. The branch stream
+// is architectural, so the results are the same whichever engine runs the
+// program.
+class BranchSim {
+public:
+    static constexpr bool per_step = false;
+    static constexpr bool profile = true;
+
+    // comma-separated predictor specs (see make_predictor) and an optional
+    // ras=DEPTH (default 16, at most 65536); "default" or no predictor at all stands for
+    // taken,btfn,bimodal,gshare
+    static std::unique_ptr<BranchSim> create(const std::string& spec, std::string* err = nullptr);
+
+    void step(const CPU&) {}
+    void end(const CPU&, u64 n) { steps_ += n; }
+
+    void insn(u64 pc, const Decoded& d) {
+        pc_ = pc;
+        cond_ = d.icode == 0x7 && d.ifun != 0;
+        target_ = d.valC;
+    }
+    void mem(u64, bool) {}
+    void branch(bool taken) {
+        if (cond_) resolve(pc_, target_, taken);
+    }
+    void call(u64, u64 ret_addr) { ras_.push(ret_addr); }
+    void ret(u64 target) {
+        ++rets_;
+        if (!ras_.pop(target)) ++ret_misses_;
+    }
+
+    std::size_t predictors() const { return preds_.size(); }
+    const BranchPredictor& predictor(std::size_t i) const { return *preds_[i]; }
+
+    // totals per predictor, RAS accuracy and the `max_pcs` most executed
+    // branches with per-predictor accuracy
+    nlohmann::json to_json(std::size_t max_pcs = 16) const;
+
+private:
+    struct PcStat {
+        u64 count = 0, taken = 0;
+        std::vector<u64> misses;  // per predictor
+    };
+    explicit BranchSim(std::size_t ras_depth) : ras_(ras_depth) {}
+    void resolve(u64 pc, u64 target, bool taken);
+
+    std::vector<std::unique_ptr<BranchPredictor>> preds_;
+    std::vector<u64> misses_;
+    std::unordered_map<u64, PcStat> pcs_;
+    u64 branches_ = 0;
+
+    ReturnStack ras_;
+    u64 rets_ = 0, ret_misses_ = 0;
+
+    u64 pc_ = 0, target_ = 0;
+    bool cond_ = false;
+    u64 steps_ = 0;
+};
+
+}  // namespace y86
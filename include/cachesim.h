@@ -0,0 +1,159 @@
+#pragma once
+#include "icache.h"
+#include "types.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace y86 {
+
+class CPU;
+
+// Geometry and policies of one cache level.
+struct CacheLevelConfig {
+    enum class Replace { LRU, PLRU };
+    bool enabled = false;
+    u32 size = 32 * 1024;  // bytes
+    u32 ways = 8;
+    u32 line = 64;         // bytes
+    Replace replace = Replace::LRU;
+    bool write_back = true;      // false: write-through
+    bool write_allocate = true;  // false: a store miss goes to the next level only
+    u32 latency = 1;             // cycles for a hit
+};
+
+// L1I and L1D in front of an optional unified L2 and memory.
+struct CacheConfig {
+    CacheLevelConfig l1i, l1d, l2;
+    u32 mem_latency = 100;
+
+    CacheConfig();
+    // "default" or comma-separated items:
+    //   l1i|l1d|l2=SIZE:WAYS:LINE[:lru|plru][:wb|wt][:wa|nwa][:lat=N]
+    //   l2=off, mem=N
+    // SIZE takes a k/m suffix; set count and PLRU ways must be powers of two.
+    // Numbers are decimal or 0x hex, at most 4 GiB - 1 for SIZE and 2^30
+    // cycles for latencies.
+    static bool parse(const std::string& spec, CacheConfig& out, std::string* err = nullptr);
+};
+
+// Set-associative cache level: tags only, no data.
+class CacheLevel {
+public:
+    struct Counters {
+        u64 reads = 0, writes = 0, read_misses = 0, write_misses = 0;
+        u64 evictions = 0, writebacks = 0;
+    };
+    struct Result {
+        bool hit = false;
+        bool writeback = false;  // a dirty victim must be written to the next level
+        u64 victim = 0;          // line address of that victim
+    };
+
+    explicit CacheLevel(const CacheLevelConfig& c);
+    // `line` is addr / line size; on a miss the line is filled unless this
+    // is a store without write-allocate
+    Result access(u64 line, bool write);
+
+    const CacheLevelConfig& config() const { return cfg_; }
+    const Counters& counters() const { return n_; }
+    unsigned line_bits() const { return line_bits_; }
+
+private:
+    struct Way {
+        u64 tag = 0;
+        u64 stamp = 0;  // LRU: last use
+        bool valid = false, dirty = false;
+    };
+    u32 victim(u64 set);
+    void touch(u64 set, u32 way);
+
+    CacheLevelConfig cfg_;
+    unsigned line_bits_ = 6;
+    u64 sets_ = 1;
+    std::vector<Way> ways_;   // sets_ * cfg_.ways
+    std::vector<u64> plru_;   // one tree per set, bit i = node i
+    u64 clock_ = 0;
+    Counters n_;
+};
+
+// Cache hierarchy on the instruction fetch and data paths. Each call
+// returns the access latency in cycles and updates counters per level and
+// per PC. Accesses that straddle a line boundary touch both lines and cost
+// the slower of the two.
+class CacheModel {
+public:
+    explicit CacheModel(const CacheConfig& c);
+
+    u32 fetch(u64 pc, u64 len);
+    u32 load(u64 pc, u64 addr) { return data(pc, addr, false); }
+    u32 store(u64 pc, u64 addr) { return data(pc, addr, true); }
+
+    // cycles spent beyond an L1 hit on every access
+    u64 stall_cycles() const { return stall_; }
+
+    // per level counters, memory traffic and the `max_pcs` PCs with the
+    // most misses
+    nlohmann::json to_json(std::size_t max_pcs = 16) const;
+
+private:
+    struct PcStat {
+        u64 fetches = 0, fetch_misses = 0;
+        u64 loads = 0, stores = 0, data_misses = 0;
+        u64 l2_misses = 0;
+    };
+    u32 data(u64 pc, u64 addr, bool write);
+    u32 access(CacheLevel& l1, u64 addr, u64 len, bool write, PcStat& ps, bool& l1_miss);
+    u32 next_level(u64 line, unsigned line_bits, bool write, PcStat* ps);
+    void write_back(u64 line, unsigned line_bits);
+    PcStat& pc_stat(u64 pc) {
+        if (pc != last_pc_ || !last_) {
+            last_pc_ = pc;
+            last_ = &pcs_[pc];
+        }
+        return *last_;
+    }
+
+    CacheConfig cfg_;
+    CacheLevel l1i_, l1d_, l2_;
+    u64 mem_reads_ = 0, mem_writes_ = 0;
+    u64 stall_ = 0;
+    std::unordered_map<u64, PcStat> pcs_;
+    u64 last_pc_ = 0;
+    PcStat* last_ = nullptr;
+};
+
+// Policy for run<> (engine.h) that drives a CacheModel from the profiling
+// hooks: one fetch per instruction, one load/store per data access.
+// cycles() estimates a one-instruction-per-cycle core that stalls on
+// every access slower than an L1 hit.
+class CacheSim {
+public:
+    static constexpr bool per_step = false;
+    static constexpr bool profile = true;
+
+    explicit CacheSim(CacheModel& m) : model_(m) {}
+
+    void step(const CPU&) {}
+    void end(const CPU&, u64 n) { steps_ += n; }
+
+    void insn(u64 pc, const Decoded& d) {
+        pc_ = pc;
+        model_.fetch(pc, d.valP - pc);
+    }
+    void mem(u64 addr, bool write) { write ? model_.store(pc_, addr) : model_.load(pc_, addr); }
+    void branch(bool) {}
+    void call(u64, u64) {}
+    void ret(u64) {}
+
+    u64 instructions() const { return steps_; }
+    u64 cycles() const { return steps_ + model_.stall_cycles(); }
+
+private:
+    CacheModel& model_;
+    u64 pc_ = 0;
+    u64 steps_ = 0;
+};
+
+}  // namespace y86
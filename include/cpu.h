@@ -1,23 +1,59 @@
 #pragma once
+#include "icache.h"
+#include "mem.h"
 #include "types.h"
+#include <map>
 #include <unordered_map>
-#include <set>
 #include <nlohmann/json.hpp>
 
 namespace y86 {
 
 using Mem = std::unordered_map<u64, u8>;
 
+// memory backend used by CPU::read*/write*; pick before loading a program
+enum class MemBackend : u8 { Map, Paged };
+
+// Architectural state saved by CPU::checkpoint(). With the paged backend
+// the memory is shared copy-on-write with the CPU it came from, so taking
+// one costs O(allocated pages) and afterwards only pages written by either
+// side are duplicated; the map backend is copied in full.
+struct Checkpoint {
+    s64 R[REG_NUM]{};
+    s64 scratch = 0;
+    u64 PC = 0;
+    CC cc{};
+    Stat stat = Stat::AOK;
+    MemBackend backend = MemBackend::Paged;
+    PagedMem pages;
+    Mem mem;
+};
+
+// One thread at a time, const access included: reads and copies update
+// PagedMem's lookup cache, and qword_nonzero() rebuilds the index lazily.
 struct CPU {
     s64 R[REG_NUM]{};
+    // register "F" (RNONE) as seen by execute(): not architectural, but
+    // keeps whatever was last written to it
+    s64 scratch = 0;
     u64 PC = 0;
     CC cc{};
     Stat stat = Stat::AOK;
 
-    // byte-addressable memory (sparse)
+    // byte-addressable memory (sparse); only one backend holds data
+    MemBackend backend = MemBackend::Paged;
     Mem mem;
-    // aligned 8B blocks touched (for compact MEM dump)
-    std::set<u64> qword_touched;
+    PagedMem pages;
+    // ring of recently changed qword bases; dirty_seq counts every change,
+    // so a consumer that is at most DIRTY_RING changes behind can catch up
+    static constexpr std::size_t DIRTY_RING = 64;
+    u64 dirty_ring[DIRTY_RING]{};
+    u64 dirty_seq = 0;
+    // dirty_seq just after the last restore()/drop_index(); ring entries
+    // logged before it say nothing about the current memory
+    u64 dirty_epoch = 0;
+
+    // decoded-instruction cache, invalidated by stores to cached code
+    DecodeCache icache;
 
     // optional hard bound (off by default)
     bool bounded = false;
@@ -31,16 +67,62 @@ struct CPU {
         return (u64)a + len - 1 <= mem_upper;
     }
 
+    bool mem_empty() const {
+        return backend == MemBackend::Paged ? pages.empty() : mem.empty();
+    }
+
     // byte/qword memory operations
     bool read1(s64 a, u8& out) const;
     bool write1(s64 a, u8 v);
     bool read8(s64 a, u64& out) const;
     bool write8(s64 a, u64 v);
+    // same without check_addr(), for engines that test bounds themselves
+    u64 read8_unchecked(u64 a) const;
+    void write8_unchecked(u64 a, u64 v);
+    // write8_unchecked() for untraced runs: leaves the nonzero index to
+    // drop_index()
+    void write8_unindexed(u64 a, u64 v) {
+        store8(a, v);
+        drop_index();
+    }
+    // n-byte store, same effect as n write1() calls (used by the loader)
+    bool write_bytes(s64 a, const u8* src, std::size_t n);
+
+    // index of nonzero aligned 8B blocks (for compact MEM dump), maintained
+    // by write1/write8
+    const std::map<u64, s64>& qword_nonzero() const {
+        if (index_stale_) rebuild_index();
+        return nonzero_;
+    }
+    // marks the index stale, to be rebuilt by the next qword_nonzero(), and
+    // moves dirty_seq more than DIRTY_RING ahead so ring consumers
+    // resynchronize in full
+    void drop_index() {
+        if (index_stale_) return;
+        index_stale_ = true;
+        dirty_seq += DIRTY_RING + 1;
+        dirty_epoch = dirty_seq;
+    }
+
+    // save / restore the architectural state; restore() leaves
+    // qword_nonzero() to be rebuilt on demand and flushes the decode cache
+    Checkpoint checkpoint() const;
+    void restore(const Checkpoint& c);
 
     // dumps
     nlohmann::json dump_regs() const;
     nlohmann::json dump_cc() const;
     nlohmann::json dump_mem_nonzero() const;
+
+private:
+    void store8(u64 a, u64 v);
+    u64 load_qword(u64 base) const;
+    void note_qword(u64 base);
+    void note_range(u64 first, u64 last);
+    void rebuild_index() const;
+
+    mutable std::map<u64, s64> nonzero_;
+    mutable bool index_stale_ = false;
 };
 
 }  // namespace y86
@@ -0,0 +1,177 @@
+#pragma once
+#include "icache.h"
+#include "mem.h"
+#include "types.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace y86 {
+
+class CPU;
+
+// Boolean expression over the architectural state, compiled once to a
+// small stack bytecode. Values are signed 64-bit; the grammar, loosest
+// binding first:
+//
+//   ||   &&   == != < <= > >=   |   ^   &   + -   unary ! - ~
+//
+// Operands are decimal or 0x numbers, registers (rax or %rax), pc, the
+// condition codes zf/sf/of, and [EXPR], the little-endian qword at EXPR
+// (0 if the address is invalid).
+class Condition {
+public:
+    // false and *err set on a syntax error
+    static bool compile(const std::string& src, Condition& out, std::string* err = nullptr);
+
+    bool eval(const CPU& S) const;
+
+    // true if the condition is a conjunction with a `pc == N` term, i.e.
+    // can only hold when PC is N
+    bool anchored() const { return anchored_; }
+    u64 anchor() const { return anchor_; }
+    // true if the whole expression is a bare number
+    bool constant() const { return code_.size() == 1 && code_[0].op == CONST; }
+    s64 value() const { return (s64)code_[0].imm; }
+    const std::string& source() const { return src_; }
+
+private:
+    friend class ConditionParser;
+    enum Op : u8 {
+        CONST, REG, PC, FLAG, LOAD,
+        NEG, NOT, BNOT,
+        ADD, SUB, AND, OR, XOR,
+        EQ, NE, LT, LE, GT, GE, LAND, LOR,
+    };
+    struct Insn {
+        Op op;
+        u64 imm;
+    };
+    static constexpr std::size_t MAX_STACK = 32;
+
+    std::vector<Insn> code_;
+    std::string src_;
+    u64 anchor_ = 0;
+    bool anchored_ = false;
+};
+
+// Stopping policy for run<> (engine.h): PC breakpoints, conditional
+// breakpoints and data watchpoints.
+//
+// The hot loop asks check(pc) after every instruction, which costs a bit
+// test in a hashed PC filter plus a test of the pending-watch flag; only
+// when that fires is the state synced and stop() evaluates the exact
+// breakpoints at PC. Watchpoints see the data accesses through the mem()
+// hook and first test a filter of watched 4 KiB pages, so accesses
+// elsewhere cost one bit test. Conditions that are not tied to a PC (no
+// `pc == N` term) have to be evaluated after every instruction and make the
+// run correspondingly slower.
+//
+// Checks happen after an instruction executes, so a run never stops before
+// its first instruction: continuing from a breakpoint moves past it.
+// Stores in the run do not maintain CPU::qword_nonzero() (keeps_index,
+// engine.h); it is rebuilt when the stopped state is next dumped.
+class Debugger {
+public:
+    static constexpr bool per_step = false;
+    static constexpr bool profile = true;
+    static constexpr bool stops = true;
+
+    enum Access : u8 { READ = 1, WRITE = 2 };
+
+    struct Hit {
+        enum Kind : u8 { NONE, BREAK, WATCH } kind = NONE;
+        u32 id = 0;        // index of the breakpoint / watchpoint
+        u64 pc = 0;        // stop PC, or PC of the accessing instruction
+        u64 addr = 0;      // watch: accessed qword
+        bool write = false;
+    };
+
+    // A bare number breaks at that PC; anything else is a Condition,
+    // anchored at a PC if it has a `pc == N` term and checked after every
+    // instruction otherwise. Returns false and sets *err on a syntax error.
+    bool add_break(const std::string& spec, std::string* err = nullptr);
+    void add_break(u64 pc);
+    // ADDR[:LEN][:r|w|rw], LEN defaults to 8 and the access to w
+    bool add_watch(const std::string& spec, std::string* err = nullptr);
+    void add_watch(u64 addr, u64 len, u8 access);
+    void clear();
+
+    std::size_t breaks() const { return breaks_.size(); }
+    std::size_t watches() const { return watches_.size(); }
+
+    // why the last run stopped; kind == NONE if it was not stopped here
+    const Hit& hit() const { return hit_; }
+    std::string describe(const Hit& h) const;
+    nlohmann::json to_json(const Hit& h) const;
+
+    // hooks from run<>
+    void step(const CPU&) {}
+    void end(const CPU&, u64) {
+        if (!stopped_) hit_ = Hit{};
+        stopped_ = pending_ = false;
+    }
+    void insn(u64 pc, const Decoded&) { pc_ = pc; }
+    void mem(u64 addr, bool write) {
+        if (test(page_filter_, addr >> PagedMem::PAGE_BITS) ||
+            test(page_filter_, (addr + 7) >> PagedMem::PAGE_BITS))
+            watch_hit(addr, write);
+    }
+    void branch(bool) {}
+    void call(u64, u64) {}
+    void ret(u64) {}
+
+    // cheap pre-test after every instruction; stop() decides with the
+    // synced state
+    bool check(u64 pc) const { return pending_ || floating_ || test(pc_filter_, pc ^ (pc >> 12)); }
+    bool stop(const CPU& S);
+
+    // for callers that move through history themselves (History): true and
+    // hit() set if S is at a breakpoint / a store of the qword at `addr`
+    // by the instruction at `pc` is watched
+    bool break_at(const CPU& S);
+    bool watch_store(u64 addr, u64 pc);
+
+private:
+    static constexpr std::size_t FILTER_BITS = 4096;
+    using Filter = u64[FILTER_BITS / 64];
+    static bool test(const Filter& f, u64 key) {
+        key &= FILTER_BITS - 1;
+        return (f[key >> 6] >> (key & 63)) & 1;
+    }
+    static void set(Filter& f, u64 key) {
+        key &= FILTER_BITS - 1;
+        f[key >> 6] |= u64(1) << (key & 63);
+    }
+
+    struct Break {
+        u64 pc = 0;
+        bool at_pc = false;  // false: checked after every instruction
+        bool cond = false;   // false: unconditional
+        Condition expr;
+    };
+    struct Watch {
+        u64 lo = 0, hi = 0;  // [lo, hi)
+        u8 access = WRITE;
+    };
+
+    void watch_hit(u64 addr, bool write);
+    // index of the first watchpoint covering an 8-byte access, or -1
+    long find_watch(u64 addr, u8 access) const;
+
+    std::vector<Break> breaks_;
+    std::unordered_map<u64, std::vector<u32>> at_pc_;
+    std::vector<u32> floating_list_;
+    std::vector<Watch> watches_;
+    Filter pc_filter_{};
+    Filter page_filter_{};
+    bool floating_ = false;
+
+    u64 pc_ = 0;
+    bool pending_ = false;  // a watchpoint fired in this instruction
+    bool stopped_ = false;
+    Hit hit_;
+};
+
+}  // namespace y86
@@ -0,0 +1,159 @@
+#pragma once
+#include "cpu.h"
+#include <string>
+#include <type_traits>
+
+namespace y86 {
+
+enum class Engine { Step, Threaded, Jit, Pipe };
+
+// ---------- run<TracePolicy, BoundsPolicy> ----------
+//
+// One specialized handler per icode/ifun, dispatched through computed gotos
+// where the compiler supports them, with registers, CC and PC in locals.
+// The policies are resolved with `if constexpr`, so every combination is
+// its own hot loop without per-step mode tests. Executes until the CPU
+// leaves AOK or `limit` instructions have been attempted and returns that
+// count; the resulting state (and trace) equals an execute() loop that
+// stops on non-AOK, including the RNONE scratch (CPU::scratch).
+
+// trace policies: `per_step` ones get step(S) after every instruction with
+// S fully updated; end(S, n) runs once after the loop. `profile` ones get
+// the lightweight hooks of Profiler (profile.h) instead of a synced CPU:
+// insn() per fetched instruction, mem() per data access, branch()/call()/
+// ret() for control flow.
+struct NoTrace {
+    static constexpr bool per_step = false;
+    static constexpr bool profile = false;
+    void step(const CPU&) {}
+    void end(const CPU&, u64) {}
+};
+
+template <class Writer>
+struct TraceEach {
+    static constexpr bool per_step = true;
+    static constexpr bool profile = false;
+    Writer& w;
+    void step(const CPU& S) { w.record(S); }
+    void end(const CPU&, u64) {}
+};
+
+// only the state after the last executed instruction
+template <class Writer>
+struct TraceFinal {
+    static constexpr bool per_step = false;
+    static constexpr bool profile = false;
+    Writer& w;
+    void step(const CPU&) {}
+    void end(const CPU& S, u64 n) {
+        if (n) w.record(S);
+    }
+};
+
+// calls fn(S, user) after every instruction; a nonzero return ends the run
+// right after it (the trace callback of the C API, y86.h)
+struct StepCallback {
+    static constexpr bool per_step = true;
+    static constexpr bool profile = false;
+    static constexpr bool stops = true;
+    int (*fn)(const CPU&, void*) = nullptr;
+    void* user = nullptr;
+    bool stopped = false;
+    void step(const CPU& S) {
+        if (fn(S, user)) stopped = true;
+    }
+    void end(const CPU&, u64) {}
+    bool check(u64) const { return stopped; }
+    bool stop(const CPU&) { return true; }
+};
+
+// ends the run once PC == pc after an instruction: no hooks and no index
+// upkeep, so it runs like NoTrace plus one compare (--start=pc:ADDR)
+struct PcStop {
+    static constexpr bool per_step = false;
+    static constexpr bool profile = false;
+    static constexpr bool stops = true;
+    u64 pc = 0;
+    void step(const CPU&) {}
+    void end(const CPU&, u64) {}
+    bool check(u64 at) const { return at == pc; }
+    bool stop(const CPU&) { return true; }
+};
+
+// calls fn(user, addr) right before each 8-byte store (the JIT's
+// interpreter fallback watches them for stores into translated code)
+struct StoreHook {
+    static constexpr bool per_step = false;
+    static constexpr bool profile = false;
+    static constexpr bool stores = true;
+    void (*fn)(void*, u64) = nullptr;
+    void* user = nullptr;
+    void step(const CPU&) {}
+    void end(const CPU&, u64) {}
+    void store(const CPU&, u64 a) { fn(user, a); }
+};
+
+// stopping policies (Debugger, debug.h) also declare `stops`: after every
+// instruction run<> asks check(pc) and, if that fires, syncs S and ends the
+// run when stop(S) agrees. Policies without the member never stop early.
+template <class T, class = void>
+struct policy_stops : std::false_type {};
+template <class T>
+struct policy_stops<T, std::void_t<decltype(T::stops)>> : std::bool_constant<T::stops> {};
+
+// policies that log old memory contents declare `stores` and get
+// store(S, addr) right before each 8-byte store, after the bounds check
+template <class T, class = void>
+struct policy_stores : std::false_type {};
+template <class T>
+struct policy_stores<T, std::void_t<decltype(T::stores)>> : std::bool_constant<T::stores> {};
+
+// policies that see memory during the run (per-step traces and store-logging
+// ones) get CPU::qword_nonzero() and the dirty ring updated by every store;
+// for the others run<> stores with write8_unindexed() and the index is
+// rebuilt when it is next read. `stops` alone does not keep it: of the
+// stopping policies StepCallback and History need it as per_step ones, while
+// Debugger reads memory with read8 and its stops are reported after the run.
+template <class T>
+constexpr bool keeps_index = T::per_step || policy_stores<T>::value;
+
+// bounds policies: ok(S, a, len) is CPU::check_addr() with `bounded` fixed
+struct Unbounded {
+    static bool ok(const CPU&, u64 a, u64) { return (s64)a >= 0; }
+};
+struct Bounded {
+    static bool ok(const CPU& S, u64 a, u64 len) {
+        return (s64)a >= 0 && a + len - 1 <= S.mem_upper;
+    }
+};
+
+// instantiated in engine.cpp for NoTrace, TraceEach/TraceFinal over
+// JsonTraceWriter, TraceEach over DeltaTraceWriter and BinTraceWriter
+// (bintrace.h), StepCallback, PcStop, StoreHook, Profiler, CacheSim
+// (cachesim.h), BranchSim (bpred.h), Debugger (debug.h) and History
+// (history.h), each with both bounds policies
+template <class Trace, class Bounds>
+u64 run(CPU& S, u64 limit, Trace& trace);
+
+// picks the bounds policy from S.bounded
+template <class Trace>
+u64 run_auto(CPU& S, u64 limit, Trace& trace) {
+    return S.bounded ? run<Trace, Bounded>(S, limit, trace) : run<Trace, Unbounded>(S, limit, trace);
+}
+
+// untraced run<>; the JIT's interpreter fallback
+u64 run_threaded(CPU& S, u64 limit);
+
+// run_threaded(), the thread's JitEngine (flushed first), a one-shot
+// PipeEngine or a plain execute() loop
+u64 run_engine(Engine e, CPU& S, u64 limit);
+
+// Runs `init` under step() and under `e` side by side, comparing the full
+// architectural state (R, RNONE scratch, PC, CC, STAT, nonzero memory) every
+// `chunk` instructions. Returns an empty string if both agree up to halt/limit,
+// otherwise a description of the first divergence.
+std::string diff_engine(Engine e, const CPU& init, u64 limit, u64 chunk = 1);
+
+const char* engine_name(Engine e);
+
+}  // namespace y86
@@ -0,0 +1,128 @@
+#pragma once
+#include "cpu.h"
+#include <vector>
+
+namespace y86 {
+
+// vector instructions used for the per-lane ALU work of an Ensemble
+enum class LaneIsa : u8 { Scalar, Avx2, Avx512 };
+
+// the widest one this host supports (Scalar off x86)
+LaneIsa best_lane_isa();
+bool lane_isa_supported(LaneIsa isa);
+const char* lane_isa_name(LaneIsa isa);
+// "scalar", "avx2" or "avx512"; false if unknown
+bool parse_lane_isa(const char* s, LaneIsa& out);
+
+// Lockstep ensemble: many copies ("lanes") of one loaded program, each with
+// its own inputs, registers, CC, PC and memory, run side by side.
+//
+// Registers, CC and PC are stored structure-of-arrays (one row of s64 per
+// register across lanes). Lanes at the same PC form a group that fetches
+// and decodes once per instruction; OPq, irmovq, rrmovq/cmovXX, the
+// condition tests of jXX and the PC updates then run as one masked vector
+// operation over the group, while memory instructions walk its lanes.
+// When a branch or ret sends lanes to different PCs the group ends and the
+// lanes are regrouped by smallest PC first, so paths that join again run
+// together again.
+//
+// Instructions are decoded from the base image. A lane that stores into
+// bytes that were decoded (or whose own bytes there differ from the image)
+// leaves lockstep for good and runs alone under run<> (engine.h).
+//
+// Every lane ends in exactly the state, step count and RNONE scratch that
+// running step() on its own inputs gives.
+class Ensemble {
+public:
+    // `lanes` copies of `base`; memory is shared copy-on-write with the
+    // paged backend. Every lane starts with the RNONE scratch base.scratch.
+    // An `isa` the host lacks falls back to best_lane_isa().
+    Ensemble(const CPU& base, std::size_t lanes, LaneIsa isa = best_lane_isa());
+
+    std::size_t size() const { return n_; }
+    LaneIsa isa() const { return isa_; }
+
+    // per-lane inputs, set before (or between) run()s. write8() is
+    // CPU::write8() on the lane's memory and returns false out of bounds.
+    void set_reg(std::size_t lane, int r, s64 v) { row(r)[lane] = v; }
+    void set_pc(std::size_t lane, u64 pc) { pc_[lane] = pc; }
+    bool write8(std::size_t lane, u64 addr, u64 v);
+
+    // Runs every lane until it leaves AOK or has executed `limit` more
+    // instructions (like run_auto() per lane); returns the total over lanes.
+    u64 run(u64 limit);
+
+    s64 reg(std::size_t lane, int r) const { return row(r)[lane]; }
+    s64 scratch(std::size_t lane) const { return row(RNONE)[lane]; }
+    u64 pc(std::size_t lane) const { return pc_[lane]; }
+    CC cc(std::size_t lane) const {
+        return CC{(int)zf_[lane], (int)sf_[lane], (int)of_[lane]};
+    }
+    Stat stat(std::size_t lane) const { return stat_[lane]; }
+    // instructions the lane has executed since construction
+    u64 steps(std::size_t lane) const { return steps_[lane]; }
+    // the lane's complete state as a CPU (memory shared copy-on-write)
+    void extract(std::size_t lane, CPU& out) const;
+
+    struct Stats {
+        u64 group_insns = 0;  // instructions fetched once for a whole group
+        u64 lane_insns = 0;   // of all lanes in lockstep
+        u64 regroups = 0;
+        u64 divergences = 0;  // branches/rets that split a group
+        u64 detached = 0;     // lanes that left lockstep (self-modifying code)
+        u64 solo_insns = 0;   // executed by detached lanes
+    };
+    const Stats& stats() const { return stats_; }
+
+private:
+    enum class Lane : u8 { Live, Done, Solo };
+
+    s64* row(int r) { return r_.data() + (std::size_t)r * w_; }
+    const s64* row(int r) const { return r_.data() + (std::size_t)r * w_; }
+
+    // picks the lanes at the smallest live PC; false when none is left
+    bool regroup();
+    // runs the current group until it ends; writes back steps and PC
+    void run_group();
+    const Decoded* fetch(u64 pc);
+    // marks the aligned qwords of [pc, end) as code; lanes whose bytes
+    // there differ from the image leave lockstep
+    void note_code(u64 pc, u64 end);
+    bool is_code(u64 a, u64 len) const;
+    void store(std::size_t lane, u64 a, u64 v);
+    // lane leaves the group having executed this instruction, at `pc`
+    void leave(std::size_t lane, u64 pc);
+    void fail(std::size_t lane, Stat s);
+    // drops lanes that left from idx_
+    void compact();
+    void detach(std::size_t lane);
+    void run_solo(std::size_t lane, u64 limit);
+
+    std::size_t n_ = 0, w_ = 0;  // lanes, row width (padded to 8)
+    LaneIsa isa_;
+    std::vector<s64> r_;  // 16 rows of w_: registers, then the RNONE scratch
+    std::vector<u64> pc_, zf_, sf_, of_;
+    std::vector<u64> sel_, cnd_;  // group / taken masks, ~0 or 0 per lane
+    std::vector<Stat> stat_;
+    std::vector<Lane> state_;
+    std::vector<u64> steps_, end_;
+    std::vector<CPU> mem_;  // per-lane memory; R/PC/CC there are unused
+
+    bool icache_ = true;  // base's setting, for detached and extracted lanes
+    CPU code_;  // the image instructions are decoded from, with its cache
+    std::vector<u64> code_qwords_;  // addr >> 3, sorted
+    u64 code_filter_[64]{};         // hashed bitmap in front of it
+
+    // current group
+    std::vector<u32> idx_;
+    std::size_t lo_ = 0, hi_ = 0;  // lane range covering it, multiples of 8
+    u64 gpc_ = 0, wait_pc_ = 0;    // its PC, the smallest PC outside it
+    u64 budget_ = 0, gsteps_ = 0;  // instructions it may run / has run
+    bool split_ = false;           // lanes' PCs already written (diverged)
+    bool left_ = false;            // some lane left, idx_ needs compact()
+    std::vector<u32> detach_;      // lanes that stored into code
+
+    Stats stats_;
+};
+
+}  // namespace y86
@@ -0,0 +1,157 @@
+#pragma once
+#include "cpu.h"
+#include "debug.h"
+#include "icache.h"
+#include "types.h"
+#include "worker.h"
+#include <deque>
+#include <vector>
+
+namespace y86 {
+
+// Execution history for stepping and running backwards.
+//
+// As a policy for run<> (engine.h) it records one undo entry per executed
+// instruction (old PC and CC, at most two old register values, the RNONE
+// scratch counting as one, and the old qword under a store) in a ring of `undo_steps` entries, and takes a
+// CPU::checkpoint() every `checkpoint_every` steps, keeping the newest
+// `max_checkpoints`. Memory use is therefore bounded by the ring plus the
+// pages the kept checkpoints pin.
+//
+// Going back d steps applies d undo entries while they last; further back
+// it restores the closest earlier checkpoint and replays forward from it,
+// which refills the ring. Either way the cost is O(d + checkpoint_every),
+// independent of how long the program has run. Going back discards the
+// future: running forward again records it anew.
+//
+// A Debugger set with set_debugger() stops recorded runs like a plain
+// run<Debugger> and is used by reverse_continue().
+class History {
+public:
+    static constexpr bool per_step = true;
+    static constexpr bool profile = true;
+    static constexpr bool stops = true;
+    static constexpr bool stores = true;
+
+    struct Config {
+        std::size_t undo_steps = 1 << 18;  // rounded up to a power of two
+        u64 checkpoint_every = 1 << 16;
+        std::size_t max_checkpoints = 32;
+    };
+
+    History() : History(Config{}) {}
+    explicit History(const Config& cfg);
+
+    // start over from S, counted as step `now`; required before recording
+    void reset(const CPU& S, u64 now = 0);
+    void set_debugger(Debugger* dbg) { dbg_ = dbg; }
+
+    // step count of the current state and the earliest one reachable
+    u64 now() const { return now_; }
+    u64 oldest() const;
+
+    // Moves S back n steps, fewer if history runs out; returns how many.
+    u64 step_back(CPU& S, u64 n);
+    // Puts S in the state of step t, oldest() <= t <= now().
+    bool seek(CPU& S, u64 t);
+    // Moves S back until it is at a breakpoint of `dbg`, or just before a
+    // store to a write watchpoint, at most `max` steps; returns how many.
+    // dbg.hit() tells whether and why it stopped. Read watchpoints are not
+    // seen, since only stores are logged.
+    u64 reverse_continue(CPU& S, Debugger& dbg, u64 max = ~u64(0));
+
+    // hooks from run<>; the per-instruction ones are inline
+    void insn(u64 pc, const Decoded& d) {
+        // copied: a store in this instruction may evict `d` from the decode cache
+        pc_ = pc;
+        rA_ = d.rA;
+        rB_ = d.rB;
+        decoded_ = true;
+        if (dbg_) dbg_->insn(pc, d);
+    }
+    void mem(u64 addr, bool write) {
+        if (dbg_) dbg_->mem(addr, write);
+    }
+    void branch(bool) {}
+    void call(u64, u64) {}
+    void ret(u64) {}
+    void store(const CPU& S, u64 addr) {
+        store_addr_ = addr;
+        store_old_ = S.read8_unchecked(addr);
+        stored_ = true;
+    }
+    void step(const CPU& S) {
+        Undo& u = ring_[head_];
+        // an instruction that failed to decode changed nothing but STAT
+        u.pc = decoded_ ? pc_ : S.PC;
+        u.cc = pack_cc(prev_cc_);
+        u.reg[0] = u.reg[1] = NO_REG;
+        if (decoded_) {
+            // only rA, rB and %rsp can change, and at most two of them;
+            // run<> syncs the RNONE scratch before calling step()
+            int k = 0;
+            for (u8 r : {rA_, rB_, (u8)4}) {
+                s64 v = r == RNONE ? S.scratch : S.R[r];
+                if (v == prev_R_[r] || k == 2) continue;
+                u.reg[k] = r;
+                u.old_reg[k++] = prev_R_[r];
+                prev_R_[r] = v;
+            }
+        }
+        u.has_mem = stored_;
+        u.addr = store_addr_;
+        u.old_mem = store_old_;
+        prev_cc_ = S.cc;
+        decoded_ = stored_ = false;
+        head_ = (head_ + 1) & (ring_.size() - 1);
+        if (count_ < ring_.size()) ++count_;
+        if (++now_ - saved_.back().step >= cfg_.checkpoint_every) save(S);
+    }
+    void end(const CPU& S, u64 n);
+    bool check(u64 pc) const { return dbg_ && dbg_->check(pc); }
+    bool stop(const CPU& S);
+
+private:
+    static constexpr u8 NO_REG = 0xFF;  // RNONE names the scratch here
+
+    struct Undo {
+        u64 pc = 0;
+        u64 addr = 0;      // store address, if has_mem
+        u64 old_mem = 0;
+        s64 old_reg[2] = {};
+        u8 reg[2] = {NO_REG, NO_REG};
+        u8 cc = 0;         // ZF | SF << 1 | OF << 2
+        bool has_mem = false;
+    };
+    struct Saved {
+        u64 step;
+        Checkpoint cp;
+    };
+
+    static u8 pack_cc(const CC& cc) { return (u8)(cc.ZF | cc.SF << 1 | cc.OF << 2); }
+    void save(const CPU& S);
+    void undo_one(CPU& S, Undo& u);
+    // take S as the state before the next instruction
+    void track(const CPU& S);
+    // restore a checkpoint at or before step `t` and replay up to `t`
+    bool rebuild(CPU& S, u64 t, bool refill);
+
+    Config cfg_;
+    Debugger* dbg_ = nullptr;
+
+    std::vector<Undo> ring_;
+    std::size_t head_ = 0, count_ = 0;
+    std::deque<Saved> saved_;
+    u64 now_ = 0;
+
+    // state before the current instruction; prev_R_[RNONE] is the scratch
+    s64 prev_R_[REG_NUM + 1] = {};
+    CC prev_cc_{};
+    u64 pc_ = 0;
+    u8 rA_ = RNONE, rB_ = RNONE;
+    bool decoded_ = false;
+    bool stored_ = false;
+    u64 store_addr_ = 0, store_old_ = 0;
+};
+
+}  // namespace y86
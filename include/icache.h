@@ -0,0 +1,98 @@
+#pragma once
+#include "types.h"
+#include <vector>
+
+namespace y86 {
+
+struct Decoded {
+    u8 icode = 0, ifun = 0, rA = RNONE, rB = RNONE;
+    u64 valC = 0, valP = 0;
+    bool ok = true;
+};
+
+// Direct-mapped cache of decoded instructions keyed by PC.
+//
+// Every cached instruction marks the 64-byte lines its bytes occupy in a
+// small line filter; a store that hits a marked line drops exactly the
+// cached instructions overlapping the stored bytes, so self-modifying code
+// re-decodes. Stores elsewhere cost one bit test.
+class DecodeCache {
+public:
+    static constexpr std::size_t SIZE = 4096;
+    static constexpr unsigned LINE_BITS = 6;
+    static constexpr std::size_t FILTER_BITS = 4096;
+    static constexpr u64 MAX_INSN_LEN = 10;
+
+    bool enabled = true;
+    u64 hits = 0, misses = 0, invalidations = 0;
+
+    const Decoded* lookup(u64 pc) {
+        // ~0 tags empty slots; no instruction decodes there (fetch is ADR)
+        if (!ents_.empty() && pc != EMPTY) {
+            const Entry& e = ents_[pc & (SIZE - 1)];
+            if (e.pc == pc) {
+                ++hits;
+                return &e.d;
+            }
+        }
+        ++misses;
+        return nullptr;
+    }
+
+    void insert(u64 pc, const Decoded& d) {
+        if (ents_.empty()) ents_.resize(SIZE);
+        Entry& e = ents_[pc & (SIZE - 1)];
+        e.pc = pc;
+        e.d = d;
+        for (u64 l = pc >> LINE_BITS; l <= (d.valP - 1) >> LINE_BITS; ++l) mark(l);
+        any_ = true;
+    }
+
+    // called for every store of len bytes at a
+    void on_write(u64 a, u64 len) {
+        if (!any_) return;
+        u64 first = a >> LINE_BITS, last = (a + len - 1) >> LINE_BITS;
+        for (u64 l = first; l <= last; ++l) {
+            if (marked(l)) {
+                invalidate(a, len);
+                return;
+            }
+        }
+    }
+
+    void flush() {
+        for (auto& e : ents_) e.pc = EMPTY;
+        for (auto& w : filter_) w = 0;
+        any_ = false;
+    }
+
+private:
+    static constexpr u64 EMPTY = ~0ULL;
+    struct Entry {
+        u64 pc = EMPTY;
+        Decoded d;
+    };
+
+    void mark(u64 line) { filter_[(line / 64) % (FILTER_BITS / 64)] |= 1ULL << (line % 64); }
+    bool marked(u64 line) const {
+        return filter_[(line / 64) % (FILTER_BITS / 64)] >> (line % 64) & 1;
+    }
+
+    // drop cached instructions whose bytes overlap [a, a+len)
+    void invalidate(u64 a, u64 len) {
+        u64 lo = a >= MAX_INSN_LEN - 1 ? a - (MAX_INSN_LEN - 1) : 0;
+        for (u64 pc = lo; pc < a + len; ++pc) {
+            Entry& e = ents_[pc & (SIZE - 1)];
+            if (e.pc == pc && e.d.valP > a) {
+                e.pc = EMPTY;
+                ++invalidations;
+            }
+        }
+    }
+
+    std::vector<Entry> ents_;
+    u64 filter_[FILTER_BITS / 64]{};
+    bool any_ = false;
+};
+
+}  // namespace y86
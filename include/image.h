@@ -0,0 +1,66 @@
+#pragma once
+#include "cpu.h"
+#include <string>
+#include <vector>
+
+namespace y86 {
+
+// A loaded program independent of its text form: the stores a .yo file
+// performs, in order, plus the state load_yo() derives from it.
+struct ProgramImage {
+    struct Segment {
+        u64 addr = 0;
+        std::vector<u8> bytes;
+    };
+    u64 entry = 0;    // initial PC
+    u64 maxaddr = 0;  // highest loaded byte; mem_upper = maxaddr + slack
+    bool bounded = false;
+    u64 slack = 65536;
+    std::vector<Segment> segments;  // applied in order, later ones win
+};
+
+// .ybin layout (all fields little-endian u64 unless noted):
+//   header   magic "Y86BIN\0\0", u32 version, u32 flags (bit 0: bounded),
+//            entry, maxaddr, slack, segment count, source hash, reserved
+//   table    per segment: addr, len, file offset of the bytes
+//   data     segment bytes, each run starting 8-byte aligned
+// Loading maps the file and stores each segment straight from the mapping.
+namespace ybin {
+constexpr char MAGIC[8] = {'Y', '8', '6', 'B', 'I', 'N', 0, 0};
+constexpr u32 VERSION = 1;
+constexpr std::size_t HEADER_SIZE = 64;
+constexpr std::size_t SEGMENT_SIZE = 24;
+}  // namespace ybin
+
+ProgramImage image_from_yo(const char* p, std::size_t n, bool bound = false,
+                           std::uint64_t slack = 65536);
+void apply_image(const ProgramImage& img, CPU& cpu);
+
+bool is_ybin(const void* p, std::size_t n);
+// `src_hash` identifies the .yo the image was built from (0 if none)
+std::vector<u8> encode_ybin(const ProgramImage& img, u64 src_hash = 0);
+bool load_ybin_buffer(const void* p, std::size_t n, CPU& cpu, std::string* err = nullptr);
+bool write_ybin_file(const std::string& path, const ProgramImage& img, u64 src_hash,
+                     std::string* err = nullptr);
+
+// 64-bit content hash used to key cached images
+u64 content_hash(const void* p, std::size_t n);
+
+struct LoadOptions {
+    // serve a .yo from path + ".ybin" when that image was built from
+    // identical source bytes, (re)writing it otherwise (files only)
+    bool cache = false;
+    // bound memory at the highest loaded byte + slack (CPU::mem_upper)
+    bool bound = false;
+    u64 slack = 65536;
+};
+
+// Load a .yo or .ybin (detected by magic) from memory, a path or a
+// descriptor. opt.cache only applies to paths.
+bool load_program_buffer(const char* p, std::size_t n, CPU& cpu, const LoadOptions& opt = {},
+                         std::string* err = nullptr);
+bool load_program_file(const std::string& path, CPU& cpu, const LoadOptions& opt = {},
+                       std::string* err = nullptr);
+bool load_program_fd(int fd, CPU& cpu, const LoadOptions& opt = {}, std::string* err = nullptr);
+
+}  // namespace y86
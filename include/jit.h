@@ -0,0 +1,64 @@
+#pragma once
+#include "cpu.h"
+#include <memory>
+
+namespace y86 {
+
+// Basic-block translator from Y86-64 to host x86-64.
+//
+// Blocks start at the current PC and run up to the next jXX/call/ret (at
+// most MAX_BLOCK instructions). Guest registers live in a state block
+// addressed through a callee-saved host register; CC is kept in host
+// EFLAGS after an OPq and only spilled when a helper call or block exit
+// needs it. Direct successors are chained by patching the exit jump once
+// the target is translated. Memory accesses call back into CPU::read8 /
+// CPU::write8_unindexed, so bounds, the decode cache and the nonzero index
+// behave as in the untraced interpreter.
+//
+// halt, invalid instructions, faulting accesses and the tail of a run that
+// does not fit the remaining budget are executed by execute()/step()
+// semantics; a store into translated code ends the block and flushes all
+// translations. The resulting CPU state is identical to the interpreter.
+//
+// The code buffer is mapped on the first run(), sized from the guest's
+// memory footprint, and grows when it fills up. It is writable only while
+// blocks are translated or patched and read/execute while they run (W^X).
+//
+// Only available on x86-64 Linux/macOS; elsewhere (or if executable memory
+// cannot be mapped) run() uses run_threaded().
+class JitEngine {
+public:
+    static constexpr int MAX_BLOCK = 64;
+
+    struct Stats {
+        u64 blocks = 0;       // blocks translated
+        u64 chained = 0;      // exit jumps patched to another block
+        u64 entries = 0;      // dispatcher -> native transitions
+        u64 interpreted = 0;  // instructions executed by the fallback
+        u64 flushes = 0;      // translation cache flushes
+    };
+
+    JitEngine();
+    ~JitEngine();
+    JitEngine(const JitEngine&) = delete;
+    JitEngine& operator=(const JitEngine&) = delete;
+
+    // same contract as run_threaded(); translations persist across calls,
+    // so keep one engine per CPU/program
+    u64 run(CPU& S, u64 limit);
+    void flush();
+
+    // this thread's engine, kept for the thread's lifetime so one-shot
+    // runs do not map a buffer each; flush() it before a new program
+    static JitEngine& for_thread();
+
+    const Stats& stats() const;
+    static bool available();
+
+    struct Impl;
+
+private:
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace y86
@@ -0,0 +1,134 @@
+#pragma once
+#include "types.h"
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+namespace y86 {
+
+// Sparse paged memory: 4 KiB pages allocated on first write, looked up
+// through a small direct-mapped cache in front of the page table.
+// Unwritten bytes read as zero and never allocate.
+//
+// Copies share pages copy-on-write: copying costs one reference per page,
+// and a shared page is duplicated on the first write through either copy.
+// The lookup cache only lets writes through to pages known to be private,
+// so the write fast path stays a tag compare.
+//
+// Not thread-safe, not even for const access: reads fill the lookup cache
+// and copying flushes the source's. Only one thread at a time may read,
+// write or copy a given PagedMem, and so a CPU or Checkpoint holding it. A
+// finished copy is a separate object and may be handed to another thread.
+class PagedMem {
+public:
+    static constexpr unsigned PAGE_BITS = 12;
+    static constexpr u64 PAGE_SIZE = 1ULL << PAGE_BITS;
+    static constexpr u64 PAGE_MASK = PAGE_SIZE - 1;
+
+    struct Page {
+        u8 bytes[PAGE_SIZE]{};
+    };
+
+    PagedMem() = default;
+    PagedMem(const PagedMem& o);
+    PagedMem(PagedMem&& o) noexcept;
+    PagedMem& operator=(const PagedMem& o);
+    PagedMem& operator=(PagedMem&& o) noexcept;
+
+    u8 read1(u64 a) const {
+        const Page* p = find(a >> PAGE_BITS);
+        return p ? p->bytes[a & PAGE_MASK] : 0;
+    }
+
+    void write1(u64 a, u8 v) { touch(a >> PAGE_BITS)->bytes[a & PAGE_MASK] = v; }
+
+    u64 read8(u64 a) const {
+        u64 off = a & PAGE_MASK;
+        if (off <= PAGE_SIZE - 8) {
+            const Page* p = find(a >> PAGE_BITS);
+            return p ? load_le64(p->bytes + off) : 0;
+        }
+        return read8_split(a);
+    }
+
+    void write8(u64 a, u64 v) {
+        u64 off = a & PAGE_MASK;
+        if (off <= PAGE_SIZE - 8) {
+            store_le64(touch(a >> PAGE_BITS)->bytes + off, v);
+            return;
+        }
+        write8_split(a, v);
+    }
+
+    // bulk store of n bytes, one page lookup per page touched
+    void write_bytes(u64 a, const u8* src, std::size_t n);
+
+    // page number -> page, nullptr if the page was never written; updates
+    // the (mutable) lookup cache
+    const Page* find(u64 pn) const {
+        Slot& s = tlb_[pn & (TLB_SIZE - 1)];
+        if (s.pn == pn) return s.page;
+        auto it = table_.find(pn);
+        if (it == table_.end()) return nullptr;
+        s.pn = pn;
+        s.page = it->second.get();
+        s.writable = it->second.use_count() == 1;
+        return s.page;
+    }
+
+    bool empty() const { return table_.empty(); }
+    std::size_t page_count() const { return table_.size(); }
+    // pages currently shared with another copy
+    std::size_t shared_pages() const;
+    void clear();
+
+    // f(page_number, const Page&) for every allocated page, unordered
+    template <class F>
+    void for_each_page(F&& f) const {
+        for (auto& kv : table_) f(kv.first, *kv.second);
+    }
+
+    static u64 load_le64(const u8* p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        u64 v;
+        std::memcpy(&v, p, 8);
+        return v;
+#else
+        u64 v = 0;
+        for (int i = 0; i < 8; i++) v |= (u64)p[i] << (8 * i);
+        return v;
+#endif
+    }
+
+    static void store_le64(u8* p, u64 v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        std::memcpy(p, &v, 8);
+#else
+        for (int i = 0; i < 8; i++) p[i] = (u8)(v >> (8 * i));
+#endif
+    }
+
+private:
+    static constexpr std::size_t TLB_SIZE = 64;
+    struct Slot {
+        u64 pn = ~0ULL;
+        Page* page = nullptr;
+        bool writable = false;  // page is not shared
+    };
+
+    Page* touch(u64 pn) {
+        Slot& s = tlb_[pn & (TLB_SIZE - 1)];
+        if (s.pn == pn && s.writable) return s.page;
+        return touch_slow(s, pn);
+    }
+
+    Page* touch_slow(Slot& s, u64 pn);
+    void flush_tlb() const;
+    u64 read8_split(u64 a) const;
+    void write8_split(u64 a, u64 v);
+
+    std::unordered_map<u64, std::shared_ptr<Page>> table_;
+    mutable Slot tlb_[TLB_SIZE];
+};
+
+}  // namespace y86
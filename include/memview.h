@@ -0,0 +1,62 @@
+#pragma once
+#include "cpu.h"
+#include <unordered_map>
+#include <vector>
+
+namespace y86 {
+
+// Scrollable window over CPU::qword_nonzero() for interactive frontends.
+//
+// The window is anchored at an address rather than a row number, so
+// scrolling by k rows, jumping to an address and materializing a page cost
+// O(log n + k + rows) whatever the size of guest memory. Recently changed
+// qwords are picked up from CPU::dirty_ring on every refresh (at most
+// DIRTY_RING entries, so only the last changes before a refresh are seen
+// when many happened in between) and reported with their age in refreshes.
+// After CPU::restore() or drop_index() the ring no longer tells what
+// changed, and that refresh highlights nothing new.
+//
+// Not thread-safe; only the thread that currently owns the CPU may call
+// scroll()/jump()/refresh().
+class MemView {
+public:
+    // refreshes a write stays highlighted
+    static constexpr u32 HOT_REFRESHES = 8;
+    static constexpr u32 COLD = ~0u;
+
+    struct Row {
+        u64 addr = 0;
+        s64 value = 0;
+        u32 age = COLD;  // refreshes since the last change, 0 = since the previous refresh
+    };
+
+    explicit MemView(std::size_t rows = 20) : rows_(rows) {}
+
+    // forget position and write history, e.g. after loading a program
+    void reset(const CPU& S);
+    void set_rows(std::size_t rows) { rows_ = rows; }
+
+    // move the window by `delta` rows, stopping at the first/last row
+    void scroll(const CPU& S, long delta);
+    // put the first nonzero qword at or after align8(addr) at the top (the
+    // last one if there is none)
+    void jump(const CPU& S, u64 addr);
+
+    // visible rows into `out`, after taking in writes since the last call
+    void refresh(const CPU& S, std::vector<Row>& out);
+
+    u64 top() const { return top_; }
+    // number of nonzero qwords, for a position indicator
+    std::size_t total(const CPU& S) const { return S.qword_nonzero().size(); }
+
+private:
+    void take_writes(const CPU& S);
+
+    std::size_t rows_;
+    u64 top_ = 0;
+    u64 seq_ = 0;    // CPU::dirty_seq already taken in
+    u64 clock_ = 0;  // refresh count
+    std::unordered_map<u64, u64> written_;  // qword base -> refresh of its last change
+};
+
+}  // namespace y86
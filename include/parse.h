@@ -0,0 +1,13 @@
+#pragma once
+#include "types.h"
+#include <string>
+
+namespace y86 {
+
+// Numbers in command-line options and specs (src/parse.cpp).
+
+// decimal, or hex with 0x; a leading 0 is not octal. No sign or blanks;
+// false if `s` is not such a number or does not fit in 64 bits
+bool parse_u64(const std::string& s, u64& out);
+
+}  // namespace y86
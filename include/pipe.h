@@ -0,0 +1,73 @@
+#pragma once
+#include "cpu.h"
+#include <string>
+#include <nlohmann/json.hpp>
+
+namespace y86 {
+
+class BranchPredictor;
+class CacheModel;
+
+// Cycle-level model of the five-stage Y86-64 PIPE processor.
+//
+// F/D/E/M/W pipeline registers advance once per cycle under the PIPE
+// control logic: operands are forwarded from E, M and W; a load/use pair
+// stalls F and D for one cycle; jXX is predicted taken (or by an attached
+// BranchPredictor, trained when the branch resolves in E) and a
+// misprediction resolved in E cancels the two instructions behind it; ret
+// stalls fetch until the return address is read in M. Registers are
+// written in W and memory in M, exceptions take effect when the faulting
+// instruction retires. A store that overwrites an instruction already
+// fetched squashes D/E and refetches after the store.
+//
+// With a CacheModel attached, every fetch and data access also goes
+// through it and any latency beyond an L1 hit stalls the whole pipeline
+// (a blocking cache), counted in Stats::mem_stalls.
+//
+// Semantics follow step() exactly, including the RNONE scratch register,
+// %rsp as base when rB is RNONE and %rsp being updated by a faulting
+// call/pushq, so the architectural state after n retirements equals n
+// execute() steps. Each run() starts with an empty pipeline.
+class PipeEngine {
+public:
+    struct Stats {
+        u64 cycles = 0;
+        u64 retired = 0;
+        u64 load_use = 0;            // stall cycles (bubble into E)
+        u64 branches = 0;            // jXX resolved in E
+        u64 mispredicts = 0;         // each costs two bubbles
+        u64 rets = 0;                // each costs three bubbles
+        u64 ret_bubbles = 0;
+        u64 smc_flushes = 0;         // squashes after a store into fetched code
+        u64 mem_stalls = 0;          // cycles waiting on the cache model
+        double cpi() const { return retired ? (double)cycles / (double)retired : 0.0; }
+        nlohmann::json to_json() const;
+    };
+
+    // same contract as run_threaded(): runs until an instruction retires
+    // with a non-AOK status or `limit` instructions have retired
+    u64 run(CPU& S, u64 limit);
+
+    // When set, every retirement also steps `ref` with execute() and
+    // compares registers, CC, STAT and PC; the first difference ends the
+    // run and is kept in mismatch().
+    void check_against(CPU* ref) { ref_ = ref; }
+    const std::string& mismatch() const { return mismatch_; }
+
+    // fetches and data accesses also drive `c` (not owned); null detaches
+    void set_cache(CacheModel* c) { cache_ = c; }
+    // conditional jXX direction comes from `p` (not owned) instead of
+    // always-taken; null restores always-taken
+    void set_predictor(BranchPredictor* p) { pred_ = p; }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    Stats stats_;
+    CPU* ref_ = nullptr;
+    CacheModel* cache_ = nullptr;
+    BranchPredictor* pred_ = nullptr;
+    std::string mismatch_;
+};
+
+}  // namespace y86
@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace y86 {
+
+// Runs f(i, worker) for every i in [0, n) on `threads` workers.
+//
+// Each worker owns a deque seeded round-robin with task indices. It pops
+// from the back of its own deque and, once that is empty, steals from the
+// front of the others, so a few long programs do not leave the remaining
+// cores idle. No tasks are added after start, so a worker may exit as soon
+// as one full sweep finds every deque empty.
+template <class F>
+void parallel_for_stealing(std::size_t n, unsigned threads, F&& f) {
+    if (n == 0) return;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<std::size_t>(threads, n);
+
+    struct alignas(64) Queue {
+        std::mutex m;
+        std::deque<std::size_t> q;
+    };
+    std::unique_ptr<Queue[]> qs(new Queue[threads]);
+    for (std::size_t i = 0; i < n; i++) qs[i % threads].q.push_back(i);
+
+    auto work = [&](unsigned id) {
+        for (;;) {
+            std::size_t task = 0;
+            bool got = false;
+            {
+                std::lock_guard<std::mutex> lk(qs[id].m);
+                if (!qs[id].q.empty()) {
+                    task = qs[id].q.back();
+                    qs[id].q.pop_back();
+                    got = true;
+                }
+            }
+            for (unsigned k = 1; !got && k < threads; k++) {
+                Queue& v = qs[(id + k) % threads];
+                std::lock_guard<std::mutex> lk(v.m);
+                if (!v.q.empty()) {
+                    task = v.q.front();
+                    v.q.pop_front();
+                    got = true;
+                }
+            }
+            if (!got) return;
+            f(task, id);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) pool.emplace_back(work, t);
+    work(0);
+    for (auto& t : pool) t.join();
+}
+
+}  // namespace y86
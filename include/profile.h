@@ -0,0 +1,131 @@
+#pragma once
+#include "icache.h"
+#include "types.h"
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace y86 {
+
+class CPU;
+
+// Symbol names by address, e.g. the "label:" comments of a .yo listing.
+using Symbols = std::map<u64, std::string>;
+Symbols yo_symbols(const char* p, std::size_t n);
+
+// Profiling policy for run<> (engine.h): per-PC execution counts, an
+// icode/ifun histogram, taken/not-taken counts per jXX and cmovXX, call
+// and ret edges, and a shadow call stack. Instructions are attributed to
+// the current stack, which write_folded() emits in the folded format read
+// by flamegraph.pl, inferno and speedscope.
+//
+// The hooks run on every instruction, so lookups go through an open
+// addressing table and the per-stack counters are a flat vector indexed by
+// a call-tree node id; only call/ret touch the tree.
+class Profiler {
+public:
+    static constexpr bool per_step = false;
+    static constexpr bool profile = true;
+    // deeper calls are folded into the frame at this depth
+    static constexpr std::size_t MAX_DEPTH = 256;
+
+    Profiler();
+
+    void step(const CPU&) {}
+    void end(const CPU& S, u64 n);
+
+    // hooks from run<>: insn() for every fetched instruction, then at most
+    // one of branch()/call()/ret() for that instruction; mem() is unused
+    void insn(u64 pc, const Decoded& d) {
+        ++hist_[(d.icode << 4) | d.ifun];
+        ++self_[node_];
+        u32 i = pcs_.find({pc, 0});
+        if (i == NONE) i = new_pc(pc, d);
+        cur_ = i;
+        ++pc_[i].count;
+    }
+    void mem(u64, bool) {}
+    void branch(bool taken) { ++(taken ? pc_[cur_].taken : pc_[cur_].not_taken); }
+    void call(u64 target, u64 ret_addr);
+    void ret(u64 target);
+
+    u64 instructions() const { return steps_; }
+
+    // summary: totals, icode/ifun histogram, per-PC counts (hottest first),
+    // call/ret edges and per-function self/total counts
+    nlohmann::json summary(const Symbols& syms = {}) const;
+    // one "frame;frame;... count" line per call stack with own instructions
+    void write_folded(std::ostream& out, const Symbols& syms = {}) const;
+
+private:
+    static constexpr u32 NONE = ~0u;
+
+    // (u64, u64) -> dense index, linear probing, never shrinks
+    class Index {
+    public:
+        using Key = std::pair<u64, u64>;
+        Index();
+        u32 find(const Key& k) const {
+            for (std::size_t h = slot(k);; h = (h + 1) & mask_) {
+                const Slot& s = slots_[h];
+                if (s.idx == NONE || s.key == k) return s.idx;
+            }
+        }
+        void insert(const Key& k, u32 idx);
+
+    private:
+        struct Slot {
+            Key key{};
+            u32 idx = NONE;
+        };
+        std::size_t slot(const Key& k) const {
+            return (std::size_t)((k.first * 0x9E3779B97F4A7C15ULL ^ k.second * 0xC2B2AE3D27D4EB4FULL) >>
+                                 shift_) & mask_;
+        }
+        std::vector<Slot> slots_;
+        std::size_t mask_ = 0, used_ = 0;
+        unsigned shift_ = 0;
+    };
+
+    struct PcStat {
+        u64 pc = 0, count = 0, taken = 0, not_taken = 0;
+        u64 target = 0;  // call destination
+        u8 icode = 0, ifun = 0;
+    };
+    struct Node {
+        u32 parent = NONE;
+        u64 fn = 0;  // entry PC of the function
+    };
+    struct Frame {
+        u32 node;
+        u64 ret_addr;
+    };
+
+    u32 new_pc(u64 pc, const Decoded& d);
+    std::string frame_name(u64 fn, const Symbols& syms) const;
+
+    u64 hist_[256] = {};
+    std::vector<PcStat> pc_;
+    Index pcs_;
+    u32 cur_ = 0;
+
+    std::vector<Node> nodes_;
+    std::vector<u64> self_;  // instructions per call-tree node
+    Index children_;         // (parent node, callee) -> node
+    std::vector<Frame> stack_;
+    u32 node_ = 0;
+    u64 overflow_ = 0;  // calls beyond MAX_DEPTH not yet returned
+    bool rooted_ = false;
+
+    std::vector<std::pair<u64, u64>> ret_edges_;  // (ret PC, target)
+    std::vector<u64> ret_count_;
+    Index rets_;
+
+    u64 steps_ = 0;
+    Stat stat_ = Stat::AOK;
+};
+
+}  // namespace y86
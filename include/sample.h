@@ -0,0 +1,58 @@
+#pragma once
+#include "cpu.h"
+#include <algorithm>
+#include <string>
+
+namespace y86 {
+
+// Sampled execution: run untraced up to a trigger, then alternate between
+// skipping `skip` instructions untraced and running `len` under a detailed
+// policy (a trace writer or a statistics model), at most `windows` times.
+// Without a period (len == 0) everything after the trigger is one window.
+struct SampleSpec {
+    // trigger: after `start_count` instructions and then, if `start_at_pc`,
+    // the next time PC reaches `start_pc` (immediately if it is there)
+    u64 start_count = 0;
+    bool start_at_pc = false;
+    u64 start_pc = 0;
+    u64 skip = 0, len = 0;
+    u64 windows = ~u64(0);
+
+    // "SKIP:LEN[:COUNT]" for --sample and "N" or "pc:ADDR" for --start;
+    // numbers are decimal or 0x hex. false and *err set on bad input.
+    static bool parse_period(const std::string& s, SampleSpec& out, std::string* err = nullptr);
+    static bool parse_start(const std::string& s, SampleSpec& out, std::string* err = nullptr);
+};
+
+// runs untraced until PC == pc (checked after each instruction), S leaves
+// AOK or `limit` instructions have run; returns the count (src/sample.cpp)
+u64 run_to_pc(CPU& S, u64 pc, u64 limit);
+
+// Executes S under `spec` for at most `limit` instructions and returns how
+// many ran. fast(S, n) and detail(S, n) run up to n instructions and return
+// the count, like run_auto(); window(first, n) is told where each detailed
+// window started (in instructions executed) and how long it was.
+template <class Fast, class Detail, class Window>
+u64 run_sampled(CPU& S, u64 limit, const SampleSpec& spec, Fast&& fast, Detail&& detail,
+                Window&& window) {
+    auto live = [&](u64 n) { return n < limit && S.stat == Stat::AOK; };
+    u64 n = 0;
+    if (spec.start_count) n += fast(S, std::min(spec.start_count, limit));
+    if (spec.start_at_pc && live(n) && S.PC != spec.start_pc)
+        n += run_to_pc(S, spec.start_pc, limit - n);
+    if (spec.start_at_pc && S.PC != spec.start_pc) return n;  // never triggered
+    for (u64 w = 0; w < spec.windows && live(n); w++) {
+        if (spec.len && spec.skip) {
+            n += fast(S, std::min(spec.skip, limit - n));
+            if (!live(n)) break;
+        }
+        u64 want = spec.len ? std::min(spec.len, limit - n) : limit - n;
+        u64 first = n;
+        n += detail(S, want);
+        window(first, n - first);
+        if (!spec.len) break;
+    }
+    return n;
+}
+
+}  // namespace y86
@@ -0,0 +1,93 @@
+#pragma once
+#include "cpu.h"
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace y86 {
+
+// Buffered byte sink over a FILE*; flushes whenever the buffer fills.
+class OutBuf {
+public:
+    explicit OutBuf(std::FILE* f, std::size_t cap = 1 << 16);
+    ~OutBuf() { flush(); }
+    OutBuf(const OutBuf&) = delete;
+    OutBuf& operator=(const OutBuf&) = delete;
+
+    void put(char c) {
+        if (len_ == buf_.size()) flush();
+        buf_[len_++] = c;
+    }
+    void write(const char* p, std::size_t n);
+    void write(const std::string& s) { write(s.data(), s.size()); }
+    void put_str(const char* s) { write(s, std::strlen(s)); }
+    void put_int(std::int64_t v);
+    void flush();
+
+private:
+    std::FILE* f_;
+    std::vector<char> buf_;
+    std::size_t len_ = 0;
+};
+
+// Streams the per-step STAT/PC/CC/REG/MEM records as a JSON array,
+// byte-identical to building a json::array of step() logs and dump(2).
+class JsonTraceWriter {
+public:
+    explicit JsonTraceWriter(OutBuf& out) : out_(out) {}
+
+    void record(const CPU& S);
+    // closes the array; call once after the last record
+    void finish();
+
+private:
+    void sync_mem(const CPU& S);
+    void set_row(u64 base, const CPU& S);
+
+    OutBuf& out_;
+    std::size_t count_ = 0;
+    // MEM rows keyed by decimal address (dump() order); mem_text_ is the
+    // rendered block, reused verbatim while no qword changes
+    std::map<std::string, std::string> mem_rows_;
+    std::string mem_text_;
+    u64 mem_seq_ = 0;
+    bool mem_synced_ = false;
+};
+
+// The --final-only output of a run that was not traced: the state after
+// `steps` instructions as a one-record JSON array ("[]" if none ran), as
+// TraceFinal<JsonTraceWriter> (engine.h) writes it.
+void write_final_state(const CPU& S, u64 steps, OutBuf& out);
+
+// Delta trace: one compact JSON object per line. The first line is the
+// pre-execution state tagged "INIT"; every later line is one step and
+// carries PC and STAT plus only the CC bits, registers and qwords that
+// changed (a qword value of 0 means it was cleared). If the writer falls
+// too far behind the CPU's dirty ring it emits a complete state tagged
+// "FULL" instead.
+class DeltaTraceWriter {
+public:
+    explicit DeltaTraceWriter(OutBuf& out) : out_(out) {}
+
+    void begin(const CPU& S);
+    void record(const CPU& S);
+
+private:
+    void write_full(const CPU& S, const char* tag);
+    void remember(const CPU& S);
+
+    OutBuf& out_;
+    s64 regs_[REG_NUM]{};
+    CC cc_{};
+    u64 mem_seq_ = 0;
+    std::vector<u64> bases_;
+};
+
+// Expands a delta trace back into the full per-step JSON array that
+// JsonTraceWriter (and step() + dump(2)) produce. Throws on malformed input.
+void expand_delta_trace(std::istream& in, OutBuf& out);
+
+}  // namespace y86
@@ -1,19 +1,28 @@
 #pragma once
 #include "cpu.h"
 #include <istream>
+#include <string>
 
 namespace y86 {
 
+// .yo loaders (src/loader.cpp). The first "0x<addr>:" on a line gives its
+// address; PC starts at the lowest address seen. The fd/file variants mmap
+// regular files and read pipes in large chunks; they return false if the
+// input cannot be opened or read.
 void load_yo(std::istream& in, CPU& cpu, bool bound = false, std::uint64_t slack = 65536);
-
-struct Decoded {
-    u8 icode = 0, ifun = 0, rA = RNONE, rB = RNONE;
-    u64 valC = 0, valP = 0;
-    bool ok = true;
-};
+void load_yo_buffer(const char* p, std::size_t n, CPU& cpu, bool bound = false,
+                    std::uint64_t slack = 65536);
+bool load_yo_fd(int fd, CPU& cpu, bool bound = false, std::uint64_t slack = 65536);
+bool load_yo_file(const std::string& path, CPU& cpu, bool bound = false,
+                  std::uint64_t slack = 65536);
 
 bool cond_true(const CC& c, u8 ifun);
+// decode at S.PC; fetch_and_decode() goes through S.icache first
+Decoded decode_uncached(CPU& S);
 Decoded fetch_and_decode(CPU& S);
+// execute one instruction; step() additionally returns the post-state log
+void execute(CPU& S);
+nlohmann::json dump_state(const CPU& S);
 nlohmann::json step(CPU& S);
 
 }  // namespace y86
@@ -0,0 +1,100 @@
+#ifndef Y86_H
+#define Y86_H
+
+/* C interface to y86core, built as the shared library liby86 (src/capi.cpp).
+ *
+ * A y86_cpu is one simulated machine. Functions taking one are not thread
+ * safe for the same handle; distinct handles are independent. Pointers
+ * returned into a handle (registers, memory pages, strings) stay valid until
+ * the next call that runs, loads or destroys it. Errors never escape as
+ * C++ exceptions: failing calls return a negative value, NULL or 0 as
+ * documented below, and y86_error() describes the last failure. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define Y86_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define Y86_API __attribute__((visibility("default")))
+#else
+#define Y86_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped on incompatible changes to the functions below */
+#define Y86_API_VERSION 1
+
+/* STAT values, as in the JSON dumps */
+enum { Y86_AOK = 1, Y86_HLT = 2, Y86_ADR = 3, Y86_INS = 4 };
+
+/* y86_cc() bits */
+enum { Y86_ZF = 1, Y86_SF = 2, Y86_OF = 4 };
+
+#define Y86_REG_NUM 15
+#define Y86_PAGE_SIZE 4096
+
+typedef struct y86_cpu y86_cpu;
+
+/* Called after every executed instruction (including one that faults or
+ * halts) with the state fully updated; a nonzero return ends the run after
+ * that instruction. */
+typedef int (*y86_trace_fn)(const y86_cpu* cpu, void* user);
+
+Y86_API int y86_api_version(void);
+
+Y86_API y86_cpu* y86_create(void);
+Y86_API void y86_destroy(y86_cpu* cpu);
+
+/* Resets the machine and loads a .yo text or .ybin image (told apart by
+ * magic) from `len` bytes at `buf`. With `bound` nonzero, addresses past
+ * the highest loaded byte + 64 KiB fault like in y86sim --bound. Returns 0,
+ * or -1 on a malformed image. */
+Y86_API int y86_load(y86_cpu* cpu, const void* buf, size_t len, int bound);
+
+/* Executes until the machine leaves AOK, `limit` instructions have been
+ * attempted or the trace callback asks to stop; returns the instructions
+ * executed. y86_run_to_halt() has no limit. Both return 0 and set
+ * y86_error() if memory runs out. */
+Y86_API uint64_t y86_run(y86_cpu* cpu, uint64_t limit);
+Y86_API uint64_t y86_run_to_halt(y86_cpu* cpu);
+
+/* Installs (or with fn == NULL removes) the trace callback. Runs with a
+ * callback take the per-step path and are several times slower. */
+Y86_API void y86_set_trace(y86_cpu* cpu, y86_trace_fn fn, void* user);
+
+Y86_API int y86_stat(const y86_cpu* cpu);
+Y86_API uint64_t y86_pc(const y86_cpu* cpu);
+Y86_API int y86_cc(const y86_cpu* cpu);
+/* register r (0 = %rax ... 14 = %r14); 0 for other r */
+Y86_API int64_t y86_reg(const y86_cpu* cpu, int r);
+/* all Y86_REG_NUM registers in place, in the order of y86_reg() */
+Y86_API const int64_t* y86_regs(const y86_cpu* cpu);
+
+/* Memory without copying: the page holding `addr` and, in *avail, the bytes
+ * from `addr` to the end of that page. NULL (with *avail still set) if the
+ * page was never written, i.e. reads as zeros. */
+Y86_API const uint8_t* y86_mem_page(const y86_cpu* cpu, uint64_t addr, size_t* avail);
+/* copies `len` bytes from `addr` into `out` */
+Y86_API void y86_mem_read(const y86_cpu* cpu, uint64_t addr, void* out, size_t len);
+Y86_API uint64_t y86_mem_read8(const y86_cpu* cpu, uint64_t addr);
+/* Nonzero aligned qwords in address order, the MEM of the JSON dumps:
+ * stores up to `cap` of them and returns how many there are in total, or
+ * 0 with y86_error() set if memory runs out. */
+Y86_API size_t y86_mem_nonzero(const y86_cpu* cpu, uint64_t* addrs, int64_t* values,
+                               size_t cap);
+
+/* the state as y86sim prints it per step (PC, REG, CC, STAT, MEM) */
+Y86_API const char* y86_state_json(y86_cpu* cpu);
+
+/* description of the last failure on this handle, "" if none */
+Y86_API const char* y86_error(const y86_cpu* cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* Y86_H */
@@ -0,0 +1,186 @@
+"""ctypes binding for liby86 (include/y86.h).
+
+    import y86
+    cpu = y86.CPU()
+    cpu.load(open("test/prog1.yo", "rb").read())
+    cpu.run()
+    print(cpu.stat, cpu.regs, cpu.mem_nonzero())
+
+The library is $Y86_LIB if that is set, else the first found in build/ at the
+top of the repository, then next to this module, then by the system loader.
+"""
+
+import ctypes
+import json
+import os
+
+AOK, HLT, ADR, INS = 1, 2, 3, 4
+STAT_NAMES = {AOK: "AOK", HLT: "HLT", ADR: "ADR", INS: "INS"}
+REG_NAMES = ("rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+             "r8", "r9", "r10", "r11", "r12", "r13", "r14")
+REG_NUM = 15
+PAGE_SIZE = 4096
+API_VERSION = 1
+
+_u64 = ctypes.c_uint64
+_p = ctypes.c_void_p
+TRACE_FN = ctypes.CFUNCTYPE(ctypes.c_int, _p, _p)
+
+
+def _find_library():
+    if os.environ.get("Y86_LIB"):
+        return os.environ["Y86_LIB"]
+    here = os.path.dirname(os.path.abspath(__file__))
+    for d in (os.path.join(os.path.dirname(here), "build"), here):
+        for name in ("liby86.so", "liby86.dylib", "y86.dll"):
+            path = os.path.join(d, name)
+            if os.path.exists(path):
+                return path
+    return "liby86.so"
+
+
+def _load_library():
+    lib = ctypes.CDLL(_find_library())
+    sigs = {
+        "y86_api_version": (ctypes.c_int, []),
+        "y86_create": (_p, []),
+        "y86_destroy": (None, [_p]),
+        "y86_load": (ctypes.c_int, [_p, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int]),
+        "y86_run": (_u64, [_p, _u64]),
+        "y86_run_to_halt": (_u64, [_p]),
+        "y86_set_trace": (None, [_p, TRACE_FN, _p]),
+        "y86_stat": (ctypes.c_int, [_p]),
+        "y86_pc": (_u64, [_p]),
+        "y86_cc": (ctypes.c_int, [_p]),
+        "y86_reg": (ctypes.c_int64, [_p, ctypes.c_int]),
+        "y86_regs": (ctypes.POINTER(ctypes.c_int64 * REG_NUM), [_p]),
+        "y86_mem_page": (ctypes.POINTER(ctypes.c_uint8),
+                         [_p, _u64, ctypes.POINTER(ctypes.c_size_t)]),
+        "y86_mem_read": (None, [_p, _u64, _p, ctypes.c_size_t]),
+        "y86_mem_read8": (_u64, [_p, _u64]),
+        "y86_mem_nonzero": (ctypes.c_size_t, [_p, ctypes.POINTER(_u64),
+                                              ctypes.POINTER(ctypes.c_int64), ctypes.c_size_t]),
+        "y86_state_json": (ctypes.c_char_p, [_p]),
+        "y86_error": (ctypes.c_char_p, [_p]),
+    }
+    for name, (res, args) in sigs.items():
+        f = getattr(lib, name)
+        f.restype = res
+        f.argtypes = args
+    if lib.y86_api_version() != API_VERSION:
+        raise ImportError("liby86 API version %d, expected %d"
+                          % (lib.y86_api_version(), API_VERSION))
+    return lib
+
+
+_lib = _load_library()
+
+
+class Y86Error(Exception):
+    pass
+
+
+class CPU:
+    """One simulated machine; wraps a y86_cpu handle."""
+
+    def __init__(self, program=None, bound=False):
+        self._h = _lib.y86_create()
+        if not self._h:
+            raise MemoryError("y86_create failed")
+        self._trace = None
+        # y86_regs() points into the handle and never moves
+        self._regs = _lib.y86_regs(self._h).contents
+        if program is not None:
+            self.load(program, bound)
+
+    def close(self):
+        if self._h:
+            _lib.y86_destroy(self._h)
+            self._h = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def load(self, program, bound=False):
+        """Loads .yo text (str or bytes) or a .ybin image (bytes)."""
+        if isinstance(program, str):
+            program = program.encode()
+        if _lib.y86_load(self._h, program, len(program), int(bound)) != 0:
+            raise Y86Error(_lib.y86_error(self._h).decode())
+
+    def run(self, limit=None):
+        """Runs up to `limit` instructions (no limit if None); returns the count."""
+        if limit is None:
+            return _lib.y86_run_to_halt(self._h)
+        return _lib.y86_run(self._h, limit)
+
+    def set_trace(self, fn):
+        """fn(cpu) after every instruction; a true return stops the run."""
+        if fn is None:
+            self._trace = None
+            _lib.y86_set_trace(self._h, TRACE_FN(), None)
+            return
+        # kept referenced for as long as the library may call it
+        self._trace = TRACE_FN(lambda h, user: 1 if fn(self) else 0)
+        _lib.y86_set_trace(self._h, self._trace, None)
+
+    @property
+    def stat(self):
+        return _lib.y86_stat(self._h)
+
+    @property
+    def pc(self):
+        return _lib.y86_pc(self._h)
+
+    @property
+    def cc(self):
+        c = _lib.y86_cc(self._h)
+        return {"ZF": c & 1, "SF": (c >> 1) & 1, "OF": (c >> 2) & 1}
+
+    @property
+    def regs(self):
+        """The registers in place (a ctypes array; copy to keep a snapshot)."""
+        return self._regs
+
+    def reg(self, name):
+        return self._regs[REG_NAMES.index(name.lstrip("%"))]
+
+    def page(self, addr):
+        """Memory from `addr` to the end of its page without copying, as a
+        memoryview valid until the next run or load; None if all zeros."""
+        avail = ctypes.c_size_t()
+        p = _lib.y86_mem_page(self._h, addr, ctypes.byref(avail))
+        if not p:
+            return None
+        return memoryview((ctypes.c_uint8 * avail.value).from_address(
+            ctypes.addressof(p.contents))).cast("B")
+
+    def read(self, addr, n):
+        buf = ctypes.create_string_buffer(n)
+        _lib.y86_mem_read(self._h, addr, buf, n)
+        return buf.raw
+
+    def read8(self, addr):
+        return _lib.y86_mem_read8(self._h, addr)
+
+    def mem_nonzero(self):
+        """{address: value} of the nonzero aligned qwords."""
+        n = _lib.y86_mem_nonzero(self._h, None, None, 0)
+        addrs = (_u64 * n)()
+        vals = (ctypes.c_int64 * n)()
+        _lib.y86_mem_nonzero(self._h, addrs, vals, n)
+        return dict(zip(addrs, vals))
+
+    def state(self):
+        """The state as one element of y86sim's JSON output."""
+        return json.loads(_lib.y86_state_json(self._h))
+
+    @property
+    def stat_name(self):
+        return STAT_NAMES.get(self.stat, "?")
@@ -0,0 +1,222 @@
+"""Reader for the binary columnar traces of `y86sim --trace=bin` (.ytr).
+
+The file is memory-mapped and columns are exposed as memoryviews, so a
+trace of 10^8 steps can be opened and indexed without reading it:
+
+    import y86trace
+    t = y86trace.Trace("prog.ytr")
+    t.steps, t.pc(12345), t.stat(-1)
+    pcs = t.pc_column(0)        # u64 memoryview of block 0's PCs
+    t.state(1000)               # one element of the JSON trace
+    for s in t.states(0, 10):   # replay a range
+        ...
+
+The layout is documented in include/bintrace.h.
+"""
+
+import mmap
+import struct
+import sys
+
+MAGIC = b"Y86TRC\0\0"
+TRAILER_MAGIC = b"Y86TRIX\0"
+VERSION = 1
+HEADER_SIZE = 64
+TRAILER_SIZE = 64
+REG_NAMES = ("rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+             "r8", "r9", "r10", "r11", "r12", "r13", "r14")
+REG_NUM = 15
+
+if sys.byteorder != "little":
+    raise ImportError("y86trace reads columns in place and needs a little-endian host")
+
+
+def _pad8(n):
+    return (n + 7) & ~7
+
+
+class _Block:
+    __slots__ = ("n", "nregs", "nwrites", "first_write", "regs", "pc", "flags",
+                 "mask", "regvals", "waddr", "wval")
+
+
+class Trace:
+    def __init__(self, path):
+        self._f = open(path, "rb")
+        self._mm = mmap.mmap(self._f.fileno(), 0, access=mmap.ACCESS_READ)
+        m = memoryview(self._mm)
+        self._m = m
+        if len(m) < HEADER_SIZE + TRAILER_SIZE or m[:8] != MAGIC:
+            raise ValueError("%s: not a .ytr trace" % path)
+        version, shift = struct.unpack_from("<IB", m, 8)
+        if version != VERSION:
+            raise ValueError("%s: unsupported .ytr version %d" % (path, version))
+        self.block_shift = shift
+        tail = len(m) - TRAILER_SIZE
+        if m[tail:tail + 8] != TRAILER_MAGIC:
+            raise ValueError("%s: truncated .ytr (no trailer)" % path)
+        self.steps, nblocks, index_at, self.writes = struct.unpack_from("<4Q", m, tail + 8)
+
+        self._init = HEADER_SIZE
+        self._blocks = []
+        for i in range(nblocks):
+            off, first_write = struct.unpack_from("<2Q", m, index_at + 16 * i)
+            b = _Block()
+            b.n, b.nregs, b.nwrites = struct.unpack_from("<3Q", m, off)
+            b.first_write = first_write
+            p = off + 24
+            b.regs = m[p:p + 8 * REG_NUM].cast("q")
+            p += 8 * REG_NUM
+            b.pc = m[p:p + 8 * b.n].cast("Q")
+            p += 8 * b.n
+            b.flags = m[p:p + b.n]
+            p += _pad8(b.n)
+            b.mask = m[p:p + 2 * b.n].cast("H")
+            p += _pad8(2 * b.n)
+            b.regvals = m[p:p + 8 * b.nregs].cast("q")
+            p += 8 * b.nregs
+            b.waddr = m[p:p + 8 * b.nwrites].cast("Q")
+            p += 8 * b.nwrites
+            b.wval = m[p:p + 8 * b.nwrites].cast("q")
+            self._blocks.append(b)
+
+    def close(self):
+        for b in self._blocks:
+            for col in (b.regs, b.pc, b.flags, b.mask, b.regvals, b.waddr, b.wval):
+                col.release()
+        self._blocks = []
+        self._m.release()
+        self._mm.close()
+        self._f.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __len__(self):
+        return self.steps
+
+    # ---------- per-step columns, O(1) ----------
+
+    def _at(self, k):
+        if k < 0:
+            k += self.steps
+        if not 0 <= k < self.steps:
+            raise IndexError(k)
+        return self._blocks[k >> self.block_shift], k & ((1 << self.block_shift) - 1)
+
+    @property
+    def blocks(self):
+        return len(self._blocks)
+
+    def pc_column(self, block):
+        """PCs of one block of 2**block_shift steps, a u64 memoryview."""
+        return self._blocks[block].pc
+
+    def pc(self, k):
+        b, i = self._at(k)
+        return b.pc[i]
+
+    def stat(self, k):
+        b, i = self._at(k)
+        return b.flags[i] & 7
+
+    def cc(self, k):
+        b, i = self._at(k)
+        f = b.flags[i]
+        return {"OF": (f >> 5) & 1, "SF": (f >> 4) & 1, "ZF": (f >> 3) & 1}
+
+    def pcs(self):
+        """All PCs in order."""
+        for b in self._blocks:
+            yield from b.pc
+
+    # ---------- full states ----------
+
+    def initial_state(self):
+        m, p = self._m, self._init
+        pc, flags = struct.unpack_from("<2Q", m, p)
+        regs = list(struct.unpack_from("<15q", m, p + 16))
+        (nq,) = struct.unpack_from("<Q", m, p + 16 + 8 * REG_NUM)
+        pairs = struct.unpack_from("<%dq" % (2 * nq), m, p + 24 + 8 * REG_NUM)
+        mem = {pairs[2 * i] & (2**64 - 1): pairs[2 * i + 1] for i in range(nq)}
+        return pc, flags, regs, mem
+
+    @staticmethod
+    def _to_json(pc, flags, regs, mem):
+        return {
+            "PC": pc,
+            "STAT": flags & 7,
+            "CC": {"OF": (flags >> 5) & 1, "SF": (flags >> 4) & 1, "ZF": (flags >> 3) & 1},
+            "REG": dict(zip(REG_NAMES, regs)),
+            "MEM": {str(a): v for a, v in sorted(mem.items())},
+        }
+
+    def states(self, first=0, last=None):
+        """JSON-style states of steps [first, last); replays from the start
+        of the trace's memory, so the cost grows with `first`'s writes."""
+        last = self.steps if last is None else min(last, self.steps)
+        if first >= last:
+            return
+        _, _, regs, mem = self.initial_state()
+        shift = self.block_shift
+        bi = first >> shift
+        for b in self._blocks[:bi]:
+            w = 0
+            for f in b.flags:
+                nw = f >> 6
+                if nw == 3:
+                    nw = b.waddr[w]
+                    w += 1
+                    mem.clear()
+                for a, v in zip(b.waddr[w:w + nw], b.wval[w:w + nw]):
+                    if v:
+                        mem[a] = v
+                    else:
+                        mem.pop(a, None)
+                w += nw
+        k = first
+        while k < last:
+            b = self._blocks[k >> shift]
+            base = (k >> shift) << shift
+            regs = list(b.regs)
+            rv, w = 0, 0
+            for i in range(0, b.n):
+                m, f = b.mask[i], b.flags[i]
+                r = 0
+                while m:
+                    if m & 1:
+                        regs[r] = b.regvals[rv]
+                        rv += 1
+                    m >>= 1
+                    r += 1
+                nw = f >> 6
+                if nw == 3:
+                    # snapshot step: the complete memory after unlogged steps
+                    nw = b.waddr[w]
+                    w += 1
+                    mem.clear()
+                for _ in range(nw):
+                    a, v = b.waddr[w], b.wval[w]
+                    if v:
+                        mem[a] = v
+                    else:
+                        mem.pop(a, None)
+                    w += 1
+                if base + i >= k:
+                    yield self._to_json(b.pc[i], f, regs, mem)
+                    k += 1
+                    if k == last:
+                        return
+            k = base + b.n
+
+    def state(self, k):
+        """The JSON element of step k."""
+        if k < 0:
+            k += self.steps
+        return next(self.states(k, k + 1))
+
+    def to_json(self):
+        return list(self.states())
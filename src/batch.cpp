@@ -0,0 +1,160 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+#include "bintrace.h"
+#include "image.h"
+#include "jit.h"
+#include "pipe.h"
+#include "pool.h"
+#include "trace.h"
+
+namespace fs = std::filesystem;
+using nlohmann::json;
+
+namespace y86 {
+
+std::vector<std::string> batch_inputs(const std::string& dir_or_list, std::string* err) {
+    std::vector<std::string> out;
+    std::error_code ec;
+    if (fs::is_directory(dir_or_list, ec)) {
+        for (auto& e : fs::directory_iterator(dir_or_list, ec)) {
+            auto ext = e.path().extension();
+            if (e.is_regular_file() && (ext == ".yo" || ext == ".ybin"))
+                out.push_back(e.path().string());
+        }
+        std::sort(out.begin(), out.end());
+    } else {
+        std::ifstream in(dir_or_list);
+        if (!in) {
+            if (err) *err = "cannot open " + dir_or_list;
+            return out;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+            if (!line.empty() && line[0] != '#') out.push_back(line);
+        }
+    }
+    if (ec && err) *err = ec.message();
+    return out;
+}
+
+// out_dir/<stem>.<ext>, with "-<index>" appended (and counted up from
+// there) until the name is unused
+static std::vector<std::string> output_names(const std::vector<std::string>& programs,
+                                             const BatchOptions& opt) {
+    std::vector<std::string> names(programs.size());
+    if (opt.output == BatchOptions::Output::None) return names;
+    const char* ext = opt.output == BatchOptions::Output::Delta ? ".delta"
+                      : opt.output == BatchOptions::Output::Bin ? ".ytr"
+                                                                : ".json";
+    std::set<std::string> seen;
+    for (std::size_t i = 0; i < programs.size(); i++) {
+        std::string stem = fs::path(programs[i]).stem().string();
+        std::string name = stem;
+        for (std::size_t k = i; !seen.insert(name).second; k++) name = stem + "-" + std::to_string(k);
+        names[i] = (fs::path(opt.out_dir) / (name + ext)).string();
+    }
+    return names;
+}
+
+static u64 run_untraced(CPU& cpu, const BatchOptions& opt) {
+    if (opt.engine == Engine::Jit) {
+        // one engine per worker thread, its translations dropped per program
+        JitEngine& jit = JitEngine::for_thread();
+        jit.flush();
+        return jit.run(cpu, opt.limit);
+    }
+    if (opt.engine == Engine::Pipe) {
+        PipeEngine pipe;
+        return pipe.run(cpu, opt.limit);
+    }
+    NoTrace trace;
+    return run_auto(cpu, opt.limit, trace);
+}
+
+static void run_one(const std::string& path, BatchResult& r, const BatchOptions& opt) {
+    CPU cpu;
+    cpu.backend = opt.backend;
+    cpu.icache.enabled = opt.icache;
+    if (!load_program_file(path, cpu, opt.load, &r.error)) return;
+
+    if (opt.output == BatchOptions::Output::None) {
+        r.steps = run_untraced(cpu, opt);
+        r.stat = cpu.stat;
+        return;
+    }
+    std::FILE* f = std::fopen(r.output.c_str(), "wb");
+    if (!f) {
+        r.error = "cannot write " + r.output;
+        return;
+    }
+    {
+        OutBuf buf(f);
+        if (opt.output == BatchOptions::Output::Delta) {
+            DeltaTraceWriter writer(buf);
+            writer.begin(cpu);
+            TraceEach<DeltaTraceWriter> trace{writer};
+            r.steps = run_auto(cpu, opt.limit, trace);
+        } else if (opt.output == BatchOptions::Output::Bin) {
+            BinTraceWriter writer(buf);
+            writer.begin(cpu);
+            TraceEach<BinTraceWriter> trace{writer};
+            r.steps = run_auto(cpu, opt.limit, trace);
+            writer.finish();
+        } else if (opt.output == BatchOptions::Output::Final) {
+            r.steps = run_untraced(cpu, opt);
+            write_final_state(cpu, r.steps, buf);
+        } else {
+            JsonTraceWriter writer(buf);
+            TraceEach<JsonTraceWriter> trace{writer};
+            r.steps = run_auto(cpu, opt.limit, trace);
+            writer.finish();
+        }
+    }
+    if (std::fclose(f) != 0) r.error = "cannot write " + r.output;
+    r.stat = cpu.stat;
+}
+
+std::vector<BatchResult> run_batch(const std::vector<std::string>& programs,
+                                   const BatchOptions& opt) {
+    std::vector<BatchResult> results(programs.size());
+    std::vector<std::string> names = output_names(programs, opt);
+    if (opt.output != BatchOptions::Output::None) {
+        std::error_code ec;
+        fs::create_directories(opt.out_dir, ec);
+    }
+    for (std::size_t i = 0; i < programs.size(); i++) {
+        results[i].program = programs[i];
+        results[i].output = names[i];
+    }
+
+    parallel_for_stealing(programs.size(), opt.jobs, [&](std::size_t i, unsigned) {
+        auto t0 = std::chrono::steady_clock::now();
+        run_one(programs[i], results[i], opt);
+        results[i].ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0)
+                .count();
+    });
+    return results;
+}
+
+json batch_summary(const std::vector<BatchResult>& results) {
+    json out = json::array();
+    for (auto& r : results) {
+        json j = {{"program", r.program}, {"steps", r.steps}, {"STAT", (int)r.stat},
+                  {"ms", r.ms}};
+        if (!r.output.empty()) j["output"] = r.output;
+        if (!r.error.empty()) j["error"] = r.error;
+        out.push_back(std::move(j));
+    }
+    return out;
+}
+
+}  // namespace y86
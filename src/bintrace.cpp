@@ -0,0 +1,402 @@
+#include "bintrace.h"
+
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define Y86_HAVE_MMAP 1
+#endif
+
+namespace y86 {
+
+static u64 rd64(const u8* p) { return PagedMem::load_le64(p); }
+static u16 rd16(const u8* p) { return (u16)(p[0] | p[1] << 8); }
+static u64 pad8(u64 n) { return (n + 7) & ~u64(7); }
+
+static bool fail(std::string* err, const char* msg) {
+    if (err) *err = msg;
+    return false;
+}
+
+// ---------- writer ----------
+
+BinTraceWriter::BinTraceWriter(OutBuf& out) : out_(out) {
+    pc_.reserve(BLOCK);
+    flags_.reserve(BLOCK);
+    mask_.reserve(BLOCK);
+}
+
+void BinTraceWriter::emit(const void* p, std::size_t n) {
+    out_.write((const char*)p, n);
+    pos_ += n;
+}
+
+void BinTraceWriter::emit64(u64 v) {
+    u8 b[8];
+    PagedMem::store_le64(b, v);
+    emit(b, 8);
+}
+
+void BinTraceWriter::pad8() {
+    static const char zeros[8] = {};
+    if (pos_ & 7) emit(zeros, 8 - (pos_ & 7));
+}
+
+// a column of 8-byte values; byte-swapped one by one on big-endian hosts
+template <class T>
+void BinTraceWriter::emit_column(const std::vector<T>& v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    emit(v.data(), v.size() * 8);
+#else
+    for (T x : v) emit64((u64)x);
+#endif
+}
+
+void BinTraceWriter::begin(const CPU& S) {
+    char head[ytr::HEADER_SIZE] = {};
+    std::memcpy(head, ytr::MAGIC, 8);
+    u8 v[4];
+    for (int i = 0; i < 4; i++) v[i] = (u8)(ytr::VERSION >> (8 * i));
+    std::memcpy(head + 8, v, 4);
+    head[12] = (char)ytr::BLOCK_SHIFT;
+    emit(head, sizeof head);
+
+    emit64(S.PC);
+    emit64(pack_flags(S));
+    for (int i = 0; i < REG_NUM; i++) emit64((u64)S.R[i]);
+    emit64(S.qword_nonzero().size());
+    for (auto& kv : S.qword_nonzero()) {
+        emit64(kv.first);
+        emit64((u64)kv.second);
+    }
+    std::copy(S.R, S.R + REG_NUM, regs_);
+    std::copy(S.R, S.R + REG_NUM, block_regs_);
+    mem_seq_ = S.dirty_seq;
+}
+
+u8 BinTraceWriter::note_writes(const CPU& S, u64 nw) {
+    mem_seq_ = S.dirty_seq;
+    // one instruction stores 8 bytes, i.e. touches at most two qwords; more
+    // means steps went unlogged, and the whole memory is written instead
+    if (nw <= 2) {
+        for (u64 q = S.dirty_seq - nw; q != S.dirty_seq; ++q) {
+            u64 base = S.dirty_ring[q % CPU::DIRTY_RING];
+            waddr_.push_back(base);
+            wval_.push_back((s64)S.read8_unchecked(base));
+        }
+        return (u8)nw;
+    }
+    waddr_.push_back(S.qword_nonzero().size());
+    wval_.push_back(0);
+    for (auto& kv : S.qword_nonzero()) {
+        waddr_.push_back(kv.first);
+        wval_.push_back(kv.second);
+    }
+    return 3;
+}
+
+void BinTraceWriter::flush_block() {
+    if (pc_.empty()) return;
+    index_.push_back(pos_);
+    index_.push_back(writes_);
+    emit64(pc_.size());
+    emit64(regvals_.size());
+    emit64(waddr_.size());
+    for (int i = 0; i < REG_NUM; i++) emit64((u64)block_regs_[i]);
+
+    emit_column(pc_);
+    emit(flags_.data(), flags_.size());
+    pad8();
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    emit(mask_.data(), mask_.size() * 2);
+#else
+    for (u16 m : mask_) {
+        u8 b[2] = {(u8)m, (u8)(m >> 8)};
+        emit(b, 2);
+    }
+#endif
+    pad8();
+    emit_column(regvals_);
+    emit_column(waddr_);
+    emit_column(wval_);
+
+    steps_ += pc_.size();
+    writes_ += waddr_.size();
+    std::copy(regs_, regs_ + REG_NUM, block_regs_);
+    pc_.clear();
+    flags_.clear();
+    mask_.clear();
+    regvals_.clear();
+    waddr_.clear();
+    wval_.clear();
+}
+
+void BinTraceWriter::finish() {
+    flush_block();
+    u64 index_at = pos_;
+    for (u64 v : index_) emit64(v);
+    char tail[ytr::TRAILER_SIZE] = {};
+    std::memcpy(tail, ytr::TRAILER_MAGIC, 8);
+    u64 fields[4] = {steps_, index_.size() / 2, index_at, writes_};
+    for (int i = 0; i < 4; i++) PagedMem::store_le64((u8*)tail + 8 + 8 * i, fields[i]);
+    emit(tail, sizeof tail);
+    out_.flush();
+}
+
+// ---------- reader ----------
+
+BinTrace::~BinTrace() {
+#ifdef Y86_HAVE_MMAP
+    if (map_) munmap(map_, size_);
+#endif
+}
+
+bool BinTrace::is_ytr(const void* p, std::size_t n) {
+    return n >= ytr::HEADER_SIZE && std::memcmp(p, ytr::MAGIC, 8) == 0;
+}
+
+bool BinTrace::open(const std::string& path, std::string* err) {
+#ifdef Y86_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return fail(err, "cannot open file");
+    bool ok = open_fd(fd, err);
+    ::close(fd);
+    return ok;
+#else
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return fail(err, "cannot open file");
+    std::vector<u8> all;
+    u8 buf[1 << 16];
+    std::size_t got;
+    while ((got = std::fread(buf, 1, sizeof buf, f)) > 0) all.insert(all.end(), buf, buf + got);
+    std::fclose(f);
+    return open_buffer(std::move(all), err);
+#endif
+}
+
+bool BinTrace::open_fd(int fd, std::string* err) {
+#ifdef Y86_HAVE_MMAP
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* m = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            map_ = m;
+            data_ = (const u8*)m;
+            size_ = (std::size_t)st.st_size;
+            return parse(err);
+        }
+    }
+    std::vector<u8> all;
+    u8 buf[1 << 16];
+    for (;;) {
+        ssize_t got = ::read(fd, buf, sizeof buf);
+        if (got < 0) return fail(err, "read failed");
+        if (got == 0) break;
+        all.insert(all.end(), buf, buf + got);
+    }
+    return open_buffer(std::move(all), err);
+#else
+    (void)fd;
+    return fail(err, "cannot read descriptor");
+#endif
+}
+
+bool BinTrace::open_buffer(std::vector<u8> data, std::string* err) {
+    owned_ = std::move(data);
+    data_ = owned_.data();
+    size_ = owned_.size();
+    return parse(err);
+}
+
+bool BinTrace::parse(std::string* err) {
+    if (!is_ytr(data_, size_)) return fail(err, "not a .ytr trace");
+    u32 version = 0;
+    for (int i = 0; i < 4; i++) version |= (u32)data_[8 + i] << (8 * i);
+    if (version != ytr::VERSION) return fail(err, "unsupported .ytr version");
+    if (data_[12] != ytr::BLOCK_SHIFT) return fail(err, "unsupported .ytr block size");
+    if (size_ < ytr::HEADER_SIZE + ytr::TRAILER_SIZE) return fail(err, "truncated .ytr");
+    const u8* tail = data_ + size_ - ytr::TRAILER_SIZE;
+    if (std::memcmp(tail, ytr::TRAILER_MAGIC, 8) != 0)
+        return fail(err, "truncated .ytr (no trailer)");
+    steps_ = rd64(tail + 8);
+    u64 nblocks = rd64(tail + 16), index_at = rd64(tail + 24);
+    writes_ = rd64(tail + 32);
+    u64 body_end = size_ - ytr::TRAILER_SIZE;
+    if (index_at > body_end || nblocks > (body_end - index_at) / 16 ||
+        (steps_ + (u64(1) << ytr::BLOCK_SHIFT) - 1) >> ytr::BLOCK_SHIFT != nblocks)
+        return fail(err, "corrupt .ytr index");
+
+    init_ = data_ + ytr::HEADER_SIZE;
+    u64 init_fixed = 8 * (3 + REG_NUM);
+    if (ytr::HEADER_SIZE + init_fixed > index_at) return fail(err, "corrupt .ytr initial state");
+    u64 nq = rd64(init_ + 8 * (2 + REG_NUM));
+    if (nq > (index_at - ytr::HEADER_SIZE - init_fixed) / 16)
+        return fail(err, "corrupt .ytr initial state");
+
+    blocks_.assign(nblocks, Block{});
+    u64 steps = 0, writes = 0;
+    for (u64 i = 0; i < nblocks; i++) {
+        const u8* ix = data_ + index_at + 16 * i;
+        u64 off = rd64(ix);
+        Block& b = blocks_[i];
+        b.first_write = rd64(ix + 8);
+        if (off > index_at || index_at - off < 8 * (3 + REG_NUM))
+            return fail(err, "corrupt .ytr block");
+        const u8* p = data_ + off;
+        b.n = rd64(p);
+        b.nregs = rd64(p + 8);
+        b.nwrites = rd64(p + 16);
+        // full blocks except the last; at most 15 registers and 3 writes a step
+        u64 want_n = i + 1 < nblocks ? u64(1) << ytr::BLOCK_SHIFT : steps_ - steps;
+        if (b.n != want_n || b.nregs > b.n * REG_NUM || b.nwrites > (index_at - off) / 16 ||
+            b.first_write != writes)
+            return fail(err, "corrupt .ytr block");
+        u64 len = 8 * (3 + REG_NUM) + 8 * b.n + pad8(b.n) + pad8(2 * b.n) + 8 * b.nregs +
+                  16 * b.nwrites;
+        if (len > index_at - off) return fail(err, "corrupt .ytr block");
+        b.regs = p + 24;
+        b.pc = b.regs + 8 * REG_NUM;
+        b.flags = b.pc + 8 * b.n;
+        b.mask = b.flags + pad8(b.n);
+        b.regvals = b.mask + pad8(2 * b.n);
+        b.waddr = b.regvals + 8 * b.nregs;
+        b.wval = b.waddr + 8 * b.nwrites;
+        steps += b.n;
+        writes += b.nwrites;
+    }
+    if (writes != writes_) return fail(err, "corrupt .ytr index");
+    return true;
+}
+
+u64 BinTrace::pc(u64 k) const {
+    return rd64(block_of(k).pc + 8 * (k & ((u64(1) << ytr::BLOCK_SHIFT) - 1)));
+}
+
+Stat BinTrace::stat(u64 k) const {
+    return (Stat)(block_of(k).flags[k & ((u64(1) << ytr::BLOCK_SHIFT) - 1)] & 7);
+}
+
+static CC unpack_cc(u8 f) {
+    CC cc;
+    cc.ZF = (f >> 3) & 1;
+    cc.SF = (f >> 4) & 1;
+    cc.OF = (f >> 5) & 1;
+    return cc;
+}
+
+CC BinTrace::cc(u64 k) const {
+    return unpack_cc(block_of(k).flags[k & ((u64(1) << ytr::BLOCK_SHIFT) - 1)]);
+}
+
+void BinTrace::position(const Block& b, u64 i, u64& rv, u64& w) {
+    rv = w = 0;
+    for (u64 j = 0; j < i; j++) {
+        u16 m = rd16(b.mask + 2 * j);
+        while (m) {
+            m &= (u16)(m - 1);
+            ++rv;
+        }
+        w += write_entries(b, j, w);
+    }
+}
+
+u64 BinTrace::write_entries(const Block& b, u64 i, u64 w) {
+    // clamped, so a corrupt count cannot read past the block
+    if (w >= b.nwrites) return 0;
+    u64 f = b.flags[i] >> 6;
+    u64 n = f < 3 ? f : 1 + std::min(rd64(b.waddr + 8 * w), b.nwrites);
+    return std::min(n, b.nwrites - w);
+}
+
+void BinTrace::clear_mem(CPU& S) {
+    std::vector<u64> bases;
+    for (auto& kv : S.qword_nonzero()) bases.push_back(kv.first);
+    for (u64 a : bases) S.write8((s64)a, 0);
+}
+
+void BinTrace::writes_at(u64 k, std::vector<Write>& out, bool* snapshot) const {
+    const Block& b = block_of(k);
+    u64 i = k & ((u64(1) << ytr::BLOCK_SHIFT) - 1);
+    u64 rv, w;
+    position(b, i, rv, w);
+    u64 n = write_entries(b, i, w);
+    bool snap = (b.flags[i] >> 6) == 3;
+    if (snap) {
+        ++w;
+        --n;
+    }
+    if (snapshot) *snapshot = snap;
+    out.clear();
+    for (u64 j = 0; j < n; j++)
+        out.push_back({rd64(b.waddr + 8 * (w + j)), (s64)rd64(b.wval + 8 * (w + j))});
+}
+
+void BinTrace::set_regs(const u8* p, CPU& S) {
+    for (int i = 0; i < REG_NUM; i++) S.R[i] = (s64)rd64(p + 8 * i);
+}
+
+void BinTrace::initial_state(CPU& S) const {
+    S.PC = rd64(init_);
+    u8 f = (u8)rd64(init_ + 8);
+    S.stat = (Stat)(f & 7);
+    S.cc = unpack_cc(f);
+    set_regs(init_ + 16, S);
+    const u8* q = init_ + 8 * (2 + REG_NUM);
+    u64 nq = rd64(q);
+    for (u64 i = 0; i < nq; i++) S.write8((s64)rd64(q + 8 + 16 * i), rd64(q + 16 + 16 * i));
+}
+
+void BinTrace::apply(const Block& b, u64 i, u64& rv, u64& w, CPU& S) {
+    S.PC = rd64(b.pc + 8 * i);
+    u8 f = b.flags[i];
+    S.stat = (Stat)(f & 7);
+    S.cc = unpack_cc(f);
+    u16 m = rd16(b.mask + 2 * i);
+    for (int r = 0; m; r++, m >>= 1) {
+        if ((m & 1) && rv < b.nregs) S.R[r] = (s64)rd64(b.regvals + 8 * rv++);
+    }
+    apply_writes(b, i, w, S);
+}
+
+void BinTrace::apply_writes(const Block& b, u64 i, u64& w, CPU& S) {
+    u64 n = write_entries(b, i, w);
+    if ((b.flags[i] >> 6) == 3 && n) {
+        clear_mem(S);
+        ++w;
+        --n;
+    }
+    for (; n; n--, w++) S.write8((s64)rd64(b.waddr + 8 * w), rd64(b.wval + 8 * w));
+}
+
+void BinTrace::apply_block_writes(const Block& b, CPU& S) const {
+    u64 w = 0;
+    for (u64 i = 0; i < b.n; i++) apply_writes(b, i, w, S);
+}
+
+void BinTrace::state_at(u64 k, CPU& S) const {
+    initial_state(S);
+    if (k >= steps_) {
+        if (!steps_) return;
+        k = steps_ - 1;
+    }
+    u64 bi = k >> ytr::BLOCK_SHIFT;
+    for (u64 i = 0; i < bi; i++) apply_block_writes(blocks_[i], S);
+    const Block& b = blocks_[bi];
+    set_regs(b.regs, S);
+    u64 rv = 0, w = 0;
+    u64 last = k & ((u64(1) << ytr::BLOCK_SHIFT) - 1);
+    for (u64 i = 0; i <= last; i++) apply(b, i, rv, w, S);
+}
+
+void BinTrace::to_json(OutBuf& out) const {
+    CPU S;
+    initial_state(S);
+    JsonTraceWriter writer(out);
+    replay(S, 0, steps_, [&](const CPU& s) { writer.record(s); });
+    writer.finish();
+}
+
+}  // namespace y86
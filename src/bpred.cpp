@@ -0,0 +1,204 @@
+#include "bpred.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "parse.h"
+
+using nlohmann::json;
+
+namespace y86 {
+
+namespace {
+
+class Taken final : public BranchPredictor {
+public:
+    std::string name() const override { return "taken"; }
+    bool predict(u64, u64) const override { return true; }
+    void update(u64, u64, bool) override {}
+};
+
+class Btfn final : public BranchPredictor {
+public:
+    std::string name() const override { return "btfn"; }
+    bool predict(u64 pc, u64 target) const override { return target <= pc; }
+    void update(u64, u64, bool) override {}
+};
+
+// 2-bit saturating counters, initialised weakly taken
+class Counters {
+public:
+    explicit Counters(unsigned bits) : c_(std::size_t(1) << bits, 2), mask_((u64(1) << bits) - 1) {}
+    bool taken(u64 i) const { return c_[i & mask_] >= 2; }
+    void train(u64 i, bool taken) {
+        u8& c = c_[i & mask_];
+        if (taken && c < 3) ++c;
+        if (!taken && c > 0) --c;
+    }
+
+private:
+    std::vector<u8> c_;
+    u64 mask_;
+};
+
+class Bimodal final : public BranchPredictor {
+public:
+    explicit Bimodal(unsigned bits) : bits_(bits), t_(bits) {}
+    std::string name() const override { return "bimodal:" + std::to_string(bits_); }
+    bool predict(u64 pc, u64) const override { return t_.taken(pc); }
+    void update(u64 pc, u64, bool taken) override { t_.train(pc, taken); }
+
+private:
+    unsigned bits_;
+    Counters t_;
+};
+
+class Gshare final : public BranchPredictor {
+public:
+    Gshare(unsigned hist, unsigned bits) : hist_bits_(hist), bits_(bits), t_(bits) {}
+    std::string name() const override {
+        return "gshare:" + std::to_string(hist_bits_) + ":" + std::to_string(bits_);
+    }
+    bool predict(u64 pc, u64) const override { return t_.taken(pc ^ hist_); }
+    void update(u64 pc, u64, bool taken) override {
+        t_.train(pc ^ hist_, taken);
+        hist_ = ((hist_ << 1) | (taken ? 1 : 0)) & ((u64(1) << hist_bits_) - 1);
+    }
+
+private:
+    unsigned hist_bits_, bits_;
+    Counters t_;
+    u64 hist_ = 0;
+};
+
+// parse_u64() up to `max`
+bool parse_uint(const std::string& s, unsigned& v, unsigned max) {
+    u64 n;
+    if (!parse_u64(s, n) || n > max) return false;
+    v = (unsigned)n;
+    return true;
+}
+
+constexpr unsigned MAX_RAS = 1 << 16;
+
+const char* const DEFAULTS[] = {"taken", "btfn", "bimodal", "gshare"};
+
+}  // namespace
+
+std::unique_ptr<BranchPredictor> make_predictor(const std::string& spec, std::string* err) {
+    std::vector<std::string> f;
+    for (std::size_t p = 0;;) {
+        std::size_t q = spec.find(':', p);
+        f.push_back(spec.substr(p, q - p));
+        if (q == std::string::npos) break;
+        p = q + 1;
+    }
+    auto fail = [&](const char* why) -> std::unique_ptr<BranchPredictor> {
+        if (err) *err = "'" + spec + "': " + why;
+        return nullptr;
+    };
+    unsigned a = 12, b = 12;
+    if (f[0] == "taken" && f.size() == 1) return std::make_unique<Taken>();
+    if (f[0] == "btfn" && f.size() == 1) return std::make_unique<Btfn>();
+    if (f[0] == "bimodal" && f.size() <= 2) {
+        if (f.size() > 1 && !parse_uint(f[1], a, 24)) return fail("table bits must be 1..24");
+        if (a < 1) return fail("table bits must be 1..24");
+        return std::make_unique<Bimodal>(a);
+    }
+    if (f[0] == "gshare" && f.size() <= 3) {
+        if (f.size() > 1 && !parse_uint(f[1], a, 32)) return fail("history length must be 0..32");
+        if (f.size() > 2 && !parse_uint(f[2], b, 24)) return fail("table bits must be 1..24");
+        if (b < 1) return fail("table bits must be 1..24");
+        return std::make_unique<Gshare>(a, b);
+    }
+    return fail("unknown predictor");
+}
+
+std::unique_ptr<BranchSim> BranchSim::create(const std::string& spec, std::string* err) {
+    std::vector<std::string> items;
+    for (std::size_t p = 0; p <= spec.size();) {
+        std::size_t q = spec.find(',', p);
+        if (q == std::string::npos) q = spec.size();
+        items.push_back(spec.substr(p, q - p));
+        p = q + 1;
+    }
+    unsigned depth = 16;
+    std::vector<std::unique_ptr<BranchPredictor>> preds;
+    for (std::size_t k = 0; k < items.size(); k++) {
+        const std::string it = items[k];
+        if (it.empty()) continue;
+        if (it == "default") {
+            items.insert(items.end(), std::begin(DEFAULTS), std::end(DEFAULTS));
+            continue;
+        }
+        if (!it.compare(0, 4, "ras=")) {
+            if (!parse_uint(it.substr(4), depth, MAX_RAS) || !depth) {
+                if (err) *err = "bad ras depth '" + it + "' (1.." + std::to_string(MAX_RAS) + ")";
+                return nullptr;
+            }
+            continue;
+        }
+        auto p = make_predictor(it, err);
+        if (!p) return nullptr;
+        preds.push_back(std::move(p));
+    }
+    if (preds.empty())
+        for (const char* d : DEFAULTS) preds.push_back(make_predictor(d));
+    std::unique_ptr<BranchSim> sim(new BranchSim(depth));
+    sim->misses_.assign(preds.size(), 0);
+    sim->preds_ = std::move(preds);
+    return sim;
+}
+
+void BranchSim::resolve(u64 pc, u64 target, bool taken) {
+    ++branches_;
+    PcStat& s = pcs_[pc];
+    if (s.misses.empty()) s.misses.assign(preds_.size(), 0);
+    ++s.count;
+    if (taken) ++s.taken;
+    for (std::size_t i = 0; i < preds_.size(); i++) {
+        if (preds_[i]->predict(pc, target) != taken) {
+            ++misses_[i];
+            ++s.misses[i];
+        }
+        preds_[i]->update(pc, target, taken);
+    }
+}
+
+static double accuracy(u64 n, u64 miss) { return n ? 1.0 - (double)miss / (double)n : 1.0; }
+
+json BranchSim::to_json(std::size_t max_pcs) const {
+    json preds = json::array();
+    for (std::size_t i = 0; i < preds_.size(); i++)
+        preds.push_back({{"name", preds_[i]->name()},
+                         {"mispredicts", misses_[i]},
+                         {"accuracy", accuracy(branches_, misses_[i])}});
+
+    std::vector<std::pair<u64, const PcStat*>> v;
+    for (const auto& [pc, s] : pcs_) v.emplace_back(pc, &s);
+    std::sort(v.begin(), v.end(), [](const auto& a, const auto& b) {
+        return a.second->count != b.second->count ? a.second->count > b.second->count : a.first < b.first;
+    });
+    if (v.size() > max_pcs) v.resize(max_pcs);
+    json pcs = json::array();
+    for (const auto& [pc, s] : v) {
+        json acc = json::object(), miss = json::object();
+        for (std::size_t i = 0; i < preds_.size(); i++) {
+            miss[preds_[i]->name()] = s->misses[i];
+            acc[preds_[i]->name()] = accuracy(s->count, s->misses[i]);
+        }
+        pcs.push_back({{"pc", pc}, {"count", s->count}, {"taken", s->taken}, {"mispredicts", miss}, {"accuracy", acc}});
+    }
+    return {{"instructions", steps_},
+            {"branches", branches_},
+            {"predictors", std::move(preds)},
+            {"ras",
+             {{"depth", ras_.depth()},
+              {"rets", rets_},
+              {"mispredicts", ret_misses_},
+              {"accuracy", accuracy(rets_, ret_misses_)},
+              {"overflows", ras_.overflows}}},
+            {"pcs", std::move(pcs)}};
+}
+
+}  // namespace y86
@@ -0,0 +1,325 @@
+#include "cachesim.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "parse.h"
+
+using nlohmann::json;
+
+namespace y86 {
+
+static bool pow2(u64 v) { return v && !(v & (v - 1)); }
+
+static unsigned log2u(u64 v) {
+    unsigned b = 0;
+    while ((u64(1) << b) < v) ++b;
+    return b;
+}
+
+// ---------- CacheConfig ----------
+
+CacheConfig::CacheConfig() {
+    l1i.enabled = l1d.enabled = l2.enabled = true;
+    l2.size = 256 * 1024;
+    l2.latency = 10;
+}
+
+// parse_u64() with an optional k/m suffix; false above UINT32_MAX, since
+// every size, count and latency here is a u32
+static bool parse_num(const std::string& s, u64& v, bool suffix) {
+    u64 scale = 1;
+    std::size_t n = s.size();
+    if (suffix && n && (s[n - 1] == 'k' || s[n - 1] == 'K')) scale = 1024, --n;
+    else if (suffix && n && (s[n - 1] == 'm' || s[n - 1] == 'M')) scale = 1024 * 1024, --n;
+    if (!parse_u64(s.substr(0, n), v) || v > UINT32_MAX / scale) return false;
+    v *= scale;
+    return true;
+}
+
+// an access adds up at most an L1, an L2 and a memory latency in a u32
+static constexpr u64 MAX_LATENCY = u64(1) << 30;
+
+static bool parse_level(const std::string& name, const std::string& v, CacheLevelConfig& c,
+                        std::string* err) {
+    auto fail = [&](const std::string& why) {
+        if (err) *err = name + ": " + why;
+        return false;
+    };
+    if (v == "off") {
+        c.enabled = false;
+        return true;
+    }
+    std::vector<std::string> f;
+    for (std::size_t p = 0;;) {
+        std::size_t q = v.find(':', p);
+        f.push_back(v.substr(p, q - p));
+        if (q == std::string::npos) break;
+        p = q + 1;
+    }
+    if (f.size() < 3) return fail("expected SIZE:WAYS:LINE");
+    u64 size, ways, line;
+    if (!parse_num(f[0], size, true) || !parse_num(f[1], ways, false) || !parse_num(f[2], line, false))
+        return fail("bad SIZE:WAYS:LINE '" + v + "' (numbers up to 4294967295)");
+    c.enabled = true;
+    for (std::size_t i = 3; i < f.size(); i++) {
+        const std::string& o = f[i];
+        u64 lat;
+        if (o == "lru") c.replace = CacheLevelConfig::Replace::LRU;
+        else if (o == "plru") c.replace = CacheLevelConfig::Replace::PLRU;
+        else if (o == "wb") c.write_back = true;
+        else if (o == "wt") c.write_back = false;
+        else if (o == "wa") c.write_allocate = true;
+        else if (o == "nwa") c.write_allocate = false;
+        else if (o.compare(0, 4, "lat=")) return fail("unknown option '" + o + "'");
+        else if (parse_num(o.substr(4), lat, false) && lat <= MAX_LATENCY) c.latency = (u32)lat;
+        else return fail("bad latency '" + o.substr(4) + "'");
+    }
+    if (!pow2(line) || line < 8) return fail("line size must be a power of two >= 8");
+    // all three fit in a u32, so ways * line cannot wrap here, and once it
+    // divides size it cannot wrap in CacheLevel's u32 arithmetic either
+    if (!ways || size % (ways * line) || !pow2(size / (ways * line)))
+        return fail("SIZE / (WAYS * LINE) must be a power of two");
+    if (c.replace == CacheLevelConfig::Replace::PLRU && (!pow2(ways) || ways > 64))
+        return fail("plru needs a power-of-two way count up to 64");
+    c.size = (u32)size;
+    c.ways = (u32)ways;
+    c.line = (u32)line;
+    return true;
+}
+
+bool CacheConfig::parse(const std::string& spec, CacheConfig& out, std::string* err) {
+    CacheConfig c;
+    for (std::size_t p = 0; p <= spec.size();) {
+        std::size_t q = spec.find(',', p);
+        if (q == std::string::npos) q = spec.size();
+        std::string item = spec.substr(p, q - p);
+        p = q + 1;
+        if (item.empty() || item == "default") continue;
+        std::size_t eq = item.find('=');
+        std::string key = item.substr(0, eq), val = eq == std::string::npos ? "" : item.substr(eq + 1);
+        u64 n;
+        if (key == "l1i") {
+            if (!parse_level(key, val, c.l1i, err)) return false;
+        } else if (key == "l1d") {
+            if (!parse_level(key, val, c.l1d, err)) return false;
+        } else if (key == "l2") {
+            if (!parse_level(key, val, c.l2, err)) return false;
+        } else if (key == "mem" && parse_num(val, n, false) && n <= MAX_LATENCY) {
+            c.mem_latency = (u32)n;
+        } else {
+            if (err) *err = "bad item '" + item + "'";
+            return false;
+        }
+    }
+    out = c;
+    return true;
+}
+
+// ---------- CacheLevel ----------
+
+CacheLevel::CacheLevel(const CacheLevelConfig& c) : cfg_(c) {
+    if (!cfg_.enabled) return;
+    line_bits_ = log2u(cfg_.line);
+    sets_ = cfg_.size / (cfg_.ways * cfg_.line);
+    ways_.resize(sets_ * cfg_.ways);
+    if (cfg_.replace == CacheLevelConfig::Replace::PLRU) plru_.resize(sets_);
+}
+
+// tree PLRU: node bit set means the victim is in the right subtree; each
+// access points the nodes on its path away from itself
+void CacheLevel::touch(u64 set, u32 way) {
+    if (plru_.empty()) {
+        ways_[set * cfg_.ways + way].stamp = ++clock_;
+        return;
+    }
+    unsigned levels = log2u(cfg_.ways);
+    u64& bits = plru_[set];
+    u32 node = 0;
+    for (unsigned l = 0; l < levels; l++) {
+        u32 right = (way >> (levels - 1 - l)) & 1;
+        if (right)
+            bits &= ~(u64(1) << node);
+        else
+            bits |= u64(1) << node;
+        node = 2 * node + 1 + right;
+    }
+}
+
+u32 CacheLevel::victim(u64 set) {
+    const Way* w = &ways_[set * cfg_.ways];
+    for (u32 i = 0; i < cfg_.ways; i++)
+        if (!w[i].valid) return i;
+    if (plru_.empty()) {
+        u32 v = 0;
+        for (u32 i = 1; i < cfg_.ways; i++)
+            if (w[i].stamp < w[v].stamp) v = i;
+        return v;
+    }
+    unsigned levels = log2u(cfg_.ways);
+    u32 node = 0, way = 0;
+    for (unsigned l = 0; l < levels; l++) {
+        u32 right = (plru_[set] >> node) & 1;
+        way = way * 2 + right;
+        node = 2 * node + 1 + right;
+    }
+    return way;
+}
+
+CacheLevel::Result CacheLevel::access(u64 line, bool write) {
+    Result r;
+    u64 set = line & (sets_ - 1);
+    Way* w = &ways_[set * cfg_.ways];
+    ++(write ? n_.writes : n_.reads);
+    for (u32 i = 0; i < cfg_.ways; i++) {
+        if (w[i].valid && w[i].tag == line) {
+            if (write && cfg_.write_back) w[i].dirty = true;
+            touch(set, i);
+            r.hit = true;
+            return r;
+        }
+    }
+    ++(write ? n_.write_misses : n_.read_misses);
+    if (write && !cfg_.write_allocate) return r;
+    u32 v = victim(set);
+    if (w[v].valid) {
+        ++n_.evictions;
+        if (w[v].dirty) {
+            ++n_.writebacks;
+            r.writeback = true;
+            r.victim = w[v].tag;
+        }
+    }
+    w[v].tag = line;
+    w[v].valid = true;
+    w[v].dirty = write && cfg_.write_back;
+    touch(set, v);
+    return r;
+}
+
+// ---------- CacheModel ----------
+
+CacheModel::CacheModel(const CacheConfig& c) : cfg_(c), l1i_(c.l1i), l1d_(c.l1d), l2_(c.l2) {}
+
+u32 CacheModel::fetch(u64 pc, u64 len) {
+    PcStat& ps = pc_stat(pc);
+    ++ps.fetches;
+    bool miss = false;
+    u32 lat = access(l1i_, pc, len, false, ps, miss);
+    if (miss) ++ps.fetch_misses;
+    return lat;
+}
+
+u32 CacheModel::data(u64 pc, u64 addr, bool write) {
+    PcStat& ps = pc_stat(pc);
+    ++(write ? ps.stores : ps.loads);
+    bool miss = false;
+    u32 lat = access(l1d_, addr, 8, write, ps, miss);
+    if (miss) ++ps.data_misses;
+    return lat;
+}
+
+u32 CacheModel::access(CacheLevel& l1, u64 addr, u64 len, bool write, PcStat& ps, bool& l1_miss) {
+    const CacheLevelConfig& c = l1.config();
+    if (!c.enabled) {
+        // no L1 on this side: straight to L2 / memory, 64-byte granules
+        u32 lat = 0;
+        for (u64 l = addr >> 6; l <= (addr + len - 1) >> 6; ++l) lat = std::max(lat, next_level(l, 6, write, &ps));
+        stall_ += lat;
+        return lat;
+    }
+    unsigned lb = l1.line_bits();
+    u32 lat = 0;
+    for (u64 l = addr >> lb; l <= (addr + len - 1) >> lb; ++l) {
+        u32 t = c.latency;
+        CacheLevel::Result r = l1.access(l, write);
+        if (r.writeback) write_back(r.victim, lb);
+        if (!r.hit) {
+            l1_miss = true;
+            if (!write || c.write_allocate) t += next_level(l, lb, false, &ps);  // line fill
+        }
+        // write-through and no-allocate stores go on through a write buffer
+        if (write && (!c.write_back || (!r.hit && !c.write_allocate))) next_level(l, lb, true, &ps);
+        lat = std::max(lat, t);
+    }
+    stall_ += lat - c.latency;
+    return lat;
+}
+
+// latency of reading (or writing) one L1 line from L2 / memory
+u32 CacheModel::next_level(u64 line, unsigned line_bits, bool write, PcStat* ps) {
+    if (!l2_.config().enabled) {
+        ++(write ? mem_writes_ : mem_reads_);
+        return cfg_.mem_latency;
+    }
+    const CacheLevelConfig& c = l2_.config();
+    unsigned lb = l2_.line_bits();
+    u64 first = (line << line_bits) >> lb, last = (((line + 1) << line_bits) - 1) >> lb;
+    u32 lat = 0;
+    for (u64 l = first; l <= last; ++l) {
+        u32 t = c.latency;
+        CacheLevel::Result r = l2_.access(l, write);
+        if (r.writeback) ++mem_writes_;
+        if (!r.hit) {
+            if (ps) ++ps->l2_misses;
+            if (!write || c.write_allocate) {
+                ++mem_reads_;
+                t += cfg_.mem_latency;
+            }
+        }
+        if (write && (!c.write_back || (!r.hit && !c.write_allocate))) ++mem_writes_;
+        lat = std::max(lat, t);
+    }
+    return lat;
+}
+
+void CacheModel::write_back(u64 line, unsigned line_bits) { next_level(line, line_bits, true, nullptr); }
+
+static json level_json(const CacheLevel& l) {
+    const CacheLevelConfig& c = l.config();
+    if (!c.enabled) return nullptr;
+    const CacheLevel::Counters& n = l.counters();
+    u64 acc = n.reads + n.writes, miss = n.read_misses + n.write_misses;
+    return {{"size", c.size},
+            {"ways", c.ways},
+            {"line", c.line},
+            {"replace", c.replace == CacheLevelConfig::Replace::LRU ? "lru" : "plru"},
+            {"write", std::string(c.write_back ? "wb" : "wt") + (c.write_allocate ? "+wa" : "+nwa")},
+            {"latency", c.latency},
+            {"accesses", acc},
+            {"hits", acc - miss},
+            {"misses", miss},
+            {"miss_rate", acc ? (double)miss / (double)acc : 0.0},
+            {"read_misses", n.read_misses},
+            {"write_misses", n.write_misses},
+            {"evictions", n.evictions},
+            {"writebacks", n.writebacks}};
+}
+
+json CacheModel::to_json(std::size_t max_pcs) const {
+    std::vector<std::pair<u64, const PcStat*>> v;
+    for (const auto& [pc, s] : pcs_)
+        if (s.fetch_misses || s.data_misses) v.emplace_back(pc, &s);
+    auto misses = [](const PcStat* s) { return s->fetch_misses + s->data_misses; };
+    std::sort(v.begin(), v.end(), [&](const auto& a, const auto& b) {
+        return misses(a.second) != misses(b.second) ? misses(a.second) > misses(b.second) : a.first < b.first;
+    });
+    if (v.size() > max_pcs) v.resize(max_pcs);
+    json pcs = json::array();
+    for (const auto& [pc, s] : v)
+        pcs.push_back({{"pc", pc},
+                       {"fetches", s->fetches},
+                       {"fetch_misses", s->fetch_misses},
+                       {"loads", s->loads},
+                       {"stores", s->stores},
+                       {"data_misses", s->data_misses},
+                       {"l2_misses", s->l2_misses}});
+    return {{"l1i", level_json(l1i_)},
+            {"l1d", level_json(l1d_)},
+            {"l2", level_json(l2_)},
+            {"memory", {{"latency", cfg_.mem_latency}, {"reads", mem_reads_}, {"writes", mem_writes_}}},
+            {"stall_cycles", stall_},
+            {"pcs", std::move(pcs)}};
+}
+
+}  // namespace y86
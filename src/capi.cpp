@@ -0,0 +1,154 @@
+// C interface (y86.h) over CPU, the loaders and run<>.
+#include "y86.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <string>
+
+#include "engine.h"
+#include "image.h"
+#include "worker.h"
+
+using namespace y86;
+
+struct y86_cpu {
+    CPU cpu;
+    y86_trace_fn trace = nullptr;
+    void* user = nullptr;
+    mutable std::string error;  // also set by the const y86_mem_nonzero()
+    std::string json;  // y86_state_json() result
+};
+
+static_assert(Y86_REG_NUM == REG_NUM, "y86.h register count");
+static_assert(Y86_PAGE_SIZE == PagedMem::PAGE_SIZE, "y86.h page size");
+
+static int forward_trace(const CPU&, void* user) {
+    auto* h = static_cast<y86_cpu*>(user);
+    return h->trace(h, h->user);
+}
+
+extern "C" {
+
+int y86_api_version(void) { return Y86_API_VERSION; }
+
+y86_cpu* y86_create(void) {
+    try {
+        return new y86_cpu;
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+void y86_destroy(y86_cpu* h) { delete h; }
+
+int y86_load(y86_cpu* h, const void* buf, size_t len, int bound) {
+    h->error.clear();
+    try {
+        h->cpu = CPU{};
+        LoadOptions opt;
+        opt.bound = bound != 0;
+        if (!load_program_buffer(static_cast<const char*>(buf), len, h->cpu, opt, &h->error)) {
+            if (h->error.empty()) h->error = "cannot load program";
+            h->cpu = CPU{};
+            return -1;
+        }
+    } catch (const std::exception& e) {
+        h->error = e.what();
+        h->cpu = CPU{};
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t y86_run(y86_cpu* h, uint64_t limit) {
+    // page allocation and the nonzero index can throw std::bad_alloc
+    try {
+        if (!h->trace) {
+            NoTrace t;
+            return run_auto(h->cpu, limit, t);
+        }
+        StepCallback cb{forward_trace, h};
+        return run_auto(h->cpu, limit, cb);
+    } catch (const std::exception& e) {
+        h->error = e.what();
+        return 0;
+    }
+}
+
+uint64_t y86_run_to_halt(y86_cpu* h) { return y86_run(h, ~uint64_t(0)); }
+
+void y86_set_trace(y86_cpu* h, y86_trace_fn fn, void* user) {
+    h->trace = fn;
+    h->user = user;
+}
+
+int y86_stat(const y86_cpu* h) { return static_cast<int>(h->cpu.stat); }
+
+uint64_t y86_pc(const y86_cpu* h) { return h->cpu.PC; }
+
+int y86_cc(const y86_cpu* h) {
+    const CC& c = h->cpu.cc;
+    return (c.ZF ? Y86_ZF : 0) | (c.SF ? Y86_SF : 0) | (c.OF ? Y86_OF : 0);
+}
+
+int64_t y86_reg(const y86_cpu* h, int r) {
+    return r >= 0 && r < REG_NUM ? h->cpu.R[r] : 0;
+}
+
+const int64_t* y86_regs(const y86_cpu* h) { return h->cpu.R; }
+
+const uint8_t* y86_mem_page(const y86_cpu* h, uint64_t addr, size_t* avail) {
+    u64 off = addr & PagedMem::PAGE_MASK;
+    if (avail) *avail = PagedMem::PAGE_SIZE - off;
+    const PagedMem::Page* p = h->cpu.pages.find(addr >> PagedMem::PAGE_BITS);
+    return p ? p->bytes + off : nullptr;
+}
+
+void y86_mem_read(const y86_cpu* h, uint64_t addr, void* out, size_t len) {
+    u8* dst = static_cast<u8*>(out);
+    while (len) {
+        size_t avail;
+        const uint8_t* src = y86_mem_page(h, addr, &avail);
+        size_t n = std::min(avail, len);
+        if (src)
+            std::memcpy(dst, src, n);
+        else
+            std::memset(dst, 0, n);
+        dst += n;
+        addr += n;
+        len -= n;
+    }
+}
+
+uint64_t y86_mem_read8(const y86_cpu* h, uint64_t addr) { return h->cpu.pages.read8(addr); }
+
+size_t y86_mem_nonzero(const y86_cpu* h, uint64_t* addrs, int64_t* values, size_t cap) {
+    try {
+        // rebuilds the index if a run or load left it stale
+        const auto& nz = h->cpu.qword_nonzero();
+        size_t i = 0;
+        for (auto it = nz.begin(); it != nz.end() && i < cap; ++it, ++i) {
+            if (addrs) addrs[i] = it->first;
+            if (values) values[i] = it->second;
+        }
+        return nz.size();
+    } catch (const std::exception& e) {
+        h->error = e.what();
+        return 0;
+    }
+}
+
+const char* y86_state_json(y86_cpu* h) {
+    try {
+        h->json = dump_state(h->cpu).dump();
+    } catch (const std::exception& e) {
+        h->error = e.what();
+        return nullptr;
+    }
+    return h->json.c_str();
+}
+
+const char* y86_error(const y86_cpu* h) { return h->error.c_str(); }
+
+}  // extern "C"
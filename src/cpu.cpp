@@ -1,9 +1,17 @@
 #include "cpu.h"
+
+#include <algorithm>
+#include <vector>
+
 using nlohmann::json;
 namespace y86 {
 
 bool CPU::read1(s64 a, u8& out) const {
     if (!check_addr(a, 1)) return false;
+    if (backend == MemBackend::Paged) {
+        out = pages.read1((u64)a);
+        return true;
+    }
     auto it = mem.find((u64)a);
     out = (it == mem.end() ? 0 : it->second);
     return true;
@@ -11,31 +19,206 @@ bool CPU::read1(s64 a, u8& out) const {
 
 bool CPU::write1(s64 a, u8 v) {
     if (!check_addr(a, 1)) return false;
-    mem[(u64)a] = v;
-    qword_touched.insert(align8((u64)a));
+    if (backend == MemBackend::Paged)
+        pages.write1((u64)a, v);
+    else
+        mem[(u64)a] = v;
+    if (icache.enabled) icache.on_write((u64)a, 1);
+    note_qword(align8((u64)a));
     return true;
 }
 
 bool CPU::read8(s64 a, u64& out) const {
     if (!check_addr(a, 8)) return false;
-    out = 0;
+    out = read8_unchecked((u64)a);
+    return true;
+}
+
+u64 CPU::read8_unchecked(u64 a) const {
+    if (backend == MemBackend::Paged) return pages.read8(a);
+    u64 out = 0;
     for (int i = 0; i < 8; i++) {
-        auto it = mem.find((u64)a + i);
+        auto it = mem.find(a + i);
         u8 b = (it == mem.end() ? 0 : it->second);
         out |= (u64)b << (8 * i);
     }
-    return true;
+    return out;
 }
 
 bool CPU::write8(s64 a, u64 v) {
     if (!check_addr(a, 8)) return false;
-    for (int i = 0; i < 8; i++) {
-        mem[(u64)a + i] = (u8)((v >> (8 * i)) & 0xFF);
+    write8_unchecked((u64)a, v);
+    return true;
+}
+
+void CPU::write8_unchecked(u64 a, u64 v) {
+    store8(a, v);
+    note_qword(align8(a));
+    // an unaligned store also changes the next block; a rebuilt index would
+    // list it, so the live one must too
+    if ((a & 7) != 0) note_qword(align8(a) + 8);
+}
+
+bool CPU::write_bytes(s64 a, const u8* src, std::size_t n) {
+    if (n == 0) return true;
+    if (!check_addr(a, n) || (u64)a + n < (u64)a) {
+        // partially out of range: keep write1()'s per-byte behaviour
+        bool ok = true;
+        for (std::size_t i = 0; i < n; i++) ok &= write1(a + (s64)i, src[i]);
+        return ok;
     }
-    qword_touched.insert(align8((u64)a));
+    if (backend == MemBackend::Paged) {
+        pages.write_bytes((u64)a, src, n);
+    } else {
+        for (std::size_t i = 0; i < n; i++) mem[(u64)a + i] = src[i];
+    }
+    if (icache.enabled) icache.on_write((u64)a, n);
+    note_range(align8((u64)a), align8((u64)a + n - 1));
     return true;
 }
 
+// the store itself: backend and decode cache, no index
+void CPU::store8(u64 a, u64 v) {
+    if (backend == MemBackend::Paged) {
+        pages.write8(a, v);
+    } else {
+        for (int i = 0; i < 8; i++) {
+            mem[a + i] = (u8)((v >> (8 * i)) & 0xFF);
+        }
+    }
+    if (icache.enabled) icache.on_write(a, 8);
+}
+
+// unchecked read of an aligned qword, straight from the backend
+u64 CPU::load_qword(u64 base) const {
+    if (backend == MemBackend::Paged) return pages.read8(base);
+    u64 out = 0;
+    for (int i = 0; i < 8; i++) {
+        auto it = mem.find(base + i);
+        if (it != mem.end()) out |= (u64)it->second << (8 * i);
+    }
+    return out;
+}
+
+// refresh the index for one block and log it if its value changed; while
+// the index is stale only the ring is kept
+void CPU::note_qword(u64 base) {
+    if (index_stale_) {
+        dirty_ring[dirty_seq++ % DIRTY_RING] = base;
+        return;
+    }
+    s64 v = (s64)load_qword(base);
+    auto it = nonzero_.lower_bound(base);
+    bool found = it != nonzero_.end() && it->first == base;
+    if (v != 0) {
+        if (!found)
+            nonzero_.emplace_hint(it, base, v);
+        else if (it->second != v)
+            it->second = v;
+        else
+            return;
+    } else {
+        if (!found) return;
+        nonzero_.erase(it);
+    }
+    dirty_ring[dirty_seq++ % DIRTY_RING] = base;
+}
+
+// note_qword() for every block in [first, last], walking the index once
+void CPU::note_range(u64 first, u64 last) {
+    if (index_stale_) {
+        // only the last DIRTY_RING blocks can still be read back from the ring
+        u64 n = (last - first) / 8 + 1;
+        if (n > DIRTY_RING) {
+            dirty_seq += n - DIRTY_RING;
+            first = last - 8 * (DIRTY_RING - 1);
+        }
+        for (u64 b = first; b <= last; b += 8) dirty_ring[dirty_seq++ % DIRTY_RING] = b;
+        return;
+    }
+    auto it = nonzero_.lower_bound(first);
+    for (u64 b = first; b <= last; b += 8) {
+        s64 v = (s64)load_qword(b);
+        bool found = it != nonzero_.end() && it->first == b;
+        if (v != 0) {
+            if (!found)
+                nonzero_.emplace_hint(it, b, v);
+            else if (it->second != v)
+                (it++)->second = v;
+            else {
+                ++it;
+                continue;
+            }
+        } else {
+            if (!found) continue;
+            it = nonzero_.erase(it);
+        }
+        dirty_ring[dirty_seq++ % DIRTY_RING] = b;
+    }
+}
+
+Checkpoint CPU::checkpoint() const {
+    Checkpoint c;
+    std::copy(R, R + REG_NUM, c.R);
+    c.scratch = scratch;
+    c.PC = PC;
+    c.cc = cc;
+    c.stat = stat;
+    c.backend = backend;
+    if (backend == MemBackend::Paged)
+        c.pages = pages;
+    else
+        c.mem = mem;
+    return c;
+}
+
+void CPU::restore(const Checkpoint& c) {
+    std::copy(c.R, c.R + REG_NUM, R);
+    scratch = c.scratch;
+    PC = c.PC;
+    cc = c.cc;
+    stat = c.stat;
+    backend = c.backend;
+    if (backend == MemBackend::Paged) {
+        pages = c.pages;
+        mem.clear();
+    } else {
+        mem = c.mem;
+        pages.clear();
+    }
+    // all of memory may have changed: rebuilt on the next qword_nonzero()
+    nonzero_.clear();
+    index_stale_ = true;
+    dirty_seq += DIRTY_RING + 1;
+    dirty_epoch = dirty_seq;
+    icache.flush();
+}
+
+// the index from scratch, in address order so it is built by appending
+void CPU::rebuild_index() const {
+    nonzero_.clear();
+    index_stale_ = false;
+    if (backend == MemBackend::Paged) {
+        std::vector<u64> pns;
+        pages.for_each_page([&](u64 pn, const PagedMem::Page&) { pns.push_back(pn); });
+        std::sort(pns.begin(), pns.end());
+        for (u64 pn : pns) {
+            const PagedMem::Page* p = pages.find(pn);
+            for (u64 off = 0; off < PagedMem::PAGE_SIZE; off += 8) {
+                if (s64 v = (s64)PagedMem::load_le64(p->bytes + off))
+                    nonzero_.emplace_hint(nonzero_.end(), (pn << PagedMem::PAGE_BITS) + off, v);
+            }
+        }
+    } else {
+        for (auto& kv : mem)
+            if (kv.second) nonzero_.emplace(align8(kv.first), 0);
+        for (auto it = nonzero_.begin(); it != nonzero_.end();) {
+            it->second = (s64)load_qword(it->first);
+            it = it->second ? std::next(it) : nonzero_.erase(it);
+        }
+    }
+}
+
 json CPU::dump_regs() const {
     json j = json::object();
     for (int i = 0; i < REG_NUM; i++) {
@@ -50,13 +233,7 @@ json CPU::dump_cc() const {
 
 json CPU::dump_mem_nonzero() const {
     json j = json::object();
-    for (auto base : qword_touched) {
-        u64 raw = 0;
-        // 这里的 read8 不会失败（base >= 0）
-        const_cast<CPU*>(this)->read8((s64)base, raw);
-        s64 val = (s64)raw;
-        if (val != 0) j[std::to_string(base)] = val;
-    }
+    for (auto& kv : qword_nonzero()) j[std::to_string(kv.first)] = kv.second;
     return j;
 }
 
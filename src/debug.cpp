@@ -0,0 +1,421 @@
+#include "debug.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "cpu.h"
+#include "parse.h"
+
+using nlohmann::json;
+
+namespace y86 {
+
+// ---------- Condition ----------
+
+// recursive descent straight to bytecode, one function per precedence level
+class ConditionParser {
+public:
+    using Op = Condition::Op;
+
+    ConditionParser(const std::string& src, Condition& out) : src_(src), p_(src.c_str()), c_(out) {}
+
+    bool parse(std::string* err) {
+        c_.code_.clear();
+        c_.anchored_ = false;
+        skip();
+        if (!*p_) fail("empty expression");
+        if (err_.empty()) parse_or();
+        if (err_.empty() && *p_) fail("unexpected '" + std::string(1, *p_) + "'");
+        if (err_.empty() && max_depth() > Condition::MAX_STACK) fail("expression too deep");
+        if (!err_.empty()) {
+            if (err) *err = err_;
+            return false;
+        }
+        c_.src_ = src_;
+        return true;
+    }
+
+private:
+    void skip() {
+        while (std::isspace((unsigned char)*p_)) ++p_;
+    }
+    void fail(const std::string& why) {
+        if (err_.empty()) err_ = "col " + std::to_string(p_ - src_.c_str() + 1) + ": " + why;
+    }
+    // matches `tok` unless it is the prefix of a longer operator
+    bool eat(const char* tok) {
+        std::size_t n = std::strlen(tok);
+        if (std::strncmp(p_, tok, n)) return false;
+        char next = p_[n];
+        if (n == 1 && (next == tok[0] || next == '=') && std::strchr("&|<>!=", tok[0])) return false;
+        p_ += n;
+        skip();
+        return true;
+    }
+    void emit(Op op, u64 imm = 0) { c_.code_.push_back({op, imm}); }
+
+    void parse_or() {
+        bool any = false;
+        parse_and();
+        while (err_.empty() && eat("||")) {
+            parse_and();
+            emit(Op::LOR);
+            any = true;
+        }
+        if (any && depth_ == 0) c_.anchored_ = false;
+    }
+    void parse_and() {
+        std::size_t start = c_.code_.size();
+        parse_cmp();
+        note_anchor(start);
+        while (err_.empty() && eat("&&")) {
+            start = c_.code_.size();
+            parse_cmp();
+            note_anchor(start);
+            emit(Op::LAND);
+        }
+    }
+    // a top-level `pc == N` / `N == pc` conjunct ties the condition to N
+    void note_anchor(std::size_t start) {
+        const auto& k = c_.code_;
+        if (depth_ || c_.anchored_ || k.size() - start != 3 || k[start + 2].op != Op::EQ) return;
+        if (k[start].op == Op::PC && k[start + 1].op == Op::CONST) c_.anchor_ = k[start + 1].imm;
+        else if (k[start].op == Op::CONST && k[start + 1].op == Op::PC) c_.anchor_ = k[start].imm;
+        else return;
+        c_.anchored_ = true;
+    }
+    void parse_cmp() {
+        parse_bitor();
+        static const struct {
+            const char* tok;
+            Op op;
+        } ops[] = {{"==", Op::EQ}, {"!=", Op::NE}, {"<=", Op::LE},
+                   {">=", Op::GE}, {"<", Op::LT},  {">", Op::GT}};
+        for (const auto& o : ops) {
+            if (err_.empty() && eat(o.tok)) {
+                parse_bitor();
+                emit(o.op);
+                return;
+            }
+        }
+    }
+    void parse_bitor() {
+        parse_bitxor();
+        while (err_.empty() && eat("|")) {
+            parse_bitxor();
+            emit(Op::OR);
+        }
+    }
+    void parse_bitxor() {
+        parse_bitand();
+        while (err_.empty() && eat("^")) {
+            parse_bitand();
+            emit(Op::XOR);
+        }
+    }
+    void parse_bitand() {
+        parse_sum();
+        while (err_.empty() && eat("&")) {
+            parse_sum();
+            emit(Op::AND);
+        }
+    }
+    void parse_sum() {
+        parse_unary();
+        while (err_.empty()) {
+            if (eat("+")) {
+                parse_unary();
+                emit(Op::ADD);
+            } else if (eat("-")) {
+                parse_unary();
+                emit(Op::SUB);
+            } else {
+                break;
+            }
+        }
+    }
+    void parse_unary() {
+        if (eat("!")) {
+            parse_unary();
+            emit(Op::NOT);
+        } else if (eat("-")) {
+            parse_unary();
+            emit(Op::NEG);
+        } else if (eat("~")) {
+            parse_unary();
+            emit(Op::BNOT);
+        } else {
+            parse_primary();
+        }
+    }
+    void parse_primary() {
+        char open = *p_;
+        if (open == '(' || open == '[') {
+            ++p_;
+            skip();
+            ++depth_;
+            parse_or();
+            --depth_;
+            if (!err_.empty()) return;
+            if (!eat(open == '(' ? ")" : "]")) return fail(open == '(' ? "expected ')'" : "expected ']'");
+            if (open == '[') emit(Op::LOAD);
+            return;
+        }
+        if (std::isdigit((unsigned char)*p_)) {
+            char* end = nullptr;
+            bool hex = p_[0] == '0' && (p_[1] == 'x' || p_[1] == 'X');
+            // strtoull would skip blanks and take a sign after the 0x
+            if (hex && !std::isxdigit((unsigned char)p_[2])) return fail("bad number");
+            errno = 0;
+            u64 v = std::strtoull(hex ? p_ + 2 : p_, &end, hex ? 16 : 10);
+            if (std::isalnum((unsigned char)*end)) return fail("bad number");
+            if (errno == ERANGE) return fail("number out of range");
+            p_ = end;
+            skip();
+            emit(Op::CONST, v);
+            return;
+        }
+        const char* name = p_;
+        if (*p_ == '%') ++p_;
+        const char* word = p_;
+        while (std::isalnum((unsigned char)*p_)) ++p_;
+        std::string id(word, p_);
+        for (char& ch : id) ch = (char)std::tolower((unsigned char)ch);
+        if (id.empty()) return fail(*name ? "unexpected '" + std::string(1, *name) + "'" : "unexpected end");
+        skip();
+        for (int i = 0; i < REG_NUM; i++) {
+            if (id == reg_name(i)) return emit(Op::REG, (u64)i);
+        }
+        if (*name != '%') {
+            if (id == "pc") return emit(Op::PC);
+            if (id == "zf") return emit(Op::FLAG, 0);
+            if (id == "sf") return emit(Op::FLAG, 1);
+            if (id == "of") return emit(Op::FLAG, 2);
+        }
+        p_ = name;
+        fail("unknown name '" + std::string(name, word + id.size()) + "'");
+    }
+    std::size_t max_depth() const {
+        std::size_t d = 0, m = 0;
+        for (const auto& i : c_.code_) {
+            if (i.op <= Op::FLAG) m = std::max(m, ++d);
+            else if (i.op >= Op::ADD) --d;
+        }
+        return m;
+    }
+
+    const std::string& src_;
+    const char* p_;
+    Condition& c_;
+    std::string err_;
+    int depth_ = 0;  // () / [] nesting
+};
+
+bool Condition::compile(const std::string& src, Condition& out, std::string* err) {
+    return ConditionParser(src, out).parse(err);
+}
+
+bool Condition::eval(const CPU& S) const {
+    s64 st[MAX_STACK];
+    std::size_t sp = 0;
+    for (const Insn& i : code_) {
+        switch (i.op) {
+            case CONST: st[sp++] = (s64)i.imm; break;
+            case REG: st[sp++] = S.R[i.imm]; break;
+            case PC: st[sp++] = (s64)S.PC; break;
+            case FLAG: st[sp++] = i.imm == 0 ? S.cc.ZF : i.imm == 1 ? S.cc.SF : S.cc.OF; break;
+            case LOAD: {
+                u64 v = 0;
+                if (!S.read8(st[sp - 1], v)) v = 0;
+                st[sp - 1] = (s64)v;
+                break;
+            }
+            case NEG: st[sp - 1] = (s64)(0 - (u64)st[sp - 1]); break;
+            case NOT: st[sp - 1] = !st[sp - 1]; break;
+            case BNOT: st[sp - 1] = ~st[sp - 1]; break;
+            default: {
+                s64 b = st[--sp], &a = st[sp - 1];
+                switch (i.op) {
+                    case ADD: a = (s64)((u64)a + (u64)b); break;
+                    case SUB: a = (s64)((u64)a - (u64)b); break;
+                    case AND: a &= b; break;
+                    case OR: a |= b; break;
+                    case XOR: a ^= b; break;
+                    case EQ: a = a == b; break;
+                    case NE: a = a != b; break;
+                    case LT: a = a < b; break;
+                    case LE: a = a <= b; break;
+                    case GT: a = a > b; break;
+                    case GE: a = a >= b; break;
+                    case LAND: a = a && b; break;
+                    case LOR: a = a || b; break;
+                    default: break;
+                }
+            }
+        }
+    }
+    return sp && st[0] != 0;
+}
+
+// ---------- Debugger ----------
+
+bool Debugger::add_break(const std::string& spec, std::string* err) {
+    Break b;
+    if (!Condition::compile(spec, b.expr, err)) return false;
+    if (b.expr.constant()) {
+        add_break((u64)b.expr.value());
+        return true;
+    }
+    b.cond = true;
+    b.at_pc = b.expr.anchored();
+    b.pc = b.expr.anchor();
+    u32 id = (u32)breaks_.size();
+    if (b.at_pc) {
+        at_pc_[b.pc].push_back(id);
+        set(pc_filter_, b.pc ^ (b.pc >> 12));
+    } else {
+        floating_list_.push_back(id);
+        floating_ = true;
+    }
+    breaks_.push_back(std::move(b));
+    return true;
+}
+
+void Debugger::add_break(u64 pc) {
+    Break b;
+    b.pc = pc;
+    b.at_pc = true;
+    at_pc_[pc].push_back((u32)breaks_.size());
+    set(pc_filter_, pc ^ (pc >> 12));
+    breaks_.push_back(std::move(b));
+}
+
+bool Debugger::add_watch(const std::string& spec, std::string* err) {
+    std::vector<std::string> f;
+    for (std::size_t p = 0;;) {
+        std::size_t q = spec.find(':', p);
+        f.push_back(spec.substr(p, q - p));
+        if (q == std::string::npos) break;
+        p = q + 1;
+    }
+    auto fail = [&](const std::string& why) {
+        if (err) *err = why;
+        return false;
+    };
+    u64 addr, len = 8;
+    u8 access = WRITE;
+    if (f.size() > 3 || !parse_u64(f[0], addr)) return fail("expected ADDR[:LEN][:r|w|rw]");
+    for (std::size_t i = 1; i < f.size(); i++) {
+        if (f[i] == "r") access = READ;
+        else if (f[i] == "w") access = WRITE;
+        else if (f[i] == "rw" || f[i] == "wr") access = READ | WRITE;
+        else if (i == 1 && parse_u64(f[i], len) && len) continue;
+        else return fail("bad field '" + f[i] + "' in '" + spec + "'");
+    }
+    if ((s64)addr < 0 || addr + len < addr) return fail("address out of range");
+    add_watch(addr, len, access);
+    return true;
+}
+
+void Debugger::add_watch(u64 addr, u64 len, u8 access) {
+    if (!len) return;
+    watches_.push_back({addr, addr + len, access});
+    u64 first = addr >> PagedMem::PAGE_BITS, last = (addr + len - 1) >> PagedMem::PAGE_BITS;
+    for (u64 pn = first; pn <= last && pn - first < FILTER_BITS; ++pn) set(page_filter_, pn);
+}
+
+void Debugger::clear() {
+    breaks_.clear();
+    at_pc_.clear();
+    floating_list_.clear();
+    watches_.clear();
+    std::memset(pc_filter_, 0, sizeof pc_filter_);
+    std::memset(page_filter_, 0, sizeof page_filter_);
+    floating_ = pending_ = stopped_ = false;
+    hit_ = Hit{};
+}
+
+long Debugger::find_watch(u64 addr, u8 access) const {
+    for (std::size_t i = 0; i < watches_.size(); i++) {
+        const Watch& w = watches_[i];
+        if ((w.access & access) && addr < w.hi && addr + 8 > w.lo) return (long)i;
+    }
+    return -1;
+}
+
+void Debugger::watch_hit(u64 addr, bool write) {
+    if (pending_) return;
+    long i = find_watch(addr, write ? WRITE : READ);
+    if (i < 0) return;
+    hit_ = Hit{Hit::WATCH, (u32)i, pc_, addr, write};
+    pending_ = true;
+}
+
+bool Debugger::watch_store(u64 addr, u64 pc) {
+    long i = find_watch(addr, WRITE);
+    if (i < 0) return false;
+    hit_ = Hit{Hit::WATCH, (u32)i, pc, addr, true};
+    return true;
+}
+
+bool Debugger::stop(const CPU& S) {
+    if (pending_) {
+        pending_ = false;
+        return stopped_ = true;
+    }
+    return stopped_ = break_at(S);
+}
+
+bool Debugger::break_at(const CPU& S) {
+    auto it = at_pc_.find(S.PC);
+    if (it != at_pc_.end()) {
+        for (u32 i : it->second) {
+            if (!breaks_[i].cond || breaks_[i].expr.eval(S)) {
+                hit_ = Hit{Hit::BREAK, i, S.PC, 0, false};
+                return true;
+            }
+        }
+    }
+    for (u32 i : floating_list_) {
+        if (breaks_[i].expr.eval(S)) {
+            hit_ = Hit{Hit::BREAK, i, S.PC, 0, false};
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string Debugger::describe(const Hit& h) const {
+    switch (h.kind) {
+        case Hit::BREAK: {
+            std::string s = "breakpoint " + std::to_string(h.id) + " at PC=" + std::to_string(h.pc);
+            const Break& b = breaks_[h.id];
+            if (b.cond) s += " (" + b.expr.source() + ")";
+            return s;
+        }
+        case Hit::WATCH:
+            return "watchpoint " + std::to_string(h.id) + ": " + (h.write ? "write" : "read") + " of " +
+                   std::to_string(h.addr) + " by PC=" + std::to_string(h.pc);
+        default:
+            return "no stop";
+    }
+}
+
+json Debugger::to_json(const Hit& h) const {
+    json j;
+    if (h.kind == Hit::BREAK) {
+        j = {{"kind", "break"}, {"id", h.id}, {"pc", h.pc}};
+        if (breaks_[h.id].cond) j["cond"] = breaks_[h.id].expr.source();
+    } else if (h.kind == Hit::WATCH) {
+        j = {{"kind", "watch"}, {"id", h.id}, {"pc", h.pc}, {"addr", h.addr},
+             {"access", h.write ? "write" : "read"}};
+    } else {
+        j = {{"kind", "none"}};
+    }
+    return j;
+}
+
+}  // namespace y86
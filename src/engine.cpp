@@ -0,0 +1,486 @@
+#include "engine.h"
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+
+#include "bintrace.h"
+#include "bpred.h"
+#include "cachesim.h"
+#include "debug.h"
+#include "history.h"
+#include "jit.h"
+#include "pipe.h"
+#include "profile.h"
+#include "trace.h"
+#include "worker.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define Y86_COMPUTED_GOTO 1
+#endif
+
+namespace y86 {
+
+namespace {
+
+enum Handler : u8 {
+    H_HALT, H_NOP, H_RRMOV,
+    H_CMOVLE, H_CMOVL, H_CMOVE, H_CMOVNE, H_CMOVGE, H_CMOVG,
+    H_IRMOV, H_RMMOV, H_MRMOV,
+    H_ADD, H_SUB, H_AND, H_XOR,
+    H_JMP, H_JLE, H_JL, H_JE, H_JNE, H_JGE, H_JG,
+    H_CALL, H_RET, H_PUSH, H_POP, H_INS,
+    H_COUNT
+};
+
+// instruction byte (icode<<4 | ifun) -> handler. Unknown condition codes
+// never hold, so cmovXX/jXX with ifun > 6 behave like nop.
+constexpr std::array<u8, 256> make_handler_map() {
+    std::array<u8, 256> m{};
+    for (int b = 0; b < 256; b++) {
+        int ic = b >> 4, fn = b & 0xF;
+        u8 h = H_INS;
+        switch (ic) {
+            case 0x0: h = H_HALT; break;
+            case 0x1: h = H_NOP; break;
+            case 0x2: h = fn == 0 ? (u8)H_RRMOV : fn <= 6 ? (u8)(H_CMOVLE + fn - 1) : (u8)H_NOP; break;
+            case 0x3: h = H_IRMOV; break;
+            case 0x4: h = H_RMMOV; break;
+            case 0x5: h = H_MRMOV; break;
+            case 0x6: h = fn <= 3 ? (u8)(H_ADD + fn) : (u8)H_INS; break;
+            case 0x7: h = fn <= 6 ? (u8)(H_JMP + fn) : (u8)H_NOP; break;
+            case 0x8: h = H_CALL; break;
+            case 0x9: h = H_RET; break;
+            case 0xA: h = H_PUSH; break;
+            case 0xB: h = H_POP; break;
+            default: break;
+        }
+        m[b] = h;
+    }
+    return m;
+}
+
+constexpr std::array<u8, 256> HANDLER_OF = make_handler_map();
+
+inline const Decoded* fetch(CPU& S, u64 pc, Decoded& tmp) {
+    if (S.icache.enabled) {
+        if (const Decoded* hit = S.icache.lookup(pc)) return hit;
+    }
+    S.PC = pc;
+    tmp = decode_uncached(S);
+    if (!tmp.ok) return nullptr;
+    if (S.icache.enabled) S.icache.insert(pc, tmp);
+    return &tmp;
+}
+
+// rB operand as read by step(): RNONE falls back to %rsp
+inline int base_reg(const Decoded* d) { return d->rB == RNONE ? 4 : d->rB; }
+
+}  // namespace
+
+template <class Trace, class Bounds>
+u64 run(CPU& S, u64 limit, Trace& trace) {
+    if (limit == 0 || S.stat != Stat::AOK) return 0;
+
+    // r[15] is the RNONE scratch slot, so operand access is branch-free
+    s64 r[16];
+    for (int i = 0; i < REG_NUM; i++) r[i] = S.R[i];
+    r[RNONE] = S.scratch;
+    CC cc = S.cc;
+    u64 pc = S.PC;
+    u64 n = 0;
+    const Decoded* d = nullptr;
+    Decoded tmp;
+
+#ifdef Y86_COMPUTED_GOTO
+    static void* const labels[H_COUNT] = {
+        &&h_HALT, &&h_NOP, &&h_RRMOV,
+        &&h_CMOVLE, &&h_CMOVL, &&h_CMOVE, &&h_CMOVNE, &&h_CMOVGE, &&h_CMOVG,
+        &&h_IRMOV, &&h_RMMOV, &&h_MRMOV,
+        &&h_ADD, &&h_SUB, &&h_AND, &&h_XOR,
+        &&h_JMP, &&h_JLE, &&h_JL, &&h_JE, &&h_JNE, &&h_JGE, &&h_JG,
+        &&h_CALL, &&h_RET, &&h_PUSH, &&h_POP, &&h_INS,
+    };
+#define HANDLER(h) h_##h:
+#define DISPATCH()                                               \
+    do {                                                         \
+        if (n == limit) goto out;                                \
+        ++n;                                                     \
+        if (!(d = fetch(S, pc, tmp))) goto out;                  \
+        PROFILE(insn(pc, *d));                                   \
+        goto* labels[HANDLER_OF[(d->icode << 4) | d->ifun]];     \
+    } while (0)
+#define NEXT()           \
+    do {                 \
+        TRACE_STEP();    \
+        STOP_CHECK();    \
+        DISPATCH();      \
+    } while (0)
+#else
+#define HANDLER(h) case H_##h:
+#define NEXT()        \
+    do {              \
+        TRACE_STEP(); \
+        STOP_CHECK(); \
+        goto dispatch; \
+    } while (0)
+#endif
+
+    // write the locals back so a per-step trace sees the complete state,
+    // RNONE scratch included
+    auto sync = [&] {
+        for (int i = 0; i < REG_NUM; i++) S.R[i] = r[i];
+        S.scratch = r[RNONE];
+        S.cc = cc;
+        S.PC = pc;
+    };
+#define PROFILE(hook)                                  \
+    do {                                               \
+        if constexpr (Trace::profile) trace.hook;      \
+    } while (0)
+#define TRACE_STEP()                                   \
+    do {                                               \
+        if constexpr (Trace::per_step) {               \
+            sync();                                    \
+            trace.step(S);                             \
+        }                                              \
+    } while (0)
+#define STOP_CHECK()                                   \
+    do {                                               \
+        if constexpr (policy_stops<Trace>::value) {    \
+            if (trace.check(pc)) {                     \
+                sync();                                \
+                if (trace.stop(S)) goto out;           \
+            }                                          \
+        }                                              \
+    } while (0)
+
+#define STORE(addr)                                    \
+    do {                                               \
+        if constexpr (policy_stores<Trace>::value)     \
+            trace.store(S, addr);                      \
+    } while (0)
+
+#define WRITE8(addr, v)                                \
+    do {                                               \
+        if constexpr (keeps_index<Trace>)              \
+            S.write8_unchecked(addr, v);               \
+        else                                           \
+            S.write8_unindexed(addr, v);               \
+    } while (0)
+
+#define ADR_OUT()            \
+    do {                     \
+        S.stat = Stat::ADR;  \
+        goto out;            \
+    } while (0)
+
+#define CMOV(name, cond)                 \
+    HANDLER(name) {                      \
+        bool t = (cond);                 \
+        PROFILE(branch(t));              \
+        if (t) r[d->rB] = r[d->rA];      \
+        pc = d->valP;                    \
+        NEXT();                          \
+    }
+
+#define JUMP(name, cond)                 \
+    HANDLER(name) {                      \
+        bool t = (cond);                 \
+        PROFILE(branch(t));              \
+        pc = t ? d->valC : d->valP;      \
+        NEXT();                          \
+    }
+
+#define C_LE ((cc.SF ^ cc.OF) || cc.ZF)
+#define C_L (cc.SF ^ cc.OF)
+#define C_E (cc.ZF)
+#define C_NE (!cc.ZF)
+#define C_GE (!(cc.SF ^ cc.OF))
+#define C_G (!(cc.SF ^ cc.OF) && !cc.ZF)
+
+#ifdef Y86_COMPUTED_GOTO
+    DISPATCH();
+#else
+dispatch:
+    if (n == limit) goto out;
+    ++n;
+    if (!(d = fetch(S, pc, tmp))) goto out;
+    PROFILE(insn(pc, *d));
+    switch (HANDLER_OF[(d->icode << 4) | d->ifun]) {
+#endif
+
+    HANDLER(HALT) {
+        S.stat = Stat::HLT;
+        goto out;
+    }
+    HANDLER(NOP) {
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(RRMOV) {
+        r[d->rB] = r[d->rA];
+        pc = d->valP;
+        NEXT();
+    }
+    CMOV(CMOVLE, C_LE)
+    CMOV(CMOVL, C_L)
+    CMOV(CMOVE, C_E)
+    CMOV(CMOVNE, C_NE)
+    CMOV(CMOVGE, C_GE)
+    CMOV(CMOVG, C_G)
+    HANDLER(IRMOV) {
+        r[d->rB] = (s64)d->valC;
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(RMMOV) {
+        u64 ea = (u64)r[base_reg(d)] + d->valC;
+        if (!Bounds::ok(S, ea, 8)) ADR_OUT();
+        STORE(ea);
+        WRITE8(ea, (u64)r[d->rA]);
+        PROFILE(mem(ea, true));
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(MRMOV) {
+        u64 ea = (u64)r[base_reg(d)] + d->valC;
+        if (!Bounds::ok(S, ea, 8)) ADR_OUT();
+        r[d->rA] = (s64)S.read8_unchecked(ea);
+        PROFILE(mem(ea, false));
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(ADD) {
+        s64 a = r[d->rA], b = r[base_reg(d)];
+        s64 v = (s64)((u64)b + (u64)a);
+        cc.ZF = v == 0;
+        cc.SF = v < 0;
+        cc.OF = ((a < 0) == (b < 0)) && ((v < 0) != (a < 0));
+        r[d->rB] = v;
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(SUB) {
+        s64 a = r[d->rA], b = r[base_reg(d)];
+        s64 v = (s64)((u64)b - (u64)a);
+        cc.ZF = v == 0;
+        cc.SF = v < 0;
+        cc.OF = ((b < 0) != (a < 0)) && ((v < 0) != (b < 0));
+        r[d->rB] = v;
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(AND) {
+        s64 v = r[base_reg(d)] & r[d->rA];
+        cc.ZF = v == 0;
+        cc.SF = v < 0;
+        cc.OF = 0;
+        r[d->rB] = v;
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(XOR) {
+        s64 v = r[base_reg(d)] ^ r[d->rA];
+        cc.ZF = v == 0;
+        cc.SF = v < 0;
+        cc.OF = 0;
+        r[d->rB] = v;
+        pc = d->valP;
+        NEXT();
+    }
+    JUMP(JMP, true)
+    JUMP(JLE, C_LE)
+    JUMP(JL, C_L)
+    JUMP(JE, C_E)
+    JUMP(JNE, C_NE)
+    JUMP(JGE, C_GE)
+    JUMP(JG, C_G)
+    HANDLER(CALL) {
+        u64 sp = (u64)r[4] - 8;
+        r[4] = (s64)sp;
+        if (!Bounds::ok(S, sp, 8)) ADR_OUT();
+        STORE(sp);
+        WRITE8(sp, d->valP);
+        PROFILE(mem(sp, true));
+        PROFILE(call(d->valC, d->valP));
+        pc = d->valC;
+        NEXT();
+    }
+    HANDLER(RET) {
+        u64 sp = (u64)r[4];
+        if (!Bounds::ok(S, sp, 8)) ADR_OUT();
+        r[4] = (s64)(sp + 8);
+        pc = S.read8_unchecked(sp);
+        PROFILE(mem(sp, false));
+        PROFILE(ret(pc));
+        NEXT();
+    }
+    HANDLER(PUSH) {
+        s64 a = r[d->rA];
+        u64 sp = (u64)r[base_reg(d)] - 8;
+        r[4] = (s64)sp;
+        if (!Bounds::ok(S, sp, 8)) ADR_OUT();
+        STORE(sp);
+        WRITE8(sp, (u64)a);
+        PROFILE(mem(sp, true));
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(POP) {
+        u64 sp = (u64)r[base_reg(d)];
+        if (!Bounds::ok(S, sp, 8)) ADR_OUT();
+        u64 v = S.read8_unchecked(sp);
+        PROFILE(mem(sp, false));
+        r[4] = (s64)(sp + 8);
+        r[d->rA] = (s64)v;
+        pc = d->valP;
+        NEXT();
+    }
+    HANDLER(INS) {
+        S.stat = Stat::INS;
+        goto out;
+    }
+
+#ifndef Y86_COMPUTED_GOTO
+        default:
+            goto out;
+    }
+#endif
+
+out:
+    sync();
+    // the failing instruction still counts as a step and is traced
+    if constexpr (Trace::per_step) {
+        if (S.stat != Stat::AOK) trace.step(S);
+    }
+    trace.end(S, n);
+    return n;
+
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+#undef TRACE_STEP
+#undef STOP_CHECK
+#undef STORE
+#undef WRITE8
+#undef PROFILE
+#undef ADR_OUT
+#undef CMOV
+#undef JUMP
+#undef C_LE
+#undef C_L
+#undef C_E
+#undef C_NE
+#undef C_GE
+#undef C_G
+}
+
+template u64 run<NoTrace, Unbounded>(CPU&, u64, NoTrace&);
+template u64 run<NoTrace, Bounded>(CPU&, u64, NoTrace&);
+template u64 run<TraceEach<JsonTraceWriter>, Unbounded>(CPU&, u64, TraceEach<JsonTraceWriter>&);
+template u64 run<TraceEach<JsonTraceWriter>, Bounded>(CPU&, u64, TraceEach<JsonTraceWriter>&);
+template u64 run<TraceFinal<JsonTraceWriter>, Unbounded>(CPU&, u64, TraceFinal<JsonTraceWriter>&);
+template u64 run<TraceFinal<JsonTraceWriter>, Bounded>(CPU&, u64, TraceFinal<JsonTraceWriter>&);
+template u64 run<TraceEach<DeltaTraceWriter>, Unbounded>(CPU&, u64, TraceEach<DeltaTraceWriter>&);
+template u64 run<TraceEach<DeltaTraceWriter>, Bounded>(CPU&, u64, TraceEach<DeltaTraceWriter>&);
+template u64 run<TraceEach<BinTraceWriter>, Unbounded>(CPU&, u64, TraceEach<BinTraceWriter>&);
+template u64 run<TraceEach<BinTraceWriter>, Bounded>(CPU&, u64, TraceEach<BinTraceWriter>&);
+template u64 run<StepCallback, Unbounded>(CPU&, u64, StepCallback&);
+template u64 run<StepCallback, Bounded>(CPU&, u64, StepCallback&);
+template u64 run<PcStop, Unbounded>(CPU&, u64, PcStop&);
+template u64 run<PcStop, Bounded>(CPU&, u64, PcStop&);
+template u64 run<StoreHook, Unbounded>(CPU&, u64, StoreHook&);
+template u64 run<StoreHook, Bounded>(CPU&, u64, StoreHook&);
+template u64 run<Profiler, Unbounded>(CPU&, u64, Profiler&);
+template u64 run<Profiler, Bounded>(CPU&, u64, Profiler&);
+template u64 run<CacheSim, Unbounded>(CPU&, u64, CacheSim&);
+template u64 run<CacheSim, Bounded>(CPU&, u64, CacheSim&);
+template u64 run<BranchSim, Unbounded>(CPU&, u64, BranchSim&);
+template u64 run<BranchSim, Bounded>(CPU&, u64, BranchSim&);
+template u64 run<Debugger, Unbounded>(CPU&, u64, Debugger&);
+template u64 run<Debugger, Bounded>(CPU&, u64, Debugger&);
+template u64 run<History, Unbounded>(CPU&, u64, History&);
+template u64 run<History, Bounded>(CPU&, u64, History&);
+
+u64 run_threaded(CPU& S, u64 limit) {
+    NoTrace t;
+    return run_auto(S, limit, t);
+}
+
+u64 run_engine(Engine e, CPU& S, u64 limit) {
+    if (e == Engine::Threaded) return run_threaded(S, limit);
+    if (e == Engine::Jit) {
+        JitEngine& jit = JitEngine::for_thread();
+        jit.flush();
+        return jit.run(S, limit);
+    }
+    if (e == Engine::Pipe) {
+        PipeEngine pipe;
+        return pipe.run(S, limit);
+    }
+    u64 n = 0;
+    while (n < limit) {
+        execute(S);
+        ++n;
+        if (S.stat != Stat::AOK) break;
+    }
+    return n;
+}
+
+static std::string diff_state(const CPU& a, const CPU& b) {
+    std::ostringstream os;
+    if (a.stat != b.stat) os << " STAT " << (int)a.stat << " != " << (int)b.stat;
+    if (a.PC != b.PC) os << " PC " << a.PC << " != " << b.PC;
+    if (a.cc.ZF != b.cc.ZF || a.cc.SF != b.cc.SF || a.cc.OF != b.cc.OF)
+        os << " CC " << a.cc.ZF << a.cc.SF << a.cc.OF << " != " << b.cc.ZF << b.cc.SF
+           << b.cc.OF;
+    for (int i = 0; i < REG_NUM; i++)
+        if (a.R[i] != b.R[i]) os << " " << reg_name(i) << " " << a.R[i] << " != " << b.R[i];
+    if (a.scratch != b.scratch) os << " RNONE scratch differs";
+    if (a.qword_nonzero() != b.qword_nonzero()) os << " MEM differs";
+    return os.str();
+}
+
+std::string diff_engine(Engine e, const CPU& init, u64 limit, u64 chunk) {
+    CPU ref = init, test = init;
+    JitEngine jit;  // translations must survive across chunks
+    if (chunk == 0) chunk = 1;
+    u64 done = 0;
+    while (done < limit && ref.stat == Stat::AOK) {
+        u64 want = std::min(chunk, limit - done);
+        u64 n = 0, m = 0;
+        if (e == Engine::Pipe) {
+            // the reference steps once per retirement and is compared there
+            PipeEngine pipe;
+            pipe.check_against(&ref);
+            n = m = pipe.run(test, want);
+            if (!pipe.mismatch().empty())
+                return "after " + std::to_string(done) + " steps, " + pipe.mismatch();
+        } else {
+            n = run_engine(Engine::Step, ref, want);
+            m = e == Engine::Jit ? jit.run(test, want) : run_engine(e, test, want);
+        }
+        std::string d = diff_state(ref, test);
+        if (n != m) d = " steps " + std::to_string(n) + " != " + std::to_string(m) + d;
+        if (!d.empty()) {
+            std::ostringstream os;
+            os << "after " << done + n << " steps (step vs " << engine_name(e) << "):" << d;
+            return os.str();
+        }
+        done += n;
+    }
+    return {};
+}
+
+const char* engine_name(Engine e) {
+    switch (e) {
+        case Engine::Step: return "step";
+        case Engine::Threaded: return "threaded";
+        case Engine::Jit: return "jit";
+        case Engine::Pipe: return "pipe";
+    }
+    return "?";
+}
+
+}  // namespace y86
@@ -0,0 +1,670 @@
+#include "ensemble.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "engine.h"
+#include "worker.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define Y86_LANE_X86 1
+#include <immintrin.h>
+#define Y86_AVX2 __attribute__((target("avx2")))
+#define Y86_AVX512 __attribute__((target("avx512f")))
+#endif
+
+namespace y86 {
+
+namespace {
+
+// Lane kernels over [lo, hi), a range of whole 8-lane blocks. `sel` and the
+// result of cond() hold ~0 for lanes taking part and 0 for the rest; only
+// lanes taking part are written. Flags are 0/1 per lane. alu() computes
+// dst = b OP a like OPq (b is the rB side); dst may be a or b.
+struct Kernels {
+    void (*alu)(u8 fn, s64* dst, const s64* a, const s64* b, u64* zf, u64* sf, u64* of,
+                const u64* sel, std::size_t lo, std::size_t hi);
+    void (*set)(u64* dst, u64 v, const u64* sel, std::size_t lo, std::size_t hi);
+    void (*move)(s64* dst, const s64* src, const u64* sel, std::size_t lo, std::size_t hi);
+    // out = sel where condition fn (1-6) holds; returns how many lanes
+    std::size_t (*cond)(u8 fn, const u64* zf, const u64* sf, const u64* of, const u64* sel,
+                        u64* out, std::size_t lo, std::size_t hi);
+};
+
+// ---------- portable ----------
+
+void alu_scalar(u8 fn, s64* dst, const s64* a, const s64* b, u64* zf, u64* sf, u64* of,
+                const u64* sel, std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i++) {
+        if (!sel[i]) continue;
+        s64 x = a[i], y = b[i], v;
+        u64 o = 0;
+        switch (fn) {
+            case 0:
+                v = (s64)((u64)y + (u64)x);
+                o = (u64)(~(x ^ y) & (x ^ v)) >> 63;
+                break;
+            case 1:
+                v = (s64)((u64)y - (u64)x);
+                o = (u64)((x ^ y) & (y ^ v)) >> 63;
+                break;
+            case 2: v = y & x; break;
+            default: v = y ^ x; break;
+        }
+        dst[i] = v;
+        zf[i] = v == 0;
+        sf[i] = (u64)v >> 63;
+        of[i] = o;
+    }
+}
+
+void set_scalar(u64* dst, u64 v, const u64* sel, std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i++)
+        if (sel[i]) dst[i] = v;
+}
+
+void move_scalar(s64* dst, const s64* src, const u64* sel, std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i++)
+        if (sel[i]) dst[i] = src[i];
+}
+
+// cond_true() on 0/1 flags: lt = SF ^ OF
+inline u64 cond_bit(u8 fn, u64 z, u64 lt) {
+    switch (fn) {
+        case 1: return lt | z;
+        case 2: return lt;
+        case 3: return z;
+        case 4: return z ^ 1;
+        case 5: return lt ^ 1;
+        default: return (lt | z) ^ 1;
+    }
+}
+
+std::size_t cond_scalar(u8 fn, const u64* zf, const u64* sf, const u64* of, const u64* sel,
+                        u64* out, std::size_t lo, std::size_t hi) {
+    std::size_t n = 0;
+    for (std::size_t i = lo; i < hi; i++) {
+        u64 c = cond_bit(fn, zf[i], sf[i] ^ of[i]) & (sel[i] & 1);
+        out[i] = 0 - c;
+        n += c;
+    }
+    return n;
+}
+
+constexpr Kernels SCALAR{alu_scalar, set_scalar, move_scalar, cond_scalar};
+
+#ifdef Y86_LANE_X86
+
+// ---------- AVX2: 4 lanes per vector, masks in the sign bits ----------
+
+Y86_AVX2 inline __m256i load4(const void* p) { return _mm256_loadu_si256((const __m256i*)p); }
+
+template <int FN>
+Y86_AVX2 void alu_avx2_fn(s64* dst, const s64* a, const s64* b, u64* zf, u64* sf, u64* of,
+                          const u64* sel, std::size_t lo, std::size_t hi) {
+    const __m256i zero = _mm256_setzero_si256();
+    for (std::size_t i = lo; i < hi; i += 4) {
+        __m256i m = load4(sel + i);
+        if (_mm256_testz_si256(m, m)) continue;
+        __m256i x = load4(a + i), y = load4(b + i), v, o = zero;
+        if constexpr (FN == 0) {
+            v = _mm256_add_epi64(y, x);
+            o = _mm256_andnot_si256(_mm256_xor_si256(x, y), _mm256_xor_si256(x, v));
+        } else if constexpr (FN == 1) {
+            v = _mm256_sub_epi64(y, x);
+            o = _mm256_and_si256(_mm256_xor_si256(x, y), _mm256_xor_si256(y, v));
+        } else if constexpr (FN == 2) {
+            v = _mm256_and_si256(y, x);
+        } else {
+            v = _mm256_xor_si256(y, x);
+        }
+        _mm256_maskstore_epi64((long long*)(dst + i), m, v);
+        _mm256_maskstore_epi64((long long*)(zf + i), m, _mm256_srli_epi64(_mm256_cmpeq_epi64(v, zero), 63));
+        _mm256_maskstore_epi64((long long*)(sf + i), m, _mm256_srli_epi64(v, 63));
+        _mm256_maskstore_epi64((long long*)(of + i), m, _mm256_srli_epi64(o, 63));
+    }
+}
+
+void alu_avx2(u8 fn, s64* dst, const s64* a, const s64* b, u64* zf, u64* sf, u64* of,
+              const u64* sel, std::size_t lo, std::size_t hi) {
+    switch (fn) {
+        case 0: alu_avx2_fn<0>(dst, a, b, zf, sf, of, sel, lo, hi); break;
+        case 1: alu_avx2_fn<1>(dst, a, b, zf, sf, of, sel, lo, hi); break;
+        case 2: alu_avx2_fn<2>(dst, a, b, zf, sf, of, sel, lo, hi); break;
+        default: alu_avx2_fn<3>(dst, a, b, zf, sf, of, sel, lo, hi); break;
+    }
+}
+
+Y86_AVX2 void set_avx2(u64* dst, u64 v, const u64* sel, std::size_t lo, std::size_t hi) {
+    const __m256i x = _mm256_set1_epi64x((long long)v);
+    for (std::size_t i = lo; i < hi; i += 4)
+        _mm256_maskstore_epi64((long long*)(dst + i), load4(sel + i), x);
+}
+
+Y86_AVX2 void move_avx2(s64* dst, const s64* src, const u64* sel, std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i += 4)
+        _mm256_maskstore_epi64((long long*)(dst + i), load4(sel + i), load4(src + i));
+}
+
+template <int FN>
+Y86_AVX2 std::size_t cond_avx2_fn(const u64* zf, const u64* sf, const u64* of, const u64* sel,
+                                  u64* out, std::size_t lo, std::size_t hi) {
+    const __m256i one = _mm256_set1_epi64x(1);
+    std::size_t n = 0;
+    for (std::size_t i = lo; i < hi; i += 4) {
+        __m256i z = load4(zf + i), lt = _mm256_xor_si256(load4(sf + i), load4(of + i)), c;
+        if constexpr (FN == 1) c = _mm256_or_si256(lt, z);
+        else if constexpr (FN == 2) c = lt;
+        else if constexpr (FN == 3) c = z;
+        else if constexpr (FN == 4) c = _mm256_xor_si256(z, one);
+        else if constexpr (FN == 5) c = _mm256_xor_si256(lt, one);
+        else c = _mm256_xor_si256(_mm256_or_si256(lt, z), one);
+        __m256i m = _mm256_and_si256(_mm256_cmpeq_epi64(c, one), load4(sel + i));
+        _mm256_storeu_si256((__m256i*)(out + i), m);
+        n += (std::size_t)__builtin_popcount((unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+    }
+    return n;
+}
+
+std::size_t cond_avx2(u8 fn, const u64* zf, const u64* sf, const u64* of, const u64* sel, u64* out,
+                      std::size_t lo, std::size_t hi) {
+    switch (fn) {
+        case 1: return cond_avx2_fn<1>(zf, sf, of, sel, out, lo, hi);
+        case 2: return cond_avx2_fn<2>(zf, sf, of, sel, out, lo, hi);
+        case 3: return cond_avx2_fn<3>(zf, sf, of, sel, out, lo, hi);
+        case 4: return cond_avx2_fn<4>(zf, sf, of, sel, out, lo, hi);
+        case 5: return cond_avx2_fn<5>(zf, sf, of, sel, out, lo, hi);
+        default: return cond_avx2_fn<6>(zf, sf, of, sel, out, lo, hi);
+    }
+}
+
+// ---------- AVX-512: 8 lanes per vector, masks in k registers ----------
+
+Y86_AVX512 inline __m512i load8(const void* p) { return _mm512_loadu_si512(p); }
+Y86_AVX512 inline __mmask8 lanes8(const u64* sel) {
+    __m512i s = load8(sel);
+    return _mm512_test_epi64_mask(s, s);
+}
+
+template <int FN>
+Y86_AVX512 void alu_avx512_fn(s64* dst, const s64* a, const s64* b, u64* zf, u64* sf, u64* of,
+                              const u64* sel, std::size_t lo, std::size_t hi) {
+    const __m512i zero = _mm512_setzero_si512(), one = _mm512_set1_epi64(1);
+    for (std::size_t i = lo; i < hi; i += 8) {
+        __mmask8 m = lanes8(sel + i);
+        if (!m) continue;
+        __m512i x = load8(a + i), y = load8(b + i), v, o = zero;
+        if constexpr (FN == 0) {
+            v = _mm512_add_epi64(y, x);
+            o = _mm512_maskz_andnot_epi64(m, _mm512_xor_si512(x, y), _mm512_xor_si512(x, v));
+        } else if constexpr (FN == 1) {
+            v = _mm512_sub_epi64(y, x);
+            o = _mm512_and_si512(_mm512_xor_si512(x, y), _mm512_xor_si512(y, v));
+        } else if constexpr (FN == 2) {
+            v = _mm512_and_si512(y, x);
+        } else {
+            v = _mm512_xor_si512(y, x);
+        }
+        _mm512_mask_storeu_epi64(dst + i, m, v);
+        _mm512_mask_storeu_epi64(zf + i, m, _mm512_maskz_mov_epi64(_mm512_cmpeq_epi64_mask(v, zero), one));
+        // maskz forms: the unmasked ones start from _mm512_undefined_epi32(),
+        // which GCC 12 flags as maybe-uninitialized
+        _mm512_mask_storeu_epi64(sf + i, m, _mm512_maskz_srli_epi64(m, v, 63));
+        _mm512_mask_storeu_epi64(of + i, m, _mm512_maskz_srli_epi64(m, o, 63));
+    }
+}
+
+void alu_avx512(u8 fn, s64* dst, const s64* a, const s64* b, u64* zf, u64* sf, u64* of,
+                const u64* sel, std::size_t lo, std::size_t hi) {
+    switch (fn) {
+        case 0: alu_avx512_fn<0>(dst, a, b, zf, sf, of, sel, lo, hi); break;
+        case 1: alu_avx512_fn<1>(dst, a, b, zf, sf, of, sel, lo, hi); break;
+        case 2: alu_avx512_fn<2>(dst, a, b, zf, sf, of, sel, lo, hi); break;
+        default: alu_avx512_fn<3>(dst, a, b, zf, sf, of, sel, lo, hi); break;
+    }
+}
+
+Y86_AVX512 void set_avx512(u64* dst, u64 v, const u64* sel, std::size_t lo, std::size_t hi) {
+    const __m512i x = _mm512_set1_epi64((long long)v);
+    for (std::size_t i = lo; i < hi; i += 8) _mm512_mask_storeu_epi64(dst + i, lanes8(sel + i), x);
+}
+
+Y86_AVX512 void move_avx512(s64* dst, const s64* src, const u64* sel, std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i += 8)
+        _mm512_mask_storeu_epi64(dst + i, lanes8(sel + i), load8(src + i));
+}
+
+template <int FN>
+Y86_AVX512 std::size_t cond_avx512_fn(const u64* zf, const u64* sf, const u64* of, const u64* sel,
+                                      u64* out, std::size_t lo, std::size_t hi) {
+    const __m512i one = _mm512_set1_epi64(1), ones = _mm512_set1_epi64(-1);
+    std::size_t n = 0;
+    for (std::size_t i = lo; i < hi; i += 8) {
+        __m512i z = load8(zf + i), lt = _mm512_xor_si512(load8(sf + i), load8(of + i)), c;
+        if constexpr (FN == 1) c = _mm512_or_si512(lt, z);
+        else if constexpr (FN == 2) c = lt;
+        else if constexpr (FN == 3) c = z;
+        else if constexpr (FN == 4) c = _mm512_xor_si512(z, one);
+        else if constexpr (FN == 5) c = _mm512_xor_si512(lt, one);
+        else c = _mm512_xor_si512(_mm512_or_si512(lt, z), one);
+        __mmask8 m = _mm512_mask_cmpeq_epi64_mask(lanes8(sel + i), c, one);
+        _mm512_storeu_si512(out + i, _mm512_maskz_mov_epi64(m, ones));
+        n += (std::size_t)__builtin_popcount((unsigned)m);
+    }
+    return n;
+}
+
+std::size_t cond_avx512(u8 fn, const u64* zf, const u64* sf, const u64* of, const u64* sel,
+                        u64* out, std::size_t lo, std::size_t hi) {
+    switch (fn) {
+        case 1: return cond_avx512_fn<1>(zf, sf, of, sel, out, lo, hi);
+        case 2: return cond_avx512_fn<2>(zf, sf, of, sel, out, lo, hi);
+        case 3: return cond_avx512_fn<3>(zf, sf, of, sel, out, lo, hi);
+        case 4: return cond_avx512_fn<4>(zf, sf, of, sel, out, lo, hi);
+        case 5: return cond_avx512_fn<5>(zf, sf, of, sel, out, lo, hi);
+        default: return cond_avx512_fn<6>(zf, sf, of, sel, out, lo, hi);
+    }
+}
+
+constexpr Kernels AVX2{alu_avx2, set_avx2, move_avx2, cond_avx2};
+constexpr Kernels AVX512{alu_avx512, set_avx512, move_avx512, cond_avx512};
+
+#endif  // Y86_LANE_X86
+
+const Kernels& kernels(LaneIsa isa) {
+#ifdef Y86_LANE_X86
+    if (isa == LaneIsa::Avx512) return AVX512;
+    if (isa == LaneIsa::Avx2) return AVX2;
+#endif
+    (void)isa;
+    return SCALAR;
+}
+
+}  // namespace
+
+bool lane_isa_supported(LaneIsa isa) {
+    if (isa == LaneIsa::Scalar) return true;
+#ifdef Y86_LANE_X86
+    __builtin_cpu_init();
+    if (isa == LaneIsa::Avx2) return __builtin_cpu_supports("avx2");
+    if (isa == LaneIsa::Avx512) return __builtin_cpu_supports("avx512f");
+#endif
+    return false;
+}
+
+LaneIsa best_lane_isa() {
+    for (LaneIsa isa : {LaneIsa::Avx512, LaneIsa::Avx2})
+        if (lane_isa_supported(isa)) return isa;
+    return LaneIsa::Scalar;
+}
+
+const char* lane_isa_name(LaneIsa isa) {
+    switch (isa) {
+        case LaneIsa::Avx2: return "avx2";
+        case LaneIsa::Avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+bool parse_lane_isa(const char* s, LaneIsa& out) {
+    for (LaneIsa isa : {LaneIsa::Scalar, LaneIsa::Avx2, LaneIsa::Avx512}) {
+        if (!std::strcmp(s, lane_isa_name(isa))) {
+            out = isa;
+            return true;
+        }
+    }
+    return false;
+}
+
+Ensemble::Ensemble(const CPU& base, std::size_t lanes, LaneIsa isa)
+    : n_(lanes),
+      w_((lanes + 7) & ~std::size_t(7)),
+      isa_(lane_isa_supported(isa) ? isa : best_lane_isa()),
+      r_((std::size_t)(REG_NUM + 1) * w_),
+      pc_(w_, base.PC),
+      zf_(w_, (u64)base.cc.ZF),
+      sf_(w_, (u64)base.cc.SF),
+      of_(w_, (u64)base.cc.OF),
+      sel_(w_),
+      cnd_(w_),
+      stat_(lanes, base.stat),
+      state_(lanes, base.stat == Stat::AOK ? Lane::Live : Lane::Done),
+      steps_(lanes),
+      end_(lanes),
+      icache_(base.icache.enabled) {
+    for (int r = 0; r < REG_NUM; r++) std::fill(row(r), row(r) + w_, base.R[r]);
+    std::fill(row(RNONE), row(RNONE) + w_, base.scratch);
+
+    // memory only: the decode cache is shared through code_
+    CPU proto;
+    proto.backend = base.backend;
+    proto.mem = base.mem;
+    proto.pages = base.pages;
+    proto.dirty_seq = base.dirty_seq;
+    proto.drop_index();
+    proto.bounded = base.bounded;
+    proto.mem_upper = base.mem_upper;
+    code_ = proto;
+    proto.icache.enabled = false;
+    mem_.assign(lanes, proto);
+}
+
+bool Ensemble::write8(std::size_t lane, u64 addr, u64 v) {
+    if (!mem_[lane].write8((s64)addr, v)) return false;
+    if (state_[lane] == Lane::Live && is_code(addr, 8)) detach(lane);
+    return true;
+}
+
+void Ensemble::extract(std::size_t lane, CPU& out) const {
+    out = mem_[lane];
+    for (int r = 0; r < REG_NUM; r++) out.R[r] = row(r)[lane];
+    out.scratch = row(RNONE)[lane];
+    out.PC = pc_[lane];
+    out.cc = cc(lane);
+    out.stat = stat_[lane];
+    out.icache = DecodeCache{};
+    out.icache.enabled = icache_;
+}
+
+u64 Ensemble::run(u64 limit) {
+    u64 before = 0;
+    for (std::size_t i = 0; i < n_; i++) {
+        before += steps_[i];
+        end_[i] = steps_[i] + std::min(limit, ~u64(0) - steps_[i]);
+    }
+    while (regroup()) run_group();
+    for (std::size_t i = 0; i < n_; i++)
+        if (state_[i] == Lane::Solo && stat_[i] == Stat::AOK && steps_[i] < end_[i])
+            run_solo(i, end_[i] - steps_[i]);
+    u64 after = 0;
+    for (std::size_t i = 0; i < n_; i++) after += steps_[i];
+    return after - before;
+}
+
+bool Ensemble::regroup() {
+    // the smallest PC goes first, the next smallest bounds how far it runs
+    bool any = false;
+    u64 first = 0, next = ~u64(0);
+    for (std::size_t i = 0; i < n_; i++) {
+        if (state_[i] != Lane::Live || steps_[i] >= end_[i]) continue;
+        u64 p = pc_[i];
+        if (!any) {
+            first = p;
+            any = true;
+        } else if (p < first) {
+            next = first;
+            first = p;
+        } else if (p > first && p < next) {
+            next = p;
+        }
+    }
+    if (!any) return false;
+    ++stats_.regroups;
+    idx_.clear();
+    budget_ = ~u64(0);
+    for (std::size_t i = 0; i < n_; i++) {
+        if (state_[i] != Lane::Live || steps_[i] >= end_[i] || pc_[i] != first) continue;
+        idx_.push_back((u32)i);
+        sel_[i] = ~u64(0);
+        budget_ = std::min(budget_, end_[i] - steps_[i]);
+    }
+    lo_ = idx_.front() & ~std::size_t(7);
+    hi_ = (idx_.back() + 8) & ~std::size_t(7);
+    gpc_ = first;
+    wait_pc_ = next;
+    gsteps_ = 0;
+    split_ = false;
+    return true;
+}
+
+void Ensemble::leave(std::size_t lane, u64 pc) {
+    steps_[lane] += gsteps_;
+    pc_[lane] = pc;
+    sel_[lane] = 0;
+    left_ = true;
+}
+
+void Ensemble::fail(std::size_t lane, Stat s) {
+    leave(lane, gpc_);
+    stat_[lane] = s;
+    state_[lane] = Lane::Done;
+}
+
+void Ensemble::compact() {
+    idx_.erase(std::remove_if(idx_.begin(), idx_.end(), [&](u32 i) { return !sel_[i]; }), idx_.end());
+    left_ = false;
+}
+
+void Ensemble::detach(std::size_t lane) {
+    state_[lane] = Lane::Solo;
+    ++stats_.detached;
+}
+
+bool Ensemble::is_code(u64 a, u64 len) const {
+    for (u64 q = a >> 3; q <= (a + len - 1) >> 3; q++) {
+        if ((code_filter_[(q >> 6) & 63] >> (q & 63) & 1) &&
+            std::binary_search(code_qwords_.begin(), code_qwords_.end(), q))
+            return true;
+    }
+    return false;
+}
+
+void Ensemble::note_code(u64 pc, u64 end) {
+    for (u64 q = pc >> 3; q <= (end - 1) >> 3; q++) {
+        auto it = std::lower_bound(code_qwords_.begin(), code_qwords_.end(), q);
+        if (it != code_qwords_.end() && *it == q) continue;
+        code_qwords_.insert(it, q);
+        code_filter_[(q >> 6) & 63] |= u64(1) << (q & 63);
+        // from now on stores to the qword detach; lanes already differing go now
+        u64 img = code_.read8_unchecked(q << 3);
+        for (std::size_t i = 0; i < n_; i++) {
+            if (state_[i] != Lane::Live || mem_[i].read8_unchecked(q << 3) == img) continue;
+            if (sel_[i]) leave(i, gpc_);
+            detach(i);
+        }
+    }
+}
+
+const Decoded* Ensemble::fetch(u64 pc) {
+    if (const Decoded* d = code_.icache.lookup(pc)) return d;
+    code_.PC = pc;
+    Decoded d = decode_uncached(code_);
+    // a failed decode reads at most an instruction's length: lanes whose
+    // bytes there differ might decode, so they leave before failing
+    u64 end = d.ok ? d.valP : pc + std::min(DecodeCache::MAX_INSN_LEN, ~pc);
+    note_code(pc, end);
+    if (!d.ok) return nullptr;
+    code_.icache.insert(pc, d);
+    return code_.icache.lookup(pc);
+}
+
+void Ensemble::store(std::size_t lane, u64 a, u64 v) {
+    mem_[lane].write8_unindexed(a, v);
+    if (is_code(a, 8)) detach_.push_back((u32)lane);
+}
+
+void Ensemble::run_group() {
+    const Kernels& k = kernels(isa_);
+    const bool bounded = code_.bounded;
+    const u64 upper = code_.mem_upper;
+    auto ok = [&](u64 a) { return (s64)a >= 0 && (!bounded || a + 7 <= upper); };
+    s64* rsp = row(4);
+
+    while (gsteps_ < budget_) {
+        const Decoded* d = fetch(gpc_);
+        if (left_) compact();
+        if (idx_.empty()) break;
+        ++gsteps_;
+        ++stats_.group_insns;
+        stats_.lane_insns += idx_.size();
+        if (!d) {
+            Stat s = code_.stat;
+            code_.stat = Stat::AOK;
+            for (u32 i : idx_) fail(i, s);
+            idx_.clear();
+            break;
+        }
+        s64* ra = row(d->rA);
+        s64* rb = row(d->rB);
+        s64* base = row(d->rB == RNONE ? 4 : d->rB);  // rB as step() reads it
+        u64 next = d->valP;
+        switch ((Icode)d->icode) {
+            case Icode::HALT:
+                for (u32 i : idx_) fail(i, Stat::HLT);
+                break;
+            case Icode::NOP:
+                break;
+            case Icode::RRMOVQ:
+                if (d->ifun == 0)
+                    k.move(rb, ra, sel_.data(), lo_, hi_);
+                else if (d->ifun <= 6 &&
+                         k.cond(d->ifun, zf_.data(), sf_.data(), of_.data(), sel_.data(), cnd_.data(), lo_, hi_))
+                    k.move(rb, ra, cnd_.data(), lo_, hi_);
+                break;
+            case Icode::IRMOVQ:
+                k.set((u64*)rb, d->valC, sel_.data(), lo_, hi_);
+                break;
+            case Icode::OPQ:
+                if (d->ifun > 3) {
+                    for (u32 i : idx_) fail(i, Stat::INS);
+                    break;
+                }
+                k.alu(d->ifun, rb, ra, base, zf_.data(), sf_.data(), of_.data(), sel_.data(), lo_, hi_);
+                break;
+            case Icode::JXX:
+                if (d->ifun == 0) {
+                    next = d->valC;
+                } else if (d->ifun <= 6) {
+                    std::size_t t = k.cond(d->ifun, zf_.data(), sf_.data(), of_.data(), sel_.data(),
+                                           cnd_.data(), lo_, hi_);
+                    if (t == idx_.size()) {
+                        next = d->valC;
+                    } else if (t) {
+                        k.set(pc_.data(), d->valP, sel_.data(), lo_, hi_);
+                        k.set(pc_.data(), d->valC, cnd_.data(), lo_, hi_);
+                        split_ = true;
+                    }
+                }
+                break;
+            case Icode::RMMOVQ:
+                for (u32 i : idx_) {
+                    u64 ea = (u64)base[i] + d->valC;
+                    if (!ok(ea)) {
+                        fail(i, Stat::ADR);
+                        continue;
+                    }
+                    store(i, ea, (u64)ra[i]);
+                }
+                break;
+            case Icode::MRMOVQ:
+                for (u32 i : idx_) {
+                    u64 ea = (u64)base[i] + d->valC;
+                    if (!ok(ea)) {
+                        fail(i, Stat::ADR);
+                        continue;
+                    }
+                    ra[i] = (s64)mem_[i].read8_unchecked(ea);
+                }
+                break;
+            case Icode::CALL:
+                for (u32 i : idx_) {
+                    u64 sp = (u64)rsp[i] - 8;
+                    rsp[i] = (s64)sp;
+                    if (!ok(sp)) {
+                        fail(i, Stat::ADR);
+                        continue;
+                    }
+                    store(i, sp, d->valP);
+                }
+                next = d->valC;
+                break;
+            case Icode::RET: {
+                bool same = true;
+                u64 to = 0, n = 0;
+                for (u32 i : idx_) {
+                    u64 sp = (u64)rsp[i];
+                    if (!ok(sp)) {
+                        fail(i, Stat::ADR);
+                        continue;
+                    }
+                    rsp[i] = (s64)(sp + 8);
+                    pc_[i] = mem_[i].read8_unchecked(sp);
+                    if (n++ && pc_[i] != to) same = false;
+                    to = pc_[i];
+                }
+                next = to;
+                split_ = !same;
+                break;
+            }
+            case Icode::PUSHQ:
+                for (u32 i : idx_) {
+                    s64 a = ra[i];
+                    u64 sp = (u64)base[i] - 8;
+                    rsp[i] = (s64)sp;
+                    if (!ok(sp)) {
+                        fail(i, Stat::ADR);
+                        continue;
+                    }
+                    store(i, sp, (u64)a);
+                }
+                break;
+            case Icode::POPQ:
+                for (u32 i : idx_) {
+                    u64 sp = (u64)base[i];
+                    if (!ok(sp)) {
+                        fail(i, Stat::ADR);
+                        continue;
+                    }
+                    u64 v = mem_[i].read8_unchecked(sp);
+                    rsp[i] = (s64)(sp + 8);
+                    ra[i] = (s64)v;
+                }
+                break;
+            default:
+                for (u32 i : idx_) fail(i, Stat::INS);
+                break;
+        }
+        // lanes that stored into code finish this instruction, then go solo
+        for (u32 i : detach_) {
+            leave(i, next);
+            detach(i);
+        }
+        detach_.clear();
+        if (left_) compact();
+        if (split_) {
+            ++stats_.divergences;
+            break;
+        }
+        gpc_ = next;
+        if (idx_.empty() || gpc_ >= wait_pc_) break;
+    }
+    for (u32 i : idx_) {
+        steps_[i] += gsteps_;
+        if (!split_) pc_[i] = gpc_;
+        sel_[i] = 0;
+    }
+    idx_.clear();
+}
+
+void Ensemble::run_solo(std::size_t lane, u64 limit) {
+    CPU& S = mem_[lane];
+    for (int r = 0; r < REG_NUM; r++) S.R[r] = row(r)[lane];
+    S.PC = pc_[lane];
+    S.cc = cc(lane);
+    S.stat = stat_[lane];
+    S.icache.enabled = icache_;
+    S.scratch = row(RNONE)[lane];
+    NoTrace t;
+    u64 n = run_auto(S, limit, t);
+    row(RNONE)[lane] = S.scratch;
+    for (int r = 0; r < REG_NUM; r++) row(r)[lane] = S.R[r];
+    pc_[lane] = S.PC;
+    zf_[lane] = (u64)S.cc.ZF;
+    sf_[lane] = (u64)S.cc.SF;
+    of_[lane] = (u64)S.cc.OF;
+    stat_[lane] = S.stat;
+    steps_[lane] += n;
+    stats_.solo_insns += n;
+}
+
+}  // namespace y86
@@ -0,0 +1,136 @@
+#include "history.h"
+
+#include <algorithm>
+
+#include "engine.h"
+
+namespace y86 {
+
+static CC unpack_cc(u8 v) {
+    CC cc;
+    cc.ZF = v & 1;
+    cc.SF = (v >> 1) & 1;
+    cc.OF = (v >> 2) & 1;
+    return cc;
+}
+
+History::History(const Config& cfg) : cfg_(cfg) {
+    // a power of two, so the ring index is a mask
+    std::size_t n = 1;
+    while (n < cfg_.undo_steps) n <<= 1;
+    cfg_.undo_steps = n;
+    if (!cfg_.checkpoint_every) cfg_.checkpoint_every = 1;
+    if (!cfg_.max_checkpoints) cfg_.max_checkpoints = 1;
+    ring_.resize(n);
+}
+
+void History::reset(const CPU& S, u64 now) {
+    head_ = count_ = 0;
+    saved_.clear();
+    saved_.push_back({now, S.checkpoint()});
+    now_ = now;
+    track(S);
+    decoded_ = stored_ = false;
+}
+
+u64 History::oldest() const {
+    u64 o = now_ - count_;
+    if (!saved_.empty()) o = std::min(o, saved_.front().step);
+    return o;
+}
+
+// ---------- recording ----------
+
+void History::track(const CPU& S) {
+    std::copy(S.R, S.R + REG_NUM, prev_R_);
+    prev_R_[RNONE] = S.scratch;
+    prev_cc_ = S.cc;
+    // undo entries can reach back past the oldest kept checkpoint; recording
+    // needs one to count from, so take S as the new one
+    if (saved_.empty()) saved_.push_back({now_, S.checkpoint()});
+}
+
+void History::save(const CPU& S) {
+    saved_.push_back({now_, S.checkpoint()});
+    if (saved_.size() > cfg_.max_checkpoints) saved_.pop_front();
+}
+
+void History::end(const CPU& S, u64 n) {
+    if (dbg_) dbg_->end(S, n);
+}
+
+bool History::stop(const CPU& S) { return dbg_->stop(S); }
+
+// ---------- moving back ----------
+
+void History::undo_one(CPU& S, Undo& u) {
+    head_ = (head_ - 1) & (ring_.size() - 1);
+    --count_;
+    u = ring_[head_];
+    if (u.has_mem) S.write8_unchecked(u.addr, u.old_mem);
+    for (int k = 0; k < 2; k++) {
+        if (u.reg[k] == RNONE) S.scratch = u.old_reg[k];
+        else if (u.reg[k] != NO_REG) S.R[u.reg[k]] = u.old_reg[k];
+    }
+    S.PC = u.pc;
+    S.cc = unpack_cc(u.cc);
+    S.stat = Stat::AOK;
+    --now_;
+    while (!saved_.empty() && saved_.back().step > now_) saved_.pop_back();
+}
+
+bool History::rebuild(CPU& S, u64 t, bool refill) {
+    while (!saved_.empty() && saved_.back().step > t) saved_.pop_back();
+    if (saved_.empty()) return false;
+    // with `refill` the newest checkpoint strictly before t, so that the
+    // replay leaves undo entries behind (t itself if nothing earlier is kept)
+    auto it = saved_.end() - 1;
+    if (refill && it->step == t && it != saved_.begin()) --it;
+    S.restore(it->cp);
+    now_ = it->step;
+    saved_.erase(it + 1, saved_.end());
+    head_ = count_ = 0;
+    track(S);
+    decoded_ = stored_ = false;
+    // replay without stopping; the program is deterministic, so this
+    // reaches exactly the state recorded before
+    Debugger* dbg = dbg_;
+    dbg_ = nullptr;
+    u64 want = t - now_;
+    u64 n = run_auto(S, want, *this);
+    dbg_ = dbg;
+    return n == want;
+}
+
+bool History::seek(CPU& S, u64 t) {
+    if (t > now_ || t < oldest()) return false;
+    if (now_ - t > count_ && !rebuild(S, t, false)) return false;
+    Undo u;
+    while (now_ > t) undo_one(S, u);
+    track(S);
+    return true;
+}
+
+u64 History::step_back(CPU& S, u64 n) {
+    u64 t = now_ - std::min(n, now_ - oldest());
+    u64 from = now_;
+    return seek(S, t) ? from - t : 0;
+}
+
+u64 History::reverse_continue(CPU& S, Debugger& dbg, u64 max) {
+    u64 from = now_;
+    bool hit = false;
+    while (!hit && from - now_ < max && now_ > oldest()) {
+        // ring exhausted: restore the previous segment and replay it
+        if (!count_ && !rebuild(S, now_, true)) break;
+        if (!count_) break;
+        Undo u;
+        undo_one(S, u);
+        hit = (u.has_mem && dbg.watch_store(u.addr, u.pc)) || dbg.break_at(S);
+    }
+    if (!hit) dbg.end(S, 0);  // clears a stale hit()
+    track(S);
+    return from - now_;
+}
+
+}  // namespace y86
@@ -0,0 +1,651 @@
+#include "jit.h"
+
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "engine.h"
+#include "worker.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define Y86_JIT_X64 1
+#include <sys/mman.h>
+#endif
+
+namespace y86 {
+
+#ifdef Y86_JIT_X64
+
+namespace {
+
+// Guest state seen by translated code (addressed through rbx).
+struct JitState {
+    s64 r[16];     // r[15] absorbs RNONE like run_threaded()
+    u64 flags;     // host RFLAGS image of CC when not live in EFLAGS
+    u64 pc;
+    u64 n;         // instructions retired in this run
+    u64 limit;
+    u64 tmp;       // helper out-parameter
+    CPU* cpu;
+    JitEngine::Impl* impl;
+};
+
+constexpr int OFF_R = offsetof(JitState, r);
+constexpr int OFF_FLAGS = offsetof(JitState, flags);
+constexpr int OFF_PC = offsetof(JitState, pc);
+constexpr int OFF_N = offsetof(JitState, n);
+constexpr int OFF_LIMIT = offsetof(JitState, limit);
+constexpr int OFF_TMP = offsetof(JitState, tmp);
+
+inline int slot(int reg) { return OFF_R + 8 * reg; }
+
+constexpr u64 F_ZF = 1ULL << 6, F_SF = 1ULL << 7, F_OF = 1ULL << 11;
+
+u64 cc_to_flags(const CC& c) {
+    return 0x2 | (c.ZF ? F_ZF : 0) | (c.SF ? F_SF : 0) | (c.OF ? F_OF : 0);
+}
+
+CC flags_to_cc(u64 f) {
+    CC c;
+    c.ZF = (f & F_ZF) != 0;
+    c.SF = (f & F_SF) != 0;
+    c.OF = (f & F_OF) != 0;
+    return c;
+}
+
+// exit codes returned by translated code
+enum Exit : int { EXIT_NEXT = 0, EXIT_INTERP = 1, EXIT_FLUSH = 2, EXIT_LIMIT = 3 };
+
+// host registers (no REX.R/B needed below r8)
+enum HostReg { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7 };
+
+// Y86 ifun -> x86 condition nibble (le, l, e, ne, ge, g)
+constexpr u8 X86_CC[7] = {0, 0xE, 0xC, 0x4, 0x5, 0xD, 0xF};
+
+struct Asm {
+    u8* p;
+
+    void b(u8 x) { *p++ = x; }
+    void d32(u32 x) {
+        std::memcpy(p, &x, 4);
+        p += 4;
+    }
+    void q64(u64 x) {
+        std::memcpy(p, &x, 8);
+        p += 8;
+    }
+    // mov reg, [rbx+off]
+    void load(int reg, int off) { b(0x48), b(0x8B), b(0x80 | reg << 3 | RBX), d32(off); }
+    // mov [rbx+off], reg
+    void store(int off, int reg) { b(0x48), b(0x89), b(0x80 | reg << 3 | RBX), d32(off); }
+    // op reg, [rbx+off] with op = 0x03 add, 0x2B sub, 0x23 and, 0x33 xor, 0x3B cmp
+    void alu_load(u8 op, int reg, int off) { b(0x48), b(op), b(0x80 | reg << 3 | RBX), d32(off); }
+    void cmov_load(u8 cc, int reg, int off) {
+        b(0x48), b(0x0F), b(0x40 | cc), b(0x80 | reg << 3 | RBX), d32(off);
+    }
+    void mov_imm64(int reg, u64 v) { b(0x48), b((u8)(0xB8 + reg)), q64(v); }
+    void mov_eax_imm(u32 v) { b(0xB8), d32(v); }
+    void mov_rr(int dst, int src) { b(0x48), b(0x89), b(0xC0 | src << 3 | dst); }
+    void add_rr(int dst, int src) { b(0x48), b(0x01), b(0xC0 | src << 3 | dst); }
+    // lea dst, [base+disp8]; base must not be rsp
+    void lea8(int dst, int base, s8 disp) { b(0x48), b(0x8D), b(0x40 | dst << 3 | base), b((u8)disp); }
+    // lea dst, [rbx+off]
+    void lea_state(int dst, int off) { b(0x48), b(0x8D), b(0x80 | dst << 3 | RBX), d32(off); }
+    void add_rax_imm(s32 v) { b(0x48), b(0x05), d32((u32)v); }
+    void sub_mem_imm(int off, s32 v) { b(0x48), b(0x81), b(0xAB), d32(off), d32((u32)v); }
+    void pushfq() { b(0x9C); }
+    void popfq() { b(0x9D); }
+    void push_mem(int off) { b(0xFF), b(0xB3), d32(off); }
+    void pop_mem(int off) { b(0x8F), b(0x83), d32(off); }
+    void call_abs(const void* fn) {
+        mov_imm64(RAX, (u64)(std::uintptr_t)fn);
+        b(0xFF), b(0xD0);
+    }
+    void test_eax() { b(0x85), b(0xC0); }
+    void cmp_eax_imm8(u8 v) { b(0x83), b(0xF8), b(v); }
+    // jcc/jmp rel32; return the rel32 field for patching
+    u8* jcc(u8 cc) {
+        b(0x0F), b(0x80 | cc);
+        u8* site = p;
+        d32(0);
+        return site;
+    }
+    u8* jmp() {
+        b(0xE9);
+        u8* site = p;
+        d32(0);
+        return site;
+    }
+    static void patch(u8* site, const u8* target) {
+        s32 rel = (s32)(target - (site + 4));
+        std::memcpy(site, &rel, 4);
+    }
+};
+
+// generous per-block bound: entry + per-insn code + stubs
+constexpr std::size_t MAX_BLOCK_BYTES = 256 + JitEngine::MAX_BLOCK * 160;
+// the code buffer starts at 16x the guest's memory footprint within these
+// bounds and doubles when it fills up
+constexpr std::size_t MIN_CODE = 64u << 10;
+constexpr std::size_t MAX_CODE = 16u << 20;
+
+std::size_t initial_code_size(const CPU& S) {
+    u64 bytes = S.backend == MemBackend::Paged ? (u64)S.pages.page_count() * PagedMem::PAGE_SIZE
+                                               : (u64)S.mem.size();
+    std::size_t size = MIN_CODE;
+    while (size < MAX_CODE && size < bytes * 16) size *= 2;
+    return size;
+}
+
+int jit_read8(JitState* st, s64 a, u64* out);
+int jit_write8(JitState* st, s64 a, u64 v);
+
+}  // namespace
+
+struct JitEngine::Impl {
+    using EnterFn = int (*)(JitState*, const u8*);
+
+    u8* code = nullptr;
+    u8* code_end = nullptr;
+    u8* cur = nullptr;
+    u8* first_block = nullptr;
+    EnterFn enter = nullptr;
+    u8* epilogue = nullptr;
+    std::size_t cap = 0;
+    bool writable = false;
+
+    std::unordered_map<u64, u8*> blocks;                    // guest pc -> entry
+    std::unordered_map<u64, std::vector<u8*>> pending;      // guest pc -> exit jumps
+    std::map<u64, u64> ranges;                              // block start -> end
+    u64 code_lo = ~0ULL, code_hi = 0;
+    Stats stats;
+
+    ~Impl() { unmap(); }
+
+    // maps a read/write buffer of `size` bytes with the trampoline in it
+    bool map(std::size_t size) {
+        void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) return false;
+        code = (u8*)m;
+        code_end = code + size;
+        cap = size;
+        writable = true;
+        emit_trampoline();
+        return true;
+    }
+
+    void unmap() {
+        if (code) munmap(code, cap);
+        code = code_end = cur = nullptr;
+        cap = 0;
+    }
+
+    // W^X: the buffer is writable while translating and executable while
+    // running, never both; false if mprotect() fails
+    bool protect(bool write) {
+        if (write == writable) return true;
+        if (mprotect(code, cap, write ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0)
+            return false;
+        writable = write;
+        return true;
+    }
+
+    // drops all translations for a buffer of twice the size (at most
+    // MAX_CODE); keeps the current one if that cannot be mapped
+    void grow() {
+        flush();
+        if (cap >= MAX_CODE) return;
+        std::size_t size = std::min(cap * 2, MAX_CODE);
+        void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) return;
+        unmap();
+        code = (u8*)m;
+        code_end = code + size;
+        cap = size;
+        writable = true;
+        emit_trampoline();
+    }
+
+    // enter(st, block): save callee-saved regs, rbx = st, jump to block.
+    // Three pushes keep rsp 16-byte aligned for helper calls in blocks.
+    void emit_trampoline() {
+        Asm a{code};
+        enter = (EnterFn)(void*)a.p;
+        a.b(0x53);              // push rbx
+        a.b(0x55);              // push rbp
+        a.b(0x41), a.b(0x54);   // push r12
+        a.mov_rr(RBX, RDI);
+        a.b(0xFF), a.b(0xE6);   // jmp rsi
+        epilogue = a.p;
+        a.b(0x41), a.b(0x5C);   // pop r12
+        a.b(0x5D);              // pop rbp
+        a.b(0x5B);              // pop rbx
+        a.b(0xC3);              // ret
+        first_block = cur = a.p;
+    }
+
+    void flush() {
+        blocks.clear();
+        pending.clear();
+        ranges.clear();
+        code_lo = ~0ULL;
+        code_hi = 0;
+        cur = first_block;
+        ++stats.flushes;
+    }
+
+    bool overlaps_code(u64 lo, u64 hi) const {
+        if (hi <= code_lo || lo >= code_hi) return false;
+        u64 from = lo >= MAX_BLOCK * 10 ? lo - MAX_BLOCK * 10 : 0;
+        for (auto it = ranges.lower_bound(from); it != ranges.end() && it->first < hi; ++it)
+            if (it->second > lo) return true;
+        return false;
+    }
+
+    // decode at pc without disturbing S.PC / S.stat
+    static Decoded decode_at(CPU& S, u64 pc) {
+        u64 save_pc = S.PC;
+        Stat save_stat = S.stat;
+        S.PC = pc;
+        Decoded d = fetch_and_decode(S);
+        S.PC = save_pc;
+        S.stat = save_stat;
+        return d;
+    }
+
+    static bool translatable(const Decoded& d) {
+        if (!d.ok) return false;
+        switch ((Icode)d.icode) {
+            case Icode::HALT: return false;
+            case Icode::OPQ: return d.ifun <= 3;
+            default: return d.icode <= (u8)Icode::POPQ;
+        }
+    }
+
+    // chained exit to a known guest pc
+    void emit_exit_to(Asm& a, u64 target) {
+        a.mov_imm64(RAX, target);
+        a.store(OFF_PC, RAX);
+        a.mov_eax_imm(EXIT_NEXT);
+        u8* site = a.jmp();
+        auto it = blocks.find(target);
+        if (it != blocks.end()) {
+            Asm::patch(site, it->second);
+            ++stats.chained;
+        } else {
+            Asm::patch(site, epilogue);
+            pending[target].push_back(site);
+        }
+    }
+
+    u8* translate(CPU& S, u64 start);
+};
+
+namespace {
+
+int jit_read8(JitState* st, s64 a, u64* out) { return st->cpu->read8(a, *out) ? 1 : 0; }
+
+int jit_write8(JitState* st, s64 a, u64 v) {
+    if (!st->cpu->check_addr(a, 8)) return 0;
+    st->cpu->write8_unindexed((u64)a, v);
+    return st->impl->overlaps_code((u64)a, (u64)a + 8) ? 2 : 1;
+}
+
+}  // namespace
+
+u8* JitEngine::Impl::translate(CPU& S, u64 start) {
+    Decoded insn[MAX_BLOCK];
+    u64 pcs[MAX_BLOCK + 1];
+    int len = 0;
+    u64 pc = start;
+    while (len < MAX_BLOCK) {
+        Decoded d = decode_at(S, pc);
+        if (!translatable(d)) break;
+        insn[len] = d;
+        pcs[len++] = pc;
+        pc = d.valP;
+        Icode ic = (Icode)d.icode;
+        if (ic == Icode::CALL || ic == Icode::RET || (ic == Icode::JXX && d.ifun <= 6)) break;
+    }
+    pcs[len] = pc;
+    if (len == 0) return nullptr;
+
+    if ((std::size_t)(code_end - cur) < MAX_BLOCK_BYTES) grow();
+    if (!protect(true)) return nullptr;
+    Asm a{cur};
+    u8* entry = a.p;
+
+    // budget check: the whole block must fit in the remaining limit
+    a.load(RAX, OFF_N);
+    a.add_rax_imm(len);
+    a.alu_load(0x3B, RAX, OFF_LIMIT);
+    u8* over = a.jcc(0x7);  // ja
+    a.store(OFF_N, RAX);
+
+    struct Stub {
+        u8* site;
+        int retired;  // instructions completed when leaving
+        u64 pc;
+        int code;
+    };
+    std::vector<Stub> stubs;
+    stubs.push_back({over, -1, start, EXIT_LIMIT});
+
+    bool host_cc = false, mem_cc = true;
+    auto spill = [&] {
+        if (!mem_cc) {
+            a.pushfq();
+            a.pop_mem(OFF_FLAGS);
+            mem_cc = true;
+        }
+    };
+    auto reload = [&] {
+        if (!host_cc) {
+            a.push_mem(OFF_FLAGS);
+            a.popfq();
+            host_cc = true;
+        }
+    };
+    auto clobber = [&] {
+        spill();
+        host_cc = false;
+    };
+    auto base_of = [](const Decoded& d) { return d.rB == RNONE ? 4 : d.rB; };
+    auto on_fault = [&](int k) { stubs.push_back({a.jcc(0x4), k, pcs[k], EXIT_INTERP}); };  // jz
+    auto on_smc = [&](int k, u64 next) {
+        a.cmp_eax_imm8(2);
+        stubs.push_back({a.jcc(0x4), k + 1, next, EXIT_FLUSH});  // je
+    };
+
+    bool ended = false;
+    for (int k = 0; k < len; k++) {
+        const Decoded& d = insn[k];
+        switch ((Icode)d.icode) {
+            case Icode::NOP:
+                break;
+            case Icode::RRMOVQ:
+                if (d.ifun == 0) {
+                    a.load(RAX, slot(d.rA));
+                    a.store(slot(d.rB), RAX);
+                } else if (d.ifun <= 6) {
+                    reload();
+                    a.load(RAX, slot(d.rB));
+                    a.cmov_load(X86_CC[d.ifun], RAX, slot(d.rA));
+                    a.store(slot(d.rB), RAX);
+                }
+                break;
+            case Icode::IRMOVQ:
+                a.mov_imm64(RAX, d.valC);
+                a.store(slot(d.rB), RAX);
+                break;
+            case Icode::OPQ: {
+                static const u8 op[4] = {0x03, 0x2B, 0x23, 0x33};
+                a.load(RAX, slot(base_of(d)));
+                a.alu_load(op[d.ifun], RAX, slot(d.rA));
+                a.store(slot(d.rB), RAX);
+                host_cc = true;
+                mem_cc = false;
+            } break;
+            case Icode::RMMOVQ:
+                clobber();
+                a.mov_rr(RDI, RBX);
+                a.load(RSI, slot(base_of(d)));
+                a.mov_imm64(RAX, d.valC);
+                a.add_rr(RSI, RAX);
+                a.load(RDX, slot(d.rA));
+                a.call_abs((const void*)&jit_write8);
+                a.test_eax();
+                on_fault(k);
+                on_smc(k, pcs[k + 1]);
+                break;
+            case Icode::MRMOVQ:
+                clobber();
+                a.mov_rr(RDI, RBX);
+                a.load(RSI, slot(base_of(d)));
+                a.mov_imm64(RAX, d.valC);
+                a.add_rr(RSI, RAX);
+                a.lea_state(RDX, OFF_TMP);
+                a.call_abs((const void*)&jit_read8);
+                a.test_eax();
+                on_fault(k);
+                a.load(RAX, OFF_TMP);
+                a.store(slot(d.rA), RAX);
+                break;
+            case Icode::PUSHQ:
+                clobber();
+                a.mov_rr(RDI, RBX);
+                a.load(RSI, slot(base_of(d)));
+                a.lea8(RSI, RSI, -8);
+                a.load(RDX, slot(d.rA));
+                a.call_abs((const void*)&jit_write8);
+                a.test_eax();
+                on_fault(k);
+                a.load(RCX, slot(base_of(d)));
+                a.lea8(RCX, RCX, -8);
+                a.store(slot(4), RCX);
+                on_smc(k, pcs[k + 1]);
+                break;
+            case Icode::POPQ:
+                clobber();
+                a.mov_rr(RDI, RBX);
+                a.load(RSI, slot(base_of(d)));
+                a.lea_state(RDX, OFF_TMP);
+                a.call_abs((const void*)&jit_read8);
+                a.test_eax();
+                on_fault(k);
+                a.load(RCX, slot(base_of(d)));
+                a.lea8(RCX, RCX, 8);
+                a.store(slot(4), RCX);
+                a.load(RAX, OFF_TMP);
+                a.store(slot(d.rA), RAX);
+                break;
+            case Icode::CALL:
+                clobber();
+                a.mov_rr(RDI, RBX);
+                a.load(RSI, slot(4));
+                a.lea8(RSI, RSI, -8);
+                a.mov_imm64(RDX, d.valP);
+                a.call_abs((const void*)&jit_write8);
+                a.test_eax();
+                on_fault(k);
+                a.load(RCX, slot(4));
+                a.lea8(RCX, RCX, -8);
+                a.store(slot(4), RCX);
+                on_smc(k, d.valC);
+                emit_exit_to(a, d.valC);
+                ended = true;
+                break;
+            case Icode::RET:
+                clobber();
+                a.mov_rr(RDI, RBX);
+                a.load(RSI, slot(4));
+                a.lea_state(RDX, OFF_TMP);
+                a.call_abs((const void*)&jit_read8);
+                a.test_eax();
+                on_fault(k);
+                a.load(RCX, slot(4));
+                a.lea8(RCX, RCX, 8);
+                a.store(slot(4), RCX);
+                a.load(RAX, OFF_TMP);
+                a.store(OFF_PC, RAX);
+                a.mov_eax_imm(EXIT_NEXT);
+                Asm::patch(a.jmp(), epilogue);
+                ended = true;
+                break;
+            case Icode::JXX:
+                if (d.ifun == 0) {
+                    spill();
+                    emit_exit_to(a, d.valC);
+                    ended = true;
+                } else if (d.ifun <= 6) {
+                    spill();
+                    reload();
+                    u8* taken = a.jcc(X86_CC[d.ifun]);
+                    emit_exit_to(a, d.valP);
+                    Asm::patch(taken, a.p);
+                    emit_exit_to(a, d.valC);
+                    ended = true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    if (!ended) {
+        spill();
+        emit_exit_to(a, pcs[len]);
+    }
+
+    // out-of-line exits; CC is already spilled wherever a stub is taken
+    for (auto& s : stubs) {
+        Asm::patch(s.site, a.p);
+        if (s.retired >= 0 && s.retired < len) a.sub_mem_imm(OFF_N, len - s.retired);
+        a.mov_imm64(RAX, s.pc);
+        a.store(OFF_PC, RAX);
+        a.mov_eax_imm((u32)s.code);
+        Asm::patch(a.jmp(), epilogue);
+    }
+    cur = a.p;
+
+    blocks[start] = entry;
+    ranges[start] = pcs[len];
+    if (start < code_lo) code_lo = start;
+    if (pcs[len] > code_hi) code_hi = pcs[len];
+    ++stats.blocks;
+
+    auto it = pending.find(start);
+    if (it != pending.end()) {
+        for (u8* site : it->second) {
+            Asm::patch(site, entry);
+            ++stats.chained;
+        }
+        pending.erase(it);
+    }
+    return entry;
+}
+
+JitEngine::JitEngine() : impl_(new Impl()) {}
+JitEngine::~JitEngine() = default;
+
+bool JitEngine::available() {
+    static const bool ok = [] {
+        Impl probe;
+        return probe.map(MIN_CODE) && probe.protect(false);
+    }();
+    return ok;
+}
+
+JitEngine& JitEngine::for_thread() {
+    thread_local JitEngine jit;
+    return jit;
+}
+
+const JitEngine::Stats& JitEngine::stats() const { return impl_->stats; }
+
+void JitEngine::flush() {
+    if (impl_->code) impl_->flush();
+}
+
+u64 JitEngine::run(CPU& S, u64 limit) {
+    Impl& J = *impl_;
+    if (!J.code && !J.map(initial_code_size(S))) return run_threaded(S, limit);
+    if (limit == 0 || S.stat != Stat::AOK) return 0;
+
+    // the RNONE scratch travels with the registers, as in run<>
+    JitState st;
+    auto load_state = [&] {
+        for (int i = 0; i < REG_NUM; i++) st.r[i] = S.R[i];
+        st.r[RNONE] = S.scratch;
+        st.flags = cc_to_flags(S.cc);
+        st.pc = S.PC;
+    };
+    auto save_state = [&] {
+        for (int i = 0; i < REG_NUM; i++) S.R[i] = st.r[i];
+        S.scratch = st.r[RNONE];
+        S.cc = flags_to_cc(st.flags);
+        S.PC = st.pc;
+    };
+    load_state();
+    st.n = 0;
+    st.limit = limit;
+    st.tmp = 0;
+    st.cpu = &S;
+    st.impl = &J;
+
+    // run k instructions in the interpreter, watching for stores into code
+    struct Watch {
+        Impl* J;
+        bool smc;
+    } watch{&J, false};
+    StoreHook hook;
+    hook.fn = [](void* user, u64 a) {
+        auto* w = static_cast<Watch*>(user);
+        if (w->J->overlaps_code(a, a + 8)) w->smc = true;
+    };
+    hook.user = &watch;
+    auto interpret = [&](u64 k) {
+        save_state();
+        watch.smc = false;
+        u64 done = run_auto(S, k, hook);
+        st.n += done;
+        J.stats.interpreted += done;
+        if (watch.smc) J.flush();
+        load_state();
+    };
+
+    while (st.n < limit && S.stat == Stat::AOK) {
+        u8* entry = nullptr;
+        auto it = J.blocks.find(st.pc);
+        if (it != J.blocks.end())
+            entry = it->second;
+        else
+            entry = J.translate(S, st.pc);
+        if (!entry) {
+            interpret(1);
+            continue;
+        }
+        if (!J.protect(false)) {
+            interpret(limit - st.n);
+            break;
+        }
+        ++J.stats.entries;
+        switch (J.enter(&st, entry)) {
+            case EXIT_NEXT:
+                break;
+            case EXIT_INTERP:
+                interpret(1);
+                break;
+            case EXIT_FLUSH:
+                J.flush();
+                break;
+            case EXIT_LIMIT:
+                interpret(limit - st.n);
+                break;
+        }
+    }
+    save_state();
+    return st.n;
+}
+
+#else  // !Y86_JIT_X64
+
+struct JitEngine::Impl {
+    Stats stats;
+};
+
+JitEngine::JitEngine() : impl_(new Impl()) {}
+JitEngine::~JitEngine() = default;
+bool JitEngine::available() { return false; }
+JitEngine& JitEngine::for_thread() {
+    thread_local JitEngine jit;
+    return jit;
+}
+const JitEngine::Stats& JitEngine::stats() const { return impl_->stats; }
+void JitEngine::flush() {}
+u64 JitEngine::run(CPU& S, u64 limit) { return run_threaded(S, limit); }
+
+#endif
+
+}  // namespace y86
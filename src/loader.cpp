@@ -0,0 +1,561 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "worker.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define Y86_HAVE_MMAP 1
+#endif
+
+namespace y86 {
+
+namespace {
+
+// Hand-written replacement for the old per-line
+//   regex_search(line, R"(0x([0-9a-fA-F]+):\s*([0-9a-fA-F\s]*))")
+// with identical results: the first "0x<hex>:" anywhere in the line sets the
+// address (and may lower the entry PC even without data); the following run
+// of hex digits and whitespace is the data, ignored unless it has an even
+// number of digits. Contiguous lines are merged into one pending run that
+// is handed to the sink in a single store() call.
+struct StoreSink {
+    virtual void store(u64 addr, const u8* p, std::size_t n) = 0;
+};
+
+struct CpuSink final : StoreSink {
+    CPU& cpu;
+    // loading never reads the index; whoever needs it builds it in one pass
+    explicit CpuSink(CPU& c) : cpu(c) { cpu.drop_index(); }
+    void store(u64 addr, const u8* p, std::size_t n) override {
+        cpu.write_bytes((s64)addr, p, n);
+    }
+};
+
+struct ImageSink final : StoreSink {
+    ProgramImage& img;
+    explicit ImageSink(ProgramImage& i) : img(i) {}
+    void store(u64 addr, const u8* p, std::size_t n) override {
+        auto& segs = img.segments;
+        if (segs.empty() || segs.back().addr + segs.back().bytes.size() != addr)
+            segs.push_back({addr, {}});
+        segs.back().bytes.insert(segs.back().bytes.end(), p, p + n);
+    }
+};
+
+class YoParser {
+public:
+    explicit YoParser(StoreSink& sink) : sink_(sink) {}
+
+    // one line, without the trailing '\n'
+    void line(const char* p, const char* e) {
+        const char* q = p;
+        u64 addr = 0;
+        for (;; ++q) {
+            q = find_0x(q, e);
+            if (!q) return;
+            if (parse_addr(q + 2, e, addr, q)) break;
+        }
+        ++q;  // ':'
+
+        if (entry_ == ~0ULL) entry_ = addr;
+        if (addr < entry_) entry_ = addr;
+
+        // decode straight into the pending run, dropped again if odd
+        if (!run_.empty() && addr != run_addr_ + run_.size()) flush();
+        if (run_.empty()) run_addr_ = addr;
+        std::size_t start = run_.size(), digits = 0;
+        int hi = -1;
+        for (; q < e; ++q) {
+            unsigned char c = (unsigned char)*q;
+            int v = hexval(c);
+            if (v < 0) {
+                if (!is_space(c)) break;
+                continue;
+            }
+            ++digits;
+            if (hi < 0) {
+                hi = v;
+            } else {
+                run_.push_back((u8)(hi << 4 | v));
+                hi = -1;
+            }
+        }
+        if (digits % 2 != 0) {
+            run_.resize(start);
+            return;
+        }
+        std::size_t nb = run_.size() - start;
+        if (nb == 0) return;
+        if (addr + nb - 1 > maxaddr_) maxaddr_ = addr + nb - 1;
+        if (run_.size() >= RUN_FLUSH) flush();
+    }
+
+    // feed a buffer that may end mid-line; returns bytes consumed
+    std::size_t feed(const char* p, std::size_t n, bool last) {
+        const char* e = p + n;
+        const char* s = p;
+        while (s < e) {
+            const char* nl = (const char*)std::memchr(s, '\n', (std::size_t)(e - s));
+            if (!nl) {
+                if (!last) break;
+                line(s, e);
+                s = e;
+                break;
+            }
+            line(s, nl);
+            s = nl + 1;
+        }
+        return (std::size_t)(s - p);
+    }
+
+    void finish(CPU& cpu, bool bound, std::uint64_t slack) {
+        flush();
+        cpu.PC = entry();
+        cpu.bounded = bound;
+        if (bound) cpu.mem_upper = maxaddr_ + slack;
+    }
+    void finish() { flush(); }
+
+    u64 entry() const { return entry_ == ~0ULL ? 0 : entry_; }
+    u64 maxaddr() const { return maxaddr_; }
+
+private:
+    static constexpr std::size_t RUN_FLUSH = 1 << 16;
+
+    static int hexval(unsigned char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        c |= 0x20;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+    // \s inside a line (getline already removed '\n')
+    static bool is_space(unsigned char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    static const char* find_0x(const char* q, const char* e) {
+        while (q + 1 < e) {
+            q = (const char*)std::memchr(q, '0', (std::size_t)(e - q - 1));
+            if (!q) return nullptr;
+            if (q[1] == 'x') return q;
+            ++q;
+        }
+        return nullptr;
+    }
+
+    // hex digits followed by ':'; strtoull saturates on overflow
+    static bool parse_addr(const char* q, const char* e, u64& addr, const char*& end) {
+        const char* s = q;
+        u64 v = 0;
+        bool over = false;
+        for (; q < e; ++q) {
+            int h = hexval((unsigned char)*q);
+            if (h < 0) break;
+            if (v >> 60) over = true;
+            v = v << 4 | (u64)h;
+        }
+        if (q == s || q == e || *q != ':') return false;
+        addr = over ? ~0ULL : v;
+        end = q;
+        return true;
+    }
+
+    void flush() {
+        if (run_.empty()) return;
+        sink_.store(run_addr_, run_.data(), run_.size());
+        run_.clear();
+    }
+
+    StoreSink& sink_;
+    u64 entry_ = ~0ULL, maxaddr_ = 0;
+    u64 run_addr_ = 0;
+    std::vector<u8> run_;
+};
+
+constexpr std::size_t CHUNK = 1 << 20;
+
+// read(buf, n) -> bytes read, 0 at EOF, <0 on error
+template <class Read>
+bool load_chunked(YoParser& ps, Read&& read) {
+    std::vector<char> buf(CHUNK);
+    std::size_t have = 0;
+    for (;;) {
+        if (have == buf.size()) buf.resize(buf.size() * 2);  // very long line
+        long got = read(buf.data() + have, buf.size() - have);
+        if (got < 0) return false;
+        bool last = got == 0;
+        have += (std::size_t)got;
+        std::size_t used = ps.feed(buf.data(), have, last);
+        std::memmove(buf.data(), buf.data() + used, have - used);
+        have -= used;
+        if (last) return true;
+    }
+}
+
+#ifdef Y86_HAVE_MMAP
+// read-only mapping of a regular, non-empty file
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        if (data_) munmap(data_, size_);
+    }
+
+    bool map(int fd) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return false;
+        void* m = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) return false;
+#ifdef MADV_SEQUENTIAL
+        madvise(m, (std::size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+        data_ = m;
+        size_ = (std::size_t)st.st_size;
+        return true;
+    }
+    const char* data() const { return (const char*)data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    void* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+#endif
+
+u64 rd64(const u8* p) { return PagedMem::load_le64(p); }
+void put64(std::vector<u8>& out, u64 v) {
+    u8 b[8];
+    PagedMem::store_le64(b, v);
+    out.insert(out.end(), b, b + 8);
+}
+
+bool fail(std::string* err, const char* msg) {
+    if (err) *err = msg;
+    return false;
+}
+
+}  // namespace
+
+void load_yo_buffer(const char* p, std::size_t n, CPU& cpu, bool bound, std::uint64_t slack) {
+    CpuSink sink(cpu);
+    YoParser ps(sink);
+    ps.feed(p, n, true);
+    ps.finish(cpu, bound, slack);
+}
+
+void load_yo(std::istream& in, CPU& cpu, bool bound, std::uint64_t slack) {
+    CpuSink sink(cpu);
+    YoParser ps(sink);
+    load_chunked(ps, [&](char* p, std::size_t n) {
+        in.read(p, (std::streamsize)n);
+        return (long)in.gcount();
+    });
+    ps.finish(cpu, bound, slack);
+}
+
+bool load_yo_fd(int fd, CPU& cpu, bool bound, std::uint64_t slack) {
+#ifdef Y86_HAVE_MMAP
+    MappedFile m;
+    if (m.map(fd)) {
+        load_yo_buffer(m.data(), m.size(), cpu, bound, slack);
+        return true;
+    }
+    // pipe, tty or empty file: read in large chunks
+    CpuSink sink(cpu);
+    YoParser ps(sink);
+    if (!load_chunked(ps, [&](char* p, std::size_t n) { return (long)::read(fd, p, n); }))
+        return false;
+    ps.finish(cpu, bound, slack);
+    return true;
+#else
+    (void)fd, (void)cpu, (void)bound, (void)slack;
+    return false;
+#endif
+}
+
+bool load_yo_file(const std::string& path, CPU& cpu, bool bound, std::uint64_t slack) {
+#ifdef Y86_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = load_yo_fd(fd, cpu, bound, slack);
+    ::close(fd);
+    return ok;
+#else
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin) return false;
+    load_yo(fin, cpu, bound, slack);
+    return true;
+#endif
+}
+
+// ---------- program images ----------
+
+ProgramImage image_from_yo(const char* p, std::size_t n, bool bound, std::uint64_t slack) {
+    ProgramImage img;
+    ImageSink sink(img);
+    YoParser ps(sink);
+    ps.feed(p, n, true);
+    ps.finish();
+    img.entry = ps.entry();
+    img.maxaddr = ps.maxaddr();
+    img.bounded = bound;
+    img.slack = slack;
+    return img;
+}
+
+void apply_image(const ProgramImage& img, CPU& cpu) {
+    cpu.drop_index();
+    for (auto& seg : img.segments) cpu.write_bytes((s64)seg.addr, seg.bytes.data(), seg.bytes.size());
+    cpu.PC = img.entry;
+    cpu.bounded = img.bounded;
+    if (img.bounded) cpu.mem_upper = img.maxaddr + img.slack;
+}
+
+bool is_ybin(const void* p, std::size_t n) {
+    return n >= ybin::HEADER_SIZE && std::memcmp(p, ybin::MAGIC, sizeof(ybin::MAGIC)) == 0;
+}
+
+std::vector<u8> encode_ybin(const ProgramImage& img, u64 src_hash) {
+    std::vector<u8> out(ybin::MAGIC, ybin::MAGIC + sizeof(ybin::MAGIC));
+    put64(out, (u64)ybin::VERSION | (u64)(img.bounded ? 1 : 0) << 32);
+    put64(out, img.entry);
+    put64(out, img.maxaddr);
+    put64(out, img.slack);
+    put64(out, img.segments.size());
+    put64(out, src_hash);
+    put64(out, 0);
+    u64 off = ybin::HEADER_SIZE + ybin::SEGMENT_SIZE * img.segments.size();
+    for (auto& seg : img.segments) {
+        put64(out, seg.addr);
+        put64(out, seg.bytes.size());
+        put64(out, off);
+        off = (off + seg.bytes.size() + 7) & ~7ULL;
+    }
+    for (auto& seg : img.segments) {
+        out.insert(out.end(), seg.bytes.begin(), seg.bytes.end());
+        out.resize((out.size() + 7) & ~std::size_t(7), 0);
+    }
+    return out;
+}
+
+// the whole file is validated before the CPU is touched
+bool load_ybin_buffer(const void* data, std::size_t n, CPU& cpu, std::string* err) {
+    const u8* p = (const u8*)data;
+    if (!is_ybin(p, n)) return fail(err, "not a .ybin image");
+    u64 ver_flags = rd64(p + 8);
+    if ((u32)ver_flags != ybin::VERSION) return fail(err, "unsupported .ybin version");
+    u64 nseg = rd64(p + 40);
+    if (nseg > (n - ybin::HEADER_SIZE) / ybin::SEGMENT_SIZE)
+        return fail(err, "truncated .ybin segment table");
+    const u8* tab = p + ybin::HEADER_SIZE;
+    for (u64 i = 0; i < nseg; i++) {
+        u64 len = rd64(tab + i * ybin::SEGMENT_SIZE + 8), off = rd64(tab + i * ybin::SEGMENT_SIZE + 16);
+        if (off > n || len > n - off) return fail(err, "truncated .ybin segment");
+    }
+
+    cpu.drop_index();
+    for (u64 i = 0; i < nseg; i++) {
+        const u8* e = tab + i * ybin::SEGMENT_SIZE;
+        cpu.write_bytes((s64)rd64(e), p + rd64(e + 16), (std::size_t)rd64(e + 8));
+    }
+    bool bounded = (ver_flags >> 32) & 1;
+    cpu.PC = rd64(p + 16);
+    cpu.bounded = bounded;
+    if (bounded) cpu.mem_upper = rd64(p + 24) + rd64(p + 32);
+    return true;
+}
+
+bool write_ybin_file(const std::string& path, const ProgramImage& img, u64 src_hash,
+                     std::string* err) {
+    std::vector<u8> bytes = encode_ybin(img, src_hash);
+    // write-then-rename so concurrent runs never see a partial image; the
+    // temporary name is unique per call, so threads writing the same path
+    // do not share one
+#ifdef Y86_HAVE_MMAP
+    std::string tmp = path + ".tmp.XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if (fd < 0) return fail(err, "cannot write image");
+    bool ok = fchmod(fd, 0644) == 0;
+    for (std::size_t done = 0; ok && done < bytes.size();) {
+        ssize_t put = ::write(fd, bytes.data() + done, bytes.size() - done);
+        if (put < 0 && errno == EINTR) continue;
+        ok = put > 0;
+        if (ok) done += (std::size_t)put;
+    }
+    ok &= ::close(fd) == 0;
+    if (!ok) {
+        std::remove(tmp.c_str());
+        return fail(err, "cannot write image");
+    }
+#else
+    static std::atomic<unsigned> seq{0};
+    std::string tmp = path + ".tmp." + std::to_string(seq++);
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+        if (!out) {
+            std::remove(tmp.c_str());
+            return fail(err, "cannot write image");
+        }
+    }
+#endif
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return fail(err, "cannot write image");
+    }
+    return true;
+}
+
+u64 content_hash(const void* data, std::size_t n) {
+    const u8* p = (const u8*)data;
+    u64 h = 0x9E3779B97F4A7C15ULL ^ n;
+    auto mix = [&](u64 w) {
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    };
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) mix(rd64(p + i));
+    if (i < n) {
+        u8 t[8]{};
+        std::memcpy(t, p + i, n - i);
+        mix(rd64(t));
+    }
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// LoadOptions::bound on top of a loaded .ybin (its header keeps maxaddr)
+static bool load_ybin_bounded(const char* p, std::size_t n, CPU& cpu, const LoadOptions& opt,
+                              std::string* err) {
+    if (!load_ybin_buffer(p, n, cpu, err)) return false;
+    if (opt.bound) {
+        cpu.bounded = true;
+        cpu.mem_upper = rd64((const u8*)p + 24) + opt.slack;
+    }
+    return true;
+}
+
+bool load_program_buffer(const char* p, std::size_t n, CPU& cpu, const LoadOptions& opt,
+                         std::string* err) {
+    if (is_ybin(p, n)) return load_ybin_bounded(p, n, cpu, opt, err);
+    load_yo_buffer(p, n, cpu, opt.bound, opt.slack);
+    return true;
+}
+
+// Unmappable input (pipe, tty): a .ybin needs the whole image, a .yo is
+// parsed in chunks as it arrives, like load_yo_fd(). read(buf, n) -> bytes
+// read, 0 at EOF, <0 on error.
+template <class Read>
+static bool load_program_stream(Read&& read, CPU& cpu, const LoadOptions& opt,
+                                std::string* err) {
+    char head[sizeof(ybin::MAGIC)];
+    std::size_t have = 0;
+    while (have < sizeof(head)) {
+        long got = read(head + have, sizeof(head) - have);
+        if (got < 0) return fail(err, "read failed");
+        if (got == 0) break;
+        have += (std::size_t)got;
+    }
+    if (have == sizeof(head) && std::memcmp(head, ybin::MAGIC, sizeof(head)) == 0) {
+        std::vector<char> all(head, head + have);
+        char buf[1 << 16];
+        for (;;) {
+            long got = read(buf, sizeof(buf));
+            if (got < 0) return fail(err, "read failed");
+            if (got == 0) break;
+            all.insert(all.end(), buf, buf + got);
+        }
+        return load_program_buffer(all.data(), all.size(), cpu, opt, err);
+    }
+    CpuSink sink(cpu);
+    YoParser ps(sink);
+    std::size_t pos = 0;
+    bool ok = load_chunked(ps, [&](char* p, std::size_t n) -> long {
+        if (pos == have) return read(p, n);
+        std::size_t k = std::min(n, have - pos);
+        std::memcpy(p, head + pos, k);
+        pos += k;
+        return (long)k;
+    });
+    if (!ok) return fail(err, "read failed");
+    ps.finish(cpu, opt.bound, opt.slack);
+    return true;
+}
+
+bool load_program_fd(int fd, CPU& cpu, const LoadOptions& opt, std::string* err) {
+#ifdef Y86_HAVE_MMAP
+    MappedFile m;
+    if (m.map(fd)) return load_program_buffer(m.data(), m.size(), cpu, opt, err);
+    return load_program_stream([&](char* p, std::size_t n) { return (long)::read(fd, p, n); },
+                               cpu, opt, err);
+#else
+    // no mmap: only stdin is supported
+    if (fd != 0) return fail(err, "cannot read descriptor");
+    return load_program_stream(
+        [](char* p, std::size_t n) {
+            std::cin.read(p, (std::streamsize)n);
+            return std::cin.bad() ? -1L : (long)std::cin.gcount();
+        },
+        cpu, opt, err);
+#endif
+}
+
+bool load_program_file(const std::string& path, CPU& cpu, const LoadOptions& opt,
+                       std::string* err) {
+#ifdef Y86_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return fail(err, "cannot open file");
+    MappedFile src;
+    bool mapped = src.map(fd);
+    if (!mapped) {
+        bool ok = load_program_fd(fd, cpu, opt, err);
+        ::close(fd);
+        return ok;
+    }
+    ::close(fd);
+    if (is_ybin(src.data(), src.size()) || !opt.cache)
+        return load_program_buffer(src.data(), src.size(), cpu, opt, err);
+
+    u64 h = content_hash(src.data(), src.size());
+    std::string cache = path + ".ybin";
+    int cfd = ::open(cache.c_str(), O_RDONLY);
+    if (cfd >= 0) {
+        MappedFile img;
+        bool ok = img.map(cfd);
+        ::close(cfd);
+        if (ok && is_ybin(img.data(), img.size()) &&
+            rd64((const u8*)img.data() + 48) == h &&
+            load_ybin_bounded(img.data(), img.size(), cpu, opt, nullptr))
+            return true;
+    }
+    // cached images are always unbounded; opt.bound is applied on load
+    ProgramImage img = image_from_yo(src.data(), src.size());
+    write_ybin_file(cache, img, h);  // best effort, e.g. read-only trees
+    img.bounded = opt.bound;
+    img.slack = opt.slack;
+    apply_image(img, cpu);
+    return true;
+#else
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin) return fail(err, "cannot open file");
+    std::string text((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    return load_program_buffer(text.data(), text.size(), cpu, opt, err);
+#endif
+}
+
+}  // namespace y86
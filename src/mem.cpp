@@ -0,0 +1,84 @@
+#include "mem.h"
+
+#include <algorithm>
+
+namespace y86 {
+
+// shares every page; `o` may have cached its pages as writable, which they
+// no longer are
+PagedMem::PagedMem(const PagedMem& o) : table_(o.table_) { o.flush_tlb(); }
+
+PagedMem::PagedMem(PagedMem&& o) noexcept : table_(std::move(o.table_)) {
+    o.table_.clear();
+    o.flush_tlb();
+}
+
+PagedMem& PagedMem::operator=(const PagedMem& o) {
+    if (this != &o) {
+        PagedMem tmp(o);
+        *this = std::move(tmp);
+    }
+    return *this;
+}
+
+PagedMem& PagedMem::operator=(PagedMem&& o) noexcept {
+    if (this != &o) {
+        table_ = std::move(o.table_);
+        o.table_.clear();
+        o.flush_tlb();
+        flush_tlb();
+    }
+    return *this;
+}
+
+void PagedMem::clear() {
+    table_.clear();
+    flush_tlb();
+}
+
+std::size_t PagedMem::shared_pages() const {
+    std::size_t n = 0;
+    for (auto& kv : table_) n += kv.second.use_count() > 1;
+    return n;
+}
+
+// allocate the page, or take a private copy if it is shared
+PagedMem::Page* PagedMem::touch_slow(Slot& s, u64 pn) {
+    auto& sp = table_[pn];
+    if (!sp)
+        sp = std::make_shared<Page>();
+    else if (sp.use_count() > 1)
+        sp = std::make_shared<Page>(*sp);
+    s.pn = pn;
+    s.page = sp.get();
+    s.writable = true;
+    return s.page;
+}
+
+void PagedMem::flush_tlb() const {
+    for (auto& s : tlb_) s = Slot{};
+}
+
+void PagedMem::write_bytes(u64 a, const u8* src, std::size_t n) {
+    while (n > 0) {
+        u64 off = a & PAGE_MASK;
+        std::size_t k = (std::size_t)std::min<u64>(n, PAGE_SIZE - off);
+        std::memcpy(touch(a >> PAGE_BITS)->bytes + off, src, k);
+        a += k;
+        src += k;
+        n -= k;
+    }
+}
+
+// 8-byte access straddling a page boundary
+u64 PagedMem::read8_split(u64 a) const {
+    u64 v = 0;
+    for (int i = 0; i < 8; i++) v |= (u64)read1(a + i) << (8 * i);
+    return v;
+}
+
+void PagedMem::write8_split(u64 a, u64 v) {
+    for (int i = 0; i < 8; i++) write1(a + i, (u8)(v >> (8 * i)));
+}
+
+}  // namespace y86
@@ -0,0 +1,67 @@
+#include "memview.h"
+
+#include <iterator>
+
+namespace y86 {
+
+void MemView::reset(const CPU& S) {
+    top_ = 0;
+    seq_ = S.dirty_seq;
+    clock_ = 0;
+    written_.clear();
+}
+
+void MemView::scroll(const CPU& S, long delta) {
+    const auto& idx = S.qword_nonzero();
+    if (idx.empty()) return;
+    auto it = idx.lower_bound(top_);
+    if (it == idx.end()) --it;
+    for (; delta > 0 && std::next(it) != idx.end(); --delta) ++it;
+    for (; delta < 0 && it != idx.begin(); ++delta) --it;
+    top_ = it->first;
+}
+
+void MemView::jump(const CPU& S, u64 addr) {
+    const auto& idx = S.qword_nonzero();
+    auto it = idx.lower_bound(CPU::align8(addr));
+    if (it == idx.end() && !idx.empty()) --it;
+    top_ = it == idx.end() ? CPU::align8(addr) : it->first;
+}
+
+void MemView::take_writes(const CPU& S) {
+    // memory was replaced since the last refresh (restore(), drop_index()):
+    // which qwords changed is unknown, so nothing new is highlighted
+    if (S.dirty_epoch > seq_) seq_ = S.dirty_seq;
+    u64 first = S.dirty_seq - seq_ > CPU::DIRTY_RING ? S.dirty_seq - CPU::DIRTY_RING : seq_;
+    for (u64 q = first; q != S.dirty_seq; ++q) written_[S.dirty_ring[q % CPU::DIRTY_RING]] = clock_;
+    seq_ = S.dirty_seq;
+    // at most HOT_REFRESHES * DIRTY_RING entries survive
+    for (auto it = written_.begin(); it != written_.end();) {
+        if (clock_ - it->second >= HOT_REFRESHES)
+            it = written_.erase(it);
+        else
+            ++it;
+    }
+}
+
+void MemView::refresh(const CPU& S, std::vector<Row>& out) {
+    take_writes(S);
+    out.clear();
+    const auto& idx = S.qword_nonzero();
+    auto it = idx.lower_bound(top_);
+    // near the end, pull earlier rows in so the window stays full
+    std::size_t below = 0;
+    for (auto j = it; j != idx.end() && below < rows_; ++j) ++below;
+    for (; below < rows_ && it != idx.begin(); ++below) --it;
+    for (; it != idx.end() && out.size() < rows_; ++it) {
+        Row r;
+        r.addr = it->first;
+        r.value = it->second;
+        auto w = written_.find(it->first);
+        if (w != written_.end()) r.age = (u32)(clock_ - w->second);
+        out.push_back(r);
+    }
+    ++clock_;
+}
+
+}  // namespace y86
@@ -0,0 +1,21 @@
+#include "parse.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+
+namespace y86 {
+
+bool parse_u64(const std::string& s, u64& out) {
+    bool hex = s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+    const char* p = s.c_str() + (hex ? 2 : 0);
+    // strtoull would also skip blanks and take a sign
+    unsigned char c = (unsigned char)*p;
+    if (!(hex ? std::isxdigit(c) : std::isdigit(c))) return false;
+    char* end = nullptr;
+    errno = 0;
+    out = std::strtoull(p, &end, hex ? 16 : 10);
+    return *end == 0 && errno != ERANGE;
+}
+
+}  // namespace y86
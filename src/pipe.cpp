@@ -0,0 +1,303 @@
+#include "pipe.h"
+
+#include <sstream>
+
+#include "bpred.h"
+#include "cachesim.h"
+
+#include "worker.h"
+
+namespace y86 {
+
+namespace {
+
+constexpr u8 NOREG = 0x10;  // no register; 0xF is the RNONE scratch slot
+constexpr u8 I_HALT = 0x0, I_NOP = 0x1, I_RRMOV = 0x2, I_IRMOV = 0x3, I_RMMOV = 0x4,
+             I_MRMOV = 0x5, I_OPQ = 0x6, I_JXX = 0x7, I_CALL = 0x8, I_RET = 0x9,
+             I_PUSH = 0xA, I_POP = 0xB;
+
+// contents of one pipeline register; later stages fill in more fields
+struct Inst {
+    bool bubble = true;
+    Stat stat = Stat::AOK;
+    u8 icode = I_NOP, ifun = 0, rA = RNONE, rB = RNONE;
+    u64 pc = 0, valC = 0, valP = 0;
+    u8 srcA = NOREG, srcB = NOREG, dstE = NOREG, dstM = NOREG;
+    s64 valA = 0, valB = 0;  // operands after forwarding
+    u64 valE = 0, addr = 0, valM = 0;
+    bool cnd = false;
+    bool pred = true;  // jXX: predicted taken at fetch
+    u64 newpc = 0;  // PC after this instruction
+    CC cc{};        // CC after this instruction
+};
+
+inline bool live(const Inst& i) { return !i.bubble && i.stat == Stat::AOK; }
+
+inline u8 base_reg(u8 rB) { return rB == RNONE ? 4 : rB; }
+
+}  // namespace
+
+nlohmann::json PipeEngine::Stats::to_json() const {
+    return {{"cycles", cycles},
+            {"instructions", retired},
+            {"CPI", cpi()},
+            {"stalls", {{"load_use", load_use}, {"memory", mem_stalls}}},
+            {"bubbles", {{"mispredict", 2 * mispredicts}, {"ret", ret_bubbles}, {"smc", 2 * smc_flushes}}},
+            {"events", {{"branches", branches}, {"mispredicts", mispredicts}, {"rets", rets}, {"smc_flushes", smc_flushes}}}};
+}
+
+u64 PipeEngine::run(CPU& S, u64 limit) {
+    if (limit == 0 || S.stat != Stat::AOK) return 0;
+
+    s64 r[16];
+    for (int i = 0; i < REG_NUM; i++) r[i] = S.R[i];
+    r[RNONE] = S.scratch;
+    CC cc = S.cc;
+    u64 predPC = S.PC;
+    Inst D, E, M, W;
+    u64 retired = 0;
+    const Stat saved_stat = S.stat;
+    u64 stalled = cache_ ? cache_->stall_cycles() : 0;
+
+    for (;;) {
+        ++stats_.cycles;
+
+        // ---------- W: write back, retire ----------
+        if (!W.bubble) {
+            if (W.dstE != NOREG) r[W.dstE] = (s64)W.valE;
+            if (W.dstM != NOREG) r[W.dstM] = (s64)W.valM;
+            ++retired;
+            ++stats_.retired;
+            if (W.stat == Stat::AOK && W.icode == I_JXX) {
+                ++stats_.branches;
+                if (W.cnd != W.pred) ++stats_.mispredicts;
+            }
+            if (W.stat == Stat::AOK && W.icode == I_RET) ++stats_.rets;
+            if (ref_) {
+                execute(*ref_);
+                std::ostringstream os;
+                Stat st = W.stat;
+                u64 pc = st == Stat::AOK ? W.newpc : W.pc;
+                if (ref_->stat != st) os << " STAT " << (int)ref_->stat << " != " << (int)st;
+                if (ref_->PC != pc) os << " PC " << ref_->PC << " != " << pc;
+                if (ref_->cc.ZF != W.cc.ZF || ref_->cc.SF != W.cc.SF || ref_->cc.OF != W.cc.OF)
+                    os << " CC differs";
+                for (int i = 0; i < REG_NUM; i++)
+                    if (ref_->R[i] != r[i]) os << " " << reg_name(i) << " " << ref_->R[i] << " != " << r[i];
+                if (ref_->scratch != r[RNONE]) os << " RNONE scratch differs";
+                if (!os.str().empty()) {
+                    std::ostringstream m;
+                    m << "retirement " << retired << " (pc " << W.pc << "):" << os.str();
+                    mismatch_ = m.str();
+                }
+            }
+            if (W.stat != Stat::AOK || retired == limit || !mismatch_.empty()) break;
+        }
+
+        // ---------- M: memory ----------
+        Inst m = M;
+        bool smc = false;
+        if (live(m)) {
+            switch (m.icode) {
+                case I_MRMOV:
+                case I_POP:
+                case I_RET: {
+                    u64 v = 0;
+                    if (!S.read8((s64)m.addr, v)) {
+                        m.stat = Stat::ADR;
+                        m.dstE = m.dstM = NOREG;
+                    } else {
+                        m.valM = v;
+                        if (m.icode == I_RET) m.newpc = v;
+                        if (cache_) cache_->load(m.pc, m.addr);
+                    }
+                    break;
+                }
+                case I_RMMOV:
+                case I_PUSH:
+                case I_CALL: {
+                    u64 v = m.icode == I_CALL ? m.valP : (u64)m.valA;
+                    if (!S.write8((s64)m.addr, v)) {
+                        // call/pushq have already moved %rsp in step()
+                        m.stat = Stat::ADR;
+                        if (m.icode == I_RMMOV) m.dstE = NOREG;
+                        break;
+                    }
+                    if (cache_) cache_->store(m.pc, m.addr);
+                    // younger instructions fetched from the bytes just written
+                    auto hit = [&](const Inst& i) {
+                        if (i.bubble) return false;
+                        u64 end = i.stat == Stat::AOK ? i.valP : i.pc + DecodeCache::MAX_INSN_LEN;
+                        return m.addr < end && i.pc < m.addr + 8;
+                    };
+                    smc = hit(E) || hit(D);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        bool m_exc = !m.bubble && m.stat != Stat::AOK;
+
+        // ---------- E: execute ----------
+        Inst e = E;
+        if (smc) e = Inst{};
+        if (live(e)) {
+            switch (e.icode) {
+                case I_RRMOV:
+                    e.cnd = cond_true(cc, e.ifun);
+                    e.valE = (u64)e.valA;
+                    if (!e.cnd) e.dstE = NOREG;
+                    break;
+                case I_IRMOV:
+                    e.valE = e.valC;
+                    break;
+                case I_RMMOV:
+                case I_MRMOV:
+                    e.addr = (u64)e.valB + e.valC;
+                    break;
+                case I_OPQ: {
+                    s64 a = e.valA, b = e.valB, v = 0;
+                    switch (e.ifun) {
+                        case 0: v = (s64)((u64)b + (u64)a); break;
+                        case 1: v = (s64)((u64)b - (u64)a); break;
+                        case 2: v = b & a; break;
+                        default: v = b ^ a; break;
+                    }
+                    e.valE = (u64)v;
+                    if (!m_exc) {
+                        cc.ZF = v == 0;
+                        cc.SF = v < 0;
+                        cc.OF = e.ifun == 0   ? ((a < 0) == (b < 0)) && ((v < 0) != (a < 0))
+                                : e.ifun == 1 ? ((b < 0) != (a < 0)) && ((v < 0) != (b < 0))
+                                              : 0;
+                    }
+                    break;
+                }
+                case I_JXX:
+                    e.cnd = cond_true(cc, e.ifun);
+                    e.newpc = e.cnd ? e.valC : e.valP;
+                    if (pred_ && e.ifun != 0) pred_->update(e.pc, e.valC, e.cnd);
+                    break;
+                case I_CALL:
+                case I_PUSH:
+                    e.addr = e.valE = (u64)e.valB - 8;
+                    break;
+                case I_RET:
+                case I_POP:
+                    e.addr = (u64)e.valB;
+                    e.valE = (u64)e.valB + 8;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (!e.bubble) e.cc = cc;
+
+        // ---------- D: decode, register read with forwarding ----------
+        Inst d = D;
+        if (smc) d = Inst{};
+        if (live(d)) {
+            switch (d.icode) {
+                case I_RRMOV: d.srcA = d.rA; d.dstE = d.rB; break;
+                case I_IRMOV: d.dstE = d.rB; break;
+                case I_RMMOV: d.srcA = d.rA; d.srcB = base_reg(d.rB); break;
+                case I_MRMOV: d.srcB = base_reg(d.rB); d.dstM = d.rA; break;
+                case I_OPQ: d.srcA = d.rA; d.srcB = base_reg(d.rB); d.dstE = d.rB; break;
+                case I_CALL: d.srcB = 4; d.dstE = 4; break;
+                case I_RET: d.srcB = 4; d.dstE = 4; break;
+                case I_PUSH: d.srcA = d.rA; d.srcB = base_reg(d.rB); d.dstE = 4; break;
+                case I_POP: d.srcB = base_reg(d.rB); d.dstE = 4; d.dstM = d.rA; break;
+                default: break;
+            }
+            auto fwd = [&](u8 src) -> s64 {
+                if (src == NOREG) return 0;
+                if (live(e) && e.dstE == src) return (s64)e.valE;
+                if (live(m) && m.dstM == src) return (s64)m.valM;
+                if (!m.bubble && m.dstE == src) return (s64)m.valE;
+                return r[src];  // W was written back at the start of the cycle
+            };
+            d.valA = fwd(d.srcA);
+            d.valB = fwd(d.srcB);
+        }
+
+        // ---------- F: select PC, fetch, predict ----------
+        u64 f_pc = predPC;
+        if (live(M) && M.icode == I_JXX && M.cnd != M.pred)
+            f_pc = M.newpc;
+        else if (live(W) && W.icode == I_RET)
+            f_pc = W.valM;
+        Inst f;
+        f.bubble = false;
+        f.pc = f_pc;
+        S.PC = f_pc;
+        Decoded dec = fetch_and_decode(S);
+        if (!dec.ok) {
+            f.stat = S.stat;  // ADR/INS from the fetch; not architectural yet
+            S.stat = saved_stat;
+            f.icode = dec.icode;
+            f.newpc = f.valP = f_pc;
+        } else {
+            f.icode = dec.icode;
+            f.ifun = dec.ifun;
+            f.rA = dec.rA;
+            f.rB = dec.rB;
+            f.valC = dec.valC;
+            f.valP = f.newpc = dec.valP;
+            if (cache_) cache_->fetch(f_pc, dec.valP - f_pc);
+            if (f.icode == I_HALT) f.stat = Stat::HLT;
+            if (f.icode == I_OPQ && f.ifun > 3) f.stat = Stat::INS;
+            if (f.icode == I_CALL) f.newpc = f.valC;
+            if (f.icode == I_JXX && f.ifun != 0 && pred_) f.pred = pred_->predict(f.pc, f.valC);
+        }
+        bool f_taken = f.icode == I_CALL || (f.icode == I_JXX && f.pred);
+        u64 f_pred = f.stat == Stat::AOK && f_taken ? f.valC : f.valP;
+
+        // a miss freezes the whole pipeline until the slowest access is served
+        if (cache_) {
+            u64 stall = cache_->stall_cycles() - stalled;
+            stalled += stall;
+            stats_.cycles += stall;
+            stats_.mem_stalls += stall;
+        }
+
+        // ---------- pipeline control ----------
+        bool load_use = live(E) && (E.icode == I_MRMOV || E.icode == I_POP) &&
+                        live(d) && (E.dstM == d.srcA || E.dstM == d.srcB);
+        bool mispredict = live(e) && e.icode == I_JXX && e.cnd != e.pred;
+        auto is_ret = [](const Inst& i) { return live(i) && i.icode == I_RET; };
+        bool ret_stall = is_ret(D) || is_ret(E) || is_ret(M);
+
+        W = m;
+        M = m_exc ? Inst{} : e;
+        if (smc) {
+            ++stats_.smc_flushes;
+            E = Inst{};
+            D = Inst{};
+            predPC = m.newpc;
+            continue;
+        }
+        E = mispredict || load_use ? Inst{} : d;
+        if (load_use) {
+            ++stats_.load_use;  // D keeps its instruction, F refetches
+        } else if (mispredict || ret_stall) {
+            D = Inst{};
+            if (!mispredict) ++stats_.ret_bubbles;
+        } else {
+            // nothing younger than a faulting instruction can retire, so
+            // fetch drains instead of stalling on wrong-path code after it
+            auto faults = [](const Inst& i) { return !i.bubble && i.stat != Stat::AOK; };
+            D = faults(E) || faults(M) || faults(W) ? Inst{} : f;
+        }
+        if (!load_use && !ret_stall) predPC = f_pred;
+    }
+
+    for (int i = 0; i < REG_NUM; i++) S.R[i] = r[i];
+    S.scratch = r[RNONE];
+    S.cc = W.cc;
+    S.stat = W.stat;
+    S.PC = W.stat == Stat::AOK ? W.newpc : W.pc;
+    return retired;
+}
+
+}  // namespace y86
@@ -0,0 +1,248 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <set>
+
+#include "cpu.h"
+
+using nlohmann::json;
+
+namespace y86 {
+
+static std::string insn_name(u8 icode, u8 ifun) {
+    static const char* cond[] = {"", "le", "l", "e", "ne", "ge", "g"};
+    static const char* op[] = {"addq", "subq", "andq", "xorq"};
+    switch (icode) {
+        case 0x0: return "halt";
+        case 0x1: return "nop";
+        case 0x2: return ifun == 0 ? "rrmovq" : ifun <= 6 ? std::string("cmov") + cond[ifun] : "cmov?";
+        case 0x3: return "irmovq";
+        case 0x4: return "rmmovq";
+        case 0x5: return "mrmovq";
+        case 0x6: return ifun <= 3 ? op[ifun] : "opq?";
+        case 0x7: return ifun == 0 ? "jmp" : ifun <= 6 ? std::string("j") + cond[ifun] : "j?";
+        case 0x8: return "call";
+        case 0x9: return "ret";
+        case 0xA: return "pushq";
+        case 0xB: return "popq";
+        default: return "ins?";
+    }
+}
+
+Symbols yo_symbols(const char* p, std::size_t n) {
+    Symbols syms;
+    const char* end = p + n;
+    while (p < end) {
+        const char* eol = std::find(p, end, '\n');
+        const char* q = p;
+        while (q < eol && std::isspace((unsigned char)*q)) ++q;
+        if (eol - q > 2 && q[0] == '0' && (q[1] == 'x' || q[1] == 'X')) {
+            u64 addr = 0;
+            const char* h = q + 2;
+            while (h < eol && std::isxdigit((unsigned char)*h)) {
+                int c = std::tolower((unsigned char)*h++);
+                addr = addr << 4 | (u64)(c <= '9' ? c - '0' : c - 'a' + 10);
+            }
+            const char* bar = std::find(h, eol, '|');
+            if (h < eol && *h == ':' && bar < eol) {
+                const char* s = bar + 1;
+                while (s < eol && (*s == ' ' || *s == '\t')) ++s;
+                const char* e = s;
+                while (e < eol && (std::isalnum((unsigned char)*e) || *e == '_' || *e == '.')) ++e;
+                if (e > s && e < eol && *e == ':' && !std::isdigit((unsigned char)*s))
+                    syms.emplace(addr, std::string(s, e));
+            }
+        }
+        p = eol + 1;
+    }
+    return syms;
+}
+
+// ---------- Index ----------
+
+Profiler::Index::Index() : slots_(64), mask_(63), shift_(64 - 6) {}
+
+void Profiler::Index::insert(const Key& k, u32 idx) {
+    if (2 * (used_ + 1) > slots_.size()) {
+        std::vector<Slot> old = std::move(slots_);
+        slots_.assign(old.size() * 2, Slot{});
+        mask_ = slots_.size() - 1;
+        --shift_;
+        for (const Slot& s : old) {
+            if (s.idx == NONE) continue;
+            std::size_t h = slot(s.key);
+            while (slots_[h].idx != NONE) h = (h + 1) & mask_;
+            slots_[h] = s;
+        }
+    }
+    std::size_t h = slot(k);
+    while (slots_[h].idx != NONE) h = (h + 1) & mask_;
+    slots_[h] = Slot{k, idx};
+    ++used_;
+}
+
+// ---------- Profiler ----------
+
+Profiler::Profiler() : nodes_(1), self_(1, 0) {}
+
+u32 Profiler::new_pc(u64 pc, const Decoded& d) {
+    if (!rooted_) {
+        // the call tree is rooted at the first executed PC
+        nodes_[0].fn = pc;
+        rooted_ = true;
+    }
+    u32 i = (u32)pc_.size();
+    PcStat s;
+    s.pc = pc;
+    s.icode = d.icode;
+    s.ifun = d.ifun;
+    s.target = d.valC;
+    pc_.push_back(s);
+    pcs_.insert({pc, 0}, i);
+    return i;
+}
+
+void Profiler::call(u64 target, u64 ret_addr) {
+    if (stack_.size() >= MAX_DEPTH) {
+        ++overflow_;
+        return;
+    }
+    u32 child = children_.find({node_, target});
+    if (child == NONE) {
+        child = (u32)nodes_.size();
+        nodes_.push_back(Node{node_, target});
+        self_.push_back(0);
+        children_.insert({node_, target}, child);
+    }
+    stack_.push_back(Frame{node_, ret_addr});
+    node_ = child;
+}
+
+void Profiler::ret(u64 target) {
+    std::pair<u64, u64> edge{pc_[cur_].pc, target};
+    u32 e = rets_.find(edge);
+    if (e == NONE) {
+        e = (u32)ret_edges_.size();
+        ret_edges_.push_back(edge);
+        ret_count_.push_back(0);
+        rets_.insert(edge, e);
+    }
+    ++ret_count_[e];
+
+    if (overflow_) {
+        --overflow_;
+        return;
+    }
+    // normally the top frame; a ret to an outer return address unwinds to
+    // it, and one matching no frame (ret used as a jump) leaves the stack
+    for (std::size_t i = stack_.size(); i-- > 0;) {
+        if (stack_[i].ret_addr == target) {
+            node_ = stack_[i].node;
+            stack_.resize(i);
+            return;
+        }
+    }
+}
+
+void Profiler::end(const CPU& S, u64 n) {
+    steps_ += n;
+    stat_ = S.stat;
+}
+
+std::string Profiler::frame_name(u64 fn, const Symbols& syms) const {
+    auto it = syms.find(fn);
+    if (it != syms.end()) return it->second;
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)fn);
+    return buf;
+}
+
+json Profiler::summary(const Symbols& syms) const {
+    json out;
+    out["instructions"] = steps_;
+    out["STAT"] = (int)stat_;
+
+    json hist = json::array();
+    std::vector<int> order;
+    for (int b = 0; b < 256; b++)
+        if (hist_[b]) order.push_back(b);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return hist_[a] > hist_[b]; });
+    for (int b : order)
+        hist.push_back({{"insn", insn_name((u8)(b >> 4), (u8)(b & 0xF))},
+                        {"icode", b >> 4},
+                        {"ifun", b & 0xF},
+                        {"count", hist_[b]}});
+    out["histogram"] = std::move(hist);
+
+    std::vector<const PcStat*> pcs;
+    for (const PcStat& s : pc_) pcs.push_back(&s);
+    std::sort(pcs.begin(), pcs.end(), [](const PcStat* a, const PcStat* b) {
+        return a->count != b->count ? a->count > b->count : a->pc < b->pc;
+    });
+    json jp = json::array(), calls = json::array();
+    for (const PcStat* s : pcs) {
+        json j = {{"pc", s->pc}, {"insn", insn_name(s->icode, s->ifun)}, {"count", s->count}};
+        if (s->icode == 0x7 || (s->icode == 0x2 && s->ifun != 0)) {
+            j["taken"] = s->taken;
+            j["not_taken"] = s->not_taken;
+        }
+        auto sym = syms.find(s->pc);
+        if (sym != syms.end()) j["label"] = sym->second;
+        jp.push_back(std::move(j));
+        if (s->icode == 0x8)
+            calls.push_back({{"site", s->pc},
+                             {"target", s->target},
+                             {"callee", frame_name(s->target, syms)},
+                             {"count", s->count}});
+    }
+    out["pcs"] = std::move(jp);
+    out["calls"] = std::move(calls);
+
+    std::vector<u32> rets(ret_edges_.size());
+    for (u32 i = 0; i < rets.size(); i++) rets[i] = i;
+    std::sort(rets.begin(), rets.end(), [&](u32 a, u32 b) {
+        return ret_count_[a] != ret_count_[b] ? ret_count_[a] > ret_count_[b] : ret_edges_[a] < ret_edges_[b];
+    });
+    json jr = json::array();
+    for (u32 i : rets)
+        jr.push_back({{"site", ret_edges_[i].first},
+                      {"target", ret_edges_[i].second},
+                      {"count", ret_count_[i]}});
+    out["rets"] = std::move(jr);
+
+    // self: instructions executed in the function itself; total: also in
+    // its callees, counting recursive activations once
+    std::map<u64, std::pair<u64, u64>> fns;
+    for (u32 i = 0; i < nodes_.size(); i++) {
+        fns[nodes_[i].fn].first += self_[i];
+        std::set<u64> seen;
+        for (u32 a = i; a != NONE; a = nodes_[a].parent)
+            if (seen.insert(nodes_[a].fn).second) fns[nodes_[a].fn].second += self_[i];
+    }
+    std::vector<std::pair<u64, std::pair<u64, u64>>> fv(fns.begin(), fns.end());
+    std::stable_sort(fv.begin(), fv.end(),
+                     [](const auto& a, const auto& b) { return a.second.first > b.second.first; });
+    json jf = json::array();
+    for (auto& [fn, c] : fv)
+        jf.push_back({{"entry", fn}, {"name", frame_name(fn, syms)}, {"self", c.first}, {"total", c.second}});
+    out["functions"] = std::move(jf);
+    return out;
+}
+
+void Profiler::write_folded(std::ostream& out, const Symbols& syms) const {
+    std::vector<std::string> path;
+    for (u32 i = 0; i < nodes_.size(); i++) {
+        if (!self_[i]) continue;
+        path.clear();
+        for (u32 a = i; a != NONE; a = nodes_[a].parent) path.push_back(frame_name(nodes_[a].fn, syms));
+        for (std::size_t k = path.size(); k-- > 0;) {
+            out << path[k];
+            if (k) out << ';';
+        }
+        out << ' ' << self_[i] << '\n';
+    }
+}
+
+}  // namespace y86
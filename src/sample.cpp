@@ -0,0 +1,54 @@
+#include "sample.h"
+
+#include <vector>
+
+#include "engine.h"
+#include "parse.h"
+
+namespace y86 {
+
+static bool fail(std::string* err, const std::string& msg) {
+    if (err) *err = msg;
+    return false;
+}
+
+bool SampleSpec::parse_period(const std::string& s, SampleSpec& out, std::string* err) {
+    std::vector<std::string> f;
+    for (std::size_t p = 0;;) {
+        std::size_t q = s.find(':', p);
+        f.push_back(s.substr(p, q == std::string::npos ? q : q - p));
+        if (q == std::string::npos) break;
+        p = q + 1;
+    }
+    if (f.size() < 2 || f.size() > 3) return fail(err, "expected SKIP:LEN[:COUNT]");
+    u64 skip, len, windows = ~u64(0);
+    if (!parse_u64(f[0], skip)) return fail(err, "bad SKIP '" + f[0] + "'");
+    if (!parse_u64(f[1], len) || !len) return fail(err, "bad LEN '" + f[1] + "'");
+    if (f.size() == 3 && (!parse_u64(f[2], windows) || !windows))
+        return fail(err, "bad COUNT '" + f[2] + "'");
+    out.skip = skip;
+    out.len = len;
+    out.windows = windows;
+    return true;
+}
+
+bool SampleSpec::parse_start(const std::string& s, SampleSpec& out, std::string* err) {
+    if (!s.compare(0, 3, "pc:")) {
+        u64 pc;
+        if (!parse_u64(s.substr(3), pc)) return fail(err, "bad address '" + s.substr(3) + "'");
+        out.start_at_pc = true;
+        out.start_pc = pc;
+        return true;
+    }
+    u64 n;
+    if (!parse_u64(s, n)) return fail(err, "expected an instruction count or pc:ADDR");
+    out.start_count = n;
+    return true;
+}
+
+u64 run_to_pc(CPU& S, u64 pc, u64 limit) {
+    PcStop stop{pc};
+    return run_auto(S, limit, stop);
+}
+
+}  // namespace y86
@@ -0,0 +1,278 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace y86 {
+
+OutBuf::OutBuf(std::FILE* f, std::size_t cap) : f_(f), buf_(cap) {}
+
+void OutBuf::write(const char* p, std::size_t n) {
+    while (n > 0) {
+        if (len_ == buf_.size()) flush();
+        std::size_t k = std::min(n, buf_.size() - len_);
+        std::memcpy(buf_.data() + len_, p, k);
+        len_ += k;
+        p += k;
+        n -= k;
+    }
+}
+
+void OutBuf::put_int(std::int64_t v) {
+    char tmp[24];
+    auto r = std::to_chars(tmp, tmp + sizeof tmp, v);
+    write(tmp, (std::size_t)(r.ptr - tmp));
+}
+
+void OutBuf::flush() {
+    if (len_ > 0) std::fwrite(buf_.data(), 1, len_, f_);
+    len_ = 0;
+}
+
+// json objects are std::map-backed, so dump() emits keys in string order
+static const std::array<int, REG_NUM>& reg_key_order() {
+    static const std::array<int, REG_NUM> order = [] {
+        std::array<int, REG_NUM> o{};
+        for (int i = 0; i < REG_NUM; i++) o[i] = i;
+        std::sort(o.begin(), o.end(),
+                  [](int a, int b) { return std::strcmp(reg_name(a), reg_name(b)) < 0; });
+        return o;
+    }();
+    return order;
+}
+
+void JsonTraceWriter::record(const CPU& S) {
+    const auto& order = reg_key_order();
+
+    out_.put_str(count_ == 0 ? "[\n  {\n" : ",\n  {\n");
+    ++count_;
+
+    out_.put_str("    \"CC\": {\n      \"OF\": ");
+    out_.put_int(S.cc.OF);
+    out_.put_str(",\n      \"SF\": ");
+    out_.put_int(S.cc.SF);
+    out_.put_str(",\n      \"ZF\": ");
+    out_.put_int(S.cc.ZF);
+    out_.put_str("\n    },\n    \"MEM\": ");
+    sync_mem(S);
+    out_.write(mem_text_);
+    out_.put_str(",\n    \"PC\": ");
+    out_.put_int((std::int64_t)S.PC);
+    out_.put_str(",\n    \"REG\": {\n");
+    for (int k = 0; k < REG_NUM; k++) {
+        int i = order[k];
+        out_.put_str("      \"");
+        out_.put_str(reg_name(i));
+        out_.put_str("\": ");
+        out_.put_int(S.R[i]);
+        out_.put_str(k + 1 < REG_NUM ? ",\n" : "\n");
+    }
+    out_.put_str("    },\n    \"STAT\": ");
+    out_.put_int((int)S.stat);
+    out_.put_str("\n  }");
+}
+
+void JsonTraceWriter::set_row(u64 base, const CPU& S) {
+    std::string key = std::to_string(base);
+    auto it = S.qword_nonzero().find(base);
+    if (it == S.qword_nonzero().end()) {
+        mem_rows_.erase(key);
+        return;
+    }
+    char val[24];
+    auto r = std::to_chars(val, val + sizeof val, it->second);
+    std::string row = "      \"" + key + "\": ";
+    row.append(val, r.ptr);
+    mem_rows_[std::move(key)] = std::move(row);
+}
+
+// bring mem_rows_ up to date from the CPU's dirty ring, re-rendering the
+// block only when something changed since the previous record
+void JsonTraceWriter::sync_mem(const CPU& S) {
+    if (mem_synced_ && S.dirty_seq == mem_seq_) return;
+    if (!mem_synced_ || S.dirty_seq - mem_seq_ > CPU::DIRTY_RING) {
+        mem_rows_.clear();
+        for (auto& kv : S.qword_nonzero()) set_row(kv.first, S);
+    } else {
+        for (u64 q = mem_seq_; q != S.dirty_seq; ++q)
+            set_row(S.dirty_ring[q % CPU::DIRTY_RING], S);
+    }
+    mem_seq_ = S.dirty_seq;
+    mem_synced_ = true;
+
+    if (mem_rows_.empty()) {
+        mem_text_ = "{}";
+        return;
+    }
+    mem_text_ = "{\n";
+    std::size_t i = 0;
+    for (auto& kv : mem_rows_) {
+        mem_text_ += kv.second;
+        mem_text_ += (++i < mem_rows_.size() ? ",\n" : "\n");
+    }
+    mem_text_ += "    }";
+}
+
+void JsonTraceWriter::finish() {
+    out_.put_str(count_ == 0 ? "[]\n" : "\n]\n");
+    out_.flush();
+}
+
+void write_final_state(const CPU& S, u64 steps, OutBuf& out) {
+    JsonTraceWriter writer(out);
+    if (steps) writer.record(S);
+    writer.finish();
+}
+
+void DeltaTraceWriter::remember(const CPU& S) {
+    for (int i = 0; i < REG_NUM; i++) regs_[i] = S.R[i];
+    cc_ = S.cc;
+    mem_seq_ = S.dirty_seq;
+}
+
+void DeltaTraceWriter::write_full(const CPU& S, const char* tag) {
+    out_.put_str("{\"");
+    out_.put_str(tag);
+    out_.put_str("\":1,\"PC\":");
+    out_.put_int((std::int64_t)S.PC);
+    out_.put_str(",\"STAT\":");
+    out_.put_int((int)S.stat);
+    out_.put_str(",\"CC\":{\"ZF\":");
+    out_.put_int(S.cc.ZF);
+    out_.put_str(",\"SF\":");
+    out_.put_int(S.cc.SF);
+    out_.put_str(",\"OF\":");
+    out_.put_int(S.cc.OF);
+    out_.put_str("},\"REG\":{");
+    for (int i = 0; i < REG_NUM; i++) {
+        out_.put_str(i ? ",\"" : "\"");
+        out_.put_str(reg_name(i));
+        out_.put_str("\":");
+        out_.put_int(S.R[i]);
+    }
+    out_.put_str("},\"MEM\":{");
+    bool first = true;
+    for (auto& kv : S.qword_nonzero()) {
+        out_.put_str(first ? "\"" : ",\"");
+        first = false;
+        out_.put_int((std::int64_t)kv.first);
+        out_.put_str("\":");
+        out_.put_int(kv.second);
+    }
+    out_.put_str("}}\n");
+    remember(S);
+}
+
+void DeltaTraceWriter::begin(const CPU& S) { write_full(S, "INIT"); }
+
+void DeltaTraceWriter::record(const CPU& S) {
+    if (S.dirty_seq - mem_seq_ > CPU::DIRTY_RING) {
+        write_full(S, "FULL");
+        return;
+    }
+
+    out_.put_str("{\"PC\":");
+    out_.put_int((std::int64_t)S.PC);
+    out_.put_str(",\"STAT\":");
+    out_.put_int((int)S.stat);
+
+    if (S.cc.ZF != cc_.ZF || S.cc.SF != cc_.SF || S.cc.OF != cc_.OF) {
+        const char* sep = ",\"CC\":{";
+        auto bit = [&](const char* key, int now, int was) {
+            if (now == was) return;
+            out_.put_str(sep);
+            out_.put_str(key);
+            out_.put_int(now);
+            sep = ",";
+        };
+        bit("\"ZF\":", S.cc.ZF, cc_.ZF);
+        bit("\"SF\":", S.cc.SF, cc_.SF);
+        bit("\"OF\":", S.cc.OF, cc_.OF);
+        out_.put('}');
+    }
+
+    bool any_reg = false;
+    for (int i = 0; i < REG_NUM; i++) {
+        if (S.R[i] == regs_[i]) continue;
+        out_.put_str(any_reg ? ",\"" : ",\"REG\":{\"");
+        out_.put_str(reg_name(i));
+        out_.put_str("\":");
+        out_.put_int(S.R[i]);
+        any_reg = true;
+    }
+    if (any_reg) out_.put('}');
+
+    if (S.dirty_seq != mem_seq_) {
+        bases_.clear();
+        for (u64 q = mem_seq_; q != S.dirty_seq; ++q) {
+            u64 base = S.dirty_ring[q % CPU::DIRTY_RING];
+            if (std::find(bases_.begin(), bases_.end(), base) == bases_.end())
+                bases_.push_back(base);
+        }
+        out_.put_str(",\"MEM\":{");
+        for (std::size_t i = 0; i < bases_.size(); i++) {
+            auto it = S.qword_nonzero().find(bases_[i]);
+            out_.put_str(i ? ",\"" : "\"");
+            out_.put_int((std::int64_t)bases_[i]);
+            out_.put_str("\":");
+            out_.put_int(it == S.qword_nonzero().end() ? 0 : it->second);
+        }
+        out_.put('}');
+    }
+    out_.put_str("}\n");
+    remember(S);
+}
+
+void expand_delta_trace(std::istream& in, OutBuf& out) {
+    using nlohmann::json;
+    CPU S;
+    JsonTraceWriter writer(out);
+    std::string line;
+    bool have_init = false;
+
+    auto set_qword = [&](const std::string& key, s64 v) {
+        S.write8((s64)std::stoull(key), (u64)v);
+    };
+
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        json j = json::parse(line);
+        bool init = j.contains("INIT"), full = j.contains("FULL");
+        if (!init && !have_init)
+            throw std::runtime_error("delta trace does not start with an INIT record");
+        have_init = true;
+
+        S.PC = (u64)j.at("PC").get<std::int64_t>();
+        S.stat = (Stat)j.at("STAT").get<int>();
+        if (init || full) {
+            // reset memory: clear qwords missing from the snapshot
+            const json& mem = j.at("MEM");
+            std::vector<u64> stale;
+            for (auto& kv : S.qword_nonzero())
+                if (!mem.contains(std::to_string(kv.first))) stale.push_back(kv.first);
+            for (u64 b : stale) S.write8((s64)b, 0);
+        }
+        if (j.contains("CC")) {
+            const json& cc = j["CC"];
+            if (cc.contains("ZF")) S.cc.ZF = cc["ZF"].get<int>();
+            if (cc.contains("SF")) S.cc.SF = cc["SF"].get<int>();
+            if (cc.contains("OF")) S.cc.OF = cc["OF"].get<int>();
+        }
+        if (j.contains("REG")) {
+            for (int i = 0; i < REG_NUM; i++) {
+                auto it = j["REG"].find(reg_name(i));
+                if (it != j["REG"].end()) S.R[i] = it->get<s64>();
+            }
+        }
+        if (j.contains("MEM")) {
+            for (auto& kv : j["MEM"].items()) set_qword(kv.key(), kv.value().get<s64>());
+        }
+        if (!init) writer.record(S);
+    }
+    writer.finish();
+}
+
+}  // namespace y86
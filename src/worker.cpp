@@ -1,6 +1,5 @@
 #include "worker.h"
 
-#include <regex>
 #include <string>
 #include <vector>
 
@@ -8,43 +7,6 @@ using nlohmann::json;
 
 namespace y86 {
 
-static std::vector<u8> hex_to_bytes(const std::string& s_in) {
-    std::string s;
-    s.reserve(s_in.size());
-    for (char c : s_in) {
-        if (!isspace((unsigned char)c)) s.push_back(c);
-    }
-    std::vector<u8> out;
-    if (s.size() % 2 != 0) return out;
-    out.reserve(s.size() / 2);
-    for (size_t i = 0; i < s.size(); i += 2) {
-        out.push_back((u8)strtoul(s.substr(i, 2).c_str(), nullptr, 16));
-    }
-    return out;
-}
-
-void load_yo(std::istream& in, CPU& cpu, bool bound, std::uint64_t slack) {
-    std::string line;
-    std::regex re(R"(0x([0-9a-fA-F]+):\s*([0-9a-fA-F\s]*))");
-
-    u64 entry = ~0ULL, maxaddr = 0;
-    while (std::getline(in, line)) {
-        std::smatch m;
-        if (!std::regex_search(line, m, re)) continue;
-        u64 addr = strtoull(m[1].str().c_str(), nullptr, 16);
-        auto bytes = hex_to_bytes(m[2].str());
-        if (entry == ~0ULL) entry = addr;
-        if (addr < entry) entry = addr;
-        for (size_t i = 0; i < bytes.size(); ++i) {
-            cpu.write1((s64)addr + (s64)i, bytes[i]);
-            if (addr + i > maxaddr) maxaddr = addr + (u64)i;
-        }
-    }
-    cpu.PC = (entry == ~0ULL ? 0 : entry);
-    cpu.bounded = bound;
-    if (bound) cpu.mem_upper = maxaddr + slack;
-}
-
 bool cond_true(const CC& c, u8 ifun) {
     switch (ifun) {
         case 0:
@@ -66,7 +28,7 @@ bool cond_true(const CC& c, u8 ifun) {
     }
 }
 
-Decoded fetch_and_decode(CPU& S) {
+Decoded decode_uncached(CPU& S) {
     Decoded d;
     u8 b0 = 0;
     if (!S.read1((s64)S.PC, b0)) {
@@ -121,6 +83,14 @@ Decoded fetch_and_decode(CPU& S) {
     return d;
 }
 
+Decoded fetch_and_decode(CPU& S) {
+    if (!S.icache.enabled) return decode_uncached(S);
+    if (const Decoded* hit = S.icache.lookup(S.PC)) return *hit;
+    Decoded d = decode_uncached(S);
+    if (d.ok) S.icache.insert(S.PC, d);
+    return d;
+}
+
 static inline void set_cc_opq(CPU& S, s64 a, s64 b, s64 r, u8 ifun) {
     S.cc.ZF = (r == 0);
     S.cc.SF = (r < 0);
@@ -133,24 +103,23 @@ static inline void set_cc_opq(CPU& S, s64 a, s64 b, s64 r, u8 ifun) {
     }
 }
 
-nlohmann::json step(CPU& S) {
-    Decoded d = fetch_and_decode(S);
+json dump_state(const CPU& S) {
     json log;
+    log["STAT"] = (int)S.stat;
+    log["PC"] = (std::int64_t)S.PC;
+    log["CC"] = S.dump_cc();
+    log["REG"] = S.dump_regs();
+    log["MEM"] = S.dump_mem_nonzero();
+    return log;
+}
+
+void execute(CPU& S) {
+    Decoded d = fetch_and_decode(S);
 
     // 取指阶段出错（ADR/INS）
-    if (!d.ok) {
-        log["STAT"] = (int)S.stat;
-        log["PC"] = (std::int64_t)S.PC;
-        log["CC"] = S.dump_cc();
-        log["REG"] = S.dump_regs();
-        log["MEM"] = S.dump_mem_nonzero();
-        return log;
-    }
+    if (!d.ok) return;
 
-    auto R = [&](u8 id) -> s64& {
-        static s64 dummy = 0;
-        return (id == RNONE) ? dummy : S.R[id];
-    };
+    auto R = [&](u8 id) -> s64& { return (id == RNONE) ? S.scratch : S.R[id]; };
 
     s64 valA = 0, valB = 0;
     u64 valE = 0, valM = 0;
@@ -313,12 +282,12 @@ nlohmann::json step(CPU& S) {
     }
 
 FINISH:
-    log["STAT"] = (int)S.stat;
-    log["PC"] = (std::int64_t)S.PC;
-    log["CC"] = S.dump_cc();
-    log["REG"] = S.dump_regs();
-    log["MEM"] = S.dump_mem_nonzero();
-    return log;
+    return;
+}
+
+json step(CPU& S) {
+    execute(S);
+    return dump_state(S);
 }
 
 }  // namespace y86
@@ -8,4 +8,16 @@ cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DBUILD_TUI=OFF
 cmake --build build -j
 
 # testing command
-python3 test.py --bin ./build/y86sim
\ No newline at end of file
+python3 test.py --bin ./build/y86sim
+
+# features beyond the trace answers, random differential fuzz, library self-checks
+python3 test_features.py --bin ./build/y86sim || exit 1
+python3 fuzz.py --bin ./build/y86sim --count 200 || exit 1
+./build/y86check test || exit 1
+
+# differential check: fast engines vs step()
+for f in test/*.yo; do
+  ./build/y86sim --engine=threaded --diff < "$f" || exit 1
+  ./build/y86sim --engine=jit --diff < "$f" || exit 1
+  ./build/y86sim --engine=pipe --diff < "$f" || exit 1
+done
@@ -0,0 +1,466 @@
+import os
+import sys
+import json
+import argparse
+import subprocess
+import tempfile
+
+# y86sim 在 test.py 之外的功能：每项都对照 answer/ 或另一条执行路径
+# 用法：python3 test_features.py --bin ./build/y86sim
+
+# 写、读 RNONE scratch 的小程序；test/ 里的程序都不碰它
+RNONE_PROG = """\
+0x000: 30ff0700000000000000 | irmovq $7, F
+0x00a: 701300000000000000   | jmp 0x13
+0x013: 20f0                 | rrmovq F, %rax
+0x015: 10                   | nop
+0x016: 10                   | nop
+0x017: 00                   | halt
+"""
+RNONE_ENGINES = ("step", "threaded", "jit", "pipe")
+
+failures = []
+
+
+def check(cond, what):
+    if not cond:
+        failures.append(what)
+        print(f"FAIL: {what}")
+
+
+def run(args, stdin=None, input=None):
+    return subprocess.run(args, stdin=stdin, input=input, capture_output=True, timeout=60)
+
+
+def answer(name):
+    with open(f"answer/{name}.json") as f:
+        return json.load(f)
+
+
+def test_programs():
+    return sorted(f[:-3] for f in os.listdir("test") if f.endswith(".yo"))
+
+
+def stop_info(stderr):
+    for line in stderr.decode().splitlines():
+        if line.startswith("stop: "):
+            return json.loads(line[6:])
+    return None
+
+
+def test_debugger(sim):
+    r = run([sim, "--final-only", "--watch=0x1f0:16", "test/asum.yo"])
+    hit = stop_info(r.stderr)
+    check(hit is not None and hit["kind"] == "watch" and hit["access"] == "write"
+          and hit["addr"] == 504, "write watch on 0x1f0:16 hits the store to 504")
+    if hit:
+        final = json.loads(r.stdout)[-1]
+        check(final == answer("asum")[hit["steps"] - 1], "watch stops right after the store")
+
+    # asum：第 12 条指令第一次读数组；0x77 处的断点停在它执行之前
+    r = run([sim, "--final-only", "--watch=0x18:8:r", "test/asum.yo"])
+    hit = stop_info(r.stderr)
+    check(hit is not None and (hit["access"], hit["addr"], hit["pc"], hit["steps"]) == ("read", 0x18, 0x77, 12),
+          "read watch on the array stops after the first mrmovq")
+    r = run([sim, "--final-only", "--break=0x77", "test/asum.yo"])
+    hit = stop_info(r.stderr)
+    check(hit is not None and (hit["kind"], hit["pc"], hit["steps"]) == ("break", 0x77, 11),
+          "break at 0x77 stops before the loop body")
+    r = run([sim, "--final-only", "--break=[0x1f0] != 0", "test/asum.yo"])
+    hit = stop_info(r.stderr)
+    check(hit is not None and (hit["pc"], hit["steps"]) == (0x56, 5),
+          "memory condition '[0x1f0] != 0' stops after call sum")
+
+    r = run([sim, "--final-only", "--break=rax == 3", "test/prog1.yo"])
+    hit = stop_info(r.stderr)
+    check(hit is not None and hit["kind"] == "break" and hit["steps"] == 2,
+          "conditional break 'rax == 3' stops after irmovq $3")
+    r = run([sim, "--final-only", "--watch=0x1f0:16:r", "test/prog1.yo"])
+    check(stop_info(r.stderr) is None, "an untouched watch does not stop")
+
+    # 地址、长度和常量与 --start/--limit 一样严格：不收空白、符号和越界
+    for arg in ("--watch= 496", "--watch=+496", "--watch=0x1f0:+8", "--watch=0x 1f0",
+                "--break=0x 77", "--break=0x10000000000000000", "--break=rax == 99999999999999999999"):
+        r = run([sim, "--final-only", arg, "test/asum.yo"])
+        check(r.returncode == 2, f"{arg!r} is rejected")
+
+
+def test_loading(sim):
+    for name in test_programs():
+        path = f"test/{name}.yo"
+        want = answer(name)
+        r = run([sim, path])
+        check(json.loads(r.stdout) == want, f"{name}: program path")
+        with open(path, "rb") as f:
+            r = run([sim], stdin=f)
+        check(json.loads(r.stdout) == want, f"{name}: .yo from a file on stdin")
+        with open(path, "rb") as f:
+            r = run([sim], input=f.read())
+        check(json.loads(r.stdout) == want, f"{name}: .yo through a pipe")
+
+    # 比一个读缓冲大得多的程序：分块解析时行会跨块
+    lines = [f"0x{8 * i:05x}: {(i * 0x9e3779b97f4a7c15 & (1 << 64) - 1).to_bytes(8, 'little').hex()} | .quad"
+             for i in range(1, 40001)]
+    text = "0x00000: 00 | halt\n" + "\n".join(lines) + "\n"
+    with tempfile.TemporaryDirectory() as d:
+        path = os.path.join(d, "big.yo")
+        with open(path, "w") as f:
+            f.write(text)
+        want = run([sim, path]).stdout
+        r = run([sim], input=text.encode())
+        check(r.returncode == 0 and r.stdout == want and len(json.loads(want)[0]["MEM"]) == 40000,
+              "a 40000-line .yo through a pipe loads like the file")
+
+
+def test_delta(sim):
+    for name in test_programs():
+        delta = run([sim, "--trace=delta", f"test/{name}.yo"]).stdout
+        r = run([sim, "--expand"], input=delta)
+        check(r.returncode == 0 and json.loads(r.stdout) == answer(name),
+              f"{name}: --trace=delta expands to the JSON trace")
+    full = run([sim, "test/asumr.yo"]).stdout
+    delta = run([sim, "--trace=delta", "test/asumr.yo"]).stdout
+    check(len(delta) * 4 < len(full), "asumr: the delta trace is under a quarter of the full one")
+
+
+def test_ybin(sim, yo2ybin):
+    with tempfile.TemporaryDirectory() as d:
+        for name in test_programs():
+            want = answer(name)
+            ybin = os.path.join(d, name + ".ybin")
+            r = run([yo2ybin, f"test/{name}.yo", ybin])
+            check(r.returncode == 0, f"{name}: yo2ybin")
+            r = run([sim, ybin])
+            check(json.loads(r.stdout) == want, f"{name}: .ybin path")
+            with open(ybin, "rb") as f:
+                r = run([sim], input=f.read())
+            check(json.loads(r.stdout) == want, f"{name}: .ybin through a pipe")
+        ybin = os.path.join(d, "slack.ybin")
+        for arg in ("abc", "-1", " 5", "5x", "99999999999999999999"):
+            r = run([yo2ybin, f"--slack={arg}", "test/asum.yo", ybin])
+            check(r.returncode == 2 and not os.path.exists(ybin), f"yo2ybin --slack={arg!r} is rejected")
+
+
+def test_bintrace(sim):
+    with tempfile.TemporaryDirectory() as d:
+        for name in test_programs():
+            ytr = os.path.join(d, name + ".ytr")
+            with open(ytr, "wb") as f:
+                subprocess.run([sim, "--trace=bin", f"test/{name}.yo"], stdout=f, timeout=60)
+            with open(ytr, "rb") as f:
+                r = run([sim, "--expand"], stdin=f)
+            check(r.returncode == 0 and json.loads(r.stdout) == answer(name),
+                  f"{name}: --trace=bin expands to the JSON trace")
+            r = run([sim, "--expand", ytr])
+            check(r.returncode == 0 and json.loads(r.stdout) == answer(name),
+                  f"{name}: --expand reads a .ytr by path")
+
+
+def test_numbers(sim):
+    # 前导 0 是十进制，不是八进制
+    for arg, start in (("010", 10), ("10", 10), ("0x10", 16)):
+        r = run([sim, f"--start={arg}", "test/asum.yo"])
+        check(r.returncode == 0 and b'"start":%d,' % start in r.stderr,
+              f"--start={arg} starts at step {start}")
+    for arg in ("0x-1", " 5", "-5", "99999999999999999999"):
+        r = run([sim, f"--start={arg}", "test/asum.yo"])
+        check(r.returncode != 0, f"--start={arg!r} is rejected")
+    r = run([sim, "--sample=010:2:1", "test/asum.yo"])
+    check(b'"start":10,' in r.stderr, "--sample SKIP 010 is decimal")
+
+    # --limit 同样解析
+    for arg, steps in (("010", 10), ("0x10", 16)):
+        r = run([sim, f"--limit={arg}", "test/asum.yo"])
+        check(r.returncode == 0 and json.loads(r.stdout) == answer("asum")[:steps],
+              f"--limit={arg} runs {steps} steps")
+    for arg in ("-1", " 5", "5x", "0x", "0", "99999999999999999999"):
+        r = run([sim, f"--limit={arg}", "test/asum.yo"])
+        check(r.returncode == 2, f"--limit={arg!r} is rejected")
+
+
+def test_sampling(sim):
+    for name in ("asum", "asumr", "abs-asum-cmov"):
+        want = answer(name)
+        for engine in ("step", "threaded", "jit"):
+            r = run([sim, f"--engine={engine}", "--start=3", "--sample=2:3", f"test/{name}.yo"])
+            got = json.loads(r.stdout)
+            expect, starts = [], []
+            for line in r.stderr.decode().splitlines():
+                if line.startswith("window: "):
+                    w = json.loads(line[8:])
+                    expect += want[w["start"]:w["start"] + w["steps"]]
+                    starts.append(w["start"])
+            check(got and got == expect, f"{name}: sampled windows ({engine}) match the full trace")
+            # 先跑 3 步，之后每 5 步里跳过 2 步、记录 3 步
+            check(starts == list(range(5, len(want), 5)), f"{name}: sampled window starts ({engine})")
+
+
+def test_ensemble(sim):
+    with tempfile.TemporaryDirectory() as d:
+        lanes = os.path.join(d, "lanes.jsonl")
+        with open(lanes, "w") as f:
+            f.write("{}\n")
+            for i in range(1, 20):
+                f.write(json.dumps({"REG": {"rax": i, "rdx": -i}, "MEM": {str(0x100 + 8 * i): i}}) + "\n")
+        for isa in ("scalar", "avx2", "avx512"):
+            r = run([sim, "--lanes=" + lanes, f"--lane-isa={isa}", "--diff", "test/asumr.yo"])
+            if b"not supported" in r.stderr:
+                continue
+            check(r.returncode == 0 and b"lanes match step" in r.stderr, f"--lanes --diff ({isa})")
+        r = run([sim, "--lanes=" + lanes, "test/asumr.yo"])
+        out = json.loads(r.stdout) if r.returncode == 0 else []
+        check(len(out) == 20 and out[0] == answer("asumr")[-1], "--lanes: a lane without inputs ends like the answer")
+
+        # MEM 键与其它数字一样：010 是十进制 10
+        with open(lanes, "w") as f:
+            f.write('{"MEM":{"010":5}}\n{"MEM":{"0xa":5}}\n')
+        r = run([sim, "--lanes=" + lanes, "test/prog1.yo"])
+        out = json.loads(r.stdout) if r.returncode == 0 else None
+        check(out is not None and out[0] == out[1], "--lanes MEM key 010 is address 10")
+
+        # 寄存器 F 在每条 lane 里各自保存
+        path = os.path.join(d, "rnone.yo")
+        with open(path, "w") as f:
+            f.write(RNONE_PROG)
+        with open(lanes, "w") as f:
+            f.write('{}\n{"REG":{"rax":1}}\n')
+        r = run([sim, "--lanes=" + lanes, "--diff", path])
+        check(r.returncode == 0, "--lanes --diff keeps the RNONE scratch per lane")
+
+
+def test_rnone(sim):
+    # --limit 截断在块中间时，JIT 也要把 scratch 带出来
+    with tempfile.TemporaryDirectory() as d:
+        path = os.path.join(d, "rnone.yo")
+        with open(path, "w") as f:
+            f.write(RNONE_PROG)
+        for engine in RNONE_ENGINES:
+            for limit in (3, 4, 100):
+                r = run([sim, f"--engine={engine}", "--final-only", f"--limit={limit}", path])
+                final = json.loads(r.stdout)[-1] if r.returncode == 0 else {}
+                check(final.get("REG", {}).get("rax") == 7,
+                      f"RNONE scratch survives into %rax ({engine}, --limit={limit})")
+
+
+def test_batch(sim):
+    with tempfile.TemporaryDirectory() as d:
+        # 写 F 与读 F 的程序交替排在一个线程上（不论按什么顺序取），每个
+        # 程序都从 0 开始，不继承上一个程序的 scratch
+        a, b = os.path.join(d, "a.yo"), os.path.join(d, "b.yo")
+        with open(a, "w") as f:
+            f.write("0x000: 30ff0500000000000000 | irmovq $5, F\n0x00a: 00 | halt\n")
+        with open(b, "w") as f:
+            f.write("0x000: 20f0 | rrmovq F, %rax\n0x002: 00 | halt\n")
+        lst = os.path.join(d, "list.txt")
+        with open(lst, "w") as f:
+            f.write(f"{a}\n{b}\n{a}\n{b}\n")
+        for engine in RNONE_ENGINES:
+            out = os.path.join(d, engine)
+            r = run([sim, f"--batch={lst}", f"--out={out}", "--jobs=1", f"--engine={engine}", "--final-only"])
+            summary = json.loads(r.stdout) if r.returncode == 0 else []
+            rax = []
+            for p in summary:
+                if p["program"] == b:
+                    with open(p["output"]) as f:
+                        rax.append(json.load(f)[-1]["REG"]["rax"])
+            check(rax == [0, 0], f"--batch: b.yo does not see a.yo's RNONE scratch ({engine})")
+
+        # 批量结果与单独运行一致
+        out = os.path.join(d, "test")
+        r = run([sim, "--batch=test", f"--out={out}"])
+        check(r.returncode == 0, "--batch=test")
+        for name in test_programs():
+            with open(os.path.join(out, name + ".json")) as f:
+                check(json.load(f) == answer(name), f"{name}: --batch output")
+
+        # 同名程序：a、a 和 a-1 要得到三个不同的输出文件
+        a1 = os.path.join(d, "a-1.yo")
+        with open(a1, "w") as f:
+            f.write("0x000: 00 | halt\n")
+        with open(lst, "w") as f:
+            f.write(f"{a}\n{a}\n{a1}\n")
+        r = run([sim, f"--batch={lst}", f"--out={os.path.join(d, 'dup')}"])
+        outputs = [p["output"] for p in json.loads(r.stdout)] if r.returncode == 0 else []
+        check(len(set(outputs)) == 3, f"--batch: colliding stems get distinct outputs {outputs}")
+
+    for jobs in ("x", "-1", " 2", "2x"):
+        r = run([sim, "--batch=test", "--trace=none", f"--jobs={jobs}"])
+        check(r.returncode == 2, f"--jobs={jobs!r} is rejected")
+
+
+def test_profile(sim):
+    with tempfile.TemporaryDirectory() as d:
+        prefix = os.path.join(d, "prof")
+        for name in test_programs():
+            r = run([sim, "--final-only", f"--profile={prefix}", f"test/{name}.yo"])
+            check(r.returncode == 0 and json.loads(r.stdout) == answer(name)[-1:],
+                  f"{name}: --profile leaves the trace unchanged")
+            with open(prefix + ".json") as f:
+                prof = json.load(f)
+            with open(prefix + ".folded") as f:
+                folded = f.read().split("\n")[:-1]
+            steps = len(answer(name))
+            check(prof["instructions"] == steps, f"{name}: --profile counts every instruction")
+            check(sum(h["count"] for h in prof["histogram"]) == steps, f"{name}: --profile histogram")
+            check(sum(int(l.rsplit(" ", 1)[1]) for l in folded) == steps, f"{name}: --profile folded counts")
+
+        # asum：main 调 sum，sum 的循环跑 4 圈
+        run([sim, "--trace=none", f"--profile={prefix}", "test/asum.yo"])
+        with open(prefix + ".json") as f:
+            prof = json.load(f)
+        with open(prefix + ".folded") as f:
+            folded = f.read()
+        check({(f["name"], f["self"], f["total"]) for f in prof["functions"]}
+              == {("0x0", 3, 34), ("main", 4, 31), ("sum", 27, 27)}, "asum: --profile functions")
+        jne = [p for p in prof["pcs"] if p["pc"] == 0x87]
+        check(jne and jne[0]["label"] == "test" and (jne[0]["taken"], jne[0]["not_taken"]) == (4, 1),
+              "asum: --profile branch counts at test")
+        check([(c["callee"], c["site"], c["count"]) for c in prof["calls"]] == [("main", 0x0a, 1), ("sum", 0x4c, 1)],
+              "asum: --profile calls")
+        check(folded == "0x0 3\n0x0;main 4\n0x0;main;sum 27\n", "asum: --profile folded stacks")
+
+
+def test_pipe(sim):
+    # asum 在 PIPE 上：34 条指令 + 4 拍填充 + 4 次加载/使用暂停 + 1 次预测错
+    # （2 拍）+ 2 次 ret（各 3 拍）= 50 拍
+    r = run([sim, "--engine=pipe", "--stats", "--trace=none", "test/asum.yo"])
+    lines = [l for l in r.stderr.decode().splitlines() if l.startswith("pipe: ")]
+    st = json.loads(lines[0][6:]) if lines else {}
+    check(st.get("instructions") == 34 and st.get("cycles") == 50
+          and st.get("stalls") == {"load_use": 4, "memory": 0}
+          and st.get("bubbles") == {"mispredict": 2, "ret": 6, "smc": 0},
+          f"asum: --engine=pipe cycle counts {st}")
+
+
+def cachesim(sim, spec, prog):
+    r = run([sim, spec, "--trace=none", prog])
+    lines = [l for l in r.stderr.decode().splitlines() if l.startswith("cachesim: ")]
+    return json.loads(lines[0][10:]) if lines else {}
+
+
+def counts(level):
+    return {k: level[k] for k in ("accesses", "hits", "misses", "read_misses", "write_misses")}
+
+
+def test_cachesim(sim):
+    # asum：代码占 3 行，0x38 和 0x77 处的指令跨行（取指共 34 + 1 + 4 次）；
+    # 数据是 2 次 call 压栈、2 次 ret 出栈（同一行）和 4 次读数组（第 0 行，
+    # 已因取指进了 L2）
+    st = cachesim(sim, "--cachesim", "test/asum.yo")
+    check(st and counts(st["l1i"]) == {"accesses": 39, "hits": 36, "misses": 3, "read_misses": 3, "write_misses": 0}
+          and counts(st["l1d"]) == {"accesses": 8, "hits": 6, "misses": 2, "read_misses": 1, "write_misses": 1}
+          and counts(st["l2"]) == {"accesses": 5, "hits": 1, "misses": 4, "read_misses": 4, "write_misses": 0}
+          and st["memory"] == {"latency": 100, "reads": 4, "writes": 0}
+          and (st["stall_cycles"], st["cycles"]) == (5 * 10 + 4 * 100, 34 + 450),
+          f"asum: --cachesim counters {st}")
+
+    # 写直达、不写分配、没有 L2：压栈两次都缺失且直接写内存，ret 读栈再缺失一次
+    st = cachesim(sim, "--cachesim=l1d=1k:1:64:wt:nwa,l2=off,mem=80", "test/asum.yo")
+    check(st and counts(st["l1d"]) == {"accesses": 8, "hits": 4, "misses": 4, "read_misses": 2, "write_misses": 2}
+          and st["l2"] is None and st["memory"] == {"latency": 80, "reads": 5, "writes": 2}
+          and st["stall_cycles"] == 5 * 80,
+          f"asum: --cachesim wt/nwa counters {st}")
+
+    # 越界的大小、路数、延迟要报错，不能崩溃或被截成 u32
+    for spec in ("l1d=4096m:1:64", "l1d=64:288230376151711744:64", "l1d=1k:+1:64", "l1d= 1k:1:64",
+                 "mem=-1", "mem=4294967297", "l1d=1k:1:64:lat=4294967297"):
+        r = run([sim, f"--cachesim={spec}", "--trace=none", "test/asum.yo"])
+        check(r.returncode == 2 and b"--cachesim: " in r.stderr, f"--cachesim={spec!r} is rejected")
+
+
+def bpred(sim, spec, prog):
+    r = run([sim, spec, "--trace=none", prog])
+    lines = [l for l in r.stderr.decode().splitlines() if l.startswith("bpred: ")]
+    st = json.loads(lines[0][7:]) if lines else {"predictors": [], "ras": {}}
+    return st, {p["name"]: p["mispredicts"] for p in st["predictors"]}
+
+
+def test_bpred(sim):
+    # asum：循环尾的 jne 向后跳，4 次跳 1 次不跳，各预测器都只错最后一次；
+    # RAS 只有 1 项时第二次 call 把第一个返回地址挤掉
+    st, miss = bpred(sim, "--bpred=taken,btfn,bimodal:4,gshare:4:4,ras=1", "test/asum.yo")
+    check(st.get("branches") == 5 and miss == {"taken": 1, "btfn": 1, "bimodal:4": 1, "gshare:4:4": 1},
+          f"asum: --bpred mispredicts {miss}")
+    check(st["ras"] == {"accuracy": 0.5, "depth": 1, "mispredicts": 1, "overflows": 1, "rets": 2},
+          f"asum: --bpred RAS {st['ras']}")
+
+    # asumr：递归出口的 jle 向前跳，4 次不跳最后 1 次跳。计数器从弱跳转起步，
+    # 错第一次和最后一次；全局历史一直是 0，gshare 与 bimodal 相同。
+    # 6 层 call 在 2 项的 RAS 上只有最内两层的 ret 预测对
+    st, miss = bpred(sim, "--bpred=ras=2", "test/asumr.yo")
+    check(st.get("branches") == 5 and miss == {"taken": 4, "btfn": 1, "bimodal:12": 2, "gshare:12:12": 2},
+          f"asumr: --bpred mispredicts {miss}")
+    check((st["ras"].get("rets"), st["ras"].get("mispredicts"), st["ras"].get("overflows")) == (6, 4, 4),
+          f"asumr: --bpred RAS {st['ras']}")
+
+    # 负数、超过 32 位和越界的数都要报错，不能被截断或去分配 2^32 项
+    for spec in ("ras=-1", "ras=0", "ras=65537", "ras=4294967297", "gshare:4294967297:4",
+                 "gshare:33", "bimodal:-1", "bimodal: 4", "bimodal:25"):
+        r = run([sim, f"--bpred={spec}", "--trace=none", "test/asum.yo"])
+        check(r.returncode == 2 and b"--bpred: " in r.stderr, f"--bpred={spec!r} is rejected")
+
+
+def test_capi(sim):
+    libdir = os.path.dirname(os.path.abspath(sim))
+    os.environ.setdefault("Y86_LIB", os.path.join(libdir, "liby86.so"))
+    sys.path.insert(0, "python")
+    import y86
+
+    for name in test_programs():
+        with open(f"test/{name}.yo", "rb") as f:
+            cpu = y86.CPU(f.read())
+        cpu.run()
+        check(cpu.state() == answer(name)[-1], f"{name}: C API final state")
+
+    # 每步回调看到的状态就是 JSON 日志的那一步；回调返回真值时停下
+    with open("test/asum.yo", "rb") as f:
+        cpu = y86.CPU(f.read())
+    states = []
+    cpu.set_trace(lambda c: states.append(c.state()) or len(states) == 20)
+    n = cpu.run()
+    check(n == 20 and states == answer("asum")[:20], "C API trace callback stops after 20 steps")
+    cpu.set_trace(None)
+    cpu.run()
+    check(cpu.state() == answer("asum")[-1], "C API run continues after the callback stopped it")
+
+    # 两个句柄在同一线程上交替执行，RNONE scratch 互不干扰
+    a = y86.CPU(RNONE_PROG)
+    a.run(1)
+    b = y86.CPU("0x000: 30ff0500000000000000 | irmovq $5, F\n0x00a: 00 | halt\n")
+    b.run()
+    a.run()
+    check(a.reg("rax") == 7, "C API handles keep their own RNONE scratch")
+
+
+def main():
+    args = parse_args()
+    yo2ybin = os.path.join(os.path.dirname(args.bin), "yo2ybin")
+    test_debugger(args.bin)
+    test_loading(args.bin)
+    test_ybin(args.bin, yo2ybin)
+    test_delta(args.bin)
+    test_bintrace(args.bin)
+    test_numbers(args.bin)
+    test_sampling(args.bin)
+    test_ensemble(args.bin)
+    test_rnone(args.bin)
+    test_batch(args.bin)
+    test_profile(args.bin)
+    test_pipe(args.bin)
+    test_cachesim(args.bin)
+    test_bpred(args.bin)
+    test_capi(args.bin)
+    if failures:
+        print(f"{len(failures)} feature checks failed")
+        sys.exit(1)
+    print("All features correct!")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--bin', type=str, help='path to y86sim (yo2ybin and liby86 next to it)', required=True)
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    main()
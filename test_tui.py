@@ -0,0 +1,184 @@
+import os
+import re
+import sys
+import pty
+import time
+import fcntl
+import struct
+import select
+import signal
+import termios
+import argparse
+
+# y86_tui（-DBUILD_TUI=ON）的冒烟测试：在伪终端里启动，按键驱动，从屏幕输出里
+# 找状态栏和消息。只验证各面板与快捷键接到了库上、运行线程能起停，不比对界面布局
+# 用法：python3 test_tui.py --bin ./build/y86_tui
+
+COLS, ROWS = 220, 50
+ANSI = re.compile(rb"\x1b\[[0-9;?<>=]*[ -/]*[@-~]|\x1b[()][0-9A-Za-z]|\x1b[=>78]|\x1b\][^\x07]*\x07")
+
+failures = []
+
+
+def check(cond, what):
+    if not cond:
+        failures.append(what)
+        print(f"FAIL: {what}")
+
+
+class Tui:
+    def __init__(self, exe, prog):
+        self.pid, self.fd = pty.fork()
+        if self.pid == 0:
+            os.environ["TERM"] = "xterm-256color"
+            os.execv(exe, [exe, prog])
+        fcntl.ioctl(self.fd, termios.TIOCSWINSZ, struct.pack("HHHH", ROWS, COLS, 0, 0))
+        self.out = b""
+        self.mark = 0
+
+    def pump(self, timeout):
+        r, _, _ = select.select([self.fd], [], [], timeout)
+        if not r:
+            return False
+        try:
+            data = os.read(self.fd, 1 << 16)
+        except OSError:
+            return False
+        self.out += data
+        return bool(data)
+
+    def send(self, keys):
+        # 只在这之后的输出里找
+        self.mark = len(self.out)
+        os.write(self.fd, keys)
+
+    def screen(self):
+        return ANSI.sub(b"", self.out[self.mark:]).decode("utf-8", "replace")
+
+    def expect(self, text, timeout=5.0):
+        end = time.time() + timeout
+        while text not in self.screen():
+            if time.time() > end:
+                return False
+            self.pump(0.05)
+        return True
+
+    def settle(self, t=0.3):
+        end = time.time() + t
+        while time.time() < end:
+            self.pump(0.05)
+
+    def quit(self, timeout=5.0):
+        self.send(b"q")
+        end = time.time() + timeout
+        while time.time() < end:
+            pid, status = os.waitpid(self.pid, os.WNOHANG)
+            if pid:
+                return os.WIFEXITED(status) and os.WEXITSTATUS(status) == 0
+            self.pump(0.05)
+        os.kill(self.pid, signal.SIGKILL)
+        os.waitpid(self.pid, 0)
+        return False
+
+
+def test_run(exe):
+    # asum 共 34 步。启动时路径输入框有焦点，Tab 移到按钮上快捷键才生效
+    t = Tui(exe, "test/asum.yo")
+    check(t.expect("Loaded: test/asum.yo"), "loads the program given on the command line")
+    t.send(b"\t")
+    t.settle()
+    t.send(b"s")
+    check(t.expect("steps=1 "), "S steps once")
+    t.send(b"r")
+    check(t.expect("Stopped: HLT(2)") and "steps=34 " in t.screen(), "R runs asum to halt on the runner thread")
+    # 没有运行线程时 T 也不卡住
+    t.send(b"t")
+    check(t.expect("Stopped."), "T with no run in progress")
+    check(t.quit(), "Q quits with status 0")
+
+
+def test_memview(exe):
+    # asum 载入后 18 个非零 qword，停机时 20 个，最后两个是栈上的返回地址
+    t = Tui(exe, "test/asum.yo")
+    check(t.expect("18 qwords"), "memory pane counts the nonzero qwords after loading")
+    t.send(b"\t")
+    t.settle()
+    t.send(b"r")
+    check(t.expect("20 qwords"), "memory pane counts the nonzero qwords after the run")
+    check(re.search(r"\b496  :\s+85\b", t.screen()) and re.search(r"\b504  :\s+19\b", t.screen()),
+          "memory pane shows the return addresses on the stack")
+    # 滚动只是挂起请求，由持有 CPU 的线程应用；20 行正好一页，窗口不动
+    t.send(b"\x1b[B\x1b[6~\x1b[A\x1b[5~")
+    check(t.expect("20 qwords") and re.search(r"\b504  :\s+19\b", t.screen()), "scrolling keeps the window full")
+    t.send(b"g")
+    check(t.expect("Bad address."), "G with an empty address box")
+    check(t.quit(), "Q quits after using the memory pane")
+
+
+def test_breakpoints(exe):
+    # 输入框有焦点时字符都进输入框：s 不单步，地址里的 x 也不触发反向继续
+    t = Tui(exe, "test/asum.yo")
+    check(t.expect("Loaded: test/asum.yo"), "loads asum for the breakpoint checks")
+    t.send(b"s")
+    check(t.expect("test/asum.yos") and "steps=0 " in t.screen(), "S goes into the focused path box")
+    t.send(b"\x7f")
+    t.settle()
+    # 路径框 -> Load -> Reload -> 断点框
+    t.send(b"\t\t\t0x77")
+    check(t.expect("0x77") and "steps=0 " in t.screen(), "0x77 goes into the focused breakpoint box")
+    t.send(b"\tb")
+    check(t.expect("Add BP: 0x77"), "B adds the breakpoint once the box lost focus")
+    t.send(b"r")
+    check(t.expect("Hit breakpoint 0 at PC=119") and "steps=11 " in t.screen(),
+          "Run stops at the breakpoint like y86sim --break=0x77")
+    t.send(b"c")
+    check(t.expect("Breakpoints and watches cleared."), "C clears the breakpoints")
+    check(t.quit(), "Q quits after using breakpoints")
+
+
+def test_history(exe):
+    t = Tui(exe, "test/asum.yo")
+    check(t.expect("Loaded: test/asum.yo"), "loads asum for the history checks")
+    t.send(b"\t")
+    t.settle()
+    t.send(b"sss")
+    check(t.expect("steps=3 "), "three single steps")
+    t.send(b"z")
+    check(t.expect("Back 1 step(s)") and "steps=2 " in t.screen(), "Z steps back once")
+    t.send(b"r")
+    check(t.expect("Stopped: HLT(2)") and "steps=34 " in t.screen(), "Run after going back reaches halt again")
+    # Load 按钮 -> Reload -> 断点框，再 Tab 到 Add BP
+    t.send(b"\t\t0x77\tb")
+    check(t.expect("Add BP: 0x77"), "breakpoint added after the run")
+    t.send(b"x")
+    check(t.expect("Reverse hit breakpoint 0 at PC=119"), "X reverse-continues to the breakpoint")
+    t.send(b"c")
+    t.settle()
+    t.send(b"x")
+    check(t.expect("to the oldest recorded state.") and "steps=0 " in t.screen(),
+          "X without breakpoints goes back to the start")
+    t.send(b"s")
+    check(t.expect("steps=1 "), "stepping forward again after going back")
+    check(t.quit(), "Q quits after going back")
+
+
+def main():
+    args = parse_args()
+    test_run(args.bin)
+    test_memview(args.bin)
+    test_breakpoints(args.bin)
+    test_history(args.bin)
+    if failures:
+        print(f"{len(failures)} TUI checks failed")
+        sys.exit(1)
+    print("TUI smoke test passed!")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--bin', type=str, help='path to y86_tui', required=True)
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    main()